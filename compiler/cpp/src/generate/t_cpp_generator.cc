@@ -56,6 +56,17 @@ class t_cpp_generator : public t_oop_generator {
     iter = parsed_options.find("include_prefix");
     use_include_prefix_ = (iter != parsed_options.end());
 
+    iter = parsed_options.find("templates");
+    gen_templates_ = (iter != parsed_options.end());
+
+    iter = parsed_options.find("arena");
+    gen_arena_ = (iter != parsed_options.end());
+
+    iter = parsed_options.find("jump_table");
+    gen_jump_table_ = (iter != parsed_options.end());
+
+    in_types_struct_ = false;
+
     out_dir_base_ = "gen-cpp";
   }
 
@@ -87,10 +98,13 @@ class t_cpp_generator : public t_oop_generator {
   void print_const_value(std::ofstream& out, std::string name, t_type* type, t_const_value* value);
   std::string render_const_value(std::ofstream& out, std::string name, t_type* type, t_const_value* value);
 
-  void generate_struct_definition    (std::ofstream& out, t_struct* tstruct, bool is_exception=false, bool pointers=false, bool read=true, bool write=true);
+  void generate_struct_definition    (std::ofstream& out, t_struct* tstruct, bool is_exception=false, bool pointers=false, bool read=true, bool write=true, bool templates=false);
   void generate_struct_fingerprint   (std::ofstream& out, t_struct* tstruct, bool is_definition);
-  void generate_struct_reader        (std::ofstream& out, t_struct* tstruct, bool pointers=false);
-  void generate_struct_writer        (std::ofstream& out, t_struct* tstruct, bool pointers=false);
+  void generate_struct_reader        (std::ofstream& out, t_struct* tstruct, bool pointers=false, bool templates=false);
+  void generate_field_index_table    (std::ofstream& out, const std::vector<t_field*>& fields);
+  void generate_struct_writer        (std::ofstream& out, t_struct* tstruct, bool pointers=false, bool templates=false);
+  void generate_struct_serialized_size(std::ofstream& out, t_struct* tstruct, bool templates=false);
+  void generate_struct_virtual_fallback(std::ofstream& out, t_struct* tstruct);
   void generate_struct_result_writer (std::ofstream& out, t_struct* tstruct, bool pointers=false);
 
   /**
@@ -143,6 +157,15 @@ class t_cpp_generator : public t_oop_generator {
                                           std::string prefix="",
                                           std::string suffix="");
 
+  void generate_serialized_size_field    (std::ofstream& out,
+                                          t_field*    tfield,
+                                          std::string prefix="",
+                                          std::string suffix="");
+
+  void generate_serialized_size_container(std::ofstream& out,
+                                          t_type*     ttype,
+                                          std::string prefix="");
+
   void generate_serialize_struct         (std::ofstream& out,
                                           t_struct*   tstruct,
                                           std::string prefix="");
@@ -192,6 +215,61 @@ class t_cpp_generator : public t_oop_generator {
       (ttype->is_base_type() && (((t_base_type*)ttype)->get_base() == t_base_type::TYPE_STRING));
   }
 
+  /**
+   * True iff a function carries cpp.dispatch = "inline", marking it cheap
+   * enough for a nonblocking server to run on its IO thread.
+   */
+  bool is_inline_function(t_function* tfunction) {
+    std::map<std::string, std::string>::const_iterator it =
+      tfunction->annotations_.find("cpp.dispatch");
+    return it != tfunction->annotations_.end() && it->second == "inline";
+  }
+
+  /**
+   * True iff a struct or binary field carries the cpp.lazy annotation and
+   * should keep its serialized bytes until first access.
+   */
+  bool is_lazy_field(t_field* tfield) {
+    if (tfield->annotations_.find("cpp.lazy") == tfield->annotations_.end()) {
+      return false;
+    }
+    t_type* ttype = get_true_type(tfield->get_type());
+    return
+      ttype->is_struct() ||
+      ttype->is_xception() ||
+      (ttype->is_base_type() && ((t_base_type*)ttype)->is_binary());
+  }
+
+  bool lazy_field(t_field* tfield) {
+    return in_types_struct_ && is_lazy_field(tfield);
+  }
+
+  /**
+   * Name of the bulk list function ("I32" for writeI32List, etc.) that can
+   * transfer the given list in one call, or "" if it needs an element loop.
+   */
+  std::string bulk_list_type(t_type* ttype) {
+    if (!ttype->is_list() || ((t_list*)ttype)->has_cpp_name()) {
+      return "";
+    }
+    t_type* etype = get_true_type(((t_list*)ttype)->get_elem_type());
+    if (!etype->is_base_type()) {
+      return "";
+    }
+    switch (((t_base_type*)etype)->get_base()) {
+    case t_base_type::TYPE_I16:
+      return "I16";
+    case t_base_type::TYPE_I32:
+      return "I32";
+    case t_base_type::TYPE_I64:
+      return "I64";
+    case t_base_type::TYPE_DOUBLE:
+      return "Double";
+    default:
+      return "";
+    }
+  }
+
   void set_use_include_prefix(bool use_include_prefix) {
     use_include_prefix_ = use_include_prefix;
   }
@@ -214,6 +292,32 @@ class t_cpp_generator : public t_oop_generator {
    */
   bool use_include_prefix_;
 
+  /**
+   * True iff we should generate templatized reader/writer methods, so that
+   * callers holding a concrete protocol type avoid virtual dispatch.
+   */
+  bool gen_templates_;
+
+  /**
+   * True iff strings and containers should use TArenaAllocator, so that
+   * structs read inside a TArenaScope allocate from the arena.
+   */
+  bool gen_arena_;
+
+  /**
+   * True iff generated read() methods should map field ids to a dense
+   * index through a lookup table, guessing that fields arrive in order.
+   */
+  bool gen_jump_table_;
+
+  /**
+   * True while generating one of the program's own structs rather than a
+   * service helper struct.  Only the former get serializedSize(), and only
+   * they honor cpp.lazy, since helper struct fields are handed straight to
+   * the handler.
+   */
+  bool in_types_struct_;
+
   /**
    * Strings for namespace, computed once up front then used directly
    */
@@ -228,6 +332,7 @@ class t_cpp_generator : public t_oop_generator {
 
   std::ofstream f_types_;
   std::ofstream f_types_impl_;
+  std::ofstream f_types_tcc_;
   std::ofstream f_header_;
   std::ofstream f_service_;
 
@@ -255,11 +360,20 @@ void t_cpp_generator::init_generator() {
   string f_types_impl_name = get_out_dir()+program_name_+"_types.cpp";
   f_types_impl_.open(f_types_impl_name.c_str());
 
+  if (gen_templates_) {
+    // If we don't open the stream, it appears to just discard data,
+    // which is fine.
+    string f_types_tcc_name = get_out_dir()+program_name_+"_types.tcc";
+    f_types_tcc_.open(f_types_tcc_name.c_str());
+  }
+
   // Print header
   f_types_ <<
     autogen_comment();
   f_types_impl_ <<
     autogen_comment();
+  f_types_tcc_ <<
+    autogen_comment();
 
   // Start ifndef
   f_types_ <<
@@ -272,7 +386,27 @@ void t_cpp_generator::init_generator() {
     "#include <Thrift.h>" << endl <<
     "#include <TApplicationException.h>" << endl <<
     "#include <protocol/TProtocol.h>" << endl <<
-    "#include <transport/TTransport.h>" << endl <<
+    "#include <transport/TTransport.h>" << endl;
+  if (gen_arena_) {
+    f_types_ <<
+      "#include <TArena.h>" << endl;
+  }
+  bool has_lazy_fields = false;
+  const vector<t_struct*>& objects = program_->get_objects();
+  for (size_t i = 0; i < objects.size() && !has_lazy_fields; ++i) {
+    const vector<t_field*>& members = objects[i]->get_members();
+    for (size_t j = 0; j < members.size(); ++j) {
+      if (is_lazy_field(members[j])) {
+        has_lazy_fields = true;
+        break;
+      }
+    }
+  }
+  if (has_lazy_fields) {
+    f_types_ <<
+      "#include <protocol/TLazyField.h>" << endl;
+  }
+  f_types_ <<
     endl;
 
   // Include other Thrift includes
@@ -303,6 +437,13 @@ void t_cpp_generator::init_generator() {
     "#include \"" << get_include_prefix(*get_program()) << program_name_ <<
     "_types.h\"" << endl <<
     endl;
+  f_types_tcc_ <<
+    "#ifndef " << program_name_ << "_TYPES_TCC" << endl <<
+    "#define " << program_name_ << "_TYPES_TCC" << endl <<
+    endl <<
+    "#include \"" << get_include_prefix(*get_program()) << program_name_ <<
+    "_types.h\"" << endl <<
+    endl;
 
   // If we are generating local reflection metadata, we need to include
   // the definition of TypeSpec.
@@ -323,6 +464,10 @@ void t_cpp_generator::init_generator() {
   f_types_impl_ <<
     ns_open_ << endl <<
     endl;
+
+  f_types_tcc_ <<
+    ns_open_ << endl <<
+    endl;
 }
 
 /**
@@ -335,14 +480,28 @@ void t_cpp_generator::close_generator() {
     endl;
   f_types_impl_ <<
     ns_close_ << endl;
+  f_types_tcc_ <<
+    ns_close_ << endl <<
+    endl;
+
+  // Include the template definitions, so that the header is self-contained
+  if (gen_templates_) {
+    f_types_ <<
+      "#include \"" << get_include_prefix(*get_program()) << program_name_ <<
+      "_types.tcc\"" << endl <<
+      endl;
+  }
 
   // Close ifndef
   f_types_ <<
     "#endif" << endl;
+  f_types_tcc_ <<
+    "#endif" << endl;
 
   // Close output file
   f_types_.close();
   f_types_impl_.close();
+  f_types_tcc_.close();
 }
 
 /**
@@ -499,16 +658,20 @@ void t_cpp_generator::print_const_value(ofstream& out, string name, t_type* type
     map<t_const_value*, t_const_value*>::const_iterator v_iter;
     for (v_iter = val.begin(); v_iter != val.end(); ++v_iter) {
       t_type* field_type = NULL;
+      string member = v_iter->first->get_string();
       for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
         if ((*f_iter)->get_name() == v_iter->first->get_string()) {
           field_type = (*f_iter)->get_type();
+          if (is_lazy_field(*f_iter)) {
+            member = "mutable_" + member + "()";
+          }
         }
       }
       if (field_type == NULL) {
         throw "type error: " + type->get_name() + " has no field " + v_iter->first->get_string();
       }
       string val = render_const_value(out, name, field_type, v_iter->second);
-      indent(out) << name << "." << v_iter->first->get_string() << " = " << val << ";" << endl;
+      indent(out) << name << "." << member << " = " << val << ";" << endl;
       indent(out) << name << ".__isset." << v_iter->first->get_string() << " = true;" << endl;
     }
     out << endl;
@@ -599,13 +762,24 @@ string t_cpp_generator::render_const_value(ofstream& out, string name, t_type* t
  * @param tstruct The struct definition
  */
 void t_cpp_generator::generate_cpp_struct(t_struct* tstruct, bool is_exception) {
-  generate_struct_definition(f_types_, tstruct, is_exception);
+  in_types_struct_ = true;
+  generate_struct_definition(f_types_, tstruct, is_exception,
+                             false, true, true, gen_templates_);
   generate_struct_fingerprint(f_types_impl_, tstruct, true);
   generate_local_reflection(f_types_, tstruct, false);
   generate_local_reflection(f_types_impl_, tstruct, true);
   generate_local_reflection_pointer(f_types_impl_, tstruct);
-  generate_struct_reader(f_types_impl_, tstruct);
-  generate_struct_writer(f_types_impl_, tstruct);
+  if (gen_templates_) {
+    generate_struct_reader(f_types_tcc_, tstruct, false, true);
+    generate_struct_writer(f_types_tcc_, tstruct, false, true);
+    generate_struct_serialized_size(f_types_tcc_, tstruct, true);
+    generate_struct_virtual_fallback(f_types_impl_, tstruct);
+  } else {
+    generate_struct_reader(f_types_impl_, tstruct);
+    generate_struct_writer(f_types_impl_, tstruct);
+    generate_struct_serialized_size(f_types_impl_, tstruct);
+  }
+  in_types_struct_ = false;
 }
 
 /**
@@ -619,7 +793,8 @@ void t_cpp_generator::generate_struct_definition(ofstream& out,
                                                  bool is_exception,
                                                  bool pointers,
                                                  bool read,
-                                                 bool write) {
+                                                 bool write,
+                                                 bool templates) {
   string extends = "";
   if (is_exception) {
     extends = " : public ::apache::thrift::TException";
@@ -697,11 +872,57 @@ void t_cpp_generator::generate_struct_definition(ofstream& out,
       endl << endl;
   }
 
-  // Declare all fields
+  // Declare all fields.  Lazy ones are private, since until decoded they
+  // hold a default value; they are reached through their accessors.
+  bool in_private = false;
   for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
+    bool hidden = !pointers && lazy_field(*m_iter);
+    if (hidden != in_private) {
+      in_private = hidden;
+      indent_down();
+      indent(out) << (in_private ? " private:" : " public:") << endl;
+      indent_up();
+    }
     indent(out) <<
       declare_field(*m_iter, false, pointers && !(*m_iter)->get_type()->is_xception(), !read) << endl;
   }
+  if (in_private) {
+    indent_down();
+    indent(out) << " public:" << endl;
+    indent_up();
+  }
+
+  // Lazy fields keep their serialized bytes until first accessed through
+  // get_<field>() or mutable_<field>().
+  bool has_lazy_fields = false;
+  for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
+    if (pointers || !lazy_field(*m_iter)) {
+      continue;
+    }
+    if (!has_lazy_fields) {
+      has_lazy_fields = true;
+      out << endl;
+    }
+    string fname = (*m_iter)->get_name();
+    string tname = type_name((*m_iter)->get_type());
+    out <<
+      indent() << "mutable ::apache::thrift::protocol::TLazyField __lazy_" << fname << ";" << endl <<
+      endl <<
+      indent() << "const " << tname << "& get_" << fname << "() const {" << endl <<
+      indent() << "  if (__lazy_" << fname << ".pending()) {" << endl <<
+      indent() << "    __lazy_" << fname << ".load(const_cast<" << tname << "&>(" << fname << "));" << endl <<
+      indent() << "  }" << endl <<
+      indent() << "  return " << fname << ";" << endl <<
+      indent() << "}" << endl <<
+      endl <<
+      indent() << tname << "& mutable_" << fname << "() {" << endl <<
+      indent() << "  if (__lazy_" << fname << ".pending()) {" << endl <<
+      indent() << "    __lazy_" << fname << ".load(" << fname << ");" << endl <<
+      indent() << "  }" << endl <<
+      indent() << "  __lazy_" << fname << ".clear();" << endl <<
+      indent() << "  return " << fname << ";" << endl <<
+      indent() << "}" << endl;
+  }
 
   // Isset struct has boolean fields, but only for non-required fields.
   bool has_nonrequired_fields = false;
@@ -758,10 +979,14 @@ void t_cpp_generator::generate_struct_definition(ofstream& out,
     for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
       // Most existing Thrift code does not use isset or optional/required,
       // so we treat "default" fields as required.
+      string fname = (*m_iter)->get_name();
+      if (lazy_field(*m_iter)) {
+        fname = "get_" + fname + "()";
+      }
       if ((*m_iter)->get_req() != t_field::T_OPTIONAL) {
         out <<
-          indent() << "if (!(" << (*m_iter)->get_name()
-                   << " == rhs." << (*m_iter)->get_name() << "))" << endl <<
+          indent() << "if (!(" << fname
+                   << " == rhs." << fname << "))" << endl <<
           indent() << "  return false;" << endl;
       } else {
         out <<
@@ -769,7 +994,7 @@ void t_cpp_generator::generate_struct_definition(ofstream& out,
                    << " != rhs.__isset." << (*m_iter)->get_name() << ")" << endl <<
           indent() << "  return false;" << endl <<
           indent() << "else if (__isset." << (*m_iter)->get_name() << " && !("
-                   << (*m_iter)->get_name() << " == rhs." << (*m_iter)->get_name()
+                   << fname << " == rhs." << fname
                    << "))" << endl <<
           indent() << "  return false;" << endl;
       }
@@ -796,6 +1021,27 @@ void t_cpp_generator::generate_struct_definition(ofstream& out,
     out <<
       indent() << "uint32_t write(::apache::thrift::protocol::TProtocol* oprot) const;" << endl;
   }
+  if (write && in_types_struct_) {
+    out <<
+      indent() << "uint32_t serializedSize(::apache::thrift::protocol::TProtocol* oprot) const;" << endl;
+  }
+  if (templates) {
+    if (read) {
+      out <<
+        indent() << "template <class Protocol_>" << endl <<
+        indent() << "uint32_t read(Protocol_* iprot);" << endl;
+    }
+    if (write) {
+      out <<
+        indent() << "template <class Protocol_>" << endl <<
+        indent() << "uint32_t write(Protocol_* oprot) const;" << endl;
+    }
+    if (write && in_types_struct_) {
+      out <<
+        indent() << "template <class Protocol_>" << endl <<
+        indent() << "uint32_t serializedSize(Protocol_* oprot) const;" << endl;
+    }
+  }
   out << endl;
 
   indent_down();
@@ -972,6 +1218,93 @@ void t_cpp_generator::generate_local_reflection_pointer(std::ofstream& out,
     endl << endl;
 }
 
+/**
+ * Emits the tables for a jump-table read(): field_ids, the ids in
+ * declaration order, and field_index::lookup(fid), which maps an id back to its
+ * position or -1.  Ids that span a small range are looked up directly;
+ * sparse ids go through a perfect hash on fid modulo the table size.
+ * Starts findex, the position of the field expected next, at zero.
+ */
+void t_cpp_generator::generate_field_index_table(ofstream& out,
+                                                 const vector<t_field*>& fields) {
+  vector<t_field*>::const_iterator f_iter;
+  int32_t min_id = fields.front()->get_key();
+  int32_t max_id = min_id;
+  for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
+    min_id = std::min(min_id, (*f_iter)->get_key());
+    max_id = std::max(max_id, (*f_iter)->get_key());
+  }
+
+  // Pick the table: direct if dense enough, else the smallest modulus that
+  // gives each id its own slot.  Failing both, fall back to a switch.
+  int32_t nfields = fields.size();
+  int32_t range = max_id - min_id + 1;
+  int32_t modulus = 0;
+  vector<int> slots;
+  if (range > 2 * nfields + 16) {
+    for (int32_t m = nfields; m <= 16 * nfields + 64 && modulus == 0; ++m) {
+      slots.assign(m, -1);
+      modulus = m;
+      int findex = 0;
+      for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter, ++findex) {
+        int slot = (uint16_t)(*f_iter)->get_key() % m;
+        if (slots[slot] != -1) {
+          modulus = 0;
+          break;
+        }
+        slots[slot] = findex;
+      }
+    }
+  } else {
+    slots.assign(range, -1);
+    int findex = 0;
+    for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter, ++findex) {
+      slots[(*f_iter)->get_key() - min_id] = findex;
+    }
+  }
+
+  indent(out) << "static const int16_t field_ids[" << nfields << "] = {";
+  for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
+    out << (f_iter == fields.begin() ? "" : ", ") << (*f_iter)->get_key();
+  }
+  out << "};" << endl;
+
+  if (range <= 2 * nfields + 16 || modulus != 0) {
+    indent(out) << "static const int16_t field_slots[" << slots.size() << "] = {";
+    for (size_t i = 0; i < slots.size(); ++i) {
+      out << (i == 0 ? "" : ", ") << slots[i];
+    }
+    out << "};" << endl;
+  }
+
+  indent(out) << "struct field_index {" << endl;
+  indent_up();
+  indent(out) << "static int16_t lookup(int16_t fid) {" << endl;
+  indent_up();
+  if (range <= 2 * nfields + 16) {
+    out <<
+      indent() << "int32_t slot = (int32_t)fid - " << min_id << ";" << endl <<
+      indent() << "return (slot >= 0 && slot < " << range << ") ? field_slots[slot] : -1;" << endl;
+  } else if (modulus != 0) {
+    out <<
+      indent() << "int16_t findex = field_slots[(uint16_t)fid % " << modulus << "];" << endl <<
+      indent() << "return (findex >= 0 && field_ids[findex] == fid) ? findex : -1;" << endl;
+  } else {
+    indent(out) << "switch (fid) {" << endl;
+    int findex = 0;
+    for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter, ++findex) {
+      indent(out) << "case " << (*f_iter)->get_key() << ": return " << findex << ";" << endl;
+    }
+    indent(out) << "default: return -1;" << endl;
+    indent(out) << "}" << endl;
+  }
+  indent_down();
+  indent(out) << "}" << endl;
+  indent_down();
+  indent(out) << "};" << endl;
+  indent(out) << "int16_t findex = 0;" << endl << endl;
+}
+
 /**
  * Makes a helper function to gen a struct reader.
  *
@@ -980,9 +1313,17 @@ void t_cpp_generator::generate_local_reflection_pointer(std::ofstream& out,
  */
 void t_cpp_generator::generate_struct_reader(ofstream& out,
                                              t_struct* tstruct,
-                                             bool pointers) {
-  indent(out) <<
-    "uint32_t " << tstruct->get_name() << "::read(::apache::thrift::protocol::TProtocol* iprot) {" << endl;
+                                             bool pointers,
+                                             bool templates) {
+  if (templates) {
+    indent(out) <<
+      "template <class Protocol_>" << endl;
+    indent(out) <<
+      "uint32_t " << tstruct->get_name() << "::read(Protocol_* iprot) {" << endl;
+  } else {
+    indent(out) <<
+      "uint32_t " << tstruct->get_name() << "::read(::apache::thrift::protocol::TProtocol* iprot) {" << endl;
+  }
   indent_up();
 
   const vector<t_field*>& fields = tstruct->get_members();
@@ -1008,6 +1349,12 @@ void t_cpp_generator::generate_struct_reader(ofstream& out,
   }
   out << endl;
 
+  // With a jump table we switch on the field's position rather than its id
+  bool jump_table = gen_jump_table_ && !fields.empty();
+  if (jump_table) {
+    generate_field_index_table(out, fields);
+  }
+
 
   // Loop over reading in fields
   indent(out) <<
@@ -1024,16 +1371,33 @@ void t_cpp_generator::generate_struct_reader(ofstream& out,
       indent() << "  break;" << endl <<
       indent() << "}" << endl;
 
+    // Fields usually arrive in declaration order, so only look up the
+    // index when the field isn't the one after the last
+    if (jump_table) {
+      out <<
+        indent() << "if (findex >= " << fields.size() <<
+          " || fid != field_ids[findex]) {" << endl <<
+        indent() << "  findex = field_index::lookup(fid);" << endl <<
+        indent() << "}" << endl;
+    }
+
     // Switch statement on the field we are reading
     indent(out) <<
-      "switch (fid)" << endl;
+      (jump_table ? "switch (findex)" : "switch (fid)") << endl;
 
       scope_up(out);
 
       // Generate deserialization code for known cases
-      for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
-        indent(out) <<
-          "case " << (*f_iter)->get_key() << ":" << endl;
+      int findex = 0;
+      for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter, ++findex) {
+        if (jump_table) {
+          indent(out) <<
+            "case " << findex << ": // " << (*f_iter)->get_key() << ": " <<
+            (*f_iter)->get_name() << endl;
+        } else {
+          indent(out) <<
+            "case " << (*f_iter)->get_key() << ":" << endl;
+        }
         indent_up();
         indent(out) <<
           "if (ftype == " << type_to_enum((*f_iter)->get_type()) << ") {" << endl;
@@ -1054,6 +1418,14 @@ void t_cpp_generator::generate_struct_reader(ofstream& out,
 
         if (pointers && !(*f_iter)->get_type()->is_xception()) {
           generate_deserialize_field(out, *f_iter, "(*(this->", "))");
+        } else if (lazy_field(*f_iter)) {
+          indent(out) <<
+            "if (!this->__lazy_" << (*f_iter)->get_name() <<
+            ".capture(iprot, ftype, xfer)) {" << endl;
+          indent_up();
+          generate_deserialize_field(out, *f_iter, "this->");
+          indent_down();
+          indent(out) << "}" << endl;
         } else {
           generate_deserialize_field(out, *f_iter, "this->");
         }
@@ -1082,6 +1454,9 @@ void t_cpp_generator::generate_struct_reader(ofstream& out,
     // Read field end marker
     indent(out) <<
       "xfer += iprot->readFieldEnd();" << endl;
+    if (jump_table) {
+      indent(out) << "++findex;" << endl;
+    }
 
     scope_down(out);
 
@@ -1115,13 +1490,21 @@ void t_cpp_generator::generate_struct_reader(ofstream& out,
  */
 void t_cpp_generator::generate_struct_writer(ofstream& out,
                                              t_struct* tstruct,
-                                             bool pointers) {
+                                             bool pointers,
+                                             bool templates) {
   string name = tstruct->get_name();
   const vector<t_field*>& fields = tstruct->get_sorted_members();
   vector<t_field*>::const_iterator f_iter;
 
-  indent(out) <<
-    "uint32_t " << tstruct->get_name() << "::write(::apache::thrift::protocol::TProtocol* oprot) const {" << endl;
+  if (templates) {
+    indent(out) <<
+      "template <class Protocol_>" << endl;
+    indent(out) <<
+      "uint32_t " << tstruct->get_name() << "::write(Protocol_* oprot) const {" << endl;
+  } else {
+    indent(out) <<
+      "uint32_t " << tstruct->get_name() << "::write(::apache::thrift::protocol::TProtocol* oprot) const {" << endl;
+  }
   indent_up();
 
   out <<
@@ -1143,6 +1526,15 @@ void t_cpp_generator::generate_struct_writer(ofstream& out,
     // Write field contents
     if (pointers) {
       generate_serialize_field(out, *f_iter, "(*(this->", "))");
+    } else if (lazy_field(*f_iter)) {
+      // Untouched lazy fields are copied through verbatim
+      indent(out) <<
+        "if (!this->__lazy_" << (*f_iter)->get_name() <<
+        ".write(oprot, xfer)) {" << endl;
+      indent_up();
+      generate_serialize_field(out, *f_iter, "this->get_", "()");
+      indent_down();
+      indent(out) << "}" << endl;
     } else {
       generate_serialize_field(out, *f_iter, "this->");
     }
@@ -1167,6 +1559,113 @@ void t_cpp_generator::generate_struct_writer(ofstream& out,
     endl;
 }
 
+/**
+ * Generates the serializedSize() function, which mirrors write() but only
+ * adds up the sizes reported by the protocol.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ */
+void t_cpp_generator::generate_struct_serialized_size(ofstream& out,
+                                                      t_struct* tstruct,
+                                                      bool templates) {
+  const vector<t_field*>& fields = tstruct->get_sorted_members();
+  vector<t_field*>::const_iterator f_iter;
+
+  if (templates) {
+    indent(out) <<
+      "template <class Protocol_>" << endl;
+    indent(out) <<
+      "uint32_t " << tstruct->get_name() << "::serializedSize(Protocol_* oprot) const {" << endl;
+  } else {
+    indent(out) <<
+      "uint32_t " << tstruct->get_name() << "::serializedSize(::apache::thrift::protocol::TProtocol* oprot) const {" << endl;
+  }
+  indent_up();
+
+  out <<
+    indent() << "uint32_t xfer = 0;" << endl;
+
+  for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
+    if ((*f_iter)->get_req() == t_field::T_OPTIONAL) {
+      indent(out) << "if (this->__isset." << (*f_iter)->get_name() << ") {" << endl;
+      indent_up();
+    }
+    out <<
+      indent() << "xfer += oprot->serializedSizeFieldBegin(" <<
+      type_to_enum((*f_iter)->get_type()) << ", " <<
+      (*f_iter)->get_key() << ");" << endl;
+    if (lazy_field(*f_iter)) {
+      indent(out) <<
+        "if (!this->__lazy_" << (*f_iter)->get_name() <<
+        ".serializedSize(oprot, xfer)) {" << endl;
+      indent_up();
+      generate_serialized_size_field(out, *f_iter, "this->get_", "()");
+      indent_down();
+      indent(out) << "}" << endl;
+    } else {
+      generate_serialized_size_field(out, *f_iter, "this->");
+    }
+    if ((*f_iter)->get_req() == t_field::T_OPTIONAL) {
+      indent_down();
+      indent(out) << '}' << endl;
+    }
+  }
+
+  out <<
+    indent() << "xfer += oprot->serializedSizeFieldStop();" << endl <<
+    indent() << "return xfer;" << endl;
+
+  indent_down();
+  indent(out) <<
+    "}" << endl <<
+    endl;
+}
+
+/**
+ * Generates the non-template read() and write() methods for a struct whose
+ * serializers were emitted as templates.  These simply instantiate the
+ * templates with the abstract TProtocol, so callers that only have a
+ * TProtocol* keep working through virtual dispatch.
+ *
+ * @param out Stream to write to
+ * @param tstruct The struct
+ */
+void t_cpp_generator::generate_struct_virtual_fallback(ofstream& out,
+                                                       t_struct* tstruct) {
+  string name = tstruct->get_name();
+
+  indent(out) <<
+    "uint32_t " << name << "::read(::apache::thrift::protocol::TProtocol* iprot) {" << endl;
+  indent_up();
+  indent(out) <<
+    "return read< ::apache::thrift::protocol::TProtocol>(iprot);" << endl;
+  indent_down();
+  indent(out) <<
+    "}" << endl <<
+    endl;
+
+  indent(out) <<
+    "uint32_t " << name << "::write(::apache::thrift::protocol::TProtocol* oprot) const {" << endl;
+  indent_up();
+  indent(out) <<
+    "return write< ::apache::thrift::protocol::TProtocol>(oprot);" << endl;
+  indent_down();
+  indent(out) <<
+    "}" << endl <<
+    endl;
+
+  indent(out) <<
+    "uint32_t " << name << "::serializedSize(::apache::thrift::protocol::TProtocol* oprot) const {" << endl;
+  indent_up();
+  indent(out) <<
+    "return serializedSize< ::apache::thrift::protocol::TProtocol>(oprot);" << endl;
+  indent_down();
+  indent(out) <<
+    "}" << endl <<
+    endl;
+}
+
 /**
  * Struct writer for result of a function, which can have only one of its
  * fields set and does a conditional if else look up into the __isset field
@@ -1894,6 +2393,7 @@ void t_cpp_generator::generate_service_processor(t_service* tservice) {
     indent() << "}" << endl <<
     endl <<
     indent() << "virtual bool process(boost::shared_ptr< ::apache::thrift::protocol::TProtocol> piprot, boost::shared_ptr< ::apache::thrift::protocol::TProtocol> poprot);" << endl <<
+    indent() << "virtual void getInlineMethods(std::set<std::string>& fnames) const;" << endl <<
     indent() << "virtual ~" << service_name_ << "Processor() {}" << endl;
   indent_down();
   f_header_ <<
@@ -1970,6 +2470,30 @@ void t_cpp_generator::generate_service_processor(t_service* tservice) {
     "}" << endl <<
     endl;
 
+  // Methods marked cheap enough to run on a nonblocking server's IO thread
+  bool uses_fnames = !extends.empty();
+  for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
+    uses_fnames = uses_fnames || is_inline_function(*f_iter);
+  }
+  f_service_ <<
+    "void " << service_name_ << "Processor::getInlineMethods(std::set<std::string>& " <<
+    (uses_fnames ? "fnames" : "/* fnames */") << ") const {" << endl;
+  indent_up();
+  if (!extends.empty()) {
+    f_service_ <<
+      indent() << extends << "Processor::getInlineMethods(fnames);" << endl;
+  }
+  for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
+    if (is_inline_function(*f_iter)) {
+      f_service_ <<
+        indent() << "fnames.insert(\"" << (*f_iter)->get_name() << "\");" << endl;
+    }
+  }
+  indent_down();
+  f_service_ <<
+    "}" << endl <<
+    endl;
+
   // Generate the process subfunctions
   for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
     generate_process_function(tservice, *f_iter);
@@ -2353,6 +2877,17 @@ void t_cpp_generator::generate_deserialize_container(ofstream& out,
     }
   }
 
+  // Primitive lists are read in one bulk call
+  string bulk = bulk_list_type(ttype);
+  if (!bulk.empty()) {
+    out <<
+      indent() << "if (" << size << " > 0) {" << endl <<
+      indent() << "  xfer += iprot->read" << bulk << "List(&" << prefix << "[0], " << size << ");" << endl <<
+      indent() << "}" << endl <<
+      indent() << "iprot->readListEnd();" << endl;
+    scope_down(out);
+    return;
+  }
 
   // For loop iterates over elements
   string i = tmp("_i");
@@ -2519,6 +3054,115 @@ void t_cpp_generator::generate_serialize_field(ofstream& out,
   }
 }
 
+/**
+ * Sizes a field of any type, the counterpart of generate_serialize_field.
+ *
+ * @param tfield The field to size
+ * @param prefix Name to prepend to field name
+ */
+void t_cpp_generator::generate_serialized_size_field(ofstream& out,
+                                                     t_field* tfield,
+                                                     string prefix,
+                                                     string suffix) {
+  t_type* type = get_true_type(tfield->get_type());
+
+  string name = prefix + tfield->get_name() + suffix;
+
+  if (type->is_struct() || type->is_xception()) {
+    indent(out) <<
+      "xfer += " << name << ".serializedSize(oprot);" << endl;
+  } else if (type->is_container()) {
+    generate_serialized_size_container(out, type, name);
+  } else if (type->is_base_type()) {
+    indent(out) <<
+      "xfer += oprot->";
+    t_base_type::t_base tbase = ((t_base_type*)type)->get_base();
+    switch (tbase) {
+    case t_base_type::TYPE_STRING:
+      if (((t_base_type*)type)->is_binary()) {
+        out << "serializedSizeBinary(" << name << ".size());";
+      } else {
+        out << "serializedSizeString(" << name << ".size());";
+      }
+      break;
+    case t_base_type::TYPE_BOOL:
+      out << "serializedSizeBool(" << name << ");";
+      break;
+    case t_base_type::TYPE_BYTE:
+      out << "serializedSizeByte(" << name << ");";
+      break;
+    case t_base_type::TYPE_I16:
+      out << "serializedSizeI16(" << name << ");";
+      break;
+    case t_base_type::TYPE_I32:
+      out << "serializedSizeI32(" << name << ");";
+      break;
+    case t_base_type::TYPE_I64:
+      out << "serializedSizeI64(" << name << ");";
+      break;
+    case t_base_type::TYPE_DOUBLE:
+      out << "serializedSizeDouble(" << name << ");";
+      break;
+    default:
+      throw "compiler error: no C++ size for base type " + t_base_type::t_base_name(tbase) + name;
+    }
+    out << endl;
+  } else if (type->is_enum()) {
+    indent(out) <<
+      "xfer += oprot->serializedSizeI32((int32_t)" << name << ");" << endl;
+  } else {
+    throw "compiler error: cannot size field '" + name + "'";
+  }
+}
+
+/**
+ * Sizes a container and its elements.
+ */
+void t_cpp_generator::generate_serialized_size_container(ofstream& out,
+                                                         t_type* ttype,
+                                                         string prefix) {
+  scope_up(out);
+
+  if (ttype->is_map()) {
+    indent(out) <<
+      "xfer += oprot->serializedSizeMapBegin(" <<
+      type_to_enum(((t_map*)ttype)->get_key_type()) << ", " <<
+      type_to_enum(((t_map*)ttype)->get_val_type()) << ", " <<
+      prefix << ".size());" << endl;
+  } else if (ttype->is_set()) {
+    indent(out) <<
+      "xfer += oprot->serializedSizeSetBegin(" <<
+      type_to_enum(((t_set*)ttype)->get_elem_type()) << ", " <<
+      prefix << ".size());" << endl;
+  } else if (ttype->is_list()) {
+    indent(out) <<
+      "xfer += oprot->serializedSizeListBegin(" <<
+      type_to_enum(((t_list*)ttype)->get_elem_type()) << ", " <<
+      prefix << ".size());" << endl;
+  }
+
+  string iter = tmp("_iter");
+  out <<
+    indent() << type_name(ttype) << "::const_iterator " << iter << ";" << endl <<
+    indent() << "for (" << iter << " = " << prefix  << ".begin(); " << iter << " != " << prefix << ".end(); ++" << iter << ")" << endl;
+  scope_up(out);
+    if (ttype->is_map()) {
+      t_field kfield(((t_map*)ttype)->get_key_type(), iter + "->first");
+      generate_serialized_size_field(out, &kfield, "");
+      t_field vfield(((t_map*)ttype)->get_val_type(), iter + "->second");
+      generate_serialized_size_field(out, &vfield, "");
+    } else if (ttype->is_set()) {
+      t_field efield(((t_set*)ttype)->get_elem_type(), "(*" + iter + ")");
+      generate_serialized_size_field(out, &efield, "");
+    } else if (ttype->is_list()) {
+      t_field efield(((t_list*)ttype)->get_elem_type(), "(*" + iter + ")");
+      generate_serialized_size_field(out, &efield, "");
+    }
+  scope_down(out);
+
+  scope_down(out);
+}
+
 /**
  * Serializes all the members of a struct.
  *
@@ -2555,6 +3199,18 @@ void t_cpp_generator::generate_serialize_container(ofstream& out,
       prefix << ".size());" << endl;
   }
 
+  // Primitive lists are written in one bulk call
+  string bulk = bulk_list_type(ttype);
+  if (!bulk.empty()) {
+    out <<
+      indent() << "if (!" << prefix << ".empty()) {" << endl <<
+      indent() << "  xfer += oprot->write" << bulk << "List(&" << prefix << "[0], " << prefix << ".size());" << endl <<
+      indent() << "}" << endl <<
+      indent() << "xfer += oprot->writeListEnd();" << endl;
+    scope_down(out);
+    return;
+  }
+
   string iter = tmp("_iter");
   out <<
     indent() << type_name(ttype) << "::const_iterator " << iter << ";" << endl <<
@@ -2716,15 +3372,33 @@ string t_cpp_generator::type_name(t_type* ttype, bool in_typedef, bool arg) {
       cname = tcontainer->get_cpp_name();
     } else if (ttype->is_map()) {
       t_map* tmap = (t_map*) ttype;
-      cname = "std::map<" +
-        type_name(tmap->get_key_type(), in_typedef) + ", " +
-        type_name(tmap->get_val_type(), in_typedef) + "> ";
+      string kname = type_name(tmap->get_key_type(), in_typedef);
+      string vname = type_name(tmap->get_val_type(), in_typedef);
+      if (gen_arena_) {
+        cname = "std::map< " + kname + ", " + vname + ", std::less< " + kname +
+          " >, ::apache::thrift::TArenaAllocator< std::pair<const " + kname +
+          ", " + vname + " > > > ";
+      } else {
+        cname = "std::map<" + kname + ", " + vname + "> ";
+      }
     } else if (ttype->is_set()) {
       t_set* tset = (t_set*) ttype;
-      cname = "std::set<" + type_name(tset->get_elem_type(), in_typedef) + "> ";
+      string ename = type_name(tset->get_elem_type(), in_typedef);
+      if (gen_arena_) {
+        cname = "std::set< " + ename + ", std::less< " + ename +
+          " >, ::apache::thrift::TArenaAllocator< " + ename + " > > ";
+      } else {
+        cname = "std::set<" + ename + "> ";
+      }
     } else if (ttype->is_list()) {
       t_list* tlist = (t_list*) ttype;
-      cname = "std::vector<" + type_name(tlist->get_elem_type(), in_typedef) + "> ";
+      string ename = type_name(tlist->get_elem_type(), in_typedef);
+      if (gen_arena_) {
+        cname = "std::vector< " + ename + ", ::apache::thrift::TArenaAllocator< " +
+          ename + " > > ";
+      } else {
+        cname = "std::vector<" + ename + "> ";
+      }
     }
 
     if (arg) {
@@ -2773,7 +3447,7 @@ string t_cpp_generator::base_type_name(t_base_type::t_base tbase) {
   case t_base_type::TYPE_VOID:
     return "void";
   case t_base_type::TYPE_STRING:
-    return "std::string";
+    return gen_arena_ ? "::apache::thrift::TArenaString" : "std::string";
   case t_base_type::TYPE_BOOL:
     return "bool";
   case t_base_type::TYPE_BYTE:
@@ -3005,4 +3679,7 @@ string t_cpp_generator::get_include_prefix(const t_program& program) const {
 THRIFT_REGISTER_GENERATOR(cpp, "C++",
 "    dense:           Generate type specifications for the dense protocol.\n"
 "    include_prefix:  Use full include paths in generated files.\n"
+"    templates:       Generate templatized reader/writer methods.\n"
+"    arena:           Allocate strings and containers with TArenaAllocator.\n"
+"    jump_table:      Dispatch on field ids through a lookup table in read().\n"
 );
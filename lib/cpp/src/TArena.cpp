@@ -0,0 +1,120 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "TArena.h"
+
+#include <cstdlib>
+#include <pthread.h>
+
+namespace apache { namespace thrift {
+
+namespace {
+
+pthread_key_t currentArenaKey;
+pthread_once_t currentArenaOnce = PTHREAD_ONCE_INIT;
+
+void makeCurrentArenaKey() {
+  pthread_key_create(&currentArenaKey, NULL);
+}
+
+} // namespace
+
+TArena::TArena(size_t chunkSize)
+  : chunkSize_(chunkSize)
+  , curChunk_(0)
+  , cur_(NULL)
+  , end_(NULL)
+  , allocated_(0)
+  , allocations_(0)
+  , reserved_(0) {
+}
+
+TArena::~TArena() {
+  for (size_t i = 0; i < chunks_.size(); i++) {
+    std::free(chunks_[i].data);
+  }
+}
+
+void* TArena::allocateSlow(size_t size) {
+  if (size <= chunkSize_) {
+    // Reuse a chunk retained by reset() if there is one.
+    if (cur_ != NULL && curChunk_ + 1 < chunks_.size() &&
+        chunks_[curChunk_ + 1].size == chunkSize_) {
+      ++curChunk_;
+      cur_ = chunks_[curChunk_].data;
+      end_ = cur_ + chunkSize_;
+      return allocate(size);
+    }
+  }
+
+  // Oversized requests get a dedicated chunk and leave the current one
+  // in place, so we keep carving from it afterwards.
+  size_t newSize = size > chunkSize_ ? size : chunkSize_;
+  Chunk chunk;
+  chunk.data = static_cast<char*>(std::malloc(newSize));
+  if (chunk.data == NULL) {
+    throw std::bad_alloc();
+  }
+  chunk.size = newSize;
+  chunks_.push_back(chunk);
+  reserved_ += newSize;
+  allocated_ += size;
+  ++allocations_;
+
+  if (newSize == chunkSize_) {
+    curChunk_ = chunks_.size() - 1;
+    cur_ = chunk.data + size;
+    end_ = chunk.data + newSize;
+  }
+  return chunk.data;
+}
+
+void TArena::reset() {
+  std::vector<Chunk> kept;
+  for (size_t i = 0; i < chunks_.size(); i++) {
+    if (chunks_[i].size == chunkSize_) {
+      kept.push_back(chunks_[i]);
+    } else {
+      reserved_ -= chunks_[i].size;
+      std::free(chunks_[i].data);
+    }
+  }
+  chunks_.swap(kept);
+
+  curChunk_ = 0;
+  if (chunks_.empty()) {
+    cur_ = end_ = NULL;
+  } else {
+    cur_ = chunks_[0].data;
+    end_ = cur_ + chunkSize_;
+  }
+  allocated_ = 0;
+  allocations_ = 0;
+}
+
+TArena* TArena::current() {
+  pthread_once(&currentArenaOnce, makeCurrentArenaKey);
+  return static_cast<TArena*>(pthread_getspecific(currentArenaKey));
+}
+
+void TArena::setCurrent(TArena* arena) {
+  pthread_once(&currentArenaOnce, makeCurrentArenaKey);
+  pthread_setspecific(currentArenaKey, arena);
+}
+
+}} // apache::thrift
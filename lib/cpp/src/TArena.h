@@ -0,0 +1,228 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#ifndef _THRIFT_TARENA_H_
+#define _THRIFT_TARENA_H_ 1
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+namespace apache { namespace thrift {
+
+/**
+ * A simple region allocator.  Memory is handed out by bumping a pointer
+ * through a list of chunks, individual deallocations are no-ops, and
+ * everything is released at once by reset() or the destructor.
+ *
+ * This is meant for deserializing large responses: bind an arena with
+ * TArenaScope, construct and read() a struct generated with the "arena"
+ * option, and all of its strings and container nodes come out of the
+ * arena.  The struct must be destroyed before the arena is reset.
+ *
+ * An arena is not thread-safe.
+ */
+class TArena : boost::noncopyable {
+ public:
+  static const size_t DEFAULT_CHUNK_SIZE = 8192;
+
+  explicit TArena(size_t chunkSize = DEFAULT_CHUNK_SIZE);
+
+  ~TArena();
+
+  /**
+   * Returns size bytes of storage, aligned for any type.
+   */
+  void* allocate(size_t size) {
+    size = (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if (size <= (size_t)(end_ - cur_)) {
+      void* rv = cur_;
+      cur_ += size;
+      allocated_ += size;
+      ++allocations_;
+      return rv;
+    }
+    return allocateSlow(size);
+  }
+
+  /**
+   * Releases everything allocated from this arena.  Standard-sized chunks
+   * are kept around for reuse; oversized ones are freed.
+   */
+  void reset();
+
+  /**
+   * Bytes handed out since construction or the last reset().
+   */
+  size_t bytesAllocated() const {
+    return allocated_;
+  }
+
+  /**
+   * Number of allocate() calls since construction or the last reset().
+   */
+  size_t allocations() const {
+    return allocations_;
+  }
+
+  /**
+   * Bytes of chunk memory currently held by the arena.
+   */
+  size_t bytesReserved() const {
+    return reserved_;
+  }
+
+  /**
+   * The arena bound to the calling thread by TArenaScope, or NULL.
+   */
+  static TArena* current();
+
+  static void setCurrent(TArena* arena);
+
+ private:
+  static const size_t ALIGNMENT = 2 * sizeof(void*);
+
+  void* allocateSlow(size_t size);
+
+  struct Chunk {
+    char* data;
+    size_t size;
+  };
+
+  size_t chunkSize_;
+  std::vector<Chunk> chunks_;
+  // Index of the chunk we are currently carving from.
+  size_t curChunk_;
+  char* cur_;
+  char* end_;
+  size_t allocated_;
+  size_t allocations_;
+  size_t reserved_;
+};
+
+/**
+ * Binds an arena to the calling thread for the lifetime of the scope.
+ * TArenaAllocators that are default-constructed inside the scope (e.g. by
+ * the constructors of generated arena types) allocate from it.
+ */
+class TArenaScope : boost::noncopyable {
+ public:
+  explicit TArenaScope(TArena* arena) : prev_(TArena::current()) {
+    TArena::setCurrent(arena);
+  }
+
+  ~TArenaScope() {
+    TArena::setCurrent(prev_);
+  }
+
+ private:
+  TArena* prev_;
+};
+
+/**
+ * STL allocator backed by a TArena.  A default-constructed allocator binds
+ * to the thread's current arena, if any; without one it falls back to the
+ * global operator new, so arena types are usable outside of a TArenaScope.
+ */
+template <class T>
+class TArenaAllocator {
+ public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <class U>
+  struct rebind {
+    typedef TArenaAllocator<U> other;
+  };
+
+  TArenaAllocator() : arena_(TArena::current()) {}
+
+  explicit TArenaAllocator(TArena* arena) : arena_(arena) {}
+
+  template <class U>
+  TArenaAllocator(const TArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  pointer address(reference x) const {
+    return &x;
+  }
+
+  const_pointer address(const_reference x) const {
+    return &x;
+  }
+
+  pointer allocate(size_type n, const void* /* hint */ = 0) {
+    if (arena_ != NULL) {
+      return static_cast<pointer>(arena_->allocate(n * sizeof(T)));
+    }
+    return static_cast<pointer>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(pointer p, size_type /* n */) {
+    if (arena_ == NULL) {
+      ::operator delete(p);
+    }
+  }
+
+  size_type max_size() const {
+    return size_type(-1) / sizeof(T);
+  }
+
+  void construct(pointer p, const T& val) {
+    new ((void*)p) T(val);
+  }
+
+  void destroy(pointer p) {
+    p->~T();
+  }
+
+  TArena* arena() const {
+    return arena_;
+  }
+
+ private:
+  TArena* arena_;
+};
+
+template <class T, class U>
+inline bool operator==(const TArenaAllocator<T>& a, const TArenaAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <class T, class U>
+inline bool operator!=(const TArenaAllocator<T>& a, const TArenaAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+/**
+ * String type used for string and binary fields by the "arena" generator
+ * option.
+ */
+typedef std::basic_string<char, std::char_traits<char>, TArenaAllocator<char> >
+  TArenaString;
+
+}} // apache::thrift
+
+#endif // #ifndef _THRIFT_TARENA_H_
@@ -20,6 +20,7 @@
 #ifndef _THRIFT_TPROCESSOR_H_
 #define _THRIFT_TPROCESSOR_H_ 1
 
+#include <set>
 #include <string>
 #include <protocol/TProtocol.h>
 #include <boost/shared_ptr.hpp>
@@ -44,6 +45,13 @@ class TProcessor {
     return process(io, io);
   }
 
+  /**
+   * Add to fnames the methods marked, by cpp.dispatch = "inline" in their
+   * IDL, cheap enough for a nonblocking server to run on its IO thread
+   * rather than in its thread pool.
+   */
+  virtual void getInlineMethods(std::set<std::string>& /* fnames */) const {}
+
  protected:
   TProcessor() {}
 };
@@ -21,8 +21,10 @@
 #define _THRIFT_PROTOCOL_TBINARYPROTOCOL_H_ 1
 
 #include "TProtocol.h"
+#include "TVirtualProtocol.h"
 
 #include <boost/shared_ptr.hpp>
+#include <boost/static_assert.hpp>
 
 namespace apache { namespace thrift { namespace protocol {
 
@@ -30,16 +32,24 @@ namespace apache { namespace thrift { namespace protocol {
  * The default binary protocol for thrift. Writes all data in a very basic
  * binary format, essentially just spitting out the raw bytes.
  *
+ * The transport type is a template parameter so that code which knows the
+ * concrete transport (e.g. TBinaryProtocolT<TMemoryBuffer>) can call its
+ * non-virtual fast paths directly.  TBinaryProtocol is the TTransport
+ * instantiation and behaves exactly as before.
+ *
  */
-class TBinaryProtocol : public TProtocol {
+template <class Transport_>
+class TBinaryProtocolT
+  : public TVirtualProtocol< TBinaryProtocolT<Transport_> > {
  protected:
   static const int32_t VERSION_MASK = 0xffff0000;
   static const int32_t VERSION_1 = 0x80010000;
   // VERSION_2 (0x80020000)  is taken by TDenseProtocol.
 
  public:
-  TBinaryProtocol(boost::shared_ptr<TTransport> trans) :
-    TProtocol(trans),
+  TBinaryProtocolT(boost::shared_ptr<Transport_> trans) :
+    TVirtualProtocol< TBinaryProtocolT<Transport_> >(trans),
+    trans_(trans.get()),
     string_limit_(0),
     container_limit_(0),
     strict_read_(false),
@@ -47,12 +57,13 @@ class TBinaryProtocol : public TProtocol {
     string_buf_(NULL),
     string_buf_size_(0) {}
 
-  TBinaryProtocol(boost::shared_ptr<TTransport> trans,
-                  int32_t string_limit,
-                  int32_t container_limit,
-                  bool strict_read,
-                  bool strict_write) :
-    TProtocol(trans),
+  TBinaryProtocolT(boost::shared_ptr<Transport_> trans,
+                   int32_t string_limit,
+                   int32_t container_limit,
+                   bool strict_read,
+                   bool strict_write) :
+    TVirtualProtocol< TBinaryProtocolT<Transport_> >(trans),
+    trans_(trans.get()),
     string_limit_(string_limit),
     container_limit_(container_limit),
     strict_read_(strict_read),
@@ -60,7 +71,7 @@ class TBinaryProtocol : public TProtocol {
     string_buf_(NULL),
     string_buf_size_(0) {}
 
-  ~TBinaryProtocol() {
+  ~TBinaryProtocolT() {
     if (string_buf_ != NULL) {
       std::free(string_buf_);
       string_buf_size_ = 0;
@@ -84,11 +95,11 @@ class TBinaryProtocol : public TProtocol {
    * Writing functions.
    */
 
-  virtual uint32_t writeMessageBegin(const std::string& name,
-                                     const TMessageType messageType,
-                                     const int32_t seqid);
+  uint32_t writeMessageBegin(const std::string& name,
+                             const TMessageType messageType,
+                             const int32_t seqid);
 
-  virtual uint32_t writeMessageEnd();
+  uint32_t writeMessageEnd();
 
 
   uint32_t writeStructBegin(const char* name);
@@ -135,6 +146,36 @@ class TBinaryProtocol : public TProtocol {
 
   uint32_t writeBinary(const std::string& str);
 
+  // Strings with a custom allocator, e.g. TArenaString
+  template <class Traits_, class Alloc_>
+  uint32_t writeString(const std::basic_string<char, Traits_, Alloc_>& str);
+
+  template <class Traits_, class Alloc_>
+  uint32_t writeBinary(const std::basic_string<char, Traits_, Alloc_>& str) {
+    return writeString(str);
+  }
+
+  /**
+   * Bulk list functions.  Elements are byte-swapped in chunks and handed to
+   * the transport in a single call per chunk.
+   */
+
+  uint32_t writeI16List(const int16_t* values, uint32_t size) {
+    return writeListBits<uint16_t>(values, size);
+  }
+
+  uint32_t writeI32List(const int32_t* values, uint32_t size) {
+    return writeListBits<uint32_t>(values, size);
+  }
+
+  uint32_t writeI64List(const int64_t* values, uint32_t size) {
+    return writeListBits<uint64_t>(values, size);
+  }
+
+  uint32_t writeDoubleList(const double* values, uint32_t size) {
+    return writeListBits<uint64_t>(values, size);
+  }
+
   /**
    * Reading functions
    */
@@ -173,6 +214,8 @@ class TBinaryProtocol : public TProtocol {
   uint32_t readSetEnd();
 
   uint32_t readBool(bool& value);
+  // Provide the default readBool() implementation for std::vector<bool>
+  using TVirtualProtocol< TBinaryProtocolT<Transport_> >::readBool;
 
   uint32_t readByte(int8_t& byte);
 
@@ -188,8 +231,131 @@ class TBinaryProtocol : public TProtocol {
 
   uint32_t readBinary(std::string& str);
 
+  // Strings with a custom allocator, e.g. TArenaString
+  template <class Traits_, class Alloc_>
+  uint32_t readString(std::basic_string<char, Traits_, Alloc_>& str);
+
+  template <class Traits_, class Alloc_>
+  uint32_t readBinary(std::basic_string<char, Traits_, Alloc_>& str) {
+    return readString(str);
+  }
+
+  /**
+   * Bulk list functions.  The whole list is read with one readAll() and
+   * byte-swapped in place.
+   */
+
+  uint32_t readI16List(int16_t* values, uint32_t size) {
+    return readListBits<uint16_t>(values, size);
+  }
+
+  uint32_t readI32List(int32_t* values, uint32_t size) {
+    return readListBits<uint32_t>(values, size);
+  }
+
+  uint32_t readI64List(int64_t* values, uint32_t size) {
+    return readListBits<uint64_t>(values, size);
+  }
+
+  uint32_t readDoubleList(double* values, uint32_t size) {
+    return readListBits<uint64_t>(values, size);
+  }
+
+  /**
+   * Skips a value without decoding it.  Fixed-width values, strings, and
+   * containers of fixed-width elements are dropped from the transport in a
+   * single step.
+   */
+  uint32_t skip(TType type);
+
+  /**
+   * Serialized size functions.  These are exact for the binary protocol.
+   */
+
+  uint32_t serializedSizeFieldBegin(const TType /* fieldType */,
+                                    const int16_t /* fieldId */) {
+    return 3;
+  }
+
+  uint32_t serializedSizeFieldStop() {
+    return 1;
+  }
+
+  uint32_t serializedSizeMapBegin(const TType /* keyType */,
+                                  const TType /* valType */,
+                                  const uint32_t /* size */) {
+    return 6;
+  }
+
+  uint32_t serializedSizeListBegin(const TType /* elemType */,
+                                   const uint32_t /* size */) {
+    return 5;
+  }
+
+  uint32_t serializedSizeSetBegin(const TType /* elemType */,
+                                  const uint32_t /* size */) {
+    return 5;
+  }
+
+  uint32_t serializedSizeBool(const bool /* value */) {
+    return 1;
+  }
+
+  uint32_t serializedSizeByte(const int8_t /* byte */) {
+    return 1;
+  }
+
+  uint32_t serializedSizeI16(const int16_t /* i16 */) {
+    return 2;
+  }
+
+  uint32_t serializedSizeI32(const int32_t /* i32 */) {
+    return 4;
+  }
+
+  uint32_t serializedSizeI64(const int64_t /* i64 */) {
+    return 8;
+  }
+
+  uint32_t serializedSizeDouble(const double /* dub */) {
+    return 8;
+  }
+
+  uint32_t serializedSizeString(const uint32_t len) {
+    return 4 + len;
+  }
+
+  uint32_t serializedSizeBinary(const uint32_t len) {
+    return 4 + len;
+  }
+
  protected:
-  uint32_t readStringBody(std::string& str, int32_t sz);
+  template <class StrType_>
+  uint32_t readStringBody(StrType_& str, int32_t sz);
+
+  // Size on the wire of a fixed-width type, or 0 if it is variable-width.
+  static uint32_t getFixedWidth(TType type);
+
+  // Conversion between host and network byte order (it is symmetric).
+  static uint16_t swapBytes(uint16_t bits) {
+    return htons(bits);
+  }
+
+  static uint32_t swapBytes(uint32_t bits) {
+    return htonl(bits);
+  }
+
+  static uint64_t swapBytes(uint64_t bits) {
+    return htonll(bits);
+  }
+
+  template <class Bits_, class Value_>
+  uint32_t writeListBits(const Value_* values, uint32_t size);
+
+  template <class Bits_, class Value_>
+  uint32_t readListBits(Value_* values, uint32_t size);
+
+  Transport_* trans_;
 
   int32_t string_limit_;
   int32_t container_limit_;
@@ -205,24 +371,31 @@ class TBinaryProtocol : public TProtocol {
 
 };
 
+typedef TBinaryProtocolT<TTransport> TBinaryProtocol;
+
 /**
  * Constructs binary protocol handlers
+ *
+ * If the transport handed to getProtocol() is a Transport_, the factory
+ * returns a TBinaryProtocolT<Transport_>; otherwise it falls back to a
+ * plain TBinaryProtocol.
  */
-class TBinaryProtocolFactory : public TProtocolFactory {
+template <class Transport_>
+class TBinaryProtocolFactoryT : public TProtocolFactory {
  public:
-  TBinaryProtocolFactory() :
+  TBinaryProtocolFactoryT() :
     string_limit_(0),
     container_limit_(0),
     strict_read_(false),
     strict_write_(true) {}
 
-  TBinaryProtocolFactory(int32_t string_limit, int32_t container_limit, bool strict_read, bool strict_write) :
+  TBinaryProtocolFactoryT(int32_t string_limit, int32_t container_limit, bool strict_read, bool strict_write) :
     string_limit_(string_limit),
     container_limit_(container_limit),
     strict_read_(strict_read),
     strict_write_(strict_write) {}
 
-  virtual ~TBinaryProtocolFactory() {}
+  virtual ~TBinaryProtocolFactoryT() {}
 
   void setStringSizeLimit(int32_t string_limit) {
     string_limit_ = string_limit;
@@ -238,7 +411,19 @@ class TBinaryProtocolFactory : public TProtocolFactory {
   }
 
   boost::shared_ptr<TProtocol> getProtocol(boost::shared_ptr<TTransport> trans) {
-    return boost::shared_ptr<TProtocol>(new TBinaryProtocol(trans, string_limit_, container_limit_, strict_read_, strict_write_));
+    boost::shared_ptr<Transport_> specific_trans =
+      boost::dynamic_pointer_cast<Transport_>(trans);
+    TProtocol* prot;
+    if (specific_trans) {
+      prot = new TBinaryProtocolT<Transport_>(specific_trans, string_limit_,
+                                              container_limit_, strict_read_,
+                                              strict_write_);
+    } else {
+      prot = new TBinaryProtocol(trans, string_limit_, container_limit_,
+                                 strict_read_, strict_write_);
+    }
+
+    return boost::shared_ptr<TProtocol>(prot);
   }
 
  private:
@@ -249,6 +434,10 @@ class TBinaryProtocolFactory : public TProtocolFactory {
 
 };
 
+typedef TBinaryProtocolFactoryT<TTransport> TBinaryProtocolFactory;
+
 }}} // apache::thrift::protocol
 
+#include "TBinaryProtocol.tcc"
+
 #endif // #ifndef _THRIFT_PROTOCOL_TBINARYPROTOCOL_H_
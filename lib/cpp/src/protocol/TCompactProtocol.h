@@ -21,6 +21,7 @@
 #define _THRIFT_PROTOCOL_TCOMPACTPROTOCOL_H_ 1
 
 #include "TProtocol.h"
+#include "TVirtualProtocol.h"
 
 #include <stack>
 #include <boost/shared_ptr.hpp>
@@ -30,7 +31,9 @@ namespace apache { namespace thrift { namespace protocol {
 /**
  * C++ Implementation of the Compact Protocol as described in THRIFT-110
  */
-class TCompactProtocol : public TProtocol {
+template <class Transport_>
+class TCompactProtocolT
+  : public TVirtualProtocol< TCompactProtocolT<Transport_> > {
 
  protected:
   static const int8_t  PROTOCOL_ID = 0x82;
@@ -39,6 +42,8 @@ class TCompactProtocol : public TProtocol {
   static const int8_t  TYPE_MASK = 0xE0; // 1110 0000
   static const int32_t TYPE_SHIFT_AMOUNT = 5;
 
+  Transport_* trans_;
+
   /**
    * (Writing) If we encounter a boolean field begin, save the TField here
    * so it can have the value incorporated.
@@ -85,8 +90,9 @@ class TCompactProtocol : public TProtocol {
   static const int8_t TTypeToCType[16];
 
  public:
-  TCompactProtocol(boost::shared_ptr<TTransport> trans) :
-    TProtocol(trans),
+  TCompactProtocolT(boost::shared_ptr<Transport_> trans) :
+    TVirtualProtocol< TCompactProtocolT<Transport_> >(trans),
+    trans_(trans.get()),
     lastFieldId_(0),
     string_limit_(0),
     string_buf_(NULL),
@@ -96,10 +102,11 @@ class TCompactProtocol : public TProtocol {
     boolValue_.hasBoolValue = false;
   }
 
-  TCompactProtocol(boost::shared_ptr<TTransport> trans,
-                   int32_t string_limit,
-                   int32_t container_limit) :
-    TProtocol(trans),
+  TCompactProtocolT(boost::shared_ptr<Transport_> trans,
+                    int32_t string_limit,
+                    int32_t container_limit) :
+    TVirtualProtocol< TCompactProtocolT<Transport_> >(trans),
+    trans_(trans.get()),
     lastFieldId_(0),
     string_limit_(string_limit),
     string_buf_(NULL),
@@ -109,7 +116,7 @@ class TCompactProtocol : public TProtocol {
     boolValue_.hasBoolValue = false;
   }
 
-  ~TCompactProtocol() {
+  ~TCompactProtocolT() {
     free(string_buf_);
   }
 
@@ -118,9 +125,9 @@ class TCompactProtocol : public TProtocol {
    * Writing functions
    */
 
-  virtual uint32_t writeMessageBegin(const std::string& name,
-                                     const TMessageType messageType,
-                                     const int32_t seqid);
+  uint32_t writeMessageBegin(const std::string& name,
+                             const TMessageType messageType,
+                             const int32_t seqid);
 
   uint32_t writeStructBegin(const char* name);
 
@@ -138,9 +145,9 @@ class TCompactProtocol : public TProtocol {
   uint32_t writeSetBegin(const TType elemType,
                          const uint32_t size);
 
-  virtual uint32_t writeMapBegin(const TType keyType,
-                                 const TType valType,
-                                 const uint32_t size);
+  uint32_t writeMapBegin(const TType keyType,
+                         const TType valType,
+                         const uint32_t size);
 
   uint32_t writeBool(const bool value);
 
@@ -158,11 +165,41 @@ class TCompactProtocol : public TProtocol {
 
   uint32_t writeBinary(const std::string& str);
 
+  // Strings with a custom allocator, e.g. TArenaString
+  template <class Traits_, class Alloc_>
+  uint32_t writeString(const std::basic_string<char, Traits_, Alloc_>& str) {
+    return writeBinary(str);
+  }
+
+  template <class Traits_, class Alloc_>
+  uint32_t writeBinary(const std::basic_string<char, Traits_, Alloc_>& str);
+
+  /**
+   * Bulk list functions.  Varints are encoded into a stack buffer that is
+   * handed to the transport in large chunks.
+   */
+
+  uint32_t writeI16List(const int16_t* values, uint32_t size) {
+    return writeZigzagList(values, size);
+  }
+
+  uint32_t writeI32List(const int32_t* values, uint32_t size) {
+    return writeZigzagList(values, size);
+  }
+
+  uint32_t writeI64List(const int64_t* values, uint32_t size) {
+    return writeZigzagList(values, size);
+  }
+
+  uint32_t writeDoubleList(const double* values, uint32_t size) {
+    return writeDoubleBits(values, size);
+  }
+
   /**
   * These methods are called by structs, but don't actually have any wired
   * output or purpose
   */
-  virtual uint32_t writeMessageEnd() { return 0; }
+  uint32_t writeMessageEnd() { return 0; }
   uint32_t writeMapEnd() { return 0; }
   uint32_t writeListEnd() { return 0; }
   uint32_t writeSetEnd() { return 0; }
@@ -178,6 +215,46 @@ class TCompactProtocol : public TProtocol {
   uint32_t writeVarint64(uint64_t n);
   uint64_t i64ToZigzag(const int64_t l);
   uint32_t i32ToZigzag(const int32_t n);
+
+  // Encode n into buf, which must have room for 10 bytes even when n needs
+  // fewer (whole words are stored).  Returns the number of bytes used.
+  static uint32_t encodeVarint32(uint32_t n, uint8_t* buf);
+  static uint32_t encodeVarint64(uint64_t n, uint8_t* buf);
+
+  uint32_t encodeZigzag(int16_t value, uint8_t* buf) {
+    return encodeVarint32(i32ToZigzag(value), buf);
+  }
+
+  uint32_t encodeZigzag(int32_t value, uint8_t* buf) {
+    return encodeVarint32(i32ToZigzag(value), buf);
+  }
+
+  uint32_t encodeZigzag(int64_t value, uint8_t* buf) {
+    return encodeVarint64(i64ToZigzag(value), buf);
+  }
+
+  template <class Value_>
+  uint32_t writeZigzagList(const Value_* values, uint32_t size);
+  uint32_t writeDoubleBits(const double* values, uint32_t size);
+
+  static uint32_t getVarintSize32(uint32_t n) {
+    return getVarintSize64(n);
+  }
+
+  static uint32_t getVarintSize64(uint64_t n) {
+#ifdef __GNUC__
+    // ceil(bits / 7) for 1 to 64 significant bits, without a loop
+    uint32_t bits = 64 - __builtin_clzll(n | 1);
+    return (bits * 9 + 64) / 64;
+#else
+    uint32_t size = 1;
+    while (n >= 0x80) {
+      n >>= 7;
+      ++size;
+    }
+    return size;
+#endif
+  }
   inline int8_t getCompactType(int8_t ttype);
 
  public:
@@ -204,6 +281,8 @@ class TCompactProtocol : public TProtocol {
                         uint32_t& size);
 
   uint32_t readBool(bool& value);
+  // Provide the default readBool() implementation for std::vector<bool>
+  using TVirtualProtocol< TCompactProtocolT<Transport_> >::readBool;
 
   uint32_t readByte(int8_t& byte);
 
@@ -219,6 +298,106 @@ class TCompactProtocol : public TProtocol {
 
   uint32_t readBinary(std::string& str);
 
+  // Strings with a custom allocator, e.g. TArenaString
+  template <class Traits_, class Alloc_>
+  uint32_t readString(std::basic_string<char, Traits_, Alloc_>& str) {
+    return readBinary(str);
+  }
+
+  template <class Traits_, class Alloc_>
+  uint32_t readBinary(std::basic_string<char, Traits_, Alloc_>& str);
+
+  /**
+   * Bulk list functions.  Varints are decoded straight out of the
+   * transport's buffer when it is available for borrowing.
+   */
+
+  uint32_t readI16List(int16_t* values, uint32_t size) {
+    return readZigzagList(values, size);
+  }
+
+  uint32_t readI32List(int32_t* values, uint32_t size) {
+    return readZigzagList(values, size);
+  }
+
+  uint32_t readI64List(int64_t* values, uint32_t size) {
+    return readZigzagList(values, size);
+  }
+
+  uint32_t readDoubleList(double* values, uint32_t size) {
+    return readDoubleBits(values, size);
+  }
+
+  /**
+   * Skips a value without decoding it.  Varints are scanned for their
+   * terminating byte rather than decoded, and strings and containers of
+   * fixed-width elements are dropped from the transport in a single step.
+   */
+  uint32_t skip(TType type);
+
+  /**
+   * Serialized size functions.  Values are sized exactly; field headers
+   * are sized for the long form, since the short form depends on the
+   * previous field id, and a bool field is counted as a header plus a byte.
+   */
+
+  uint32_t serializedSizeFieldBegin(const TType /* fieldType */,
+                                    const int16_t fieldId) {
+    return 1 + getVarintSize32(i32ToZigzag(fieldId));
+  }
+
+  uint32_t serializedSizeFieldStop() {
+    return 1;
+  }
+
+  uint32_t serializedSizeMapBegin(const TType /* keyType */,
+                                  const TType /* valType */,
+                                  const uint32_t size) {
+    return size == 0 ? 1 : getVarintSize32(size) + 1;
+  }
+
+  uint32_t serializedSizeListBegin(const TType /* elemType */,
+                                   const uint32_t size) {
+    return size <= 14 ? 1 : 1 + getVarintSize32(size);
+  }
+
+  uint32_t serializedSizeSetBegin(const TType elemType,
+                                  const uint32_t size) {
+    return serializedSizeListBegin(elemType, size);
+  }
+
+  uint32_t serializedSizeBool(const bool /* value */) {
+    return 1;
+  }
+
+  uint32_t serializedSizeByte(const int8_t /* byte */) {
+    return 1;
+  }
+
+  uint32_t serializedSizeI16(const int16_t i16) {
+    return getVarintSize32(i32ToZigzag(i16));
+  }
+
+  uint32_t serializedSizeI32(const int32_t i32) {
+    return getVarintSize32(i32ToZigzag(i32));
+  }
+
+  uint32_t serializedSizeI64(const int64_t i64) {
+    return getVarintSize64(i64ToZigzag(i64));
+  }
+
+  uint32_t serializedSizeDouble(const double /* dub */) {
+    return 8;
+  }
+
+  uint32_t serializedSizeString(const uint32_t len) {
+    return getVarintSize32(len) + len;
+  }
+
+  uint32_t serializedSizeBinary(const uint32_t len) {
+    return getVarintSize32(len) + len;
+  }
+
   /*
    *These methods are here for the struct to call, but don't have any wire
    * encoding.
@@ -236,6 +415,42 @@ class TCompactProtocol : public TProtocol {
   int64_t zigzagToI64(uint64_t n);
   TType getTType(int8_t type);
 
+  // Decode a varint from buf, which must hold at least 10 readable bytes.
+  // Returns the number of bytes consumed.  The first eight bytes are
+  // examined as one word rather than byte by byte.
+  static uint32_t decodeVarint64(const uint8_t* buf, uint64_t& n);
+  static uint32_t lowestSetBit64(uint64_t x);
+
+  void decodeZigzag(uint64_t n, int16_t& value) {
+    value = (int16_t)zigzagToI32((uint32_t)n);
+  }
+
+  void decodeZigzag(uint64_t n, int32_t& value) {
+    value = zigzagToI32((uint32_t)n);
+  }
+
+  void decodeZigzag(uint64_t n, int64_t& value) {
+    value = zigzagToI64(n);
+  }
+
+  uint32_t readZigzag(int16_t& value) {
+    return readI16(value);
+  }
+
+  uint32_t readZigzag(int32_t& value) {
+    return readI32(value);
+  }
+
+  uint32_t readZigzag(int64_t& value) {
+    return readI64(value);
+  }
+
+  template <class Value_>
+  uint32_t readZigzagList(Value_* values, uint32_t size);
+  uint32_t readDoubleBits(double* values, uint32_t size);
+  uint32_t skipVarints(uint32_t count);
+  static uint32_t getFixedWidth(TType type);
+
   // Buffer for reading strings, save for the lifetime of the protocol to
   // avoid memory churn allocating memory on every string read
   int32_t string_limit_;
@@ -244,20 +459,27 @@ class TCompactProtocol : public TProtocol {
   int32_t container_limit_;
 };
 
+typedef TCompactProtocolT<TTransport> TCompactProtocol;
+
 /**
  * Constructs compact protocol handlers
+ *
+ * If the transport handed to getProtocol() is a Transport_, the factory
+ * returns a TCompactProtocolT<Transport_>; otherwise it falls back to a
+ * plain TCompactProtocol.
  */
-class TCompactProtocolFactory : public TProtocolFactory {
+template <class Transport_>
+class TCompactProtocolFactoryT : public TProtocolFactory {
  public:
-  TCompactProtocolFactory() :
+  TCompactProtocolFactoryT() :
     string_limit_(0),
     container_limit_(0) {}
 
-  TCompactProtocolFactory(int32_t string_limit, int32_t container_limit) :
+  TCompactProtocolFactoryT(int32_t string_limit, int32_t container_limit) :
     string_limit_(string_limit),
     container_limit_(container_limit) {}
 
-  virtual ~TCompactProtocolFactory() {}
+  virtual ~TCompactProtocolFactoryT() {}
 
   void setStringSizeLimit(int32_t string_limit) {
     string_limit_ = string_limit;
@@ -268,7 +490,17 @@ class TCompactProtocolFactory : public TProtocolFactory {
   }
 
   boost::shared_ptr<TProtocol> getProtocol(boost::shared_ptr<TTransport> trans) {
-    return boost::shared_ptr<TProtocol>(new TCompactProtocol(trans, string_limit_, container_limit_));
+    boost::shared_ptr<Transport_> specific_trans =
+      boost::dynamic_pointer_cast<Transport_>(trans);
+    TProtocol* prot;
+    if (specific_trans) {
+      prot = new TCompactProtocolT<Transport_>(specific_trans, string_limit_,
+                                               container_limit_);
+    } else {
+      prot = new TCompactProtocol(trans, string_limit_, container_limit_);
+    }
+
+    return boost::shared_ptr<TProtocol>(prot);
   }
 
  private:
@@ -277,6 +509,10 @@ class TCompactProtocolFactory : public TProtocolFactory {
 
 };
 
+typedef TCompactProtocolFactoryT<TTransport> TCompactProtocolFactory;
+
 }}} // apache::thrift::protocol
 
+#include "TCompactProtocol.tcc"
+
 #endif
@@ -0,0 +1,1145 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROTOCOL_TCOMPACTPROTOCOL_TCC_
+#define _THRIFT_PROTOCOL_TCOMPACTPROTOCOL_TCC_ 1
+
+#include "TCompactProtocol.h"
+
+#include <config.h>
+#include <cstring>
+#include <limits>
+
+/*
+ * TCompactProtocol::i*ToZigzag depend on the fact that the right shift
+ * operator on a signed integer is an arithmetic (sign-extending) shift.
+ * If this is not the case, the current implementation will not work.
+ * If anyone encounters this error, we can try to figure out the best
+ * way to implement an arithmetic right shift on their platform.
+ */
+#if !defined(SIGNED_RIGHT_SHIFT_IS) || !defined(ARITHMETIC_RIGHT_SHIFT)
+# error "Unable to determine the behavior of a signed right shift"
+#endif
+#if SIGNED_RIGHT_SHIFT_IS != ARITHMETIC_RIGHT_SHIFT
+# error "TCompactProtocol currenly only works if a signed right shift is arithmetic"
+#endif
+
+#ifdef __GNUC__
+#define UNLIKELY(val) (__builtin_expect((val), 0))
+#else
+#define UNLIKELY(val) (val)
+#endif
+
+namespace apache { namespace thrift { namespace protocol {
+
+template <class Transport_>
+const int8_t TCompactProtocolT<Transport_>::TTypeToCType[16] = {
+    CT_STOP, // T_STOP
+    0, // unused
+    CT_BOOLEAN_TRUE, // T_BOOL
+    CT_BYTE, // T_BYTE
+    CT_DOUBLE, // T_DOUBLE
+    0, // unused
+    CT_I16, // T_I16
+    0, // unused
+    CT_I32, // T_I32
+    0, // unused
+    CT_I64, // T_I64
+    CT_BINARY, // T_STRING
+    CT_STRUCT, // T_STRUCT
+    CT_MAP, // T_MAP
+    CT_SET, // T_SET
+    CT_LIST, // T_LIST
+  };
+
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeMessageBegin(const std::string& name,
+                                                          const TMessageType messageType,
+                                                          const int32_t seqid) {
+  uint32_t wsize = 0;
+  wsize += writeByte(PROTOCOL_ID);
+  wsize += writeByte((VERSION_N & VERSION_MASK) | (((int32_t)messageType << TYPE_SHIFT_AMOUNT) & TYPE_MASK));
+  wsize += writeVarint32(seqid);
+  wsize += writeString(name);
+  return wsize;
+}
+
+/**
+ * Write a field header containing the field id and field type. If the
+ * difference between the current field id and the last one is small (< 15),
+ * then the field id will be encoded in the 4 MSB as a delta. Otherwise, the
+ * field id will follow the type header as a zigzag varint.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeFieldBegin(const char* name,
+                                                        const TType fieldType,
+                                                        const int16_t fieldId) {
+  if (fieldType == T_BOOL) {
+    booleanField_.name = name;
+    booleanField_.fieldType = fieldType;
+    booleanField_.fieldId = fieldId;
+  } else {
+    return writeFieldBeginInternal(name, fieldType, fieldId, -1);
+  }
+  return 0;
+}
+
+/**
+ * Write the STOP symbol so we know there are no more fields in this struct.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeFieldStop() {
+  return writeByte(T_STOP);
+}
+
+/**
+ * Write a struct begin. This doesn't actually put anything on the wire. We
+ * use it as an opportunity to put special placeholder markers on the field
+ * stack so we can get the field id deltas correct.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeStructBegin(const char* name) {
+  lastField_.push(lastFieldId_);
+  lastFieldId_ = 0;
+  return 0;
+}
+
+/**
+ * Write a struct end. This doesn't actually put anything on the wire. We use
+ * this as an opportunity to pop the last field from the current struct off
+ * of the field stack.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeStructEnd() {
+  lastFieldId_ = lastField_.top();
+  lastField_.pop();
+  return 0;
+}
+
+/**
+ * Write a List header.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeListBegin(const TType elemType,
+                                                       const uint32_t size) {
+  return writeCollectionBegin(elemType, size);
+}
+
+/**
+ * Write a set header.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeSetBegin(const TType elemType,
+                                                      const uint32_t size) {
+  return writeCollectionBegin(elemType, size);
+}
+
+/**
+ * Write a map header. If the map is empty, omit the key and value type
+ * headers, as we don't need any additional information to skip it.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeMapBegin(const TType keyType,
+                                                      const TType valType,
+                                                      const uint32_t size) {
+  uint32_t wsize = 0;
+
+  if (size == 0) {
+    wsize += writeByte(0);
+  } else {
+    wsize += writeVarint32(size);
+    wsize += writeByte(getCompactType(keyType) << 4 | getCompactType(valType));
+  }
+  return wsize;
+}
+
+/**
+ * Write a boolean value. Potentially, this could be a boolean field, in
+ * which case the field header info isn't written yet. If so, decide what the
+ * right type header is for the value and then write the field header.
+ * Otherwise, write a single byte.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeBool(const bool value) {
+  uint32_t wsize = 0;
+
+  if (booleanField_.name != NULL) {
+    // we haven't written the field header yet
+    wsize += writeFieldBeginInternal(booleanField_.name,
+                                     booleanField_.fieldType,
+                                     booleanField_.fieldId,
+                                     value ? CT_BOOLEAN_TRUE : CT_BOOLEAN_FALSE);
+    booleanField_.name = NULL;
+  } else {
+    // we're not part of a field, so just write the value
+    wsize += writeByte(value ? CT_BOOLEAN_TRUE : CT_BOOLEAN_FALSE);
+  }
+  return wsize;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeByte(const int8_t byte) {
+  trans_->write((uint8_t*)&byte, 1);
+  return 1;
+}
+
+/**
+ * Write an i16 as a zigzag varint.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeI16(const int16_t i16) {
+  return writeVarint32(i32ToZigzag(i16));
+}
+
+/**
+ * Write an i32 as a zigzag varint.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeI32(const int32_t i32) {
+  return writeVarint32(i32ToZigzag(i32));
+}
+
+/**
+ * Write an i64 as a zigzag varint.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeI64(const int64_t i64) {
+  return writeVarint64(i64ToZigzag(i64));
+}
+
+/**
+ * Write a double to the wire as 8 bytes.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeDouble(const double dub) {
+  BOOST_STATIC_ASSERT(sizeof(double) == sizeof(uint64_t));
+  BOOST_STATIC_ASSERT(std::numeric_limits<double>::is_iec559);
+
+  uint64_t bits = bitwise_cast<uint64_t>(dub);
+  bits = htolell(bits);
+  trans_->write((uint8_t*)&bits, 8);
+  return 8;
+}
+
+/**
+ * Write a string to the wire with a varint size preceeding.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeString(const std::string& str) {
+  return writeBinary(str);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeBinary(const std::string& str) {
+  return writeBinary< std::char_traits<char>, std::allocator<char> >(str);
+}
+
+template <class Transport_>
+template <class Traits_, class Alloc_>
+uint32_t TCompactProtocolT<Transport_>::writeBinary(
+    const std::basic_string<char, Traits_, Alloc_>& str) {
+  uint32_t ssize = str.size();
+  uint32_t wsize = writeVarint32(ssize) + ssize;
+  trans_->write((uint8_t*)str.data(), ssize);
+  return wsize;
+}
+
+//
+// Internal Writing methods
+//
+
+/**
+ * The workhorse of writeFieldBegin. It has the option of doing a
+ * 'type override' of the type header. This is used specifically in the
+ * boolean field case.
+ */
+template <class Transport_>
+int32_t TCompactProtocolT<Transport_>::writeFieldBeginInternal(const char* name,
+                                                               const TType fieldType,
+                                                               const int16_t fieldId,
+                                                               int8_t typeOverride) {
+  uint32_t wsize = 0;
+
+  // if there's a type override, use that.
+  int8_t typeToWrite = (typeOverride == -1 ? getCompactType(fieldType) : typeOverride);
+
+  // check if we can use delta encoding for the field id
+  if (fieldId > lastFieldId_ && fieldId - lastFieldId_ <= 15) {
+    // write them together
+    wsize += writeByte((fieldId - lastFieldId_) << 4 | typeToWrite);
+  } else {
+    // write them separate
+    wsize += writeByte(typeToWrite);
+    wsize += writeI16(fieldId);
+  }
+
+  lastFieldId_ = fieldId;
+  return wsize;
+}
+
+/**
+ * Abstract method for writing the start of lists and sets. List and sets on
+ * the wire differ only by the type indicator.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeCollectionBegin(int8_t elemType, int32_t size) {
+  uint32_t wsize = 0;
+  if (size <= 14) {
+    wsize += writeByte(size << 4 | getCompactType(elemType));
+  } else {
+    wsize += writeByte(0xf0 | getCompactType(elemType));
+    wsize += writeVarint32(size);
+  }
+  return wsize;
+}
+
+/**
+ * Write an i32 as a varint. Results in 1-5 bytes on the wire.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeVarint32(uint32_t n) {
+  uint8_t buf[10];
+  uint32_t wsize = encodeVarint32(n, buf);
+  trans_->write(buf, wsize);
+  return wsize;
+}
+
+/**
+ * Write an i64 as a varint. Results in 1-10 bytes on the wire.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeVarint64(uint64_t n) {
+  uint8_t buf[10];
+  uint32_t wsize = encodeVarint64(n, buf);
+  trans_->write(buf, wsize);
+  return wsize;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::encodeVarint32(uint32_t n, uint8_t* buf) {
+  return encodeVarint64(n, buf);
+}
+
+/**
+ * Spreads the value into 7-bit groups one byte apart with three shift/mask
+ * steps, then sets the continuation bits and stores all eight bytes at
+ * once.  Only values of more than 56 bits need the two trailing bytes.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::encodeVarint64(uint64_t n, uint8_t* buf) {
+  if (n < 0x80) {
+    buf[0] = (uint8_t)n;
+    return 1;
+  }
+
+  uint64_t x = n & 0x00ffffffffffffffULL;
+  x = ((x & 0x00fffffff0000000ULL) << 4) | (x & 0x000000000fffffffULL);
+  x = ((x & 0x0fffc0000fffc000ULL) << 2) | (x & 0x00003fff00003fffULL);
+  x = ((x & 0x3f803f803f803f80ULL) << 1) | (x & 0x007f007f007f007fULL);
+
+  uint32_t wsize = getVarintSize64(n);
+  if (wsize <= 8) {
+    x |= 0x8080808080808080ULL & ((1ULL << (8 * (wsize - 1))) - 1);
+    x = htolell(x);
+    std::memcpy(buf, &x, 8);
+    return wsize;
+  }
+
+  x = htolell(x | 0x8080808080808080ULL);
+  std::memcpy(buf, &x, 8);
+  buf[8] = (uint8_t)((n >> 56) & 0x7f);
+  if (wsize == 10) {
+    buf[8] |= 0x80;
+    buf[9] = (uint8_t)(n >> 63);
+  }
+  return wsize;
+}
+
+/**
+ * Write a list of zigzag varints.  They are encoded into a stack buffer
+ * which is flushed whenever it might not fit another element.
+ */
+template <class Transport_>
+template <class Value_>
+uint32_t TCompactProtocolT<Transport_>::writeZigzagList(const Value_* values,
+                                                        uint32_t size) {
+  uint8_t buf[1024];
+  uint32_t used = 0;
+  uint32_t wsize = 0;
+
+  for (uint32_t i = 0; i < size; i++) {
+    if (used > sizeof(buf) - 10) {
+      trans_->write(buf, used);
+      wsize += used;
+      used = 0;
+    }
+    used += encodeZigzag(values[i], buf + used);
+  }
+  trans_->write(buf, used);
+  return wsize + used;
+}
+
+/**
+ * Write a list of doubles, 8 little-endian bytes each.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeDoubleBits(const double* values,
+                                                        uint32_t size) {
+  BOOST_STATIC_ASSERT(sizeof(double) == sizeof(uint64_t));
+  BOOST_STATIC_ASSERT(std::numeric_limits<double>::is_iec559);
+
+  uint64_t buf[128];
+  uint32_t left = size;
+  while (left > 0) {
+    uint32_t count = left < 128 ? left : 128;
+    std::memcpy(buf, values, count * sizeof(uint64_t));
+    for (uint32_t i = 0; i < count; i++) {
+      buf[i] = htolell(buf[i]);
+    }
+    trans_->write((uint8_t*)buf, count * sizeof(uint64_t));
+    values += count;
+    left -= count;
+  }
+  return size * sizeof(uint64_t);
+}
+
+/**
+ * Convert l into a zigzag long. This allows negative numbers to be
+ * represented compactly as a varint.
+ */
+template <class Transport_>
+uint64_t TCompactProtocolT<Transport_>::i64ToZigzag(const int64_t l) {
+  return (l << 1) ^ (l >> 63);
+}
+
+/**
+ * Convert n into a zigzag int. This allows negative numbers to be
+ * represented compactly as a varint.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::i32ToZigzag(const int32_t n) {
+  return (n << 1) ^ (n >> 31);
+}
+
+/**
+ * Given a TType value, find the appropriate TCompactProtocol.Type value
+ */
+template <class Transport_>
+int8_t TCompactProtocolT<Transport_>::getCompactType(int8_t ttype) {
+  return TTypeToCType[ttype];
+}
+
+//
+// Reading Methods
+//
+
+/**
+ * Read a message header.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readMessageBegin(std::string& name,
+                                                         TMessageType& messageType,
+                                                         int32_t& seqid) {
+  uint32_t rsize = 0;
+  int8_t protocolId;
+  int8_t versionAndType;
+  int8_t version;
+
+  rsize += readByte(protocolId);
+  if (protocolId != PROTOCOL_ID) {
+    throw TProtocolException(TProtocolException::BAD_VERSION, "Bad protocol identifier");
+  }
+
+  rsize += readByte(versionAndType);
+  version = (int8_t)(versionAndType & VERSION_MASK);
+  if (version != VERSION_N) {
+    throw TProtocolException(TProtocolException::BAD_VERSION, "Bad protocol version");
+  }
+
+  messageType = (TMessageType)((versionAndType >> TYPE_SHIFT_AMOUNT) & 0x03);
+  rsize += readVarint32(seqid);
+  rsize += readString(name);
+
+  return rsize;
+}
+
+/**
+ * Read a struct begin. There's nothing on the wire for this, but it is our
+ * opportunity to push a new struct begin marker on the field stack.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readStructBegin(std::string& name) {
+  name = "";
+  lastField_.push(lastFieldId_);
+  lastFieldId_ = 0;
+  return 0;
+}
+
+/**
+ * Doesn't actually consume any wire data, just removes the last field for
+ * this struct from the field stack.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readStructEnd() {
+  lastFieldId_ = lastField_.top();
+  lastField_.pop();
+  return 0;
+}
+
+/**
+ * Read a field header off the wire.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readFieldBegin(std::string& name,
+                                                       TType& fieldType,
+                                                       int16_t& fieldId) {
+  uint32_t rsize = 0;
+  int8_t byte;
+  int8_t type;
+
+  rsize += readByte(byte);
+  type = (byte & 0x0f);
+
+  // if it's a stop, then we can return immediately, as the struct is over.
+  if (type == T_STOP) {
+    fieldType = T_STOP;
+    fieldId = 0;
+    return rsize;
+  }
+
+  // mask off the 4 MSB of the type header. it could contain a field id delta.
+  int16_t modifier = (int16_t)(((uint8_t)byte & 0xf0) >> 4);
+  if (modifier == 0) {
+    // not a delta, look ahead for the zigzag varint field id.
+    rsize += readI16(fieldId);
+  } else {
+    fieldId = (int16_t)(lastFieldId_ + modifier);
+  }
+  fieldType = getTType(type);
+
+  // if this happens to be a boolean field, the value is encoded in the type
+  if (type == CT_BOOLEAN_TRUE || type == CT_BOOLEAN_FALSE) {
+    // save the boolean value in a special instance variable.
+    boolValue_.hasBoolValue = true;
+    boolValue_.boolValue = (type == CT_BOOLEAN_TRUE ? true : false);
+  }
+
+  // push the new field onto the field stack so we can keep the deltas going.
+  lastFieldId_ = fieldId;
+  return rsize;
+}
+
+/**
+ * Read a map header off the wire. If the size is zero, skip reading the key
+ * and value type. This means that 0-length maps will yield TMaps without the
+ * "correct" types.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readMapBegin(TType& keyType,
+                                                     TType& valType,
+                                                     uint32_t& size) {
+  uint32_t rsize = 0;
+  int8_t kvType = 0;
+  int32_t msize = 0;
+
+  rsize += readVarint32(msize);
+  if (msize != 0)
+    rsize += readByte(kvType);
+
+  if (msize < 0) {
+    throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+  } else if (container_limit_ && msize > container_limit_) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+
+  keyType = getTType((int8_t)((uint8_t)kvType >> 4));
+  valType = getTType((int8_t)((uint8_t)kvType & 0xf));
+  size = (uint32_t)msize;
+
+  return rsize;
+}
+
+/**
+ * Read a list header off the wire. If the list size is 0-14, the size will
+ * be packed into the element type header. If it's a longer list, the 4 MSB
+ * of the element type header will be 0xF, and a varint will follow with the
+ * true size.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readListBegin(TType& elemType,
+                                                      uint32_t& size) {
+  int8_t size_and_type;
+  uint32_t rsize = 0;
+  int32_t lsize;
+
+  rsize += readByte(size_and_type);
+
+  lsize = ((uint8_t)size_and_type >> 4) & 0x0f;
+  if (lsize == 15) {
+    rsize += readVarint32(lsize);
+  }
+
+  if (lsize < 0) {
+    throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+  } else if (container_limit_ && lsize > container_limit_) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+
+  elemType = getTType((int8_t)(size_and_type & 0x0f));
+  size = (uint32_t)lsize;
+
+  return rsize;
+}
+
+/**
+ * Read a set header off the wire. If the set size is 0-14, the size will
+ * be packed into the element type header. If it's a longer set, the 4 MSB
+ * of the element type header will be 0xF, and a varint will follow with the
+ * true size.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readSetBegin(TType& elemType,
+                                                     uint32_t& size) {
+  return readListBegin(elemType, size);
+}
+
+/**
+ * Read a boolean off the wire. If this is a boolean field, the value should
+ * already have been read during readFieldBegin, so we'll just consume the
+ * pre-stored value. Otherwise, read a byte.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readBool(bool& value) {
+  if (boolValue_.hasBoolValue == true) {
+    value = boolValue_.boolValue;
+    boolValue_.hasBoolValue = false;
+    return 0;
+  } else {
+    int8_t val;
+    readByte(val);
+    value = (val == CT_BOOLEAN_TRUE);
+    return 1;
+  }
+}
+
+/**
+ * Read a single byte off the wire. Nothing interesting here.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readByte(int8_t& byte) {
+  uint8_t b[1];
+  trans_->readAll(b, 1);
+  byte = *(int8_t*)b;
+  return 1;
+}
+
+/**
+ * Read an i16 from the wire as a zigzag varint.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readI16(int16_t& i16) {
+  int32_t value;
+  uint32_t rsize = readVarint32(value);
+  i16 = (int16_t)zigzagToI32(value);
+  return rsize;
+}
+
+/**
+ * Read an i32 from the wire as a zigzag varint.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readI32(int32_t& i32) {
+  int32_t value;
+  uint32_t rsize = readVarint32(value);
+  i32 = zigzagToI32(value);
+  return rsize;
+}
+
+/**
+ * Read an i64 from the wire as a zigzag varint.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readI64(int64_t& i64) {
+  int64_t value;
+  uint32_t rsize = readVarint64(value);
+  i64 = zigzagToI64(value);
+  return rsize;
+}
+
+/**
+ * No magic here - just read a double off the wire.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readDouble(double& dub) {
+  BOOST_STATIC_ASSERT(sizeof(double) == sizeof(uint64_t));
+  BOOST_STATIC_ASSERT(std::numeric_limits<double>::is_iec559);
+
+  uint64_t bits;
+  uint8_t b[8];
+  trans_->readAll(b, 8);
+  bits = *(uint64_t*)b;
+  bits = letohll(bits);
+  dub = bitwise_cast<double>(bits);
+  return 8;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readString(std::string& str) {
+  return readBinary(str);
+}
+
+/**
+ * Read a byte[] from the wire.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readBinary(std::string& str) {
+  return readBinary< std::char_traits<char>, std::allocator<char> >(str);
+}
+
+template <class Transport_>
+template <class Traits_, class Alloc_>
+uint32_t TCompactProtocolT<Transport_>::readBinary(
+    std::basic_string<char, Traits_, Alloc_>& str) {
+  int32_t rsize = 0;
+  int32_t size;
+
+  rsize += readVarint32(size);
+  // Catch empty string case
+  if (size == 0) {
+    str.clear();
+    return rsize;
+  }
+
+  // Catch error cases
+  if (size < 0) {
+    throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+  }
+  if (string_limit_ > 0 && size > string_limit_) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+
+  // If the whole payload is already sitting in the transport's buffer,
+  // copy it straight into the string and skip our intermediate buffer.
+  uint32_t got = (uint32_t)size;
+  const uint8_t* borrow_buf = trans_->borrow(NULL, &got);
+  if (borrow_buf != NULL) {
+    str.assign((const char*)borrow_buf, size);
+    trans_->consume(size);
+    return rsize + (uint32_t)size;
+  }
+
+  // Use the heap here to prevent stack overflow for v. large strings
+  if (size > string_buf_size_ || string_buf_ == NULL) {
+    void* new_string_buf = std::realloc(string_buf_, (uint32_t)size);
+    if (new_string_buf == NULL) {
+      throw TProtocolException(TProtocolException::UNKNOWN, "Out of memory in TCompactProtocol::readString");
+    }
+    string_buf_ = (uint8_t*)new_string_buf;
+    string_buf_size_ = size;
+  }
+  trans_->readAll(string_buf_, size);
+  str.assign((char*)string_buf_, size);
+
+  return rsize + (uint32_t)size;
+}
+
+/**
+ * Read an i32 from the wire as a varint. The MSB of each byte is set
+ * if there is another byte to follow. This can read up to 5 bytes.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readVarint32(int32_t& i32) {
+  int64_t val;
+  uint32_t rsize = readVarint64(val);
+  i32 = (int32_t)val;
+  return rsize;
+}
+
+/**
+ * Read an i64 from the wire as a proper varint. The MSB of each byte is set
+ * if there is another byte to follow. This can read up to 10 bytes.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readVarint64(int64_t& i64) {
+  uint32_t rsize = 0;
+  uint64_t val = 0;
+  int shift = 0;
+  uint8_t buf[10];  // 64 bits / (7 bits/byte) = 10 bytes.
+  uint32_t buf_size = sizeof(buf);
+  const uint8_t* borrowed = trans_->borrow(buf, &buf_size);
+
+  // Fast path.
+  if (borrowed != NULL) {
+    rsize = decodeVarint64(borrowed, val);
+    i64 = val;
+    trans_->consume(rsize);
+    return rsize;
+  }
+
+  // Slow path.
+  else {
+    while (true) {
+      uint8_t byte;
+      rsize += trans_->readAll(&byte, 1);
+      val |= (uint64_t)(byte & 0x7f) << shift;
+      shift += 7;
+      if (!(byte & 0x80)) {
+        i64 = val;
+        return rsize;
+      }
+      // Might as well check for invalid data on the slow path too.
+      if (UNLIKELY(rsize >= sizeof(buf))) {
+        throw TProtocolException(TProtocolException::INVALID_DATA, "Variable-length int over 10 bytes.");
+      }
+    }
+  }
+}
+
+/**
+ * The terminating byte is the lowest one in the first word with its high
+ * bit clear.  The 7-bit groups below it are packed together with three
+ * shift/mask steps, the reverse of encodeVarint64.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::decodeVarint64(const uint8_t* buf,
+                                                       uint64_t& n) {
+  if (!(buf[0] & 0x80)) {
+    n = buf[0];
+    return 1;
+  }
+
+  uint64_t word;
+  std::memcpy(&word, buf, 8);
+  word = letohll(word);
+
+  uint64_t stops = ~word & 0x8080808080808080ULL;
+  if (stops != 0) {
+    uint32_t rsize = lowestSetBit64(stops) / 8 + 1;
+    uint64_t x = word & 0x7f7f7f7f7f7f7f7fULL;
+    if (rsize < 8) {
+      x &= (1ULL << (8 * rsize)) - 1;
+    }
+    x = ((x & 0x7f007f007f007f00ULL) >> 1) | (x & 0x007f007f007f007fULL);
+    x = ((x & 0x3fff00003fff0000ULL) >> 2) | (x & 0x00003fff00003fffULL);
+    x = ((x & 0x0fffffff00000000ULL) >> 4) | (x & 0x000000000fffffffULL);
+    n = x;
+    return rsize;
+  }
+
+  // Nine or ten bytes; the first eight are all continuations.
+  uint64_t x = word & 0x7f7f7f7f7f7f7f7fULL;
+  x = ((x & 0x7f007f007f007f00ULL) >> 1) | (x & 0x007f007f007f007fULL);
+  x = ((x & 0x3fff00003fff0000ULL) >> 2) | (x & 0x00003fff00003fffULL);
+  x = ((x & 0x0fffffff00000000ULL) >> 4) | (x & 0x000000000fffffffULL);
+  x |= (uint64_t)(buf[8] & 0x7f) << 56;
+  if (!(buf[8] & 0x80)) {
+    n = x;
+    return 9;
+  }
+  if (UNLIKELY(buf[9] & 0x80)) {
+    throw TProtocolException(TProtocolException::INVALID_DATA, "Variable-length int over 10 bytes.");
+  }
+  n = x | (uint64_t)buf[9] << 63;
+  return 10;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::lowestSetBit64(uint64_t x) {
+#ifdef __GNUC__
+  return __builtin_ctzll(x);
+#else
+  uint32_t bit = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    ++bit;
+  }
+  return bit;
+#endif
+}
+
+/**
+ * Read a list of zigzag varints.  While the transport has at least one
+ * maximal varint buffered they are decoded in place; elements near the end
+ * of the buffer (or on transports that cannot borrow) use the normal path.
+ */
+template <class Transport_>
+template <class Value_>
+uint32_t TCompactProtocolT<Transport_>::readZigzagList(Value_* values,
+                                                       uint32_t size) {
+  uint32_t rsize = 0;
+  uint32_t i = 0;
+
+  while (i < size) {
+    uint32_t avail = 1;
+    const uint8_t* buf = trans_->borrow(NULL, &avail);
+    if (buf == NULL || avail < 10) {
+      rsize += readZigzag(values[i++]);
+      continue;
+    }
+
+    uint32_t pos = 0;
+    while (i < size && avail - pos >= 10) {
+      uint64_t n;
+      pos += decodeVarint64(buf + pos, n);
+      decodeZigzag(n, values[i++]);
+    }
+    trans_->consume(pos);
+    rsize += pos;
+  }
+  return rsize;
+}
+
+/**
+ * Read a list of doubles, 8 little-endian bytes each.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readDoubleBits(double* values,
+                                                       uint32_t size) {
+  BOOST_STATIC_ASSERT(sizeof(double) == sizeof(uint64_t));
+  BOOST_STATIC_ASSERT(std::numeric_limits<double>::is_iec559);
+
+  if (size > std::numeric_limits<uint32_t>::max() / sizeof(uint64_t)) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+  uint32_t len = size * sizeof(uint64_t);
+  trans_->readAll((uint8_t*)values, len);
+
+  for (uint32_t i = 0; i < size; i++) {
+    uint64_t bits;
+    std::memcpy(&bits, &values[i], sizeof(bits));
+    bits = letohll(bits);
+    std::memcpy(&values[i], &bits, sizeof(bits));
+  }
+  return len;
+}
+
+/**
+ * Convert from zigzag int to int.
+ */
+template <class Transport_>
+int32_t TCompactProtocolT<Transport_>::zigzagToI32(uint32_t n) {
+  return (n >> 1) ^ -(n & 1);
+}
+
+/**
+ * Convert from zigzag long to long.
+ */
+template <class Transport_>
+int64_t TCompactProtocolT<Transport_>::zigzagToI64(uint64_t n) {
+  return (n >> 1) ^ -(n & 1);
+}
+
+template <class Transport_>
+TType TCompactProtocolT<Transport_>::getTType(int8_t type) {
+  switch (type) {
+    case T_STOP:
+      return T_STOP;
+    case CT_BOOLEAN_FALSE:
+    case CT_BOOLEAN_TRUE:
+      return T_BOOL;
+    case CT_BYTE:
+      return T_BYTE;
+    case CT_I16:
+      return T_I16;
+    case CT_I32:
+      return T_I32;
+    case CT_I64:
+      return T_I64;
+    case CT_DOUBLE:
+      return T_DOUBLE;
+    case CT_BINARY:
+      return T_STRING;
+    case CT_LIST:
+      return T_LIST;
+    case CT_SET:
+      return T_SET;
+    case CT_MAP:
+      return T_MAP;
+    case CT_STRUCT:
+      return T_STRUCT;
+    default:
+      throw TException("don't know what type: " + type);
+  }
+  return T_STOP;
+}
+
+/**
+ * Size on the wire of a type that is never varint-encoded, or 0 otherwise.
+ * Bools inside containers are written as a single byte.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::getFixedWidth(TType type) {
+  switch (type) {
+  case T_BOOL:
+  case T_BYTE:
+    return 1;
+  case T_DOUBLE:
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Skip count varints by looking for their terminating bytes, without
+ * decoding them.  Scans straight out of the transport's buffer when it can
+ * be borrowed.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::skipVarints(uint32_t count) {
+  uint32_t rsize = 0;
+  // Continuation bytes seen so far in the current varint.
+  uint32_t run = 0;
+
+  while (count > 0) {
+    uint32_t avail = 1;
+    const uint8_t* borrowed = trans_->borrow(NULL, &avail);
+
+    // Slow path.
+    if (borrowed == NULL) {
+      uint8_t byte;
+      rsize += trans_->readAll(&byte, 1);
+      if (!(byte & 0x80)) {
+        count--;
+        run = 0;
+      } else if (UNLIKELY(++run == 10)) {
+        throw TProtocolException(TProtocolException::INVALID_DATA, "Variable-length int over 10 bytes.");
+      }
+      continue;
+    }
+
+    // Fast path.
+    uint32_t used = 0;
+    while (used < avail && count > 0) {
+      uint8_t byte = borrowed[used++];
+      if (!(byte & 0x80)) {
+        count--;
+        run = 0;
+      } else if (UNLIKELY(++run == 10)) {
+        throw TProtocolException(TProtocolException::INVALID_DATA, "Variable-length int over 10 bytes.");
+      }
+    }
+    trans_->consume(used);
+    rsize += used;
+  }
+
+  return rsize;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::skip(TType type) {
+  switch (type) {
+  case T_BOOL:
+    {
+      // Bool fields carry their value in the field header.
+      bool boolv;
+      return readBool(boolv);
+    }
+  case T_BYTE:
+  case T_DOUBLE:
+    return apache::thrift::transport::skipAll(*trans_, getFixedWidth(type));
+  case T_I16:
+  case T_I32:
+  case T_I64:
+    return skipVarints(1);
+  case T_STRING:
+    {
+      int32_t size;
+      uint32_t rsize = readVarint32(size);
+      if (size < 0) {
+        throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+      }
+      if (string_limit_ > 0 && size > string_limit_) {
+        throw TProtocolException(TProtocolException::SIZE_LIMIT);
+      }
+      return rsize + apache::thrift::transport::skipAll(*trans_, (uint32_t)size);
+    }
+  case T_STRUCT:
+    {
+      // Field headers are delta-encoded, so they still go through
+      // readFieldBegin() to keep the field id stack consistent.
+      uint32_t result = 0;
+      std::string name;
+      int16_t fid;
+      TType ftype;
+      result += readStructBegin(name);
+      while (true) {
+        result += readFieldBegin(name, ftype, fid);
+        if (ftype == T_STOP) {
+          break;
+        }
+        result += skip(ftype);
+        result += readFieldEnd();
+      }
+      result += readStructEnd();
+      return result;
+    }
+  case T_MAP:
+    {
+      uint32_t result = 0;
+      TType keyType;
+      TType valType;
+      uint32_t i, size;
+      result += readMapBegin(keyType, valType, size);
+      uint32_t width = getFixedWidth(keyType) + getFixedWidth(valType);
+      bool keyVarint = (keyType == T_I16 || keyType == T_I32 || keyType == T_I64);
+      bool valVarint = (valType == T_I16 || valType == T_I32 || valType == T_I64);
+      if (getFixedWidth(keyType) && getFixedWidth(valType) &&
+          size <= 0xffffffffU / width) {
+        result += apache::thrift::transport::skipAll(*trans_, size * width);
+      } else if (keyVarint && valVarint && size <= 0x7fffffffU) {
+        result += skipVarints(size * 2);
+      } else {
+        for (i = 0; i < size; i++) {
+          result += skip(keyType);
+          result += skip(valType);
+        }
+      }
+      return result;
+    }
+  case T_SET:
+  case T_LIST:
+    {
+      uint32_t result = 0;
+      TType elemType;
+      uint32_t i, size;
+      result += readListBegin(elemType, size);
+      uint32_t width = getFixedWidth(elemType);
+      if (width && size <= 0xffffffffU / width) {
+        result += apache::thrift::transport::skipAll(*trans_, size * width);
+      } else if (elemType == T_I16 || elemType == T_I32 || elemType == T_I64) {
+        result += skipVarints(size);
+      } else {
+        for (i = 0; i < size; i++) {
+          result += skip(elemType);
+        }
+      }
+      return result;
+    }
+  default:
+    return 0;
+  }
+}
+
+}}} // apache::thrift::protocol
+
+#undef UNLIKELY
+
+#endif // #ifndef _THRIFT_PROTOCOL_TCOMPACTPROTOCOL_TCC_
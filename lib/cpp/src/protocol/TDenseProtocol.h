@@ -56,7 +56,8 @@ namespace apache { namespace thrift { namespace protocol {
  * methods within our versions.
  *
  */
-class TDenseProtocol : public TBinaryProtocol {
+class TDenseProtocol
+  : public TVirtualProtocol<TDenseProtocol, TBinaryProtocol> {
  protected:
   static const int32_t VERSION_MASK = 0xffff0000;
   // VERSION_1 (0x80010000)  is taken by TBinaryProtocol.
@@ -72,7 +73,7 @@ class TDenseProtocol : public TBinaryProtocol {
    */
   TDenseProtocol(boost::shared_ptr<TTransport> trans,
                  TypeSpec* type_spec = NULL) :
-    TBinaryProtocol(trans),
+    TVirtualProtocol<TDenseProtocol, TBinaryProtocol>(trans),
     type_spec_(type_spec),
     standalone_(true)
   {}
@@ -89,56 +90,76 @@ class TDenseProtocol : public TBinaryProtocol {
    * Writing functions.
    */
 
-  virtual uint32_t writeMessageBegin(const std::string& name,
-                                     const TMessageType messageType,
-                                     const int32_t seqid);
+  uint32_t writeMessageBegin(const std::string& name,
+                             const TMessageType messageType,
+                             const int32_t seqid);
 
-  virtual uint32_t writeMessageEnd();
+  uint32_t writeMessageEnd();
 
 
-  virtual uint32_t writeStructBegin(const char* name);
+  uint32_t writeStructBegin(const char* name);
 
-  virtual uint32_t writeStructEnd();
+  uint32_t writeStructEnd();
 
-  virtual uint32_t writeFieldBegin(const char* name,
-                                   const TType fieldType,
-                                   const int16_t fieldId);
+  uint32_t writeFieldBegin(const char* name,
+                           const TType fieldType,
+                           const int16_t fieldId);
 
-  virtual uint32_t writeFieldEnd();
+  uint32_t writeFieldEnd();
 
-  virtual uint32_t writeFieldStop();
+  uint32_t writeFieldStop();
 
-  virtual uint32_t writeMapBegin(const TType keyType,
-                                 const TType valType,
-                                 const uint32_t size);
+  uint32_t writeMapBegin(const TType keyType,
+                         const TType valType,
+                         const uint32_t size);
 
-  virtual uint32_t writeMapEnd();
+  uint32_t writeMapEnd();
 
-  virtual uint32_t writeListBegin(const TType elemType,
-                                  const uint32_t size);
+  uint32_t writeListBegin(const TType elemType,
+                          const uint32_t size);
 
-  virtual uint32_t writeListEnd();
+  uint32_t writeListEnd();
 
-  virtual uint32_t writeSetBegin(const TType elemType,
-                                 const uint32_t size);
+  uint32_t writeSetBegin(const TType elemType,
+                         const uint32_t size);
 
-  virtual uint32_t writeSetEnd();
+  uint32_t writeSetEnd();
 
-  virtual uint32_t writeBool(const bool value);
+  uint32_t writeBool(const bool value);
 
-  virtual uint32_t writeByte(const int8_t byte);
+  uint32_t writeByte(const int8_t byte);
 
-  virtual uint32_t writeI16(const int16_t i16);
+  uint32_t writeI16(const int16_t i16);
 
-  virtual uint32_t writeI32(const int32_t i32);
+  uint32_t writeI32(const int32_t i32);
 
-  virtual uint32_t writeI64(const int64_t i64);
+  uint32_t writeI64(const int64_t i64);
 
-  virtual uint32_t writeDouble(const double dub);
+  uint32_t writeDouble(const double dub);
 
-  virtual uint32_t writeString(const std::string& str);
+  uint32_t writeString(const std::string& str);
 
-  virtual uint32_t writeBinary(const std::string& str);
+  uint32_t writeBinary(const std::string& str);
+
+  /*
+   * Bulk list writes go one element at a time, so that each is varint
+   * encoded and steps the TypeSpec state machine.
+   */
+  uint32_t writeI16List(const int16_t* values, uint32_t size) {
+    return apache::thrift::protocol::writeI16List(*this, values, size);
+  }
+
+  uint32_t writeI32List(const int32_t* values, uint32_t size) {
+    return apache::thrift::protocol::writeI32List(*this, values, size);
+  }
+
+  uint32_t writeI64List(const int64_t* values, uint32_t size) {
+    return apache::thrift::protocol::writeI64List(*this, values, size);
+  }
+
+  uint32_t writeDoubleList(const double* values, uint32_t size) {
+    return apache::thrift::protocol::writeDoubleList(*this, values, size);
+  }
 
 
   /*
@@ -189,6 +210,8 @@ class TDenseProtocol : public TBinaryProtocol {
 
   uint32_t readSetEnd();
 
+  using TVirtualProtocol<TDenseProtocol, TBinaryProtocol>::readBool;
+
   uint32_t readBool(bool& value);
 
   uint32_t readByte(int8_t& byte);
@@ -205,6 +228,22 @@ class TDenseProtocol : public TBinaryProtocol {
 
   uint32_t readBinary(std::string& str);
 
+  uint32_t readI16List(int16_t* values, uint32_t size) {
+    return apache::thrift::protocol::readI16List(*this, values, size);
+  }
+
+  uint32_t readI32List(int32_t* values, uint32_t size) {
+    return apache::thrift::protocol::readI32List(*this, values, size);
+  }
+
+  uint32_t readI64List(int64_t* values, uint32_t size) {
+    return apache::thrift::protocol::readI64List(*this, values, size);
+  }
+
+  uint32_t readDoubleList(double* values, uint32_t size) {
+    return apache::thrift::protocol::readDoubleList(*this, values, size);
+  }
+
   /*
    * Helper reading functions (don't do state transitions).
    */
@@ -216,6 +255,77 @@ class TDenseProtocol : public TBinaryProtocol {
     return TBinaryProtocol::readBool(value);
   }
 
+  /*
+   * Serialized sizes are not supported.  Field headers and integer widths
+   * depend on the TypeSpec and the values, so the fixed widths inherited
+   * from TBinaryProtocol would be wrong.
+   */
+
+  uint32_t serializedSizeFieldBegin(const TType /* fieldType */,
+                                    const int16_t /* fieldId */) {
+    return serializedSizeUnsupported();
+  }
+
+  uint32_t serializedSizeFieldStop() {
+    return serializedSizeUnsupported();
+  }
+
+  uint32_t serializedSizeMapBegin(const TType /* keyType */,
+                                  const TType /* valType */,
+                                  const uint32_t /* size */) {
+    return serializedSizeUnsupported();
+  }
+
+  uint32_t serializedSizeListBegin(const TType /* elemType */,
+                                   const uint32_t /* size */) {
+    return serializedSizeUnsupported();
+  }
+
+  uint32_t serializedSizeSetBegin(const TType /* elemType */,
+                                  const uint32_t /* size */) {
+    return serializedSizeUnsupported();
+  }
+
+  uint32_t serializedSizeBool(const bool /* value */) {
+    return serializedSizeUnsupported();
+  }
+
+  uint32_t serializedSizeByte(const int8_t /* byte */) {
+    return serializedSizeUnsupported();
+  }
+
+  uint32_t serializedSizeI16(const int16_t /* i16 */) {
+    return serializedSizeUnsupported();
+  }
+
+  uint32_t serializedSizeI32(const int32_t /* i32 */) {
+    return serializedSizeUnsupported();
+  }
+
+  uint32_t serializedSizeI64(const int64_t /* i64 */) {
+    return serializedSizeUnsupported();
+  }
+
+  uint32_t serializedSizeDouble(const double /* dub */) {
+    return serializedSizeUnsupported();
+  }
+
+  uint32_t serializedSizeString(const uint32_t /* len */) {
+    return serializedSizeUnsupported();
+  }
+
+  uint32_t serializedSizeBinary(const uint32_t /* len */) {
+    return serializedSizeUnsupported();
+  }
+
+  /**
+   * Skips by reading each value, so that the TypeSpec is followed.  The
+   * binary protocol's skip would parse fixed-width values.
+   */
+  uint32_t skip(TType type) {
+    return apache::thrift::protocol::skip(*this, type);
+  }
+
 
  private:
 
@@ -228,6 +338,11 @@ class TDenseProtocol : public TBinaryProtocol {
   inline uint32_t vlqRead(uint64_t& vlq);
   inline uint32_t vlqWrite(uint64_t vlq);
 
+  static uint32_t serializedSizeUnsupported() {
+    throw TProtocolException(TProtocolException::NOT_IMPLEMENTED,
+                             "TDenseProtocol does not support serialized sizes.");
+  }
+
   // Called before throwing an exception to make the object reusable.
   void resetState() {
     ts_stack_.clear();
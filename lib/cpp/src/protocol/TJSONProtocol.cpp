@@ -20,6 +20,8 @@
 #include "TJSONProtocol.h"
 
 #include <math.h>
+#include <string.h>
+#include <limits>
 #include <boost/lexical_cast.hpp>
 #include "TBase64Utils.h"
 #include <transport/TTransportException.h>
@@ -194,7 +196,7 @@ static uint8_t hexVal(uint8_t ch) {
     return ch - '0';
   }
   else if ((ch >= 'a') && (ch <= 'f')) {
-    return ch - 'a';
+    return ch - 'a' + 10;
   }
   else {
     throw TProtocolException(TProtocolException::INVALID_DATA,
@@ -211,7 +213,7 @@ static uint8_t hexChar(uint8_t val) {
     return val + '0';
   }
   else {
-    return val + 'a';
+    return val - 10 + 'a';
   }
 }
 
@@ -238,140 +240,159 @@ static bool isJSONNumeric(uint8_t ch) {
   return false;
 }
 
+// Word-at-a-time tests for the characters that end a run of plain string
+// data.  The result is non-zero iff some byte of word matches; which byte
+// it was has to be found bytewise.
+static const uint64_t kByteOnes = 0x0101010101010101ULL;
+static const uint64_t kByteHighs = 0x8080808080808080ULL;
 
-/**
- * Class to serve as base JSON context and as base class for other context
- * implementations
- */
-class TJSONContext {
-
- public:
-
-  TJSONContext() {};
-
-  virtual ~TJSONContext() {};
-
-  /**
-   * Write context data to the transport. Default is to do nothing.
-   */
-  virtual uint32_t write(TTransport &trans) {
-    return 0;
-  };
-
-  /**
-   * Read context data from the transport. Default is to do nothing.
-   */
-  virtual uint32_t read(TJSONProtocol::LookaheadReader &reader) {
-    return 0;
-  };
-
-  /**
-   * Return true if numbers need to be escaped as strings in this context.
-   * Default behavior is to return false.
-   */
-  virtual bool escapeNum() {
-    return false;
-  }
-};
-
-// Context class for object member key-value pairs
-class JSONPairContext : public TJSONContext {
-
-public:
+static inline uint64_t hasByte(uint64_t word, uint8_t ch) {
+  uint64_t x = word ^ (kByteOnes * ch);
+  return (x - kByteOnes) & ~x & kByteHighs;
+}
 
-  JSONPairContext() :
-    first_(true),
-    colon_(true) {
-  }
+static inline uint64_t hasByteLess(uint64_t word, uint8_t ch) {
+  return (word - kByteOnes * ch) & ~word & kByteHighs;
+}
 
-  uint32_t write(TTransport &trans) {
-    if (first_) {
-      first_ = false;
-      colon_ = true;
-      return 0;
+// Return the number of leading characters of p that can be written into a
+// JSON string unescaped, i.e. before the first control character, '"' or
+// '\'.
+static uint32_t plainCharsToWrite(const uint8_t* p, uint32_t len) {
+  uint32_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, p + i, 8);
+    if (hasByteLess(word, 0x20) |
+        hasByte(word, kJSONStringDelimiter) |
+        hasByte(word, kJSONBackslash)) {
+      break;
     }
-    else {
-      trans.write(colon_ ? &kJSONPairSeparator : &kJSONElemSeparator, 1);
-      colon_ = !colon_;
-      return 1;
+  }
+  for (; i < len; ++i) {
+    if (p[i] < 0x20 || p[i] == kJSONStringDelimiter || p[i] == kJSONBackslash) {
+      break;
     }
   }
+  return i;
+}
 
-  uint32_t read(TJSONProtocol::LookaheadReader &reader) {
-    if (first_) {
-      first_ = false;
-      colon_ = true;
-      return 0;
+// Return the number of leading characters of p that are string contents,
+// i.e. before the first '"' or '\'.
+static uint32_t plainCharsToRead(const uint8_t* p, uint32_t len) {
+  uint32_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, p + i, 8);
+    if (hasByte(word, kJSONStringDelimiter) | hasByte(word, kJSONBackslash)) {
+      break;
     }
-    else {
-      uint8_t ch = (colon_ ? kJSONPairSeparator : kJSONElemSeparator);
-      colon_ = !colon_;
-      return readSyntaxChar(reader, ch);
+  }
+  for (; i < len; ++i) {
+    if (p[i] == kJSONStringDelimiter || p[i] == kJSONBackslash) {
+      break;
     }
   }
+  return i;
+}
 
-  // Numbers must be turned into strings if they are the key part of a pair
-  virtual bool escapeNum() {
-    return colon_;
+// Parse the decimal integer in str into num.  Returns false if str is not
+// an integer or is out of range for NumberType.  As with lexical_cast,
+// negative values wrap for unsigned types.
+template <typename NumberType>
+static bool parseJSONInteger(const std::string& str, NumberType& num) {
+  const char* p = str.data();
+  const char* end = p + str.size();
+  bool neg = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    neg = (*p == '-');
+    ++p;
   }
-
-  private:
-
-    bool first_;
-    bool colon_;
-};
-
-// Context class for lists
-class JSONListContext : public TJSONContext {
-
-public:
-
-  JSONListContext() :
-    first_(true) {
+  if (p == end) {
+    return false;
   }
 
-  uint32_t write(TTransport &trans) {
-    if (first_) {
-      first_ = false;
-      return 0;
-    }
-    else {
-      trans.write(&kJSONElemSeparator, 1);
-      return 1;
+  uint64_t mag = 0;
+  for (; p != end; ++p) {
+    uint8_t digit = (uint8_t)(*p - '0');
+    if (digit > 9 || mag > (std::numeric_limits<uint64_t>::max() - digit) / 10) {
+      return false;
     }
+    mag = mag * 10 + digit;
   }
 
-  uint32_t read(TJSONProtocol::LookaheadReader &reader) {
-    if (first_) {
-      first_ = false;
-      return 0;
+  uint64_t max = (uint64_t)std::numeric_limits<NumberType>::max();
+  if (neg) {
+    if (mag > max + (std::numeric_limits<NumberType>::is_signed ? 1 : 0)) {
+      return false;
     }
-    else {
-      return readSyntaxChar(reader, kJSONElemSeparator);
+    num = (NumberType)(0 - mag);
+  } else {
+    if (mag > max) {
+      return false;
     }
+    num = (NumberType)mag;
   }
-
-  private:
-    bool first_;
-};
+  return true;
+}
 
 
 TJSONProtocol::TJSONProtocol(boost::shared_ptr<TTransport> ptrans) :
-  TProtocol(ptrans),
-  context_(new TJSONContext()),
+  TVirtualProtocol<TJSONProtocol>(ptrans),
   reader_(*ptrans) {
+  contexts_.reserve(16);
+  pushContext(Context::BASE);
 }
 
 TJSONProtocol::~TJSONProtocol() {}
 
-void TJSONProtocol::pushContext(boost::shared_ptr<TJSONContext> c) {
-  contexts_.push(context_);
-  context_ = c;
+void TJSONProtocol::pushContext(Context::Kind kind) {
+  Context c;
+  c.kind = kind;
+  c.first = true;
+  c.colon = true;
+  contexts_.push_back(c);
 }
 
 void TJSONProtocol::popContext() {
-  context_ = contexts_.top();
-  contexts_.pop();
+  contexts_.pop_back();
+}
+
+uint32_t TJSONProtocol::writeContext() {
+  Context& c = contexts_.back();
+  if (c.kind == Context::BASE) {
+    return 0;
+  }
+  if (c.first) {
+    c.first = false;
+    c.colon = true;
+    return 0;
+  }
+  if (c.kind == Context::PAIR) {
+    trans_->write(c.colon ? &kJSONPairSeparator : &kJSONElemSeparator, 1);
+    c.colon = !c.colon;
+  } else {
+    trans_->write(&kJSONElemSeparator, 1);
+  }
+  return 1;
+}
+
+uint32_t TJSONProtocol::readContext() {
+  Context& c = contexts_.back();
+  if (c.kind == Context::BASE) {
+    return 0;
+  }
+  if (c.first) {
+    c.first = false;
+    c.colon = true;
+    return 0;
+  }
+  if (c.kind == Context::PAIR) {
+    uint8_t ch = (c.colon ? kJSONPairSeparator : kJSONElemSeparator);
+    c.colon = !c.colon;
+    return readSyntaxChar(reader_, ch);
+  }
+  return readSyntaxChar(reader_, kJSONElemSeparator);
 }
 
 // Write the character ch as a JSON escape sequence ("\u00xx")
@@ -419,13 +440,24 @@ uint32_t TJSONProtocol::writeJSONChar(uint8_t ch) {
 // Write out the contents of the string str as a JSON string, escaping
 // characters as appropriate.
 uint32_t TJSONProtocol::writeJSONString(const std::string &str) {
-  uint32_t result = context_->write(*trans_);
+  uint32_t result = writeContext();
   result += 2; // For quotes
   trans_->write(&kJSONStringDelimiter, 1);
-  std::string::const_iterator iter(str.begin());
-  std::string::const_iterator end(str.end());
-  while (iter != end) {
-    result += writeJSONChar(*iter++);
+  const uint8_t* p = (const uint8_t*)str.data();
+  uint32_t len = str.length();
+  while (len > 0) {
+    // Write runs that need no escaping in one go
+    uint32_t run = plainCharsToWrite(p, len);
+    if (run > 0) {
+      trans_->write(p, run);
+      result += run;
+      p += run;
+      len -= run;
+    }
+    if (len > 0) {
+      result += writeJSONChar(*p++);
+      --len;
+    }
   }
   trans_->write(&kJSONStringDelimiter, 1);
   return result;
@@ -434,25 +466,36 @@ uint32_t TJSONProtocol::writeJSONString(const std::string &str) {
 // Write out the contents of the string as JSON string, base64-encoding
 // the string's contents, and escaping as appropriate
 uint32_t TJSONProtocol::writeJSONBase64(const std::string &str) {
-  uint32_t result = context_->write(*trans_);
+  uint32_t result = writeContext();
   result += 2; // For quotes
   trans_->write(&kJSONStringDelimiter, 1);
-  uint8_t b[4];
+  uint8_t b[1024];
+  uint32_t used = 0;
   const uint8_t *bytes = (const uint8_t *)str.c_str();
   uint32_t len = str.length();
   while (len >= 3) {
-    // Encode 3 bytes at a time
-    base64_encode(bytes, 3, b);
-    trans_->write(b, 4);
-    result += 4;
+    // Encode 3 bytes at a time, flushing whenever the buffer fills
+    if (used + 4 > sizeof(b)) {
+      trans_->write(b, used);
+      result += used;
+      used = 0;
+    }
+    base64_encode(bytes, 3, b + used);
+    used += 4;
     bytes += 3;
     len -=3;
   }
   if (len) { // Handle remainder
-    base64_encode(bytes, len, b);
-    trans_->write(b, len + 1);
-    result += len + 1;
+    if (used + 4 > sizeof(b)) {
+      trans_->write(b, used);
+      result += used;
+      used = 0;
+    }
+    base64_encode(bytes, len, b + used);
+    used += len + 1;
   }
+  trans_->write(b, used);
+  result += used;
   trans_->write(&kJSONStringDelimiter, 1);
   return result;
 }
@@ -461,26 +504,37 @@ uint32_t TJSONProtocol::writeJSONBase64(const std::string &str) {
 // if the context requires it (eg: key in a map pair).
 template <typename NumberType>
 uint32_t TJSONProtocol::writeJSONInteger(NumberType num) {
-  uint32_t result = context_->write(*trans_);
-  std::string val(boost::lexical_cast<std::string>(num));
-  bool escapeNum = context_->escapeNum();
-  if (escapeNum) {
-    trans_->write(&kJSONStringDelimiter, 1);
-    result += 1;
+  uint32_t result = writeContext();
+  bool quote = escapeNum();
+
+  // Format backwards from the end of buf: up to 20 digits, a sign and quotes
+  uint8_t buf[24];
+  uint8_t* end = buf + sizeof(buf);
+  uint8_t* p = end;
+  if (quote) {
+    *--p = kJSONStringDelimiter;
   }
-  trans_->write((const uint8_t *)val.c_str(), val.length());
-  result += val.length();
-  if (escapeNum) {
-    trans_->write(&kJSONStringDelimiter, 1);
-    result += 1;
+  bool neg = std::numeric_limits<NumberType>::is_signed && num < 0;
+  uint64_t mag = neg ? (uint64_t)0 - (uint64_t)num : (uint64_t)num;
+  do {
+    *--p = (uint8_t)('0' + mag % 10);
+    mag /= 10;
+  } while (mag != 0);
+  if (neg) {
+    *--p = '-';
   }
-  return result;
+  if (quote) {
+    *--p = kJSONStringDelimiter;
+  }
+
+  trans_->write(p, end - p);
+  return result + (end - p);
 }
 
 // Convert the given double to a JSON string, which is either the number,
 // "NaN" or "Infinity" or "-Infinity".
 uint32_t TJSONProtocol::writeJSONDouble(double num) {
-  uint32_t result = context_->write(*trans_);
+  uint32_t result = writeContext();
   std::string val(boost::lexical_cast<std::string>(num));
 
   // Normalize output of boost::lexical_cast for NaNs and Infinities
@@ -504,14 +558,14 @@ uint32_t TJSONProtocol::writeJSONDouble(double num) {
     break;
   }
 
-  bool escapeNum = special || context_->escapeNum();
-  if (escapeNum) {
+  bool quote = special || escapeNum();
+  if (quote) {
     trans_->write(&kJSONStringDelimiter, 1);
     result += 1;
   }
   trans_->write((const uint8_t *)val.c_str(), val.length());
   result += val.length();
-  if (escapeNum) {
+  if (quote) {
     trans_->write(&kJSONStringDelimiter, 1);
     result += 1;
   }
@@ -519,9 +573,9 @@ uint32_t TJSONProtocol::writeJSONDouble(double num) {
 }
 
 uint32_t TJSONProtocol::writeJSONObjectStart() {
-  uint32_t result = context_->write(*trans_);
+  uint32_t result = writeContext();
   trans_->write(&kJSONObjectStart, 1);
-  pushContext(boost::shared_ptr<TJSONContext>(new JSONPairContext()));
+  pushContext(Context::PAIR);
   return result + 1;
 }
 
@@ -532,9 +586,9 @@ uint32_t TJSONProtocol::writeJSONObjectEnd() {
 }
 
 uint32_t TJSONProtocol::writeJSONArrayStart() {
-  uint32_t result = context_->write(*trans_);
+  uint32_t result = writeContext();
   trans_->write(&kJSONArrayStart, 1);
-  pushContext(boost::shared_ptr<TJSONContext>(new JSONListContext()));
+  pushContext(Context::LIST);
   return result + 1;
 }
 
@@ -624,7 +678,7 @@ uint32_t TJSONProtocol::writeSetEnd() {
 }
 
 uint32_t TJSONProtocol::writeBool(const bool value) {
-  return writeJSONInteger(value);
+  return writeJSONInteger((int32_t)value);
 }
 
 uint32_t TJSONProtocol::writeByte(const int8_t byte) {
@@ -680,11 +734,23 @@ uint32_t TJSONProtocol::readJSONEscapeChar(uint8_t *out) {
 
 // Decodes a JSON string, including unescaping, and returns the string via str
 uint32_t TJSONProtocol::readJSONString(std::string &str, bool skipContext) {
-  uint32_t result = (skipContext ? 0 : context_->read(reader_));
+  uint32_t result = (skipContext ? 0 : readContext());
   result += readJSONSyntaxChar(kJSONStringDelimiter);
   uint8_t ch;
   str.clear();
   while (true) {
+    // Copy runs of plain characters straight out of the transport's buffer
+    uint32_t avail;
+    const uint8_t* buf = reader_.borrow(&avail);
+    if (buf != NULL) {
+      uint32_t run = plainCharsToRead(buf, avail);
+      str.append((const char *)buf, run);
+      reader_.consume(run);
+      result += run;
+      if (run == avail) {
+        continue;
+      }
+    }
     ch = reader_.read();
     ++result;
     if (ch == kJSONStringDelimiter) {
@@ -738,6 +804,22 @@ uint32_t TJSONProtocol::readJSONBase64(std::string &str) {
 uint32_t TJSONProtocol::readJSONNumericChars(std::string &str) {
   uint32_t result = 0;
   str.clear();
+
+  // If the number ends within the transport's buffer, take it from there
+  uint32_t avail;
+  const uint8_t* buf = reader_.borrow(&avail);
+  if (buf != NULL) {
+    uint32_t len = 0;
+    while (len < avail && isJSONNumeric(buf[len])) {
+      ++len;
+    }
+    if (len < avail) {
+      str.assign((const char *)buf, len);
+      reader_.consume(len);
+      return len;
+    }
+  }
+
   while (true) {
     uint8_t ch = reader_.peek();
     if (!isJSONNumeric(ch)) {
@@ -754,21 +836,18 @@ uint32_t TJSONProtocol::readJSONNumericChars(std::string &str) {
 // returning them via num
 template <typename NumberType>
 uint32_t TJSONProtocol::readJSONInteger(NumberType &num) {
-  uint32_t result = context_->read(reader_);
-  if (context_->escapeNum()) {
+  uint32_t result = readContext();
+  if (escapeNum()) {
     result += readJSONSyntaxChar(kJSONStringDelimiter);
   }
   std::string str;
   result += readJSONNumericChars(str);
-  try {
-    num = boost::lexical_cast<NumberType>(str);
-  }
-  catch (boost::bad_lexical_cast e) {
-    throw new TProtocolException(TProtocolException::INVALID_DATA,
-                                 "Expected numeric value; got \"" + str +
-                                  "\"");
+  if (!parseJSONInteger(str, num)) {
+    throw TProtocolException(TProtocolException::INVALID_DATA,
+                             "Expected numeric value; got \"" + str +
+                             "\"");
   }
-  if (context_->escapeNum()) {
+  if (escapeNum()) {
     result += readJSONSyntaxChar(kJSONStringDelimiter);
   }
   return result;
@@ -776,7 +855,7 @@ uint32_t TJSONProtocol::readJSONInteger(NumberType &num) {
 
 // Reads a JSON number or string and interprets it as a double.
 uint32_t TJSONProtocol::readJSONDouble(double &num) {
-  uint32_t result = context_->read(reader_);
+  uint32_t result = readContext();
   std::string str;
   if (reader_.peek() == kJSONStringDelimiter) {
     result += readJSONString(str, true);
@@ -791,23 +870,23 @@ uint32_t TJSONProtocol::readJSONDouble(double &num) {
       num = -HUGE_VAL;
     }
     else {
-      if (!context_->escapeNum()) {
+      if (!escapeNum()) {
         // Throw exception -- we should not be in a string in this case
-        throw new TProtocolException(TProtocolException::INVALID_DATA,
-                                     "Numeric data unexpectedly quoted");
+        throw TProtocolException(TProtocolException::INVALID_DATA,
+                                 "Numeric data unexpectedly quoted");
       }
       try {
         num = boost::lexical_cast<double>(str);
       }
       catch (boost::bad_lexical_cast e) {
-        throw new TProtocolException(TProtocolException::INVALID_DATA,
-                                     "Expected numeric value; got \"" + str +
-                                     "\"");
+        throw TProtocolException(TProtocolException::INVALID_DATA,
+                                 "Expected numeric value; got \"" + str +
+                                 "\"");
       }
     }
   }
   else {
-    if (context_->escapeNum()) {
+    if (escapeNum()) {
       // This will throw - we should have had a quote if escapeNum == true
       readJSONSyntaxChar(kJSONStringDelimiter);
     }
@@ -816,18 +895,18 @@ uint32_t TJSONProtocol::readJSONDouble(double &num) {
       num = boost::lexical_cast<double>(str);
     }
     catch (boost::bad_lexical_cast e) {
-      throw new TProtocolException(TProtocolException::INVALID_DATA,
-                                   "Expected numeric value; got \"" + str +
-                                   "\"");
+      throw TProtocolException(TProtocolException::INVALID_DATA,
+                               "Expected numeric value; got \"" + str +
+                               "\"");
     }
   }
   return result;
 }
 
 uint32_t TJSONProtocol::readJSONObjectStart() {
-  uint32_t result = context_->read(reader_);
+  uint32_t result = readContext();
   result += readJSONSyntaxChar(kJSONObjectStart);
-  pushContext(boost::shared_ptr<TJSONContext>(new JSONPairContext()));
+  pushContext(Context::PAIR);
   return result;
 }
 
@@ -838,9 +917,9 @@ uint32_t TJSONProtocol::readJSONObjectEnd() {
 }
 
 uint32_t TJSONProtocol::readJSONArrayStart() {
-  uint32_t result = context_->read(reader_);
+  uint32_t result = readContext();
   result += readJSONSyntaxChar(kJSONArrayStart);
-  pushContext(boost::shared_ptr<TJSONContext>(new JSONListContext()));
+  pushContext(Context::LIST);
   return result;
 }
 
@@ -20,15 +20,12 @@
 #ifndef _THRIFT_PROTOCOL_TJSONPROTOCOL_H_
 #define _THRIFT_PROTOCOL_TJSONPROTOCOL_H_ 1
 
-#include "TProtocol.h"
+#include "TVirtualProtocol.h"
 
-#include <stack>
+#include <vector>
 
 namespace apache { namespace thrift { namespace protocol {
 
-// Forward declaration
-class TJSONContext;
-
 /**
  * JSON protocol for Thrift.
  *
@@ -92,7 +89,7 @@ class TJSONContext;
  * transmission. I don't know of any work-around for this issue.
  *
  */
-class TJSONProtocol : public TProtocol {
+class TJSONProtocol : public TVirtualProtocol<TJSONProtocol> {
  public:
 
   TJSONProtocol(boost::shared_ptr<TTransport> ptrans);
@@ -101,10 +98,37 @@ class TJSONProtocol : public TProtocol {
 
  private:
 
-  void pushContext(boost::shared_ptr<TJSONContext> c);
+  /**
+   * Separator state of the enclosing JSON value.  Contexts are kept by
+   * value on a vector that is reused, so nesting does not allocate.
+   */
+  struct Context {
+    enum Kind {
+      BASE,   // top level, no separators
+      PAIR,   // object members, alternating ':' and ','
+      LIST    // array elements, separated by ','
+    };
+
+    Kind kind;
+    bool first;
+    bool colon;
+  };
+
+  void pushContext(Context::Kind kind);
 
   void popContext();
 
+  // Write or read the separator the current context needs before a value
+  uint32_t writeContext();
+
+  uint32_t readContext();
+
+  // True if numbers must be quoted, i.e. they are the key of an object member
+  bool escapeNum() const {
+    const Context& c = contexts_.back();
+    return c.kind == Context::PAIR && c.colon;
+  }
+
   uint32_t writeJSONEscapeChar(uint8_t ch);
 
   uint32_t writeJSONChar(uint8_t ch);
@@ -243,6 +267,9 @@ class TJSONProtocol : public TProtocol {
 
   uint32_t readBool(bool& value);
 
+  // Provide the default readBool() implementation for std::vector<bool>
+  using TVirtualProtocol<TJSONProtocol>::readBool;
+
   uint32_t readByte(int8_t& byte);
 
   uint32_t readI16(int16_t& i16);
@@ -284,6 +311,23 @@ class TJSONProtocol : public TProtocol {
       return data_;
     }
 
+    /**
+     * Borrows the transport's buffered input for scanning in bulk.  Returns
+     * NULL if a byte has already been peeked or the transport can't lend
+     * its buffer; otherwise *len is set to the number of bytes available.
+     */
+    const uint8_t* borrow(uint32_t* len) {
+      if (hasData_) {
+        return NULL;
+      }
+      *len = 1;
+      return trans_->borrow(NULL, len);
+    }
+
+    void consume(uint32_t len) {
+      trans_->consume(len);
+    }
+
    private:
     TTransport *trans_;
     bool hasData_;
@@ -292,8 +336,7 @@ class TJSONProtocol : public TProtocol {
 
  private:
 
-  std::stack<boost::shared_ptr<TJSONContext> > contexts_;
-  boost::shared_ptr<TJSONContext> context_;
+  std::vector<Context> contexts_;
   LookaheadReader reader_;
 };
 
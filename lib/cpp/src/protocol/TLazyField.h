@@ -0,0 +1,192 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#ifndef _THRIFT_PROTOCOL_TLAZYFIELD_H_
+#define _THRIFT_PROTOCOL_TLAZYFIELD_H_ 1
+
+#include <string>
+#include <typeinfo>
+
+#include <protocol/TBinaryProtocol.h>
+#include <protocol/TCompactProtocol.h>
+#include <transport/TBufferTransports.h>
+
+namespace apache { namespace thrift { namespace protocol {
+
+/**
+ * Holds the serialized bytes of a struct or binary field marked with the
+ * cpp.lazy annotation, so that the field is only decoded on first access
+ * and can be written back out verbatim if it was never modified.
+ *
+ * Bytes are only captured when reading with the binary or compact protocol
+ * from a TMemoryBuffer, where the whole value is contiguous in memory and
+ * can be located with borrow().  Anything else is decoded eagerly.
+ */
+class TLazyField {
+ public:
+  TLazyField() : encoding_(NONE), loaded_(false) {}
+
+  /**
+   * True iff there are captured bytes that have not been decoded yet.
+   */
+  bool pending() const {
+    return encoding_ != NONE && !loaded_;
+  }
+
+  /**
+   * Drops the captured bytes.  Called when the field may be modified.
+   */
+  void clear() {
+    encoding_ = NONE;
+    loaded_ = false;
+    data_.clear();
+  }
+
+  /**
+   * Captures the next value of type ftype from iprot, adding the number of
+   * bytes consumed to xfer.  Returns false without touching the protocol
+   * if the value can't be captured and must be read normally.
+   */
+  template <class Protocol_>
+  bool capture(Protocol_* iprot, TType ftype, uint32_t& xfer) {
+    clear();
+    Encoding encoding = encodingOf(iprot);
+    if (encoding == NONE) {
+      return false;
+    }
+    transport::TMemoryBuffer* buf =
+      dynamic_cast<transport::TMemoryBuffer*>(iprot->getTransport().get());
+    if (buf == NULL) {
+      return false;
+    }
+
+    // borrow() with a zero length just reports the read position.
+    uint32_t avail = 0;
+    const uint8_t* start = buf->borrow(NULL, &avail);
+    xfer += iprot->skip(ftype);
+    avail = 0;
+    const uint8_t* end = buf->borrow(NULL, &avail);
+
+    data_.assign((const char*)start, end - start);
+    encoding_ = encoding;
+    return true;
+  }
+
+  /**
+   * Decodes the captured bytes into value.  The bytes are kept so that an
+   * unmodified value can still be written back out verbatim.
+   */
+  template <class Value_>
+  void load(Value_& value) const {
+    boost::shared_ptr<transport::TMemoryBuffer> buf(
+      new transport::TMemoryBuffer((uint8_t*)data_.data(), data_.size()));
+    if (encoding_ == BINARY) {
+      TBinaryProtocolT<transport::TMemoryBuffer> prot(buf);
+      readValue(prot, value);
+    } else {
+      TCompactProtocolT<transport::TMemoryBuffer> prot(buf);
+      readValue(prot, value);
+    }
+    loaded_ = true;
+  }
+
+  /**
+   * Writes the captured bytes to oprot if it uses the encoding they were
+   * read with, adding the number of bytes written to xfer.  Returns false
+   * if the value must be serialized normally.
+   */
+  template <class Protocol_>
+  bool write(Protocol_* oprot, uint32_t& xfer) const {
+    if (encoding_ == NONE || encodingOf(oprot) != encoding_) {
+      return false;
+    }
+    oprot->getTransport()->write((const uint8_t*)data_.data(), data_.size());
+    xfer += data_.size();
+    return true;
+  }
+
+  /**
+   * Adds the size of the captured bytes to xfer if they would be written
+   * verbatim to oprot.  Returns false if the value must be sized normally.
+   */
+  template <class Protocol_>
+  bool serializedSize(Protocol_* oprot, uint32_t& xfer) const {
+    if (encoding_ == NONE || encodingOf(oprot) != encoding_) {
+      return false;
+    }
+    xfer += data_.size();
+    return true;
+  }
+
+ private:
+  enum Encoding {
+    NONE,
+    BINARY,
+    COMPACT
+  };
+
+  template <class Protocol_>
+  static Encoding encodingOf(Protocol_* /* prot */) {
+    return NONE;
+  }
+
+  template <class Transport_>
+  static Encoding encodingOf(TBinaryProtocolT<Transport_>* /* prot */) {
+    return BINARY;
+  }
+
+  template <class Transport_>
+  static Encoding encodingOf(TCompactProtocolT<Transport_>* /* prot */) {
+    return COMPACT;
+  }
+
+  // Exact types only: subclasses such as TDenseProtocol encode differently.
+  static Encoding encodingOf(TProtocol* prot) {
+    const std::type_info& type = typeid(*prot);
+    if (type == typeid(TBinaryProtocol) ||
+        type == typeid(TBinaryProtocolT<transport::TMemoryBuffer>) ||
+        type == typeid(TBinaryProtocolT<transport::TBufferBase>)) {
+      return BINARY;
+    }
+    if (type == typeid(TCompactProtocol) ||
+        type == typeid(TCompactProtocolT<transport::TMemoryBuffer>) ||
+        type == typeid(TCompactProtocolT<transport::TBufferBase>)) {
+      return COMPACT;
+    }
+    return NONE;
+  }
+
+  template <class Protocol_, class Struct_>
+  static void readValue(Protocol_& prot, Struct_& value) {
+    value.read(&prot);
+  }
+
+  template <class Protocol_, class Traits_, class Alloc_>
+  static void readValue(Protocol_& prot,
+                        std::basic_string<char, Traits_, Alloc_>& value) {
+    prot.readBinary(value);
+  }
+
+  std::string data_;
+  Encoding encoding_;
+  mutable bool loaded_;
+};
+
+}}} // apache::thrift::protocol
+
+#endif // #ifndef _THRIFT_PROTOCOL_TLAZYFIELD_H_
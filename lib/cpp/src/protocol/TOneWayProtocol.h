@@ -21,6 +21,7 @@
 #define _THRIFT_PROTOCOL_TONEWAYPROTOCOL_H_ 1
 
 #include "TProtocol.h"
+#include "TVirtualProtocol.h"
 
 namespace apache { namespace thrift { namespace protocol {
 
@@ -29,18 +30,18 @@ namespace apache { namespace thrift { namespace protocol {
  * not read.
  *
  */
-class TWriteOnlyProtocol : public TProtocol {
+class TWriteOnlyProtocol : public TProtocolDefaults {
  public:
   /**
    * @param subclass_name  The name of the concrete subclass.
    */
   TWriteOnlyProtocol(boost::shared_ptr<TTransport> trans,
                      const std::string& subclass_name)
-    : TProtocol(trans)
+    : TProtocolDefaults(trans)
     , subclass_(subclass_name)
   {}
 
-  // All writing functions remain abstract.
+  // All writing functions are provided by the concrete subclass.
 
   /**
    * Reading functions all throw an exception.
@@ -164,18 +165,18 @@ class TWriteOnlyProtocol : public TProtocol {
  * not written.
  *
  */
-class TReadOnlyProtocol : public TProtocol {
+class TReadOnlyProtocol : public TProtocolDefaults {
  public:
   /**
    * @param subclass_name  The name of the concrete subclass.
    */
   TReadOnlyProtocol(boost::shared_ptr<TTransport> trans,
                     const std::string& subclass_name)
-    : TProtocol(trans)
+    : TProtocolDefaults(trans)
     , subclass_(subclass_name)
   {}
 
-  // All reading functions remain abstract.
+  // All reading functions are provided by the concrete subclass.
 
   /**
    * Writing functions all throw an exception.
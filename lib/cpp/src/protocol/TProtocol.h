@@ -30,6 +30,7 @@
 #include <sys/types.h>
 #include <string>
 #include <map>
+#include <vector>
 
 
 // Use this to get around strict aliasing rules.
@@ -165,6 +166,187 @@ enum TMessageType {
   T_ONEWAY     = 4
 };
 
+/**
+ * Helper template for implementing TProtocol::skip().
+ *
+ * Templatized to avoid having to make virtual function calls.
+ */
+template <class Protocol_>
+uint32_t skip(Protocol_& prot, TType type) {
+  switch (type) {
+  case T_BOOL:
+    {
+      bool boolv;
+      return prot.readBool(boolv);
+    }
+  case T_BYTE:
+    {
+      int8_t bytev;
+      return prot.readByte(bytev);
+    }
+  case T_I16:
+    {
+      int16_t i16;
+      return prot.readI16(i16);
+    }
+  case T_I32:
+    {
+      int32_t i32;
+      return prot.readI32(i32);
+    }
+  case T_I64:
+    {
+      int64_t i64;
+      return prot.readI64(i64);
+    }
+  case T_DOUBLE:
+    {
+      double dub;
+      return prot.readDouble(dub);
+    }
+  case T_STRING:
+    {
+      std::string str;
+      return prot.readBinary(str);
+    }
+  case T_STRUCT:
+    {
+      uint32_t result = 0;
+      std::string name;
+      int16_t fid;
+      TType ftype;
+      result += prot.readStructBegin(name);
+      while (true) {
+        result += prot.readFieldBegin(name, ftype, fid);
+        if (ftype == T_STOP) {
+          break;
+        }
+        result += skip(prot, ftype);
+        result += prot.readFieldEnd();
+      }
+      result += prot.readStructEnd();
+      return result;
+    }
+  case T_MAP:
+    {
+      uint32_t result = 0;
+      TType keyType;
+      TType valType;
+      uint32_t i, size;
+      result += prot.readMapBegin(keyType, valType, size);
+      for (i = 0; i < size; i++) {
+        result += skip(prot, keyType);
+        result += skip(prot, valType);
+      }
+      result += prot.readMapEnd();
+      return result;
+    }
+  case T_SET:
+    {
+      uint32_t result = 0;
+      TType elemType;
+      uint32_t i, size;
+      result += prot.readSetBegin(elemType, size);
+      for (i = 0; i < size; i++) {
+        result += skip(prot, elemType);
+      }
+      result += prot.readSetEnd();
+      return result;
+    }
+  case T_LIST:
+    {
+      uint32_t result = 0;
+      TType elemType;
+      uint32_t i, size;
+      result += prot.readListBegin(elemType, size);
+      for (i = 0; i < size; i++) {
+        result += skip(prot, elemType);
+      }
+      result += prot.readListEnd();
+      return result;
+    }
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Helper templates for implementing the bulk list methods of TProtocol by
+ * reading or writing one element at a time.
+ */
+
+template <class Protocol_>
+uint32_t writeI16List(Protocol_& prot, const int16_t* values, uint32_t size) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    result += prot.writeI16(values[i]);
+  }
+  return result;
+}
+
+template <class Protocol_>
+uint32_t writeI32List(Protocol_& prot, const int32_t* values, uint32_t size) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    result += prot.writeI32(values[i]);
+  }
+  return result;
+}
+
+template <class Protocol_>
+uint32_t writeI64List(Protocol_& prot, const int64_t* values, uint32_t size) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    result += prot.writeI64(values[i]);
+  }
+  return result;
+}
+
+template <class Protocol_>
+uint32_t writeDoubleList(Protocol_& prot, const double* values, uint32_t size) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    result += prot.writeDouble(values[i]);
+  }
+  return result;
+}
+
+template <class Protocol_>
+uint32_t readI16List(Protocol_& prot, int16_t* values, uint32_t size) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    result += prot.readI16(values[i]);
+  }
+  return result;
+}
+
+template <class Protocol_>
+uint32_t readI32List(Protocol_& prot, int32_t* values, uint32_t size) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    result += prot.readI32(values[i]);
+  }
+  return result;
+}
+
+template <class Protocol_>
+uint32_t readI64List(Protocol_& prot, int64_t* values, uint32_t size) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    result += prot.readI64(values[i]);
+  }
+  return result;
+}
+
+template <class Protocol_>
+uint32_t readDoubleList(Protocol_& prot, double* values, uint32_t size) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < size; i++) {
+    result += prot.readDouble(values[i]);
+  }
+  return result;
+}
+
 /**
  * Abstract class for a thrift protocol driver. These are all the methods that
  * a protocol must implement. Essentially, there must be some way of reading
@@ -178,6 +360,13 @@ enum TMessageType {
  * when parsing an input XML stream, reading should be batched rather than
  * looking ahead character by character for a close tag).
  *
+ * Each reading and writing method is a non-virtual wrapper around a pure
+ * virtual *_virt() method.  Concrete protocols should derive from
+ * TVirtualProtocol, which implements the *_virt() methods in terms of the
+ * subclass's own non-virtual methods.  Code that knows the concrete protocol
+ * type (e.g. generated code built with the "templates" option) can then call
+ * those methods directly and avoid the virtual dispatch.
+ *
  */
 class TProtocol {
  public:
@@ -187,217 +376,475 @@ class TProtocol {
    * Writing functions.
    */
 
-  virtual uint32_t writeMessageBegin(const std::string& name,
-                                     const TMessageType messageType,
-                                     const int32_t seqid) = 0;
+  uint32_t writeMessageBegin(const std::string& name,
+                             const TMessageType messageType,
+                             const int32_t seqid) {
+    return writeMessageBegin_virt(name, messageType, seqid);
+  }
 
-  virtual uint32_t writeMessageEnd() = 0;
+  virtual uint32_t writeMessageBegin_virt(const std::string& name,
+                                          const TMessageType messageType,
+                                          const int32_t seqid) = 0;
 
+  uint32_t writeMessageEnd() {
+    return writeMessageEnd_virt();
+  }
 
-  virtual uint32_t writeStructBegin(const char* name) = 0;
+  virtual uint32_t writeMessageEnd_virt() = 0;
 
-  virtual uint32_t writeStructEnd() = 0;
 
-  virtual uint32_t writeFieldBegin(const char* name,
-                                   const TType fieldType,
-                                   const int16_t fieldId) = 0;
+  uint32_t writeStructBegin(const char* name) {
+    return writeStructBegin_virt(name);
+  }
 
-  virtual uint32_t writeFieldEnd() = 0;
+  virtual uint32_t writeStructBegin_virt(const char* name) = 0;
 
-  virtual uint32_t writeFieldStop() = 0;
+  uint32_t writeStructEnd() {
+    return writeStructEnd_virt();
+  }
 
-  virtual uint32_t writeMapBegin(const TType keyType,
-                                 const TType valType,
-                                 const uint32_t size) = 0;
+  virtual uint32_t writeStructEnd_virt() = 0;
 
-  virtual uint32_t writeMapEnd() = 0;
+  uint32_t writeFieldBegin(const char* name,
+                           const TType fieldType,
+                           const int16_t fieldId) {
+    return writeFieldBegin_virt(name, fieldType, fieldId);
+  }
 
-  virtual uint32_t writeListBegin(const TType elemType,
-                                  const uint32_t size) = 0;
+  virtual uint32_t writeFieldBegin_virt(const char* name,
+                                        const TType fieldType,
+                                        const int16_t fieldId) = 0;
 
-  virtual uint32_t writeListEnd() = 0;
+  uint32_t writeFieldEnd() {
+    return writeFieldEnd_virt();
+  }
 
-  virtual uint32_t writeSetBegin(const TType elemType,
-                                 const uint32_t size) = 0;
+  virtual uint32_t writeFieldEnd_virt() = 0;
 
-  virtual uint32_t writeSetEnd() = 0;
+  uint32_t writeFieldStop() {
+    return writeFieldStop_virt();
+  }
 
-  virtual uint32_t writeBool(const bool value) = 0;
+  virtual uint32_t writeFieldStop_virt() = 0;
 
-  virtual uint32_t writeByte(const int8_t byte) = 0;
+  uint32_t writeMapBegin(const TType keyType,
+                         const TType valType,
+                         const uint32_t size) {
+    return writeMapBegin_virt(keyType, valType, size);
+  }
 
-  virtual uint32_t writeI16(const int16_t i16) = 0;
+  virtual uint32_t writeMapBegin_virt(const TType keyType,
+                                      const TType valType,
+                                      const uint32_t size) = 0;
 
-  virtual uint32_t writeI32(const int32_t i32) = 0;
+  uint32_t writeMapEnd() {
+    return writeMapEnd_virt();
+  }
+
+  virtual uint32_t writeMapEnd_virt() = 0;
+
+  uint32_t writeListBegin(const TType elemType,
+                          const uint32_t size) {
+    return writeListBegin_virt(elemType, size);
+  }
 
-  virtual uint32_t writeI64(const int64_t i64) = 0;
+  virtual uint32_t writeListBegin_virt(const TType elemType,
+                                       const uint32_t size) = 0;
 
-  virtual uint32_t writeDouble(const double dub) = 0;
+  uint32_t writeListEnd() {
+    return writeListEnd_virt();
+  }
+
+  virtual uint32_t writeListEnd_virt() = 0;
+
+  uint32_t writeSetBegin(const TType elemType,
+                         const uint32_t size) {
+    return writeSetBegin_virt(elemType, size);
+  }
 
-  virtual uint32_t writeString(const std::string& str) = 0;
+  virtual uint32_t writeSetBegin_virt(const TType elemType,
+                                      const uint32_t size) = 0;
 
-  virtual uint32_t writeBinary(const std::string& str) = 0;
+  uint32_t writeSetEnd() {
+    return writeSetEnd_virt();
+  }
+
+  virtual uint32_t writeSetEnd_virt() = 0;
+
+  uint32_t writeBool(const bool value) {
+    return writeBool_virt(value);
+  }
+
+  virtual uint32_t writeBool_virt(const bool value) = 0;
+
+  uint32_t writeByte(const int8_t byte) {
+    return writeByte_virt(byte);
+  }
+
+  virtual uint32_t writeByte_virt(const int8_t byte) = 0;
+
+  uint32_t writeI16(const int16_t i16) {
+    return writeI16_virt(i16);
+  }
+
+  virtual uint32_t writeI16_virt(const int16_t i16) = 0;
+
+  uint32_t writeI32(const int32_t i32) {
+    return writeI32_virt(i32);
+  }
+
+  virtual uint32_t writeI32_virt(const int32_t i32) = 0;
+
+  uint32_t writeI64(const int64_t i64) {
+    return writeI64_virt(i64);
+  }
+
+  virtual uint32_t writeI64_virt(const int64_t i64) = 0;
+
+  uint32_t writeDouble(const double dub) {
+    return writeDouble_virt(dub);
+  }
+
+  virtual uint32_t writeDouble_virt(const double dub) = 0;
+
+  uint32_t writeString(const std::string& str) {
+    return writeString_virt(str);
+  }
+
+  virtual uint32_t writeString_virt(const std::string& str) = 0;
+
+  uint32_t writeBinary(const std::string& str) {
+    return writeBinary_virt(str);
+  }
+
+  virtual uint32_t writeBinary_virt(const std::string& str) = 0;
+
+  /**
+   * Strings with a custom allocator (e.g. TArenaString) go through a
+   * temporary std::string.  Protocols may provide direct overloads.
+   */
+  template <class Traits_, class Alloc_>
+  uint32_t writeString(const std::basic_string<char, Traits_, Alloc_>& str) {
+    return writeString_virt(std::string(str.data(), str.size()));
+  }
+
+  template <class Traits_, class Alloc_>
+  uint32_t writeBinary(const std::basic_string<char, Traits_, Alloc_>& str) {
+    return writeBinary_virt(std::string(str.data(), str.size()));
+  }
+
+  /**
+   * Bulk list functions.  These write or read the elements of a list of
+   * primitives (after writeListBegin() / readListBegin()) from a contiguous
+   * array, which lets protocols convert and copy them in batches.
+   */
+
+  uint32_t writeI16List(const int16_t* values, uint32_t size) {
+    return writeI16List_virt(values, size);
+  }
+
+  virtual uint32_t writeI16List_virt(const int16_t* values, uint32_t size) = 0;
+
+  uint32_t writeI32List(const int32_t* values, uint32_t size) {
+    return writeI32List_virt(values, size);
+  }
+
+  virtual uint32_t writeI32List_virt(const int32_t* values, uint32_t size) = 0;
+
+  uint32_t writeI64List(const int64_t* values, uint32_t size) {
+    return writeI64List_virt(values, size);
+  }
+
+  virtual uint32_t writeI64List_virt(const int64_t* values, uint32_t size) = 0;
+
+  uint32_t writeDoubleList(const double* values, uint32_t size) {
+    return writeDoubleList_virt(values, size);
+  }
+
+  virtual uint32_t writeDoubleList_virt(const double* values, uint32_t size) = 0;
 
   /**
    * Reading functions
    */
 
-  virtual uint32_t readMessageBegin(std::string& name,
-                                    TMessageType& messageType,
-                                    int32_t& seqid) = 0;
+  uint32_t readMessageBegin(std::string& name,
+                            TMessageType& messageType,
+                            int32_t& seqid) {
+    return readMessageBegin_virt(name, messageType, seqid);
+  }
+
+  virtual uint32_t readMessageBegin_virt(std::string& name,
+                                         TMessageType& messageType,
+                                         int32_t& seqid) = 0;
 
-  virtual uint32_t readMessageEnd() = 0;
+  uint32_t readMessageEnd() {
+    return readMessageEnd_virt();
+  }
+
+  virtual uint32_t readMessageEnd_virt() = 0;
+
+  uint32_t readStructBegin(std::string& name) {
+    return readStructBegin_virt(name);
+  }
+
+  virtual uint32_t readStructBegin_virt(std::string& name) = 0;
+
+  uint32_t readStructEnd() {
+    return readStructEnd_virt();
+  }
+
+  virtual uint32_t readStructEnd_virt() = 0;
+
+  uint32_t readFieldBegin(std::string& name,
+                          TType& fieldType,
+                          int16_t& fieldId) {
+    return readFieldBegin_virt(name, fieldType, fieldId);
+  }
+
+  virtual uint32_t readFieldBegin_virt(std::string& name,
+                                       TType& fieldType,
+                                       int16_t& fieldId) = 0;
+
+  uint32_t readFieldEnd() {
+    return readFieldEnd_virt();
+  }
+
+  virtual uint32_t readFieldEnd_virt() = 0;
+
+  uint32_t readMapBegin(TType& keyType,
+                        TType& valType,
+                        uint32_t& size) {
+    return readMapBegin_virt(keyType, valType, size);
+  }
+
+  virtual uint32_t readMapBegin_virt(TType& keyType,
+                                     TType& valType,
+                                     uint32_t& size) = 0;
+
+  uint32_t readMapEnd() {
+    return readMapEnd_virt();
+  }
+
+  virtual uint32_t readMapEnd_virt() = 0;
+
+  uint32_t readListBegin(TType& elemType,
+                         uint32_t& size) {
+    return readListBegin_virt(elemType, size);
+  }
+
+  virtual uint32_t readListBegin_virt(TType& elemType,
+                                      uint32_t& size) = 0;
+
+  uint32_t readListEnd() {
+    return readListEnd_virt();
+  }
+
+  virtual uint32_t readListEnd_virt() = 0;
+
+  uint32_t readSetBegin(TType& elemType,
+                        uint32_t& size) {
+    return readSetBegin_virt(elemType, size);
+  }
+
+  virtual uint32_t readSetBegin_virt(TType& elemType,
+                                     uint32_t& size) = 0;
 
-  virtual uint32_t readStructBegin(std::string& name) = 0;
+  uint32_t readSetEnd() {
+    return readSetEnd_virt();
+  }
 
-  virtual uint32_t readStructEnd() = 0;
+  virtual uint32_t readSetEnd_virt() = 0;
 
-  virtual uint32_t readFieldBegin(std::string& name,
-                                  TType& fieldType,
-                                  int16_t& fieldId) = 0;
+  uint32_t readBool(bool& value) {
+    return readBool_virt(value);
+  }
 
-  virtual uint32_t readFieldEnd() = 0;
+  virtual uint32_t readBool_virt(bool& value) = 0;
 
-  virtual uint32_t readMapBegin(TType& keyType,
-                                TType& valType,
-                                uint32_t& size) = 0;
+  uint32_t readByte(int8_t& byte) {
+    return readByte_virt(byte);
+  }
 
-  virtual uint32_t readMapEnd() = 0;
+  virtual uint32_t readByte_virt(int8_t& byte) = 0;
 
-  virtual uint32_t readListBegin(TType& elemType,
-                                 uint32_t& size) = 0;
+  uint32_t readI16(int16_t& i16) {
+    return readI16_virt(i16);
+  }
 
-  virtual uint32_t readListEnd() = 0;
+  virtual uint32_t readI16_virt(int16_t& i16) = 0;
 
-  virtual uint32_t readSetBegin(TType& elemType,
-                                uint32_t& size) = 0;
+  uint32_t readI32(int32_t& i32) {
+    return readI32_virt(i32);
+  }
 
-  virtual uint32_t readSetEnd() = 0;
+  virtual uint32_t readI32_virt(int32_t& i32) = 0;
 
-  virtual uint32_t readBool(bool& value) = 0;
+  uint32_t readI64(int64_t& i64) {
+    return readI64_virt(i64);
+  }
 
-  virtual uint32_t readByte(int8_t& byte) = 0;
+  virtual uint32_t readI64_virt(int64_t& i64) = 0;
 
-  virtual uint32_t readI16(int16_t& i16) = 0;
+  uint32_t readDouble(double& dub) {
+    return readDouble_virt(dub);
+  }
 
-  virtual uint32_t readI32(int32_t& i32) = 0;
+  virtual uint32_t readDouble_virt(double& dub) = 0;
 
-  virtual uint32_t readI64(int64_t& i64) = 0;
+  uint32_t readString(std::string& str) {
+    return readString_virt(str);
+  }
 
-  virtual uint32_t readDouble(double& dub) = 0;
+  virtual uint32_t readString_virt(std::string& str) = 0;
 
-  virtual uint32_t readString(std::string& str) = 0;
+  uint32_t readBinary(std::string& str) {
+    return readBinary_virt(str);
+  }
+
+  virtual uint32_t readBinary_virt(std::string& str) = 0;
 
-  virtual uint32_t readBinary(std::string& str) = 0;
+  template <class Traits_, class Alloc_>
+  uint32_t readString(std::basic_string<char, Traits_, Alloc_>& str) {
+    std::string tmp;
+    uint32_t result = readString_virt(tmp);
+    str.assign(tmp.data(), tmp.size());
+    return result;
+  }
 
-  uint32_t readBool(std::vector<bool>::reference ref) {
-    bool value;
-    uint32_t rv = readBool(value);
-    ref = value;
-    return rv;
+  template <class Traits_, class Alloc_>
+  uint32_t readBinary(std::basic_string<char, Traits_, Alloc_>& str) {
+    std::string tmp;
+    uint32_t result = readBinary_virt(tmp);
+    str.assign(tmp.data(), tmp.size());
+    return result;
   }
 
+  uint32_t readI16List(int16_t* values, uint32_t size) {
+    return readI16List_virt(values, size);
+  }
+
+  virtual uint32_t readI16List_virt(int16_t* values, uint32_t size) = 0;
+
+  uint32_t readI32List(int32_t* values, uint32_t size) {
+    return readI32List_virt(values, size);
+  }
+
+  virtual uint32_t readI32List_virt(int32_t* values, uint32_t size) = 0;
+
+  uint32_t readI64List(int64_t* values, uint32_t size) {
+    return readI64List_virt(values, size);
+  }
+
+  virtual uint32_t readI64List_virt(int64_t* values, uint32_t size) = 0;
+
+  uint32_t readDoubleList(double* values, uint32_t size) {
+    return readDoubleList_virt(values, size);
+  }
+
+  virtual uint32_t readDoubleList_virt(double* values, uint32_t size) = 0;
+
+  uint32_t readBool(std::vector<bool>::reference value) {
+    return readBool_virt(value);
+  }
+
+  virtual uint32_t readBool_virt(std::vector<bool>::reference value) = 0;
+
   /**
    * Method to arbitrarily skip over data.
    */
   uint32_t skip(TType type) {
-    switch (type) {
-    case T_BOOL:
-      {
-        bool boolv;
-        return readBool(boolv);
-      }
-    case T_BYTE:
-      {
-        int8_t bytev;
-        return readByte(bytev);
-      }
-    case T_I16:
-      {
-        int16_t i16;
-        return readI16(i16);
-      }
-    case T_I32:
-      {
-        int32_t i32;
-        return readI32(i32);
-      }
-    case T_I64:
-      {
-        int64_t i64;
-        return readI64(i64);
-      }
-    case T_DOUBLE:
-      {
-        double dub;
-        return readDouble(dub);
-      }
-    case T_STRING:
-      {
-        std::string str;
-        return readBinary(str);
-      }
-    case T_STRUCT:
-      {
-        uint32_t result = 0;
-        std::string name;
-        int16_t fid;
-        TType ftype;
-        result += readStructBegin(name);
-        while (true) {
-          result += readFieldBegin(name, ftype, fid);
-          if (ftype == T_STOP) {
-            break;
-          }
-          result += skip(ftype);
-          result += readFieldEnd();
-        }
-        result += readStructEnd();
-        return result;
-      }
-    case T_MAP:
-      {
-        uint32_t result = 0;
-        TType keyType;
-        TType valType;
-        uint32_t i, size;
-        result += readMapBegin(keyType, valType, size);
-        for (i = 0; i < size; i++) {
-          result += skip(keyType);
-          result += skip(valType);
-        }
-        result += readMapEnd();
-        return result;
-      }
-    case T_SET:
-      {
-        uint32_t result = 0;
-        TType elemType;
-        uint32_t i, size;
-        result += readSetBegin(elemType, size);
-        for (i = 0; i < size; i++) {
-          result += skip(elemType);
-        }
-        result += readSetEnd();
-        return result;
-      }
-    case T_LIST:
-      {
-        uint32_t result = 0;
-        TType elemType;
-        uint32_t i, size;
-        result += readListBegin(elemType, size);
-        for (i = 0; i < size; i++) {
-          result += skip(elemType);
-        }
-        result += readListEnd();
-        return result;
-      }
-    default:
-      return 0;
-    }
+    return skip_virt(type);
+  }
+
+  virtual uint32_t skip_virt(TType type) {
+    return ::apache::thrift::protocol::skip(*this, type);
+  }
+
+  /**
+   * Serialized size functions.  Each returns the number of bytes that the
+   * corresponding write function would produce, or an upper bound on it if
+   * the encoding depends on state the protocol only has while writing.
+   * Strings and binaries are sized by their length alone.
+   */
+
+  uint32_t serializedSizeFieldBegin(const TType fieldType, const int16_t fieldId) {
+    return serializedSizeFieldBegin_virt(fieldType, fieldId);
+  }
+
+  virtual uint32_t serializedSizeFieldBegin_virt(const TType fieldType, const int16_t fieldId) = 0;
+
+  uint32_t serializedSizeFieldStop() {
+    return serializedSizeFieldStop_virt();
+  }
+
+  virtual uint32_t serializedSizeFieldStop_virt() = 0;
+
+  uint32_t serializedSizeMapBegin(const TType keyType, const TType valType, const uint32_t size) {
+    return serializedSizeMapBegin_virt(keyType, valType, size);
+  }
+
+  virtual uint32_t serializedSizeMapBegin_virt(const TType keyType, const TType valType, const uint32_t size) = 0;
+
+  uint32_t serializedSizeListBegin(const TType elemType, const uint32_t size) {
+    return serializedSizeListBegin_virt(elemType, size);
   }
 
+  virtual uint32_t serializedSizeListBegin_virt(const TType elemType, const uint32_t size) = 0;
+
+  uint32_t serializedSizeSetBegin(const TType elemType, const uint32_t size) {
+    return serializedSizeSetBegin_virt(elemType, size);
+  }
+
+  virtual uint32_t serializedSizeSetBegin_virt(const TType elemType, const uint32_t size) = 0;
+
+  uint32_t serializedSizeBool(const bool value) {
+    return serializedSizeBool_virt(value);
+  }
+
+  virtual uint32_t serializedSizeBool_virt(const bool value) = 0;
+
+  uint32_t serializedSizeByte(const int8_t byte) {
+    return serializedSizeByte_virt(byte);
+  }
+
+  virtual uint32_t serializedSizeByte_virt(const int8_t byte) = 0;
+
+  uint32_t serializedSizeI16(const int16_t i16) {
+    return serializedSizeI16_virt(i16);
+  }
+
+  virtual uint32_t serializedSizeI16_virt(const int16_t i16) = 0;
+
+  uint32_t serializedSizeI32(const int32_t i32) {
+    return serializedSizeI32_virt(i32);
+  }
+
+  virtual uint32_t serializedSizeI32_virt(const int32_t i32) = 0;
+
+  uint32_t serializedSizeI64(const int64_t i64) {
+    return serializedSizeI64_virt(i64);
+  }
+
+  virtual uint32_t serializedSizeI64_virt(const int64_t i64) = 0;
+
+  uint32_t serializedSizeDouble(const double dub) {
+    return serializedSizeDouble_virt(dub);
+  }
+
+  virtual uint32_t serializedSizeDouble_virt(const double dub) = 0;
+
+  uint32_t serializedSizeString(const uint32_t len) {
+    return serializedSizeString_virt(len);
+  }
+
+  virtual uint32_t serializedSizeString_virt(const uint32_t len) = 0;
+
+  uint32_t serializedSizeBinary(const uint32_t len) {
+    return serializedSizeBinary_virt(len);
+  }
+
+  virtual uint32_t serializedSizeBinary_virt(const uint32_t len) = 0;
+
   inline boost::shared_ptr<TTransport> getTransport() {
     return ptrans_;
   }
@@ -17,8 +17,13 @@
  * under the License.
  */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "TNonblockingServer.h"
 #include <concurrency/Exception.h>
+#include <concurrency/PosixThreadFactory.h>
 #include <transport/TSocket.h>
 
 #include <iostream>
@@ -29,6 +34,9 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <assert.h>
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
 
 #ifndef AF_LOCAL
 #define AF_LOCAL AF_UNIX
@@ -43,16 +51,56 @@ using namespace std;
 using apache::thrift::transport::TSocket;
 using apache::thrift::transport::TTransportException;
 
+/**
+ * A request read from a connection that processes requests concurrently,
+ * with buffers of its own for the request and its response.
+ */
+class TConnection::Request {
+ public:
+  Request(TNonblockingServer* server) :
+    input_(new TMemoryBuffer()),
+    output_(new TMemoryBuffer()),
+    dropped_(false) {
+    inputProtocol_ = server->getInputProtocolFactory()->getProtocol(
+        server->getInputTransportFactory()->getTransport(input_));
+    outputProtocol_ = server->getOutputProtocolFactory()->getProtocol(
+        server->getOutputTransportFactory()->getTransport(output_));
+  }
+
+  /**
+   * Take a copy of a request, reserving space ahead of its response for
+   * the frame header.
+   */
+  void reset(const uint8_t* data, uint32_t len, uint32_t headerSize) {
+    input_->resetBuffer();
+    input_->write(data, len);
+    output_->resetBuffer();
+    output_->getWritePtr(headerSize);
+    output_->wroteBytes(headerSize);
+    dropped_ = false;
+  }
+
+  boost::shared_ptr<TMemoryBuffer> input_;
+  boost::shared_ptr<TMemoryBuffer> output_;
+  boost::shared_ptr<TProtocol> inputProtocol_;
+  boost::shared_ptr<TProtocol> outputProtocol_;
+
+  /// Set if the request goes unanswered, and the connection is to close
+  bool dropped_;
+};
+
 class TConnection::Task: public Runnable {
  public:
   Task(boost::shared_ptr<TProcessor> processor,
        boost::shared_ptr<TProtocol> input,
        boost::shared_ptr<TProtocol> output,
-       TConnection* connection) :
+       TConnection* connection,
+       Request* request = NULL) :
     processor_(processor),
     input_(input),
     output_(output),
-    connection_(connection) {}
+    connection_(connection),
+    request_(request) {}
 
   void run() {
     try {
@@ -72,9 +120,11 @@ class TConnection::Task: public Runnable {
       cerr << "TNonblockingServer uncaught exception." << endl;
     }
 
-    // Signal completion back to the libevent thread via a pipe
-    if (!connection_->notifyServer()) {
-      throw TException("TNonblockingServer::Task::run: failed write on notify pipe");
+    // Signal completion back to the connection's libevent thread
+    if (request_ != NULL) {
+      connection_->requestFinished(request_);
+    } else if (!connection_->notifyServer()) {
+      throw TException("TNonblockingServer::Task::run: failed to notify IO thread");
     }
   }
 
@@ -82,32 +132,58 @@ class TConnection::Task: public Runnable {
     return connection_;
   }
 
+  /// The request, if the connection processes requests concurrently
+  Request* getRequest() {
+    return request_;
+  }
+
  private:
   boost::shared_ptr<TProcessor> processor_;
   boost::shared_ptr<TProtocol> input_;
   boost::shared_ptr<TProtocol> output_;
   TConnection* connection_;
+  Request* request_;
 };
 
-void TConnection::init(int socket, short eventFlags, TNonblockingServer* s) {
+TConnection::~TConnection() {
+  for (size_t i = 0; i < requestPool_.size(); ++i) {
+    delete requestPool_[i];
+  }
+  std::free(readBuffer_);
+  std::free(frameBuffer_);
+  server_->decrementNumConnections();
+}
+
+void TConnection::init(int socket, TNonblockingServer* s,
+                       TNonblockingIOThread* ioThread) {
   socket_ = socket;
   server_ = s;
+  ioThread_ = ioThread;
   appState_ = APP_INIT;
   eventFlags_ = 0;
 
   readBufferPos_ = 0;
   readWant_ = 0;
+  frameStart_ = 0;
 
   writeBuffer_ = NULL;
   writeBufferSize_ = 0;
   writeBufferPos_ = 0;
+  coalescedResponses_->resetBuffer();
+
+  httpParser_.reset();
+  httpParser_.setMaxBodySize(s->getHttpMaxBodySize());
+  httpContinued_ = false;
+
+  concurrent_ = !s->isHttp() && s->isThreadPoolProcessing() &&
+    s->getMaxInFlightRequests() > 1;
+  numInFlight_ = 0;
+  peerClosed_ = false;
+  closing_ = false;
 
   socketState_ = SOCKET_RECV;
   appState_ = APP_INIT;
 
-  // Set flags, which also registers the event
-  setFlags(eventFlags);
-
   // get input/transports
   factoryInputTransport_ = s->getInputTransportFactory()->getTransport(inputTransport_);
   factoryOutputTransport_ = s->getOutputTransportFactory()->getTransport(outputTransport_);
@@ -123,38 +199,38 @@ void TConnection::workSocket() {
 
   switch (socketState_) {
   case SOCKET_RECV:
+    // HTTP requests are read as far as the buffer goes, growing it when full
+    if (appState_ == APP_READ_HTTP_REQUEST) {
+      readWant_ = readBufferSize_;
+      if (readBufferPos_ == readWant_) {
+        readWant_ *= 2;
+      }
+    }
+
     // It is an error to be in this state if we already have all the data
     assert(readBufferPos_ < readWant_);
 
-    // Double the buffer size until it is big enough
-    if (readWant_ > readBufferSize_) {
-      uint32_t newSize = readBufferSize_;
-      while (readWant_ > newSize) {
-        newSize *= 2;
-      }
-      uint8_t* newBuffer = (uint8_t*)std::realloc(readBuffer_, newSize);
-      if (newBuffer == NULL) {
-        GlobalOutput("TConnection::workSocket() realloc");
-        close();
-        return;
-      }
-      readBuffer_ = newBuffer;
-      readBufferSize_ = newSize;
+    if (!growReadBuffer(readWant_)) {
+      close();
+      return;
     }
 
-    // Read from the socket
-    fetch = readWant_ - readBufferPos_;
+    // Read from the socket, as far as the buffer goes to take in any
+    // requests pipelined behind this one
+    fetch = readBufferSize_ - readBufferPos_;
     got = recv(socket_, readBuffer_ + readBufferPos_, fetch, 0);
+    ioThread_->countRecv();
 
     if (got > 0) {
       // Move along in the buffer
       readBufferPos_ += got;
 
-      // Check that we did not overdo it
-      assert(readBufferPos_ <= readWant_);
-
       // We are done reading, move onto the next state
-      if (readBufferPos_ == readWant_) {
+      if (appState_ == APP_READ_HTTP_REQUEST) {
+        if (httpRequestReady()) {
+          transition();
+        }
+      } else if (readBufferPos_ >= readWant_) {
         transition();
       }
       return;
@@ -194,6 +270,7 @@ void TConnection::workSocket() {
 
     left = writeBufferSize_ - writeBufferPos_;
     sent = send(socket_, writeBuffer_ + writeBufferPos_, left, flags);
+    ioThread_->countSend();
 
     if (sent <= 0) {
       // Blocking errors are okay, just move on
@@ -225,6 +302,24 @@ void TConnection::workSocket() {
   }
 }
 
+bool TConnection::growReadBuffer(uint32_t want) {
+  // Double the buffer size until it is big enough
+  if (want > readBufferSize_) {
+    uint32_t newSize = readBufferSize_;
+    while (want > newSize) {
+      newSize *= 2;
+    }
+    uint8_t* newBuffer = (uint8_t*)std::realloc(readBuffer_, newSize);
+    if (newBuffer == NULL) {
+      GlobalOutput("TConnection::growReadBuffer() realloc");
+      return false;
+    }
+    readBuffer_ = newBuffer;
+    readBufferSize_ = newSize;
+  }
+  return true;
+}
+
 /**
  * This is called when the application transitions from one state into
  * another. This means that it has finished writing the data that it needed
@@ -234,15 +329,55 @@ void TConnection::transition() {
 
   int sz = 0;
 
+  // Requests processed concurrently come back here only as they finish
+  if (concurrent_ && appState_ != APP_INIT) {
+    {
+      Guard g(finishedMutex_);
+      finishedTaken_.swap(finished_);
+    }
+    for (size_t i = 0; i < finishedTaken_.size(); ++i) {
+      answerRequest(finishedTaken_[i]);
+    }
+    finishedTaken_.clear();
+
+    // Room may have been made for requests already read
+    dispatchRequests();
+    sendResponses();
+    settleConcurrent();
+    return;
+  }
+
   // Switch upon the state that we are currently in and move to a new state
   switch (appState_) {
 
+  LABEL_APP_READ_REQUEST:
+  case APP_READ_HTTP_REQUEST:
   case APP_READ_REQUEST:
     // We are done reading the request, package the read buffer into transport
     // and get back some data from the dispatch function
     // If we've used these transport buffers enough times, reset them to avoid bloating
 
-    inputTransport_->resetBuffer(readBuffer_, readBufferPos_);
+    if (appState_ == APP_READ_HTTP_REQUEST) {
+      inputTransport_->resetBuffer(readBuffer_ + httpParser_.getBodyOffset(),
+                                   httpParser_.getBodyLength());
+    } else if (server_->getFrameCodec()) {
+      const uint8_t* data;
+      uint32_t len;
+      try {
+        TCompressedFramedTransport::decodeFrame(readBuffer_ + frameStart_ + 4,
+                                                readWant_ - frameStart_ - 4,
+                                                &frameBuffer_, &frameBufferSize_,
+                                                &data, &len);
+      } catch (TTransportException &ttx) {
+        GlobalOutput.printf("TConnection::transition() %s", ttx.what());
+        close();
+        return;
+      }
+      inputTransport_->resetBuffer(const_cast<uint8_t*>(data), len);
+    } else {
+      inputTransport_->resetBuffer(readBuffer_ + frameStart_ + 4,
+                                   readWant_ - frameStart_ - 4);
+    }
     ++numReadsSinceReset_;
     if (numWritesSinceReset_ < 512) {
       outputTransport_->resetBuffer();
@@ -258,14 +393,15 @@ void TConnection::transition() {
       }
     }
 
-    // Prepend four bytes of blank space to the buffer so we can
-    // write the frame size there later.
-    outputTransport_->getWritePtr(4);
-    outputTransport_->wroteBytes(4);
+    // Prepend blank space to the buffer so we can write the frame
+    // size (and compression header) there later.
+    outputTransport_->getWritePtr(frameHeaderSize());
+    outputTransport_->wroteBytes(frameHeaderSize());
 
     server_->incrementActiveProcessors();
 
-    if (server_->isThreadPoolProcessing()) {
+    if (server_->isThreadPoolProcessing() &&
+        !isInlineRequest(inputTransport_.get())) {
       // We are setting up a Task to do this work and we will wait on it
 
       // Create task and dispatch to the thread manager
@@ -292,7 +428,7 @@ void TConnection::transition() {
       return;
     } else {
       try {
-        // Invoke the processor
+        // Invoke the processor, on this thread
         server_->getProcessor()->process(inputProtocol_, outputProtocol_);
       } catch (TTransportException &ttx) {
         GlobalOutput.printf("TTransportException: Server::process() %s", ttx.what());
@@ -321,22 +457,51 @@ void TConnection::transition() {
     // the writeBuffer_ for actual writing by the libevent thread
 
     server_->decrementActiveProcessors();
-    // Get the result of the operation
-    outputTransport_->getBuffer(&writeBuffer_, &writeBufferSize_);
 
-    // If the function call generated return data, then move into the send
-    // state and get going
-    // 4 bytes were reserved for frame size
-    if (writeBufferSize_ > 4) {
+    // Every HTTP request gets a response, if only an empty one
+    if (server_->isHttp()) {
+      writeHttpResponse();
+      writeBufferPos_ = 0;
+      socketState_ = SOCKET_SEND;
+      appState_ = APP_SEND_RESULT;
+      setWrite();
+      return;
+    }
+
+    // Get the result of the operation, framed
+    if (!frameResponse(outputTransport_.get(), &writeBuffer_, &writeBufferSize_)) {
+      close();
+      return;
+    }
 
+    // On to the next frame in the read buffer
+    frameStart_ = readWant_;
+
+    // Should the next request be read already and run on this thread, hold
+    // this response to send along with the next; one waiting on the pool
+    // would hold it up
+    if (writeBufferSize_ + coalescedResponses_->available_read() <
+          server_->getMaxCoalescedBytes() &&
+        frameReady() && nextRunsInline()) {
+      if (writeBufferSize_ > 0) {
+        coalescedResponses_->write(writeBuffer_, writeBufferSize_);
+      }
+      readWant_ = frameStart_ + 4;
+      appState_ = APP_READ_FRAME_SIZE;
+      goto LABEL_APP_READ_FRAME_SIZE;
+    }
+
+    // Send this response after any held
+    if (coalescedResponses_->available_read() > 0) {
+      coalescedResponses_->write(writeBuffer_, writeBufferSize_);
+      coalescedResponses_->getBuffer(&writeBuffer_, &writeBufferSize_);
+    }
+
+    if (writeBufferSize_ > 0) {
       // Move into write state
       writeBufferPos_ = 0;
       socketState_ = SOCKET_SEND;
 
-      // Put the frame size into the write buffer
-      int32_t frameSize = (int32_t)htonl(writeBufferSize_ - 4);
-      memcpy(writeBuffer_, &frameSize, 4);
-
       // Socket into write mode
       appState_ = APP_SEND_RESULT;
       setWrite();
@@ -355,13 +520,33 @@ void TConnection::transition() {
 
     ++numWritesSinceReset_;
 
+    // The HTTP client may have asked for the connection to be closed
+    if (server_->isHttp() && !httpParser_.isKeepAlive()) {
+      close();
+      return;
+    }
+
     // N.B.: We also intentionally fall through here into the INIT state!
 
   LABEL_APP_INIT:
   case APP_INIT:
 
+    // Keep any HTTP requests pipelined after the last one
+    if (server_->isHttp()) {
+      uint32_t used = httpParser_.getRequestLength();
+      memmove(readBuffer_, readBuffer_ + used, readBufferPos_ - used);
+      readBufferPos_ -= used;
+      httpParser_.reset();
+      httpContinued_ = false;
+    } else {
+      // Keep any frames pipelined after those processed
+      memmove(readBuffer_, readBuffer_ + frameStart_, readBufferPos_ - frameStart_);
+      readBufferPos_ -= frameStart_;
+      frameStart_ = 0;
+    }
+
     // reset the input buffer if we used it enough times that it might be bloated
-    if (numReadsSinceReset_ > 512)
+    if (numReadsSinceReset_ > 512 && readBufferPos_ <= 1024)
     {
       void * new_buffer = std::realloc(readBuffer_, 1024);
       if (new_buffer == NULL) {
@@ -378,9 +563,21 @@ void TConnection::transition() {
     writeBuffer_ = NULL;
     writeBufferPos_ = 0;
     writeBufferSize_ = 0;
+    coalescedResponses_->resetBuffer();
+
+    if (server_->isHttp()) {
+      socketState_ = SOCKET_RECV;
+      appState_ = APP_READ_HTTP_REQUEST;
+      setRead();
+
+      // The next request may have arrived already
+      if (readBufferPos_ > 0 && httpRequestReady()) {
+        transition();
+      }
+      return;
+    }
 
     // Set up read buffer for getting 4 bytes
-    readBufferPos_ = 0;
     readWant_ = 4;
 
     // Into read4 state we go
@@ -390,14 +587,15 @@ void TConnection::transition() {
     // Register read event
     setRead();
 
-    // Try to work the socket right away
-    // workSocket();
-
-    return;
+    // The next frame may have arrived already
+    if (readBufferPos_ < readWant_) {
+      return;
+    }
 
+  LABEL_APP_READ_FRAME_SIZE:
   case APP_READ_FRAME_SIZE:
     // We just read the request length, deserialize it
-    sz = *(int32_t*)readBuffer_;
+    memcpy(&sz, readBuffer_ + frameStart_, 4);
     sz = (int32_t)ntohl(sz);
 
     if (sz <= 0) {
@@ -406,15 +604,16 @@ void TConnection::transition() {
       return;
     }
 
-    // Reset the read buffer
-    readWant_ = (uint32_t)sz;
-    readBufferPos_= 0;
+    // The request follows the size in the read buffer
+    readWant_ = frameStart_ + 4 + (uint32_t)sz;
 
     // Move into read request state
     appState_ = APP_READ_REQUEST;
 
-    // Work the socket right away
-    // workSocket();
+    // It may have been read along with the size
+    if (readBufferPos_ >= readWant_) {
+      goto LABEL_APP_READ_REQUEST;
+    }
 
     return;
 
@@ -429,6 +628,451 @@ void TConnection::transition() {
   }
 }
 
+bool TConnection::httpRequestReady() {
+  try {
+    if (httpParser_.parse(readBuffer_, readBufferPos_)) {
+      return true;
+    }
+  } catch (TTransportException &ttx) {
+    GlobalOutput.printf("TConnection::httpRequestReady() %s", ttx.what());
+    close();
+    return false;
+  }
+
+  if (httpParser_.headersDone() && httpParser_.expectContinue() && !httpContinued_) {
+    // Sent without waiting for the socket; should it not fit, the client
+    // sends the body anyway once it tires of waiting
+    static const char continueResponse[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    int flags = 0;
+    #ifdef MSG_NOSIGNAL
+    flags |= MSG_NOSIGNAL;
+    #endif // ifdef MSG_NOSIGNAL
+    send(socket_, continueResponse, sizeof(continueResponse) - 1, flags);
+    httpContinued_ = true;
+  }
+  return false;
+}
+
+void TConnection::writeHttpResponse() {
+  uint32_t reserved = frameHeaderSize();
+  uint8_t* buf;
+  uint32_t len;
+  outputTransport_->getBuffer(&buf, &len);
+  uint32_t bodyLen = len - reserved;
+
+  // A chunked request gets a response in one chunk
+  bool chunked = httpParser_.isChunked() && bodyLen > 0;
+  if (chunked) {
+    outputTransport_->write((const uint8_t*)THttpServer::CHUNKED_RESPONSE_END,
+                            strlen(THttpServer::CHUNKED_RESPONSE_END));
+    outputTransport_->getBuffer(&buf, &len);
+  }
+
+  // Format the header into the reserved space, then move it up to the body
+  uint32_t headerLen = THttpServer::writeResponseHeader(
+      (char*)buf, bodyLen, chunked, httpParser_.isKeepAlive(),
+      server_->getHttpContentType());
+  memmove(buf + reserved - headerLen, buf, headerLen);
+
+  writeBuffer_ = buf + reserved - headerLen;
+  writeBufferSize_ = len - reserved + headerLen;
+}
+
+bool TConnection::frameReady() const {
+  if (readBufferPos_ - frameStart_ < 4) {
+    return false;
+  }
+  int32_t sz;
+  memcpy(&sz, readBuffer_ + frameStart_, 4);
+  sz = (int32_t)ntohl(sz);
+  return sz > 0 && readBufferPos_ - frameStart_ - 4 >= (uint32_t)sz;
+}
+
+bool TConnection::frameResponse(TMemoryBuffer* output,
+                                uint8_t** buf, uint32_t* size) {
+  output->getBuffer(buf, size);
+
+  // If the function call generated return data, frame it
+  // bytes were reserved for the frame header
+  if (*size <= frameHeaderSize()) {
+    // The request was oneway
+    *size = 0;
+    return true;
+  }
+
+  if (server_->getFrameCodec()) {
+    // Compress the response if it is worth it, and fill in the header
+    try {
+      *buf = TCompressedFramedTransport::encodeFrame(
+          server_->getFrameCodec().get(), server_->getFrameCompressThreshold(),
+          *buf, *size - frameHeaderSize(),
+          &frameBuffer_, &frameBufferSize_, size);
+    } catch (TTransportException &ttx) {
+      GlobalOutput.printf("TConnection::frameResponse() %s", ttx.what());
+      return false;
+    }
+  } else {
+    // Put the frame size into the write buffer
+    int32_t frameSize = (int32_t)htonl(*size - 4);
+    memcpy(*buf, &frameSize, 4);
+  }
+  return true;
+}
+
+bool TConnection::isInlineRequest(TMemoryBuffer* input) {
+  uint8_t* data;
+  uint32_t len;
+  input->getBuffer(&data, &len);
+  return isInlineRequest(data, len);
+}
+
+bool TConnection::isInlineRequest(const uint8_t* data, uint32_t len) {
+  if (!server_->hasInlineMethods()) {
+    return false;
+  }
+
+  TMessageType type;
+  if (!peekMessageBegin(data, len, &type)) {
+    // Read the message header from a view of the request; a fresh protocol
+    // each time, since some keep state across messages
+    peekTransport_->resetBuffer(const_cast<uint8_t*>(data), len);
+    boost::shared_ptr<TProtocol> peekProtocol =
+      server_->getInputProtocolFactory()->getProtocol(peekTransport_);
+    int32_t seqid;
+    try {
+      peekProtocol->readMessageBegin(peekName_, type, seqid);
+    } catch (TException&) {
+      // Let the processor in the pool deal with it
+      return false;
+    }
+  }
+
+  return (type == T_CALL || type == T_ONEWAY) && server_->isMethodInline(peekName_);
+}
+
+bool TConnection::peekMessageBegin(const uint8_t* data, uint32_t len,
+                                   TMessageType* type) {
+  int32_t sz;
+
+  // Binary protocol: version and type, then the name's length and the name
+  if (len >= 8 && data[0] == 0x80 && data[1] == 0x01) {
+    memcpy(&sz, data + 4, 4);
+    sz = (int32_t)ntohl(sz);
+    if (sz < 0 || (uint32_t)sz > len - 8) {
+      return false;
+    }
+    *type = (TMessageType)data[3];
+    peekName_.assign((const char*)data + 8, sz);
+    return true;
+  }
+
+  // Compact protocol: id, version and type, varint seqid, varint length
+  if (len >= 2 && data[0] == 0x82 && (data[1] & 0x1f) == 1) {
+    *type = (TMessageType)((data[1] >> 5) & 0x07);
+    uint32_t pos = 2;
+    uint32_t varint[2] = {0, 0};
+    for (int i = 0; i < 2; ++i) {
+      int shift = 0;
+      while (true) {
+        if (pos == len || shift > 28) {
+          return false;
+        }
+        uint8_t byte = data[pos++];
+        varint[i] |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+          break;
+        }
+        shift += 7;
+      }
+    }
+    if (varint[1] > len - pos) {
+      return false;
+    }
+    peekName_.assign((const char*)data + pos, varint[1]);
+    return true;
+  }
+
+  // Old binary protocol: the name's length and the name, then the type
+  if (len >= 5) {
+    memcpy(&sz, data, 4);
+    sz = (int32_t)ntohl(sz);
+    if (sz >= 0 && (uint32_t)sz < len - 4) {
+      *type = (TMessageType)data[4 + sz];
+      peekName_.assign((const char*)data + 4, sz);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool TConnection::nextRunsInline() {
+  if (!server_->isThreadPoolProcessing()) {
+    return true;
+  }
+
+  // A compressed frame would have to be decoded into frameBuffer_, which
+  // may still hold the response
+  if (server_->getFrameCodec()) {
+    return false;
+  }
+
+  int32_t sz;
+  memcpy(&sz, readBuffer_ + frameStart_, 4);
+  sz = (int32_t)ntohl(sz);
+  return isInlineRequest(readBuffer_ + frameStart_ + 4, (uint32_t)sz);
+}
+
+void TConnection::workConcurrent(short which) {
+  if (which & EV_WRITE) {
+    sendResponses();
+  }
+  if ((which & EV_READ) && !peerClosed_ && !closing_) {
+    readConcurrent();
+    dispatchRequests();
+    // Inline requests may have been answered already
+    sendResponses();
+  }
+  settleConcurrent();
+}
+
+void TConnection::readConcurrent() {
+  if (!growReadBuffer(readWant_)) {
+    closing_ = true;
+    return;
+  }
+
+  // Only a partial frame is left once requests are dispatched
+  assert(readBufferPos_ < readWant_);
+
+  int got = recv(socket_, readBuffer_ + readBufferPos_,
+                 readBufferSize_ - readBufferPos_, 0);
+  ioThread_->countRecv();
+
+  if (got > 0) {
+    readBufferPos_ += got;
+    return;
+  } else if (got == -1) {
+    // Blocking errors are okay, just move on
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return;
+    }
+    if (errno != ECONNRESET) {
+      GlobalOutput.perror("TConnection::readConcurrent() recv -1 ", errno);
+    }
+    closing_ = true;
+    return;
+  }
+
+  // The peer has finished sending; answer what it sent before closing
+  peerClosed_ = true;
+}
+
+void TConnection::dispatchRequests() {
+  if (closing_) {
+    return;
+  }
+
+  int32_t sz;
+  while (numInFlight_ < server_->getMaxInFlightRequests() && frameReady()) {
+    memcpy(&sz, readBuffer_ + frameStart_, 4);
+    sz = (int32_t)ntohl(sz);
+    const uint8_t* frame = readBuffer_ + frameStart_ + 4;
+    frameStart_ += 4 + (uint32_t)sz;
+    if (!dispatchRequest(frame, (uint32_t)sz)) {
+      closing_ = true;
+      return;
+    }
+  }
+
+  // Keep any frames not yet dispatched
+  memmove(readBuffer_, readBuffer_ + frameStart_, readBufferPos_ - frameStart_);
+  readBufferPos_ -= frameStart_;
+  frameStart_ = 0;
+
+  // Read on until the next frame is whole
+  readWant_ = 4;
+  if (readBufferPos_ >= 4) {
+    memcpy(&sz, readBuffer_, 4);
+    sz = (int32_t)ntohl(sz);
+    if (sz <= 0) {
+      GlobalOutput.printf("TConnection::dispatchRequests() Negative frame size %d, remote side not using TFramedTransport?", sz);
+      closing_ = true;
+      return;
+    }
+    readWant_ = 4 + (uint32_t)sz;
+  }
+}
+
+bool TConnection::dispatchRequest(const uint8_t* frame, uint32_t len) {
+  const uint8_t* data = frame;
+  uint32_t dataLen = len;
+  if (server_->getFrameCodec()) {
+    try {
+      TCompressedFramedTransport::decodeFrame(frame, len,
+                                              &frameBuffer_, &frameBufferSize_,
+                                              &data, &dataLen);
+    } catch (TTransportException &ttx) {
+      GlobalOutput.printf("TConnection::dispatchRequest() %s", ttx.what());
+      return false;
+    }
+  }
+
+  // The frame is copied out, as the read buffer moves on while it runs
+  Request* request;
+  if (requestPool_.empty()) {
+    request = new Request(server_);
+  } else {
+    request = requestPool_.back();
+    requestPool_.pop_back();
+  }
+  request->reset(data, dataLen, frameHeaderSize());
+
+  ++numInFlight_;
+  server_->incrementActiveProcessors();
+
+  if (isInlineRequest(request->input_.get())) {
+    try {
+      // Invoke the processor, on this thread
+      server_->getProcessor()->process(request->inputProtocol_,
+                                       request->outputProtocol_);
+    } catch (TException &x) {
+      GlobalOutput.printf("TException: Server::process() %s", x.what());
+      request->dropped_ = true;
+    } catch (...) {
+      GlobalOutput.printf("Server::process() unknown exception");
+      request->dropped_ = true;
+    }
+    answerRequest(request);
+    return true;
+  }
+
+  boost::shared_ptr<Runnable> task =
+    boost::shared_ptr<Runnable>(new Task(server_->getProcessor(),
+                                         request->inputProtocol_,
+                                         request->outputProtocol_,
+                                         this,
+                                         request));
+  try {
+    server_->addTask(task);
+  } catch (IllegalStateException & ise) {
+    // The ThreadManager is not ready to handle any more tasks (it's probably shutting down).
+    GlobalOutput.printf("IllegalStateException: Server::process() %s", ise.what());
+    request->dropped_ = true;
+    answerRequest(request);
+  }
+  return true;
+}
+
+void TConnection::answerRequest(Request* request) {
+  --numInFlight_;
+  server_->decrementActiveProcessors();
+
+  if (request->dropped_) {
+    closing_ = true;
+  } else if (!closing_) {
+    uint8_t* buf;
+    uint32_t size;
+    if (!frameResponse(request->output_.get(), &buf, &size)) {
+      closing_ = true;
+    } else if (size > 0) {
+      coalescedResponses_->write(buf, size);
+    }
+  }
+
+  requestPool_.push_back(request);
+}
+
+void TConnection::sendResponses() {
+  uint8_t* buf;
+  uint32_t len;
+  coalescedResponses_->getBuffer(&buf, &len);
+  if (closing_ || len == 0) {
+    return;
+  }
+
+  int flags = 0;
+  #ifdef MSG_NOSIGNAL
+  flags |= MSG_NOSIGNAL;
+  #endif // ifdef MSG_NOSIGNAL
+
+  int sent = send(socket_, buf, len, flags);
+  ioThread_->countSend();
+
+  if (sent <= 0) {
+    // Blocking errors are okay, just move on
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return;
+    }
+    if (errno != EPIPE) {
+      GlobalOutput.perror("TConnection::sendResponses() send -1 ", errno);
+    }
+    closing_ = true;
+    return;
+  }
+
+  if ((uint32_t)sent == len) {
+    coalescedResponses_->resetBuffer();
+  } else {
+    coalescedResponses_->consume(sent);
+  }
+}
+
+void TConnection::settleConcurrent() {
+  // Nothing more is sent on a connection that is closing
+  if (closing_) {
+    coalescedResponses_->resetBuffer();
+  }
+
+  uint32_t pending = coalescedResponses_->available_read();
+  bool done = closing_ || peerClosed_;
+  if (done && numInFlight_ == 0 && pending == 0) {
+    close();
+    return;
+  }
+
+  // Read more requests while there is room for them, and the client is
+  // taking its responses
+  short flags = 0;
+  if (!done && numInFlight_ < server_->getMaxInFlightRequests() &&
+      pending <= server_->getMaxCoalescedBytes()) {
+    flags |= EV_READ;
+  }
+  if (pending > 0) {
+    flags |= EV_WRITE;
+  }
+  setFlags(flags != 0 ? (flags | EV_PERSIST) : 0);
+}
+
+void TConnection::forceClose(Request* request) {
+  if (request != NULL) {
+    request->dropped_ = true;
+    requestFinished(request);
+    return;
+  }
+
+  appState_ = APP_CLOSE_CONNECTION;
+  if (!notifyServer()) {
+    throw TException("TConnection::forceClose: failed write on notify pipe");
+  }
+}
+
+void TConnection::requestFinished(Request* request) {
+  bool first;
+  {
+    Guard g(finishedMutex_);
+    first = finished_.empty();
+    finished_.push_back(request);
+  }
+
+  // One notification has the IO thread take all the requests finished by
+  // the time it gets to it.  A connection cannot close with requests in
+  // flight, so every notification arrives before it does.
+  if (first && !notifyServer()) {
+    throw TException("TConnection::requestFinished: failed to notify IO thread");
+  }
+}
+
 void TConnection::setFlags(short eventFlags) {
   // Catch the do nothing case
   if (eventFlags_ == eventFlags) {
@@ -479,7 +1123,7 @@ void TConnection::setFlags(short eventFlags) {
    * its own ev.
    */
   event_set(&event_, socket_, eventFlags_, TConnection::eventHandler, this);
-  event_base_set(server_->getEventBase(), &event_);
+  event_base_set(ioThread_->getEventBase(), &event_);
 
   // Add the event
   if (event_add(&event_, 0) == -1) {
@@ -491,10 +1135,11 @@ void TConnection::setFlags(short eventFlags) {
  * Closes a connection
  */
 void TConnection::close() {
-  // Delete the registered libevent
-  if (event_del(&event_) == -1) {
+  // Delete the registered libevent, if a transition() ever registered one
+  if (eventFlags_ != 0 && event_del(&event_) == -1) {
     GlobalOutput("TConnection::close() event_del");
   }
+  eventFlags_ = 0;
 
   // Close the socket
   if (socket_ >= 0) {
@@ -506,48 +1151,60 @@ void TConnection::close() {
   factoryInputTransport_->close();
   factoryOutputTransport_->close();
 
-  // Give this object back to the server that owns it
-  server_->returnConnection(this);
+  // Free the buffers of any requests processed concurrently
+  for (size_t i = 0; i < requestPool_.size(); ++i) {
+    delete requestPool_[i];
+  }
+  requestPool_.clear();
+
+  // Trim buffers outside the pool's lock, then give this object back to
+  // the IO thread that owns it.  A connection whose buffers couldn't be
+  // trimmed isn't worth keeping idle.
+  if (checkIdleBufferMemLimit(server_->getIdleBufferMemLimit())) {
+    ioThread_->returnConnection(this);
+  } else {
+    delete this;
+  }
 }
 
-void TConnection::checkIdleBufferMemLimit(size_t limit) {
-  if (readBufferSize_ > limit) {
-    readBufferSize_ = limit;
-    readBuffer_ = (uint8_t*)std::realloc(readBuffer_, readBufferSize_);
-    if (readBuffer_ == NULL) {
+bool TConnection::checkIdleBufferMemLimit(size_t limit) {
+  if (frameBufferSize_ > limit) {
+    std::free(frameBuffer_);
+    frameBuffer_ = NULL;
+    frameBufferSize_ = 0;
+  }
+  // The read buffer can't go away entirely, since it only ever doubles
+  if (readBufferSize_ > limit && limit > 0) {
+    // On failure the old buffer is still valid and is freed with us
+    uint8_t* newBuffer = (uint8_t*)std::realloc(readBuffer_, limit);
+    if (newBuffer == NULL) {
       GlobalOutput("TConnection::checkIdleBufferMemLimit() realloc");
-      close();
+      return false;
     }
+    readBuffer_ = newBuffer;
+    readBufferSize_ = limit;
   }
+  return true;
 }
 
-/**
- * Creates a new connection either by reusing an object off the stack or
- * by allocating a new one entirely
- */
-TConnection* TNonblockingServer::createConnection(int socket, short flags) {
-  // Check the stack
-  if (connectionStack_.empty()) {
-    return new TConnection(socket, flags, this);
-  } else {
-    TConnection* result = connectionStack_.top();
-    connectionStack_.pop();
-    result->init(socket, flags, this);
-    return result;
+TNonblockingServer::~TNonblockingServer() {
+  // Free the pooled connections while the server they count against lives
+  ioThreads_.clear();
+
+  if (serverSocket_ >= 0) {
+    if (eventBase_ != NULL) {
+      event_del(&serverEvent_);
+    }
+    close(serverSocket_);
   }
 }
 
-/**
- * Returns a connection to the stack
- */
-void TNonblockingServer::returnConnection(TConnection* connection) {
-  if (connectionStackLimit_ &&
-      (connectionStack_.size() >= connectionStackLimit_)) {
-    delete connection;
-  } else {
-    connection->checkIdleBufferMemLimit(idleBufferMemLimit_);
-    connectionStack_.push(connection);
+size_t TNonblockingServer::getNumIdleConnections() const {
+  size_t idle = 0;
+  for (size_t i = 0; i < ioThreads_.size(); ++i) {
+    idle += ioThreads_[i]->getNumIdleConnections();
   }
+  return idle;
 }
 
 /**
@@ -594,9 +1251,10 @@ void TNonblockingServer::handleEvent(int fd, short which) {
       return;
     }
 
-    // Create a new TConnection for this client socket.
-    TConnection* clientConnection =
-      createConnection(clientSocket, EV_READ | EV_PERSIST);
+    // Create a new TConnection for this client socket, in the next IO thread
+    TNonblockingIOThread* ioThread =
+      ioThreads_[nextIOThread_++ % ioThreads_.size()].get();
+    TConnection* clientConnection = ioThread->createConnection(clientSocket);
 
     // Fail fast if we could not create a TConnection object
     if (clientConnection == NULL) {
@@ -605,8 +1263,15 @@ void TNonblockingServer::handleEvent(int fd, short which) {
       return;
     }
 
-    // Put this client connection into the proper state
-    clientConnection->transition();
+    // Put this client connection into the proper state, in its own thread
+    if (ioThread->getNumber() == 0) {
+      clientConnection->transition();
+    } else if (!ioThread->notify(clientConnection)) {
+      GlobalOutput.perror("thriftServerEventHandler: IO thread notify ", errno);
+      close(clientSocket);
+      ioThread->returnConnection(clientConnection);
+      return;
+    }
 
     // addrLen is written by the accept() call, so needs to be set before the next call.
     addrLen = sizeof(addr);
@@ -727,20 +1392,6 @@ void TNonblockingServer::listenSocket(int s) {
   serverSocket_ = s;
 }
 
-void TNonblockingServer::createNotificationPipe() {
-  if (pipe(notificationPipeFDs_) != 0) {
-    GlobalOutput.perror("TNonblockingServer::createNotificationPipe ", errno);
-      throw TException("can't create notification pipe");
-  }
-  int flags;
-  if ((flags = fcntl(notificationPipeFDs_[0], F_GETFL, 0)) < 0 ||
-      fcntl(notificationPipeFDs_[0], F_SETFL, flags | O_NONBLOCK) < 0) {
-    close(notificationPipeFDs_[0]);
-    close(notificationPipeFDs_[1]);
-    throw TException("TNonblockingServer::createNotificationPipe() O_NONBLOCK");
-  }
-}
-
 /**
  * Register the core libevent events onto the proper base.
  */
@@ -754,6 +1405,28 @@ void TNonblockingServer::registerEvents(event_base* base) {
           event_get_version(),
           event_get_method());
 
+  // Settle which methods run on the IO threads
+  std::set<std::string> annotated;
+  getProcessor()->getInlineMethods(annotated);
+  for (std::set<std::string>::const_iterator it = annotated.begin();
+       it != annotated.end(); ++it) {
+    inlineMethods_.insert(std::make_pair(*it, true));
+  }
+  anyInlineMethods_ = false;
+  for (std::map<std::string, bool>::const_iterator it = inlineMethods_.begin();
+       it != inlineMethods_.end(); ++it) {
+    anyInlineMethods_ = anyInlineMethods_ || it->second;
+  }
+
+  // Create the IO threads, the first looping over the base we were given
+  ioThreads_.clear();
+  for (size_t i = 0; i < numIOThreads_; ++i) {
+    boost::shared_ptr<TNonblockingIOThread> ioThread(
+      new TNonblockingIOThread(this, i, i == 0 ? eventBase_ : NULL));
+    ioThread->registerEvents();
+    ioThreads_.push_back(ioThread);
+  }
+
   // Register the server event
   event_set(&serverEvent_,
             serverSocket_,
@@ -766,21 +1439,15 @@ void TNonblockingServer::registerEvents(event_base* base) {
   if (-1 == event_add(&serverEvent_, 0)) {
     throw TException("TNonblockingServer::serve(): coult not event_add");
   }
-  if (threadPoolProcessing_) {
-    // Create an event to be notified when a task finishes
-    event_set(&notificationEvent_,
-              getNotificationRecvFD(),
-              EV_READ | EV_PERSIST,
-              TConnection::taskHandler,
-              this);
 
-    // Attach to the base
-    event_base_set(eventBase_, &notificationEvent_);
-
-    // Add the event and start up the server
-    if (-1 == event_add(&notificationEvent_, 0)) {
-      throw TException("TNonblockingServer::serve(): notification event_add fail");
-    }
+  // Start all but the first IO thread, whose loop is run by our caller
+  PosixThreadFactory threadFactory(PosixThreadFactory::ROUND_ROBIN,
+                                   PosixThreadFactory::NORMAL, 1, false);
+  ioThreadHandles_.clear();
+  for (size_t i = 1; i < ioThreads_.size(); ++i) {
+    boost::shared_ptr<Thread> thread = threadFactory.newThread(ioThreads_[i]);
+    thread->start();
+    ioThreadHandles_.push_back(thread);
   }
 }
 
@@ -795,7 +1462,7 @@ void TNonblockingServer::setThreadManager(boost::shared_ptr<ThreadManager> threa
 }
 
 bool  TNonblockingServer::serverOverloaded() {
-  size_t activeConnections = numTConnections_ - connectionStack_.size();
+  size_t activeConnections = numTConnections_ - getNumIdleConnections();
   if (numActiveProcessors_ > maxActiveProcessors_ ||
       activeConnections > maxConnections_) {
     if (!overloaded_) {
@@ -820,11 +1487,13 @@ bool TNonblockingServer::drainPendingTask() {
   if (threadManager_) {
     boost::shared_ptr<Runnable> task = threadManager_->removeNextPending();
     if (task) {
-      TConnection* connection =
-        static_cast<TConnection::Task*>(task.get())->getTConnection();
+      TConnection::Task* connectionTask =
+        static_cast<TConnection::Task*>(task.get());
+      TConnection* connection = connectionTask->getTConnection();
       assert(connection && connection->getServer()
-             && connection->getState() == APP_WAIT_TASK);
-      connection->forceClose();
+             && (connectionTask->getRequest() != NULL
+                 || connection->getState() == APP_WAIT_TASK));
+      connection->forceClose(connectionTask->getRequest());
       return true;
     }
   }
@@ -832,11 +1501,13 @@ bool TNonblockingServer::drainPendingTask() {
 }
 
 void TNonblockingServer::expireClose(boost::shared_ptr<Runnable> task) {
-  TConnection* connection =
-    static_cast<TConnection::Task*>(task.get())->getTConnection();
+  TConnection::Task* connectionTask =
+    static_cast<TConnection::Task*>(task.get());
+  TConnection* connection = connectionTask->getTConnection();
   assert(connection && connection->getServer()
-	 && connection->getState() == APP_WAIT_TASK);
-  connection->forceClose();
+	 && (connectionTask->getRequest() != NULL
+	     || connection->getState() == APP_WAIT_TASK));
+  connection->forceClose(connectionTask->getRequest());
 }
 
 /**
@@ -847,12 +1518,7 @@ void TNonblockingServer::serve() {
   // Init socket
   listenSocket();
 
-  if (threadPoolProcessing_) {
-    // Init task completion notification pipe
-    createNotificationPipe();
-  }
-
-  // Initialize libevent core
+  // Initialize libevent core, and start the other IO threads
   registerEvents(static_cast<event_base*>(event_init()));
 
   // Run the preServe event
@@ -860,8 +1526,220 @@ void TNonblockingServer::serve() {
     eventHandler_->preServe();
   }
 
-  // Run libevent engine, never returns, invokes calls to eventHandler
+  // Run libevent engine, invokes calls to eventHandler, returns on stop()
+  ioThreads_[0]->run();
+
+  // Wait for the other IO threads to leave their loops
+  for (size_t i = 0; i < ioThreadHandles_.size(); ++i) {
+    ioThreadHandles_[i]->join();
+  }
+  ioThreadHandles_.clear();
+}
+
+void TNonblockingServer::stop() {
+  for (size_t i = 0; i < ioThreads_.size(); ++i) {
+    ioThreads_[i]->stop();
+  }
+}
+
+TNonblockingIOThread::TNonblockingIOThread(TNonblockingServer* server,
+                                           int number,
+                                           event_base* eventBase) :
+  server_(server),
+  number_(number),
+  eventBase_(eventBase),
+  ownEventBase_(false),
+  numNotifications_(0),
+  numSignals_(0),
+  numWakeups_(0),
+  numRecvs_(0),
+  numSends_(0) {
+  notificationFDs_[0] = -1;
+  notificationFDs_[1] = -1;
+  if (eventBase_ == NULL) {
+    eventBase_ = event_base_new();
+    if (eventBase_ == NULL) {
+      throw TException("TNonblockingIOThread: event_base_new failed");
+    }
+    ownEventBase_ = true;
+  }
+}
+
+TNonblockingIOThread::~TNonblockingIOThread() {
+  while (!connectionStack_.empty()) {
+    delete connectionStack_.top();
+    connectionStack_.pop();
+  }
+  if (notificationFDs_[0] >= 0) {
+    event_del(&notificationEvent_);
+    ::close(notificationFDs_[0]);
+    if (notificationFDs_[1] != notificationFDs_[0]) {
+      ::close(notificationFDs_[1]);
+    }
+  }
+  if (ownEventBase_) {
+    event_base_free(eventBase_);
+  }
+}
+
+void TNonblockingIOThread::createNotificationFDs() {
+#ifdef HAVE_SYS_EVENTFD_H
+  int fd = eventfd(0, 0);
+  if (fd < 0) {
+    GlobalOutput.perror("TNonblockingIOThread::createNotificationFDs eventfd ", errno);
+    throw TException("can't create notification eventfd");
+  }
+  notificationFDs_[0] = fd;
+  notificationFDs_[1] = fd;
+#else
+  if (pipe(notificationFDs_) != 0) {
+    GlobalOutput.perror("TNonblockingIOThread::createNotificationFDs pipe ", errno);
+    throw TException("can't create notification pipe");
+  }
+#endif
+  int flags;
+  if ((flags = fcntl(notificationFDs_[0], F_GETFL, 0)) < 0 ||
+      fcntl(notificationFDs_[0], F_SETFL, flags | O_NONBLOCK) < 0) {
+    ::close(notificationFDs_[0]);
+    if (notificationFDs_[1] != notificationFDs_[0]) {
+      ::close(notificationFDs_[1]);
+    }
+    notificationFDs_[0] = -1;
+    notificationFDs_[1] = -1;
+    throw TException("TNonblockingIOThread::createNotificationFDs() O_NONBLOCK");
+  }
+}
+
+void TNonblockingIOThread::registerEvents() {
+  createNotificationFDs();
+
+  // Create an event to be notified of connections handed to us
+  event_set(&notificationEvent_,
+            getNotificationRecvFD(),
+            EV_READ | EV_PERSIST,
+            TNonblockingIOThread::notifyHandler,
+            this);
+
+  // Attach to the base
+  event_base_set(eventBase_, &notificationEvent_);
+
+  if (-1 == event_add(&notificationEvent_, 0)) {
+    throw TException("TNonblockingIOThread: notification event_add fail");
+  }
+}
+
+void TNonblockingIOThread::run() {
   event_base_loop(eventBase_, 0);
 }
 
+void TNonblockingIOThread::stop() {
+  notify(NULL);
+}
+
+bool TNonblockingIOThread::notify(TConnection* connection) {
+  Guard g(notificationMutex_);
+
+  notifications_.push_back(connection);
+  ++numNotifications_;
+
+  // A queue that was not empty has been signalled already, and the loop
+  // takes the whole of it after reading the signal
+  if (notifications_.size() > 1) {
+    return true;
+  }
+
+#ifdef HAVE_SYS_EVENTFD_H
+  uint64_t signal = 1;
+#else
+  uint8_t signal = 1;
+#endif
+  if (write(getNotificationSendFD(), &signal, sizeof(signal)) != sizeof(signal)) {
+    notifications_.pop_back();
+    --numNotifications_;
+    return false;
+  }
+  ++numSignals_;
+
+  return true;
+}
+
+void TNonblockingIOThread::notifyHandler(int fd, short /* which */, void* v) {
+  TNonblockingIOThread* ioThread = static_cast<TNonblockingIOThread*>(v);
+
+  // Consume the signal before taking the queue, so that anything queued
+  // after we take it signals afresh
+#ifdef HAVE_SYS_EVENTFD_H
+  uint64_t signals;
+  ssize_t nBytes = read(fd, &signals, sizeof(signals));
+#else
+  uint8_t signals[64];
+  ssize_t nBytes;
+  while ((nBytes = read(fd, signals, sizeof(signals))) == sizeof(signals)) {}
+#endif
+  if (nBytes < 0 && errno != EWOULDBLOCK && errno != EAGAIN) {
+    GlobalOutput.perror("TNonblockingIOThread::notifyHandler read failed ", errno);
+  }
+
+  std::vector<TConnection*>& taken = ioThread->notificationsTaken_;
+  {
+    Guard g(ioThread->notificationMutex_);
+    taken.swap(ioThread->notifications_);
+    ++ioThread->numWakeups_;
+  }
+
+  bool stop = false;
+  for (size_t i = 0; i < taken.size(); ++i) {
+    if (taken[i] == NULL) {
+      stop = true;
+    } else {
+      taken[i]->transition();
+    }
+  }
+  taken.clear();
+
+  if (stop) {
+    event_base_loopbreak(ioThread->eventBase_);
+  }
+}
+
+/**
+ * Creates a new connection either by reusing an object off the stack or
+ * by allocating a new one entirely
+ */
+TConnection* TNonblockingIOThread::createConnection(int socket) {
+  Guard g(connectionStackMutex_);
+
+  // Check the stack
+  if (connectionStack_.empty()) {
+    return new TConnection(socket, server_, this);
+  } else {
+    TConnection* result = connectionStack_.top();
+    connectionStack_.pop();
+    result->init(socket, server_, this);
+    return result;
+  }
+}
+
+/**
+ * Returns a connection to the stack
+ */
+void TNonblockingIOThread::returnConnection(TConnection* connection) {
+  size_t limit = server_->getConnectionStackLimit();
+  {
+    Guard g(connectionStackMutex_);
+    if (!limit || (connectionStack_.size() < limit)) {
+      connectionStack_.push(connection);
+      connection = NULL;
+    }
+  }
+  if (connection != NULL) {
+    delete connection;
+  }
+}
+
+size_t TNonblockingIOThread::getNumIdleConnections() const {
+  Guard g(connectionStackMutex_);
+  return connectionStack_.size();
+}
+
 }}} // apache::thrift::server
@@ -23,10 +23,15 @@
 #include <Thrift.h>
 #include <server/TServer.h>
 #include <transport/TBufferTransports.h>
+#include <transport/TCompressedFramedTransport.h>
+#include <transport/THttpServer.h>
 #include <concurrency/ThreadManager.h>
+#include <concurrency/Mutex.h>
 #include <climits>
+#include <map>
 #include <stack>
 #include <string>
+#include <vector>
 #include <errno.h>
 #include <cstdlib>
 #include <unistd.h>
@@ -35,17 +40,24 @@
 namespace apache { namespace thrift { namespace server {
 
 using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TFrameCodec;
+using apache::thrift::transport::THttpRequestParser;
 using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TMessageType;
 using apache::thrift::concurrency::Runnable;
 using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::concurrency::Mutex;
+using apache::thrift::concurrency::Thread;
 
 // Forward declaration of class
 class TConnection;
+class TNonblockingIOThread;
 
 /**
  * This is a non-blocking server in C++ for high performance that operates a
- * single IO thread. It assumes that all incoming requests are framed with a
- * 4 byte length indicator and writes out responses using the same framing.
+ * configurable number of IO threads, one by default. It assumes that all
+ * incoming requests are framed with a 4 byte length indicator and writes out
+ * responses using the same framing.
  *
  * It does not use the TServerTransport framework, but rather has socket
  * operations hardcoded for use with select.
@@ -71,6 +83,12 @@ class TNonblockingServer : public TServer {
   /// Maximum size of buffer allocated to idle connection
   static const uint32_t IDLE_BUFFER_MEM_LIMIT = 8192;
 
+  /// Default limit on the responses to pipelined requests sent together
+  static const uint32_t MAX_COALESCED_BYTES = 65536;
+
+  /// Default limit on requests from one connection processed at once
+  static const uint32_t MAX_IN_FLIGHT_REQUESTS = 1;
+
   /// Default limit on total number of connected sockets
   static const int MAX_CONNECTIONS = INT_MAX;
 
@@ -89,22 +107,31 @@ class TNonblockingServer : public TServer {
   /// Is thread pool processing?
   bool threadPoolProcessing_;
 
-  /// The event base for libevent
+  /// The event base for libevent, that of the first IO thread
   event_base* eventBase_;
 
   /// Event struct, used with eventBase_ for connection events
   struct event serverEvent_;
 
-  /// Event struct, used with eventBase_ for task completion notification
-  struct event notificationEvent_;
+  /// Number of IO threads to run
+  size_t numIOThreads_;
+
+  /// The IO threads, the first of which also accepts connections
+  std::vector<boost::shared_ptr<TNonblockingIOThread> > ioThreads_;
+
+  /// Threads running all but the first IO thread, which runs in serve()
+  std::vector<boost::shared_ptr<Thread> > ioThreadHandles_;
 
-  /// Number of TConnection object we've created
+  /// The IO thread that gets the next connection accepted
+  size_t nextIOThread_;
+
+  /// Number of TConnection object we've created, updated atomically
   size_t numTConnections_;
 
-  /// Number of Connections processing or waiting to process
+  /// Number of Connections processing or waiting to process, updated atomically
   size_t numActiveProcessors_;
 
-  /// Limit for how many TConnection objects to cache
+  /// Limit for how many TConnection objects each IO thread caches
   size_t connectionStackLimit_;
 
   /// Limit for number of connections processing or waiting to process
@@ -133,6 +160,18 @@ class TNonblockingServer : public TServer {
    */
   size_t idleBufferMemLimit_;
 
+  /**
+   * Most bytes of responses to gather, while requests pipelined behind them
+   * are already read, before sending them together.
+   */
+  uint32_t maxCoalescedBytes_;
+
+  /**
+   * Most framed requests from one connection the thread manager may be
+   * processing at once, their responses sent in the order they finish.
+   */
+  uint32_t maxInFlightRequests_;
+
   /// Set if we are currently in an overloaded state.
   bool overloaded_;
 
@@ -142,16 +181,30 @@ class TNonblockingServer : public TServer {
   /// Count of connections dropped on overload since server started
   uint64_t nTotalConnectionsDropped_;
 
-  /// File descriptors for pipe used for task completion notification.
-  int notificationPipeFDs_[2];
+  /// Codec for responses, if frames carry a TCompressedFramedTransport header
+  boost::shared_ptr<TFrameCodec> frameCodec_;
+
+  /// Responses smaller than this are not compressed
+  uint32_t frameCompressThreshold_;
+
+  /// Whether requests and responses are the bodies of HTTP messages
+  bool http_;
+
+  /// Content type of HTTP responses
+  std::string httpContentType_;
+
+  /// Largest HTTP request body accepted
+  uint32_t httpMaxBodySize_;
 
   /**
-   * This is a stack of all the objects that have been created but that
-   * are NOT currently in use. When we close a connection, we place it on this
-   * stack so that the object can be reused later, rather than freeing the
-   * memory and reallocating a new object later.
+   * Methods to run on the IO thread (true) or in the thread pool (false)
+   * when there is one: those set through setMethodInline(), and, unless set
+   * otherwise there, those the processor's IDL marks inline.
    */
-  std::stack<TConnection*> connectionStack_;
+  std::map<std::string, bool> inlineMethods_;
+
+  /// Whether any of inlineMethods_ run on the IO thread
+  bool anyInlineMethods_;
 
   /**
    * Called when server socket had something happen.  We accept all waiting
@@ -171,6 +224,8 @@ class TNonblockingServer : public TServer {
     port_(port),
     threadPoolProcessing_(false),
     eventBase_(NULL),
+    numIOThreads_(1),
+    nextIOThread_(0),
     numTConnections_(0),
     numActiveProcessors_(0),
     connectionStackLimit_(CONNECTION_STACK_LIMIT),
@@ -180,9 +235,15 @@ class TNonblockingServer : public TServer {
     overloadHysteresis_(0.8),
     overloadAction_(T_OVERLOAD_NO_ACTION),
     idleBufferMemLimit_(IDLE_BUFFER_MEM_LIMIT),
+    maxCoalescedBytes_(MAX_COALESCED_BYTES),
+    maxInFlightRequests_(MAX_IN_FLIGHT_REQUESTS),
     overloaded_(false),
     nConnectionsDropped_(0),
-    nTotalConnectionsDropped_(0) {}
+    nTotalConnectionsDropped_(0),
+    frameCompressThreshold_(0),
+    http_(false),
+    httpMaxBodySize_(THttpRequestParser::DEFAULT_MAX_BODY_SIZE),
+    anyInlineMethods_(false) {}
 
   TNonblockingServer(boost::shared_ptr<TProcessor> processor,
                      boost::shared_ptr<TProtocolFactory> protocolFactory,
@@ -193,6 +254,8 @@ class TNonblockingServer : public TServer {
     port_(port),
     threadManager_(threadManager),
     eventBase_(NULL),
+    numIOThreads_(1),
+    nextIOThread_(0),
     numTConnections_(0),
     numActiveProcessors_(0),
     connectionStackLimit_(CONNECTION_STACK_LIMIT),
@@ -202,9 +265,15 @@ class TNonblockingServer : public TServer {
     overloadHysteresis_(0.8),
     overloadAction_(T_OVERLOAD_NO_ACTION),
     idleBufferMemLimit_(IDLE_BUFFER_MEM_LIMIT),
+    maxCoalescedBytes_(MAX_COALESCED_BYTES),
+    maxInFlightRequests_(MAX_IN_FLIGHT_REQUESTS),
     overloaded_(false),
     nConnectionsDropped_(0),
-    nTotalConnectionsDropped_(0) {
+    nTotalConnectionsDropped_(0),
+    frameCompressThreshold_(0),
+    http_(false),
+    httpMaxBodySize_(THttpRequestParser::DEFAULT_MAX_BODY_SIZE),
+    anyInlineMethods_(false) {
     setInputTransportFactory(boost::shared_ptr<TTransportFactory>(new TTransportFactory()));
     setOutputTransportFactory(boost::shared_ptr<TTransportFactory>(new TTransportFactory()));
     setInputProtocolFactory(protocolFactory);
@@ -224,6 +293,8 @@ class TNonblockingServer : public TServer {
     port_(port),
     threadManager_(threadManager),
     eventBase_(NULL),
+    numIOThreads_(1),
+    nextIOThread_(0),
     numTConnections_(0),
     numActiveProcessors_(0),
     connectionStackLimit_(CONNECTION_STACK_LIMIT),
@@ -233,9 +304,15 @@ class TNonblockingServer : public TServer {
     overloadHysteresis_(0.8),
     overloadAction_(T_OVERLOAD_NO_ACTION),
     idleBufferMemLimit_(IDLE_BUFFER_MEM_LIMIT),
+    maxCoalescedBytes_(MAX_COALESCED_BYTES),
+    maxInFlightRequests_(MAX_IN_FLIGHT_REQUESTS),
     overloaded_(false),
     nConnectionsDropped_(0),
-    nTotalConnectionsDropped_(0) {
+    nTotalConnectionsDropped_(0),
+    frameCompressThreshold_(0),
+    http_(false),
+    httpMaxBodySize_(THttpRequestParser::DEFAULT_MAX_BODY_SIZE),
+    anyInlineMethods_(false) {
     setInputTransportFactory(inputTransportFactory);
     setOutputTransportFactory(outputTransportFactory);
     setInputProtocolFactory(inputProtocolFactory);
@@ -243,7 +320,7 @@ class TNonblockingServer : public TServer {
     setThreadManager(threadManager);
   }
 
-  ~TNonblockingServer() {}
+  ~TNonblockingServer();
 
   void setThreadManager(boost::shared_ptr<ThreadManager> threadManager);
 
@@ -252,7 +329,34 @@ class TNonblockingServer : public TServer {
   }
 
   /**
-   * Get the maximum number of unused TConnection we will hold in reserve.
+   * Set the number of IO threads, each running its own libevent loop over
+   * the connections assigned to it.  The first also accepts connections,
+   * handing them to the threads in turn, and runs in serve(); the others
+   * get threads of their own.  Must be called before serve().
+   *
+   * @param numIOThreads the number of IO threads, at least one.
+   */
+  void setNumIOThreads(size_t numIOThreads) {
+    numIOThreads_ = numIOThreads > 0 ? numIOThreads : 1;
+  }
+
+  size_t getNumIOThreads() const {
+    return numIOThreads_;
+  }
+
+  /**
+   * Get one of the IO threads, once serve() or registerEvents() has
+   * created them.
+   *
+   * @param n number of the IO thread, less than getNumIOThreads().
+   */
+  boost::shared_ptr<TNonblockingIOThread> getIOThread(size_t n) const {
+    return ioThreads_[n];
+  }
+
+  /**
+   * Get the maximum number of unused TConnection we will hold in reserve,
+   * in each IO thread.
    *
    * @return the current limit on TConnection pool size.
    */
@@ -261,7 +365,8 @@ class TNonblockingServer : public TServer {
   }
 
   /**
-   * Set the maximum number of unused TConnection we will hold in reserve.
+   * Set the maximum number of unused TConnection we will hold in reserve,
+   * in each IO thread.
    *
    * @param sz the new limit for TConnection pool size.
    */
@@ -277,18 +382,19 @@ class TNonblockingServer : public TServer {
     threadManager_->add(task, 0LL, taskExpireTime_);
   }
 
+  /// The event base of the first IO thread, which accepts connections.
   event_base* getEventBase() const {
     return eventBase_;
   }
 
   /// Increment our count of the number of connected sockets.
   void incrementNumConnections() {
-    ++numTConnections_;
+    __sync_fetch_and_add(&numTConnections_, 1);
   }
 
   /// Decrement our count of the number of connected sockets.
   void decrementNumConnections() {
-    --numTConnections_;
+    __sync_fetch_and_sub(&numTConnections_, 1);
   }
 
   /**
@@ -305,9 +411,7 @@ class TNonblockingServer : public TServer {
    *
    * @return count of idle connection objects.
    */
-  size_t getNumIdleConnections() const {
-    return connectionStack_.size();
-  }
+  size_t getNumIdleConnections() const;
 
   /**
    * Return count of number of connections which are currently processing.
@@ -323,13 +427,18 @@ class TNonblockingServer : public TServer {
 
   /// Increment the count of connections currently processing.
   void incrementActiveProcessors() {
-    ++numActiveProcessors_;
+    __sync_fetch_and_add(&numActiveProcessors_, 1);
   }
 
   /// Decrement the count of connections currently processing.
   void decrementActiveProcessors() {
-    if (numActiveProcessors_ > 0) {
-      --numActiveProcessors_;
+    size_t active = numActiveProcessors_;
+    while (active > 0) {
+      size_t seen = __sync_val_compare_and_swap(&numActiveProcessors_, active, active - 1);
+      if (seen == active) {
+        break;
+      }
+      active = seen;
     }
   }
 
@@ -463,25 +572,132 @@ class TNonblockingServer : public TServer {
     idleBufferMemLimit_ = limit;
   }
 
+  uint32_t getMaxCoalescedBytes() const {
+    return maxCoalescedBytes_;
+  }
+
   /**
-   * Return an initialized connection object.  Creates or recovers from
-   * pool a TConnection and initializes it with the provided socket FD
-   * and flags.
+   * Set how many bytes of framed responses a connection may gather before
+   * sending them in one go.  A connection that finds another whole request
+   * already read, once it has the response to the last, processes that
+   * request before sending if it runs on the IO thread; a client
+   * pipelining calls thus gets many responses per send.  A response is
+   * never held for a request handed to the thread pool.  Zero sends each
+   * response as soon as it is ready.
    *
-   * @param socket FD of socket associated with this connection.
-   * @param flags initial lib_event flags for this connection.
-   * @return pointer to initialized TConnection object.
+   * @param maxBytes most bytes of responses to send together.
    */
-  TConnection* createConnection(int socket, short flags);
+  void setMaxCoalescedBytes(uint32_t maxBytes) {
+    maxCoalescedBytes_ = maxBytes;
+  }
+
+  uint32_t getMaxInFlightRequests() const {
+    return maxInFlightRequests_;
+  }
 
   /**
-   * Returns a connection to pool or deletion.  If the connection pool
-   * (a stack) isn't full, place the connection object on it, otherwise
-   * just delete it.
+   * Set how many framed requests from one connection may be processed by
+   * the thread manager at once.  Above one, a connection goes on reading
+   * and dispatching requests pipelined behind those still running, and
+   * sends each response as soon as it is ready, so a slow call no longer
+   * holds up the quick ones behind it.  Responses may then come back in a
+   * different order from their requests, and clients must match them up
+   * by sequence id.  HTTP connections, and servers without a thread
+   * manager, process one request at a time regardless.
    *
-   * @param connection the TConection being returned.
+   * @param maxRequests most requests from one connection in flight.
    */
-  void returnConnection(TConnection* connection);
+  void setMaxInFlightRequests(uint32_t maxRequests) {
+    maxInFlightRequests_ = maxRequests > 0 ? maxRequests : 1;
+  }
+
+  /**
+   * Exchange frames in the format of TCompressedFramedTransport, rather than
+   * plain framing.  Requests are decoded with whatever registered codec
+   * their header names, and responses of at least threshold bytes are
+   * compressed with codec.
+   *
+   * @param codec for responses.
+   * @param threshold size below which responses are sent uncompressed.
+   */
+  void setFrameCodec(boost::shared_ptr<TFrameCodec> codec,
+                     uint32_t threshold = apache::thrift::transport::
+                       TCompressedFramedTransport::DEFAULT_COMPRESS_THRESHOLD) {
+    frameCodec_ = codec;
+    frameCompressThreshold_ = threshold;
+  }
+
+  boost::shared_ptr<TFrameCodec> getFrameCodec() const {
+    return frameCodec_;
+  }
+
+  uint32_t getFrameCompressThreshold() const {
+    return frameCompressThreshold_;
+  }
+
+  /**
+   * Speak HTTP rather than framing.  Each request is the body of a POST,
+   * as THttpClient sends them, and each response the body of a 200
+   * response.  Requests are parsed as they arrive, without blocking, and
+   * connections are kept alive, with pipelined requests answered in order.
+   * Clients that send chunked requests get chunked responses.  Frame
+   * codecs do not apply.
+   *
+   * @param http whether to speak HTTP.
+   * @param contentType of responses, such as "application/json" for
+   *        clients using TJSONProtocol.
+   */
+  void setHttp(bool http, const std::string& contentType = "application/x-thrift") {
+    http_ = http;
+    httpContentType_ = contentType;
+  }
+
+  bool isHttp() const {
+    return http_;
+  }
+
+  const std::string& getHttpContentType() const {
+    return httpContentType_;
+  }
+
+  /**
+   * Set the largest HTTP request body accepted.  Connections sending a
+   * longer one are closed, which bounds their read buffers.
+   *
+   * @param maxBodySize in bytes.
+   */
+  void setHttpMaxBodySize(uint32_t maxBodySize) {
+    httpMaxBodySize_ = maxBodySize;
+  }
+
+  uint32_t getHttpMaxBodySize() const {
+    return httpMaxBodySize_;
+  }
+
+  /**
+   * Choose where a method runs when there is a thread manager: inline on
+   * the IO thread, which saves the hand-off to the pool and back but holds
+   * up the thread's other connections while it runs, or in the pool.  This
+   * overrides the cpp.dispatch = "inline" annotation the method may carry.
+   * Must be called before serve().
+   *
+   * @param fname name of the method.
+   * @param runInline whether to run it on the IO thread.
+   */
+  void setMethodInline(const std::string& fname, bool runInline) {
+    inlineMethods_[fname] = runInline;
+  }
+
+  /// Whether the named method runs on the IO thread, once serve() has begun.
+  bool isMethodInline(const std::string& fname) const {
+    std::map<std::string, bool>::const_iterator it = inlineMethods_.find(fname);
+    return it != inlineMethods_.end() && it->second;
+  }
+
+  /// Whether any method runs on the IO thread, once serve() has begun.
+  bool hasInlineMethods() const {
+    return anyInlineMethods_;
+  }
 
   /**
    * Callback function that the threadmanager calls when a task reaches
@@ -514,29 +730,9 @@ class TNonblockingServer : public TServer {
    */
   void listenSocket(int fd);
 
-  /// Create the pipe used to notify I/O process of task completion.
-  void createNotificationPipe();
-
-  /**
-   * Get notification pipe send descriptor.
-   *
-   * @return write fd for pipe.
-   */
-  int getNotificationSendFD() const {
-    return notificationPipeFDs_[1];
-  }
-
   /**
-   * Get notification pipe receive descriptor.
-   *
-   * @return read fd of pipe.
-   */
-  int getNotificationRecvFD() const {
-    return notificationPipeFDs_[0];
-  }
-
-  /**
-   * Register the core libevent events onto the proper base.
+   * Register the core libevent events onto the proper base, which becomes
+   * that of the first IO thread, and start any other IO threads.
    *
    * @param base pointer to the event base to be initialized.
    */
@@ -547,6 +743,9 @@ class TNonblockingServer : public TServer {
    * loops over the libevent handler.
    */
   void serve();
+
+  /// Make the IO threads leave their loops, and serve() return.
+  void stop();
 };
 
 /// Two states for sockets, recv and send mode
@@ -559,7 +758,7 @@ enum TSocketState {
  * Five states for the nonblocking servr:
  *  1) initialize
  *  2) read 4 byte frame size
- *  3) read frame of data
+ *  3) read frame of data, or an HTTP request
  *  4) send back data (if any)
  *  5) force immediate connection close
  */
@@ -567,16 +766,180 @@ enum TAppState {
   APP_INIT,
   APP_READ_FRAME_SIZE,
   APP_READ_REQUEST,
+  APP_READ_HTTP_REQUEST,
   APP_WAIT_TASK,
   APP_SEND_RESULT,
   APP_CLOSE_CONNECTION
 };
 
+/**
+ * One of the IO threads of a TNonblockingServer, with its own libevent base
+ * and pool of TConnection objects.  Connections are handed to it, tasks
+ * report their completion to it, and it is told to stop, by queueing them
+ * for it; its loop runs transition() on the connections queued, and stops
+ * on NULL.  The queue is signalled through an eventfd (a pipe where there is
+ * none) only when it stops being empty, so a busy thread takes many
+ * completions per wakeup and their producers make no system call.
+ */
+class TNonblockingIOThread : public Runnable {
+ public:
+  /**
+   * @param server the server the thread belongs to.
+   * @param number of the thread, from zero.
+   * @param eventBase to run the loop over, or NULL to create one.
+   */
+  TNonblockingIOThread(TNonblockingServer* server, int number, event_base* eventBase);
+
+  ~TNonblockingIOThread();
+
+  /// Create the notification pipe and register its event.
+  void registerEvents();
+
+  /// Run the event loop until stop() is called.
+  void run();
+
+  /// Make run() return.  Safe to call from any thread.
+  void stop();
+
+  /**
+   * Hand a connection to this thread, which calls its transition().
+   * Safe to call from any thread.
+   *
+   * @return true if successful, false if unable to notify (check errno).
+   */
+  bool notify(TConnection* connection);
+
+  /**
+   * Return a connection for socket, from the pool or newly created, ready
+   * to be handed to this thread.  Safe to call from any thread.
+   */
+  TConnection* createConnection(int socket);
+
+  /**
+   * Returns a connection to pool or deletion.  If the connection pool
+   * (a stack) isn't full, place the connection object on it, otherwise
+   * just delete it.
+   *
+   * @param connection the TConection being returned.
+   */
+  void returnConnection(TConnection* connection);
+
+  /// Return the count of connection objects in the pool.
+  size_t getNumIdleConnections() const;
+
+  event_base* getEventBase() const {
+    return eventBase_;
+  }
+
+  int getNumber() const {
+    return number_;
+  }
+
+  int getNotificationSendFD() const {
+    return notificationFDs_[1];
+  }
+
+  int getNotificationRecvFD() const {
+    return notificationFDs_[0];
+  }
+
+  /// Number of connections queued by notify().
+  uint64_t getNumNotifications() const {
+    return numNotifications_;
+  }
+
+  /// Number of times notify() signalled the notification descriptor.
+  uint64_t getNumSignals() const {
+    return numSignals_;
+  }
+
+  /// Number of times the loop woke up to take the queue.
+  uint64_t getNumWakeups() const {
+    return numWakeups_;
+  }
+
+  /// Number of recv() calls on this thread's connections.
+  uint64_t getNumRecvs() const {
+    return numRecvs_;
+  }
+
+  /// Number of send() calls on this thread's connections.
+  uint64_t getNumSends() const {
+    return numSends_;
+  }
+
+  /// Count a recv() by a connection of this thread, on this thread.
+  void countRecv() {
+    ++numRecvs_;
+  }
+
+  /// Count a send() by a connection of this thread, on this thread.
+  void countSend() {
+    ++numSends_;
+  }
+
+  /**
+   * C-callable event handler for the notification descriptor, which takes
+   * the queued connections and calls their transition().
+   *
+   * @param fd the descriptor the event occured on.
+   * @param v void* callback arg where we placed the thread's "this".
+   */
+  static void notifyHandler(int fd, short which, void* v);
+
+ private:
+  /// Create the eventfd or pipe used to notify this thread.
+  void createNotificationFDs();
+
+  TNonblockingServer* server_;
+  int number_;
+
+  event_base* eventBase_;
+  bool ownEventBase_;
+
+  /// Event struct, used with eventBase_ for the notification descriptor
+  struct event notificationEvent_;
+
+  /// Receive and send descriptors for notification, the same for an eventfd
+  int notificationFDs_[2];
+
+  /// Guards notifications_ and the counts of them
+  Mutex notificationMutex_;
+
+  /// Connections handed to this thread and not yet taken by its loop
+  std::vector<TConnection*> notifications_;
+
+  /// Connections being taken by the loop; kept to reuse its storage
+  std::vector<TConnection*> notificationsTaken_;
+
+  uint64_t numNotifications_;
+  uint64_t numSignals_;
+  uint64_t numWakeups_;
+  uint64_t numRecvs_;
+  uint64_t numSends_;
+
+  /// Guards connectionStack_, as connections are created in another thread
+  Mutex connectionStackMutex_;
+
+  /**
+   * This is a stack of all the objects that have been created but that
+   * are NOT currently in use. When we close a connection, we place it on this
+   * stack so that the object can be reused later, rather than freeing the
+   * memory and reallocating a new object later.
+   */
+  std::stack<TConnection*> connectionStack_;
+};
+
 /**
  * Represents a connection that is handled via libevent. This connection
  * essentially encapsulates a socket that has some associated libevent state.
  */
 class TConnection {
+ public:
+
+  class Task;
+  class Request;
+
  private:
 
   /// Starting size for new connection buffer
@@ -585,6 +948,9 @@ class TConnection {
   /// Server handle
   TNonblockingServer* server_;
 
+  /// IO thread that handles this connection
+  TNonblockingIOThread* ioThread_;
+
   /// Socket handle
   int socket_;
 
@@ -600,12 +966,19 @@ class TConnection {
   /// Application state
   TAppState appState_;
 
-  /// How much data needed to read
+  /// How much data needed in the read buffer, counting from its start
   uint32_t readWant_;
 
   /// Where in the read buffer are we
   uint32_t readBufferPos_;
 
+  /**
+   * Offset in the read buffer of the frame being read or processed.  Frames
+   * are read ahead as far as the buffer goes, so those before it have been
+   * processed and those after it are pipelined behind it.
+   */
+  uint32_t frameStart_;
+
   /// Read buffer
   uint8_t* readBuffer_;
 
@@ -621,6 +994,30 @@ class TConnection {
   /// How far through writing are we?
   uint32_t writeBufferPos_;
 
+  /**
+   * Responses gathered to be sent with that of a later pipelined request,
+   * or, with requests processed concurrently, all those yet to be sent.
+   */
+  boost::shared_ptr<TMemoryBuffer> coalescedResponses_;
+
+  /**
+   * Whether a whole frame is in the read buffer at frameStart_, which can
+   * be processed without waiting on the socket.
+   */
+  bool frameReady() const;
+
+  /// Decompressed request or compressed response, for compressed frames
+  uint8_t* frameBuffer_;
+
+  /// Frame buffer size
+  uint32_t frameBufferSize_;
+
+  /// Parses HTTP requests in the read buffer
+  THttpRequestParser httpParser_;
+
+  /// Has "100 Continue" been sent for the current HTTP request?
+  bool httpContinued_;
+
   /// How many times have we read since our last buffer reset?
   uint32_t numReadsSinceReset_;
 
@@ -649,6 +1046,113 @@ class TConnection {
   /// Protocol encoder
   boost::shared_ptr<TProtocol> outputProtocol_;
 
+  /// Looks at a request's method name without consuming the request
+  boost::shared_ptr<TMemoryBuffer> peekTransport_;
+
+  /// Method name of the request last looked at
+  std::string peekName_;
+
+  /**
+   * Whether the request in input calls a method the server runs on the IO
+   * thread although it has a thread pool.
+   */
+  bool isInlineRequest(TMemoryBuffer* input);
+
+  /// Whether the request in the given frame body runs on the IO thread
+  bool isInlineRequest(const uint8_t* data, uint32_t len);
+
+  /**
+   * Reads the type and, into peekName_, the method name of a binary or
+   * compact protocol message without going through a protocol.
+   *
+   * @return false if data holds no such message header.
+   */
+  bool peekMessageBegin(const uint8_t* data, uint32_t len, TMessageType* type);
+
+  /**
+   * Whether the request ready at frameStart_ will be processed on the IO
+   * thread, so that a response held for it is not kept waiting on the pool.
+   */
+  bool nextRunsInline();
+
+  /**
+   * Puts the frame header in the space reserved ahead of the response in
+   * output, compressing it for compressed frames.
+   *
+   * @param output transport the processor wrote the response to.
+   * @param buf set to the framed response.
+   * @param size set to its length, zero if the request was oneway.
+   * @return false if the response could not be framed.
+   */
+  bool frameResponse(TMemoryBuffer* output, uint8_t** buf, uint32_t* size);
+
+  /**
+   * Grow the read buffer to hold at least want bytes.
+   *
+   * @return false if out of memory.
+   */
+  bool growReadBuffer(uint32_t want);
+
+  /// Whether requests are processed concurrently and answered out of order
+  bool concurrent_;
+
+  /// Requests dispatched but not yet answered, when processed concurrently
+  uint32_t numInFlight_;
+
+  /// Has the peer stopped sending requests?
+  bool peerClosed_;
+
+  /// Close once no request is in flight, without sending anything more
+  bool closing_;
+
+  /// Guards finished_
+  Mutex finishedMutex_;
+
+  /// Requests processed by the thread manager, waiting to be answered
+  std::vector<Request*> finished_;
+
+  /// Requests taken from finished_ by the IO thread
+  std::vector<Request*> finishedTaken_;
+
+  /// Request buffers free for reuse
+  std::vector<Request*> requestPool_;
+
+  /**
+   * Libevent handler when requests are processed concurrently.  Unlike
+   * workSocket() this both reads and writes the socket, as the flags
+   * libevent passed say it is ready to.
+   */
+  void workConcurrent(short which);
+
+  /// Read whatever has arrived on the socket into the read buffer.
+  void readConcurrent();
+
+  /**
+   * Dispatch the whole frames in the read buffer while fewer than the
+   * server's limit are in flight, then keep what is left of the buffer.
+   */
+  void dispatchRequests();
+
+  /**
+   * Copy a frame's request and dispatch it to the thread manager, or
+   * process it here if it calls an inline method.
+   *
+   * @return false if the frame could not be decoded.
+   */
+  bool dispatchRequest(const uint8_t* frame, uint32_t len);
+
+  /// Queue the response to a request for sending, and free the request.
+  void answerRequest(Request* request);
+
+  /// Send as much of the queued responses as the socket will take.
+  void sendResponses();
+
+  /**
+   * Register for the events the connection now waits on, or close it once
+   * it is done with.  Nothing may touch the connection after this.
+   */
+  void settleConcurrent();
+
   /// Go into read mode
   void setRead() {
     setFlags(EV_READ | EV_PERSIST);
@@ -682,18 +1186,40 @@ class TConnection {
   /// Close this connection and free or reset its resources.
   void close();
 
- public:
+  /// Bytes ahead of each response for its frame size and any header
+  uint32_t frameHeaderSize() const {
+    if (server_->isHttp()) {
+      return apache::thrift::transport::THttpServer::RESPONSE_HEADER_SIZE +
+        server_->getHttpContentType().size();
+    }
+    return server_->getFrameCodec() ?
+      apache::thrift::transport::TCompressedFramedTransport::FRAME_HEADER_SIZE : 4;
+  }
 
-  class Task;
+  /**
+   * Parses what has arrived of an HTTP request.  If the request is
+   * malformed, the connection is closed.
+   *
+   * @return true if the whole request is in the read buffer.
+   */
+  bool httpRequestReady();
+
+  /// Puts the HTTP response header in front of the response in writeBuffer_.
+  void writeHttpResponse();
+
+ public:
 
   /// Constructor
-  TConnection(int socket, short eventFlags, TNonblockingServer *s) {
+  TConnection(int socket, TNonblockingServer *s, TNonblockingIOThread* ioThread) {
     readBuffer_ = (uint8_t*)std::malloc(STARTING_CONNECTION_BUFFER_SIZE);
     if (readBuffer_ == NULL) {
       throw new apache::thrift::TException("Out of memory.");
     }
     readBufferSize_ = STARTING_CONNECTION_BUFFER_SIZE;
 
+    frameBuffer_ = NULL;
+    frameBufferSize_ = 0;
+
     numReadsSinceReset_ = 0;
     numWritesSinceReset_ = 0;
 
@@ -702,25 +1228,28 @@ class TConnection {
     // reallocated on init() call)
     inputTransport_ = boost::shared_ptr<TMemoryBuffer>(new TMemoryBuffer(readBuffer_, readBufferSize_));
     outputTransport_ = boost::shared_ptr<TMemoryBuffer>(new TMemoryBuffer());
+    peekTransport_ = boost::shared_ptr<TMemoryBuffer>(new TMemoryBuffer());
+    coalescedResponses_ = boost::shared_ptr<TMemoryBuffer>(new TMemoryBuffer());
 
-    init(socket, eventFlags, s);
+    init(socket, s, ioThread);
     server_->incrementNumConnections();
   }
 
-  ~TConnection() {
-    std::free(readBuffer_);
-    server_->decrementNumConnections();
-  }
+  ~TConnection();
 
   /**
    * Check read buffer against a given limit and shrink it if exceeded.
    *
    * @param limit we limit buffer size to.
+   * @return false if the read buffer could not be shrunk.
    */
-  void checkIdleBufferMemLimit(size_t limit);
+  bool checkIdleBufferMemLimit(size_t limit);
 
-  /// Initialize
-  void init(int socket, short eventFlags, TNonblockingServer *s);
+  /**
+   * Initialize, in APP_INIT state with no events registered, so that the
+   * first transition() starts reading in the IO thread.
+   */
+  void init(int socket, TNonblockingServer *s, TNonblockingIOThread* ioThread);
 
   /**
    * This is called when the application transitions from one state into
@@ -731,70 +1260,61 @@ class TConnection {
 
   /**
    * C-callable event handler for connection events.  Provides a callback
-   * that libevent can understand which invokes connection_->workSocket().
+   * that libevent can understand which invokes connection_->workSocket(),
+   * or workConcurrent() when requests are processed concurrently.
    *
    * @param fd the descriptor the event occured on.
    * @param which the flags associated with the event.
    * @param v void* callback arg where we placed TConnection's "this".
    */
-  static void eventHandler(int fd, short /* which */, void* v) {
-    assert(fd == ((TConnection*)v)->socket_);
-    ((TConnection*)v)->workSocket();
-  }
-
-  /**
-   * C-callable event handler for signaling task completion.  Provides a
-   * callback that libevent can understand that will read a connection
-   * object's address from a pipe and call connection->transition() for
-   * that object.
-   *
-   * @param fd the descriptor the event occured on.
-   */
-  static void taskHandler(int fd, short /* which */, void* /* v */) {
-    TConnection* connection;
-    ssize_t nBytes;
-    while ((nBytes = read(fd, (void*)&connection, sizeof(TConnection*)))
-        == sizeof(TConnection*)) {
-      connection->transition();
-    }
-    if (nBytes > 0) {
-      throw TException("TConnection::taskHandler unexpected partial read");
-    }
-    if (errno != EWOULDBLOCK && errno != EAGAIN) {
-      GlobalOutput.perror("TConnection::taskHandler read failed, resource leak", errno);
+  static void eventHandler(int fd, short which, void* v) {
+    TConnection* connection = (TConnection*)v;
+    assert(fd == connection->socket_);
+    if (connection->concurrent_) {
+      connection->workConcurrent(which);
+    } else {
+      connection->workSocket();
     }
   }
 
   /**
-   * Notification to server that processing has ended on this request.
+   * Notification to the IO thread that processing has ended on this request.
    * Can be called either when processing is completed or when a waiting
    * task has been preemptively terminated (on overload).
    *
    * @return true if successful, false if unable to notify (check errno).
    */
   bool notifyServer() {
-    TConnection* connection = this;
-    if (write(server_->getNotificationSendFD(), (const void*)&connection,
-             sizeof(TConnection*)) != sizeof(TConnection*)) {
-      return false;
-    }
-
-    return true;
+    return ioThread_->notify(this);
   }
 
-  /// Force connection shutdown for this connection.
-  void forceClose() {
-    appState_ = APP_CLOSE_CONNECTION;
-    if (!notifyServer()) {
-      throw TException("TConnection::forceClose: failed write on notify pipe");
-    }
-  }
+  /**
+   * Force connection shutdown for this connection.  With requests processed
+   * concurrently, the request is dropped and the connection closed once no
+   * other is in flight.
+   *
+   * @param request the task's request, or NULL if not processed concurrently.
+   */
+  void forceClose(Request* request = NULL);
+
+  /**
+   * Hand a request the thread manager has processed back to the IO thread,
+   * which sends its response.  Called by the task's thread.
+   *
+   * @param request the request, its response written.
+   */
+  void requestFinished(Request* request);
 
   /// return the server this connection was initialized for.
   TNonblockingServer* getServer() {
     return server_;
   }
 
+  /// return the IO thread that handles this connection.
+  TNonblockingIOThread* getIOThread() {
+    return ioThread_;
+  }
+
   /// get state of connection.
   TAppState getState() {
     return appState_;
@@ -177,6 +177,21 @@ protected:
 
   boost::shared_ptr<TServerEventHandler> eventHandler_;
 
+  /**
+   * Wraps an accepted client's transport for input and output, letting a
+   * factory that makes both pair them up.
+   */
+  void getTransports(boost::shared_ptr<TTransport> client,
+                     boost::shared_ptr<TTransport>& input,
+                     boost::shared_ptr<TTransport>& output) {
+    if (inputTransportFactory_ == outputTransportFactory_) {
+      inputTransportFactory_->getTransports(client, input, output);
+    } else {
+      input = inputTransportFactory_->getTransport(client);
+      output = outputTransportFactory_->getTransport(client);
+    }
+  }
+
 public:
   void setInputTransportFactory(boost::shared_ptr<TTransportFactory> inputTransportFactory) {
     inputTransportFactory_ = inputTransportFactory;
@@ -59,8 +59,7 @@ void TSimpleServer::serve() {
   while (!stop_) {
     try {
       client = serverTransport_->accept();
-      inputTransport = inputTransportFactory_->getTransport(client);
-      outputTransport = outputTransportFactory_->getTransport(client);
+      getTransports(client, inputTransport, outputTransport);
       inputProtocol = inputProtocolFactory_->getProtocol(inputTransport);
       outputProtocol = outputProtocolFactory_->getProtocol(outputTransport);
       if (eventHandler_ != NULL) {
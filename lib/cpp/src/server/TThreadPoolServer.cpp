@@ -161,8 +161,7 @@ void TThreadPoolServer::serve() {
       client = serverTransport_->accept();
 
       // Make IO transports
-      inputTransport = inputTransportFactory_->getTransport(client);
-      outputTransport = outputTransportFactory_->getTransport(client);
+      getTransports(client, inputTransport, outputTransport);
       inputProtocol = inputProtocolFactory_->getProtocol(inputTransport);
       outputProtocol = outputProtocolFactory_->getProtocol(outputTransport);
 
@@ -165,8 +165,7 @@ void TThreadedServer::serve() {
       client = serverTransport_->accept();
 
       // Make IO transports
-      inputTransport = inputTransportFactory_->getTransport(client);
-      outputTransport = outputTransportFactory_->getTransport(client);
+      getTransports(client, inputTransport, outputTransport);
       inputProtocol = inputProtocolFactory_->getProtocol(inputTransport);
       outputProtocol = outputProtocolFactory_->getProtocol(outputTransport);
 
@@ -0,0 +1,233 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <cstring>
+
+#include <transport/TBufferPool.h>
+
+namespace apache { namespace thrift { namespace transport {
+
+using apache::thrift::concurrency::Guard;
+
+const uint32_t TBufferPool::MIN_BUFFER_SIZE;
+const uint32_t TBufferPool::MAX_BUFFER_SIZE;
+const uint32_t TBufferPool::DEFAULT_MAX_RETAINED_BYTES;
+const uint32_t TBufferPool::DEFAULT_THREAD_CACHE_BYTES;
+
+TBufferPool::TBufferPool(uint32_t maxRetainedBytes, uint32_t threadCacheBytes)
+  : maxRetainedBytes_(maxRetainedBytes)
+  , threadCacheBytes_(threadCacheBytes)
+  , freeBytes_(0)
+  , caches_(NULL)
+  , hits_(0)
+  , misses_(0)
+{
+  if (pthread_key_create(&cacheKey_, releaseThreadCache) != 0) {
+    throw TException("TBufferPool: pthread_key_create failed");
+  }
+}
+
+TBufferPool::~TBufferPool() {
+  // No thread cache is released after this
+  pthread_key_delete(cacheKey_);
+  while (caches_ != NULL) {
+    freeThreadCache(caches_, false);
+  }
+
+  for (int c = 0; c < NUM_CLASSES; ++c) {
+    for (size_t i = 0; i < free_[c].size(); ++i) {
+      delete[] free_[c][i];
+    }
+  }
+}
+
+boost::shared_ptr<TBufferPool> TBufferPool::getDefaultPool() {
+  // Leaked, so that threads still running at exit can return buffers
+  static boost::shared_ptr<TBufferPool>* pool =
+    new boost::shared_ptr<TBufferPool>(new TBufferPool());
+  return *pool;
+}
+
+uint64_t TBufferPool::getHits() const {
+  Guard g(mutex_);
+  uint64_t hits = hits_;
+  for (ThreadCache* cache = caches_; cache != NULL; cache = cache->next) {
+    hits += cache->hits;
+  }
+  return hits;
+}
+
+uint64_t TBufferPool::getRetainedBytes() const {
+  Guard g(mutex_);
+  uint64_t bytes = freeBytes_;
+  for (ThreadCache* cache = caches_; cache != NULL; cache = cache->next) {
+    bytes += cache->bytes;
+  }
+  return bytes;
+}
+
+int TBufferPool::sizeClass(uint32_t size) {
+  if (size <= MIN_BUFFER_SIZE) {
+    return 0;
+  }
+  // The number of bits in size - 1, less those of MIN_BUFFER_SIZE - 1
+  return (32 - __builtin_clz(size - 1)) - MIN_SHIFT;
+}
+
+TBufferPool::ThreadCache* TBufferPool::threadCache() {
+  ThreadCache* cache = static_cast<ThreadCache*>(pthread_getspecific(cacheKey_));
+  if (cache == NULL) {
+    cache = new ThreadCache();
+    cache->pool = this;
+    cache->prev = NULL;
+    cache->bytes = 0;
+    cache->hits = 0;
+    {
+      Guard g(mutex_);
+      cache->next = caches_;
+      if (caches_ != NULL) {
+        caches_->prev = cache;
+      }
+      caches_ = cache;
+    }
+    pthread_setspecific(cacheKey_, cache);
+  }
+  return cache;
+}
+
+uint8_t* TBufferPool::get(uint32_t* size) {
+  if (*size > MAX_BUFFER_SIZE) {
+    __sync_fetch_and_add(&misses_, 1);
+    return new uint8_t[*size];
+  }
+
+  int c = sizeClass(*size);
+  uint32_t classSize = MIN_BUFFER_SIZE << c;
+  *size = classSize;
+
+  ThreadCache* cache = threadCache();
+  if (!cache->buffers[c].empty()) {
+    uint8_t* buf = cache->buffers[c].back();
+    cache->buffers[c].pop_back();
+    cache->bytes -= classSize;
+    ++cache->hits;
+    return buf;
+  }
+
+  {
+    Guard g(mutex_);
+    if (!free_[c].empty()) {
+      uint8_t* buf = free_[c].back();
+      free_[c].pop_back();
+      freeBytes_ -= classSize;
+      ++hits_;
+      return buf;
+    }
+  }
+
+  __sync_fetch_and_add(&misses_, 1);
+  return new uint8_t[classSize];
+}
+
+void TBufferPool::put(uint8_t* buf, uint32_t size) {
+  if (buf == NULL) {
+    return;
+  }
+
+  // Only buffers of a class size can be handed out again
+  int c = sizeClass(size);
+  if (size > MAX_BUFFER_SIZE || size != (MIN_BUFFER_SIZE << c)) {
+    delete[] buf;
+    return;
+  }
+
+  ThreadCache* cache = threadCache();
+  if (cache->bytes + size <= threadCacheBytes_) {
+    cache->buffers[c].push_back(buf);
+    cache->bytes += size;
+    return;
+  }
+
+  Guard g(mutex_);
+  putFree(buf, c);
+}
+
+void TBufferPool::putFree(uint8_t* buf, int c) {
+  uint32_t size = MIN_BUFFER_SIZE << c;
+  if (freeBytes_ + size <= maxRetainedBytes_) {
+    free_[c].push_back(buf);
+    freeBytes_ += size;
+  } else {
+    delete[] buf;
+  }
+}
+
+void TBufferPool::freeThreadCache(ThreadCache* cache, bool keepBuffers) {
+  Guard g(mutex_);
+  if (cache->prev != NULL) {
+    cache->prev->next = cache->next;
+  } else {
+    caches_ = cache->next;
+  }
+  if (cache->next != NULL) {
+    cache->next->prev = cache->prev;
+  }
+
+  hits_ += cache->hits;
+  for (int c = 0; c < NUM_CLASSES; ++c) {
+    for (size_t i = 0; i < cache->buffers[c].size(); ++i) {
+      if (keepBuffers) {
+        putFree(cache->buffers[c][i], c);
+      } else {
+        delete[] cache->buffers[c][i];
+      }
+    }
+  }
+  delete cache;
+}
+
+void TBufferPool::releaseThreadCache(void* arg) {
+  // Hand the cache of an exiting thread over to other threads
+  ThreadCache* cache = static_cast<ThreadCache*>(arg);
+  cache->pool->freeThreadCache(cache, true);
+}
+
+
+void TPooledBuffer::resize(uint32_t size, uint32_t keep) {
+  uint32_t newSize = size;
+  uint8_t* newBuf = pool_ ? pool_->get(&newSize) : new uint8_t[newSize];
+  if (keep > 0) {
+    memcpy(newBuf, buf_, keep);
+  }
+  release();
+  buf_ = newBuf;
+  size_ = newSize;
+}
+
+void TPooledBuffer::release() {
+  if (pool_) {
+    pool_->put(buf_, size_);
+  } else {
+    delete[] buf_;
+  }
+  buf_ = NULL;
+  size_ = 0;
+}
+
+}}} // apache::thrift::transport
@@ -0,0 +1,180 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TBUFFERPOOL_H_
+#define _THRIFT_TRANSPORT_TBUFFERPOOL_H_ 1
+
+#include <pthread.h>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <Thrift.h>
+#include <concurrency/Mutex.h>
+
+namespace apache { namespace thrift { namespace transport {
+
+/**
+ * A pool of transport buffers in power-of-two size classes, so that
+ * short-lived transports, such as those a server creates for every
+ * connection, reuse their buffers instead of allocating them.
+ *
+ * Each thread keeps a small cache of its own, which is served from and
+ * returned to without locking or atomic operations.  Past that, buffers
+ * go to a global free list bounded by the number of bytes it may retain,
+ * and anything more is freed.  A thread's cache moves to the free list
+ * when the thread exits.  Buffers larger than MAX_BUFFER_SIZE are never
+ * pooled.
+ *
+ * A pool must outlive the threads that use it, or they must no longer
+ * use it when it is destroyed.
+ */
+class TBufferPool : boost::noncopyable {
+ public:
+  static const uint32_t MIN_BUFFER_SIZE = 512;
+  static const uint32_t MAX_BUFFER_SIZE = 1024 * 1024;
+  static const uint32_t DEFAULT_MAX_RETAINED_BYTES = 16 * 1024 * 1024;
+  static const uint32_t DEFAULT_THREAD_CACHE_BYTES = 256 * 1024;
+
+  TBufferPool(uint32_t maxRetainedBytes = DEFAULT_MAX_RETAINED_BYTES,
+              uint32_t threadCacheBytes = DEFAULT_THREAD_CACHE_BYTES);
+
+  ~TBufferPool();
+
+  /**
+   * Returns a buffer of at least *size bytes, allocated with new[], and
+   * sets *size to its actual size.
+   */
+  uint8_t* get(uint32_t* size);
+
+  /**
+   * Takes back a buffer of the given actual size.
+   */
+  void put(uint8_t* buf, uint32_t size);
+
+  /**
+   * Buffers handed out from a cache or the free list.  The counts of
+   * running threads are read without synchronization, so are approximate.
+   */
+  uint64_t getHits() const;
+
+  /// Buffers that had to be allocated.
+  uint64_t getMisses() const {
+    return misses_;
+  }
+
+  /// Bytes held in thread caches and the free list, also approximate.
+  uint64_t getRetainedBytes() const;
+
+  /**
+   * The pool that TBufferedTransportFactory and TFramedTransportFactory
+   * draw from unless given another.  It is never destroyed.
+   */
+  static boost::shared_ptr<TBufferPool> getDefaultPool();
+
+ private:
+  static const int MIN_SHIFT = 9;
+  static const int MAX_SHIFT = 20;
+  static const int NUM_CLASSES = MAX_SHIFT - MIN_SHIFT + 1;
+
+  struct ThreadCache {
+    TBufferPool* pool;
+    ThreadCache* prev;
+    ThreadCache* next;
+    uint32_t bytes;
+    uint64_t hits;
+    std::vector<uint8_t*> buffers[NUM_CLASSES];
+  };
+
+  static int sizeClass(uint32_t size);
+  ThreadCache* threadCache();
+  // Called with mutex_ held
+  void putFree(uint8_t* buf, int sizeClass);
+  void freeThreadCache(ThreadCache* cache, bool keepBuffers);
+  static void releaseThreadCache(void* cache);
+
+  uint32_t maxRetainedBytes_;
+  uint32_t threadCacheBytes_;
+  pthread_key_t cacheKey_;
+
+  // Guards the free list, the list of thread caches and hits_
+  apache::thrift::concurrency::Mutex mutex_;
+  std::vector<uint8_t*> free_[NUM_CLASSES];
+  uint64_t freeBytes_;
+  ThreadCache* caches_;
+
+  // Hits on the free list and in the caches of exited threads
+  uint64_t hits_;
+  volatile uint64_t misses_;
+};
+
+/**
+ * A transport buffer that comes from a TBufferPool, or from new[] when
+ * there is no pool, and goes back there when it is replaced or destroyed.
+ */
+class TPooledBuffer : boost::noncopyable {
+ public:
+  TPooledBuffer(const boost::shared_ptr<TBufferPool>& pool, uint32_t size)
+    : pool_(pool)
+    , buf_(NULL)
+    , size_(0)
+  {
+    resize(size, 0);
+  }
+
+  ~TPooledBuffer() {
+    release();
+  }
+
+  uint8_t* get() const {
+    return buf_;
+  }
+
+  /// The actual size, which the pool may have rounded up.
+  uint32_t size() const {
+    return size_;
+  }
+
+  const boost::shared_ptr<TBufferPool>& getPool() const {
+    return pool_;
+  }
+
+  /**
+   * Replaces the buffer with one of at least size bytes that starts with
+   * the first keep bytes of the old one.
+   */
+  void resize(uint32_t size, uint32_t keep);
+
+  void swap(TPooledBuffer& other) {
+    pool_.swap(other.pool_);
+    std::swap(buf_, other.buf_);
+    std::swap(size_, other.size_);
+  }
+
+ private:
+  void release();
+
+  boost::shared_ptr<TBufferPool> pool_;
+  uint8_t* buf_;
+  uint32_t size_;
+};
+
+}}} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TBUFFERPOOL_H_
@@ -41,11 +41,19 @@ uint32_t TBufferedTransport::readSlow(uint8_t* buf, uint32_t len) {
     want -= have;
     buf += have;
   }
+  // Reads that would fill the buffer go straight into buf rather than
+  // through the buffer a piece at a time.
+  if (want >= rBufSize_) {
+    setReadBuffer(rBuf_.get(), 0);
+    uint32_t got = transport_->read(buf, want);
+    rFilled_ += got;
+    return have + got;
+  }
+
   // Get more from underlying transport up to buffer size.
-  // Note that this makes a lot of sense if len < rBufSize_
-  // and almost no sense otherwise.  TODO(dreiss): Fix that
-  // case (possibly including some readv hotness).
-  setReadBuffer(rBuf_.get(), transport_->read(rBuf_.get(), rBufSize_));
+  uint32_t got = transport_->read(rBuf_.get(), rBufSize_);
+  rFilled_ += got;
+  setReadBuffer(rBuf_.get(), got);
 
   // Hand over whatever we have.
   uint32_t give = std::min(want, static_cast<uint32_t>(rBound_ - rBase_));
@@ -82,12 +90,19 @@ void TBufferedTransport::writeSlow(const uint8_t* buf, uint32_t len) {
   // The case where we have to do two syscalls.
   // This case also covers the case where the buffer is empty,
   // but it is clearer (I think) to think of it as two separate cases.
+  // Both go out in one writev() where the underlying transport allows.
   if ((have_bytes + len >= 2*wBufSize_) || (have_bytes == 0)) {
-    // TODO(dreiss): writev
     if (have_bytes > 0) {
-      transport_->write(wBuf_.get(), have_bytes);
+      struct iovec iov[2];
+      iov[0].iov_base = wBuf_.get();
+      iov[0].iov_len = have_bytes;
+      iov[1].iov_base = const_cast<uint8_t*>(buf);
+      iov[1].iov_len = len;
+      transport_->writev(iov, 2);
+    } else {
+      transport_->write(buf, len);
     }
-    transport_->write(buf, len);
+    wWritten_ += have_bytes + len;
     wBase_ = wBuf_.get();
     return;
   }
@@ -97,6 +112,7 @@ void TBufferedTransport::writeSlow(const uint8_t* buf, uint32_t len) {
   buf += space;
   len -= space;
   transport_->write(wBuf_.get(), wBufSize_);
+  wWritten_ += wBufSize_;
 
   // Copy the rest into our buffer.
   assert(len < wBufSize_);
@@ -138,8 +154,11 @@ const uint8_t* TBufferedTransport::borrowSlow(uint8_t* buf, uint32_t* len) {
 
   // If that fails, readAll until we get what we need.
   if (need > 0) {
-    rBound_ += transport_->readAll(rBound_, need);
+    uint32_t more = transport_->readAll(rBound_, need);
+    rBound_ += more;
+    got += more;
   }
+  rFilled_ += got;
 
   *len = rBound_ - rBase_;
   return rBase_;
@@ -158,6 +177,103 @@ void TBufferedTransport::flush()  {
 
   // Flush the underlying transport.
   transport_->flush();
+
+  uint32_t message = wWritten_ + have_bytes;
+  wWritten_ = 0;
+  if (adaptive_ && message > 0 && wSizes_.record(message)) {
+    // The buffer is empty, so it can simply be replaced
+    uint32_t size = adaptSize(wSizes_, wBufSize_);
+    if (size > 0) {
+      if (size > wBufSize_) {
+        ++grows_;
+      } else {
+        ++shrinks_;
+      }
+      wBuf_.resize(size, 0);
+      wBufSize_ = wBuf_.size();
+      setWriteBuffer(wBuf_.get(), wBufSize_);
+    }
+  }
+}
+
+void TBufferedTransport::readEnd() {
+  uint32_t have = rBound_ - rBase_;
+  uint64_t consumed = rFilled_ - have;
+  uint32_t message = consumed - rMark_;
+  rMark_ = consumed;
+  if (adaptive_ && message > 0 && rSizes_.record(message)) {
+    // Keep whatever of the next message has been read already
+    uint32_t size = adaptSize(rSizes_, rBufSize_);
+    if (size > 0 && have <= size) {
+      if (size > rBufSize_) {
+        ++grows_;
+      } else {
+        ++shrinks_;
+      }
+      memmove(rBuf_.get(), rBase_, have);
+      rBuf_.resize(size, have);
+      rBufSize_ = rBuf_.size();
+      setReadBuffer(rBuf_.get(), have);
+    }
+  }
+}
+
+void TBufferedTransport::setAdaptive(uint32_t minSize, uint32_t maxSize, uint32_t percentile) {
+  adaptive_ = true;
+  minSize_ = minSize;
+  maxSize_ = std::max(minSize, maxSize);
+  rSizes_ = TMessageSizeTracker(percentile);
+  wSizes_ = TMessageSizeTracker(percentile);
+}
+
+uint32_t TBufferedTransport::adaptSize(const TMessageSizeTracker& sizes, uint32_t size) const {
+  uint32_t target = std::min(std::max(sizes.getEstimate(), minSize_), maxSize_);
+  if (target > size || target <= size / 4) {
+    return target;
+  }
+  return 0;
+}
+
+
+TMessageSizeTracker::TMessageSizeTracker(uint32_t percentile, uint32_t window)
+  : total_(0)
+  , percentile_(std::min(percentile, 100u))
+  , window_(std::max(window, 1u))
+  , windowCount_(0)
+  , estimate_(0)
+  , maxSize_(0)
+  , messages_(0)
+{
+  memset(counts_, 0, sizeof(counts_));
+}
+
+bool TMessageSizeTracker::record(uint32_t size) {
+  // Class c holds sizes up to 2^c
+  int c = (size <= 1) ? 0 : 32 - __builtin_clz(size - 1);
+  ++counts_[c];
+  ++total_;
+  ++messages_;
+  maxSize_ = std::max(maxSize_, size);
+
+  if (++windowCount_ < window_) {
+    return false;
+  }
+  windowCount_ = 0;
+
+  // Find the class the percentile falls in, then age the counts
+  uint64_t wanted = ((uint64_t)total_ * percentile_ + 99) / 100;
+  uint64_t seen = 0;
+  for (c = 0; c < NUM_CLASSES - 1 && seen + counts_[c] < wanted; ++c) {
+    seen += counts_[c];
+  }
+  estimate_ = (c >= 32) ? 0xFFFFFFFF : (1u << c);
+
+  total_ = 0;
+  for (int i = 0; i < NUM_CLASSES; ++i) {
+    counts_[i] /= 2;
+    total_ += counts_[i];
+  }
+  return true;
 }
 
 
@@ -205,37 +321,56 @@ void TFramedTransport::readFrame() {
 
   // Read the frame payload, and reset markers.
   if (sz > static_cast<int32_t>(rBufSize_)) {
-    rBuf_.reset(new uint8_t[sz]);
-    rBufSize_ = sz;
+    rBuf_.resize(sz, 0);
+    rBufSize_ = rBuf_.size();
   }
   transport_->readAll(rBuf_.get(), sz);
   setReadBuffer(rBuf_.get(), sz);
 }
 
 void TFramedTransport::writeSlow(const uint8_t* buf, uint32_t len) {
+  // Large writes can be left where they are until flush().
+  if (wRefThreshold_ > 0 && len >= wRefThreshold_) {
+    WriteRef ref;
+    ref.offset = wBase_ - wBuf_.get();
+    ref.buf = buf;
+    ref.len = len;
+    wRefs_.push_back(ref);
+    wRefBytes_ += len;
+    return;
+  }
+
   // Double buffer size until sufficient.
   uint32_t have = wBase_ - wBuf_.get();
-  while (wBufSize_ < len + have) {
-    wBufSize_ *= 2;
+  uint32_t new_size = wBufSize_;
+  while (new_size < len + have) {
+    new_size *= 2;
   }
+  resizeWriteBuffer(new_size);
 
-  // TODO(dreiss): Consider modifying this class to use malloc/free
-  // so we can use realloc here.
+  // Copy the data into the new buffer.
+  memcpy(wBase_, buf, len);
+  wBase_ += len;
+}
 
-  // Allocate new buffer.
-  uint8_t* new_buf = new uint8_t[wBufSize_];
+void TFramedTransport::reserve(uint32_t len) {
+  if (wRefThreshold_ > 0) {
+    len = std::min(len, wRefThreshold_);
+  }
+  if (len <= (uint32_t)(wBound_ - wBase_)) {
+    return;
+  }
+  resizeWriteBuffer((wBase_ - wBuf_.get()) + len);
+}
 
-  // Copy the old buffer to the new one.
-  memcpy(new_buf, wBuf_.get(), have);
+void TFramedTransport::resizeWriteBuffer(uint32_t size) {
+  uint32_t have = wBase_ - wBuf_.get();
 
-  // Now point buf to the new one.
-  wBuf_.reset(new_buf);
+  // Move into a new buffer, returning the old one to the pool.
+  wBuf_.resize(size, have);
+  wBufSize_ = wBuf_.size();
   wBase_ = wBuf_.get() + have;
   wBound_ = wBuf_.get() + wBufSize_;
-
-  // Copy the data into the new buffer.
-  memcpy(wBase_, buf, len);
-  wBase_ += len;
 }
 
 void TFramedTransport::flush()  {
@@ -243,7 +378,8 @@ void TFramedTransport::flush()  {
   assert(wBufSize_ > sizeof(sz_nbo));
 
   // Slip the frame size into the start of the buffer.
-  sz_hbo = wBase_ - (wBuf_.get() + sizeof(sz_nbo));
+  uint32_t have = wBase_ - wBuf_.get();
+  sz_hbo = have - sizeof(sz_nbo) + wRefBytes_;
   sz_nbo = (int32_t)htonl((uint32_t)(sz_hbo));
   memcpy(wBuf_.get(), (uint8_t*)&sz_nbo, sizeof(sz_nbo));
 
@@ -254,8 +390,33 @@ void TFramedTransport::flush()  {
     // up an exception
     wBase_ = wBuf_.get() + sizeof(sz_nbo);
 
-    // Write size and frame body.
-    transport_->write(wBuf_.get(), sizeof(sz_nbo)+sz_hbo);
+    if (wRefs_.empty()) {
+      // Write size and frame body.
+      transport_->write(wBuf_.get(), sizeof(sz_nbo)+sz_hbo);
+    } else {
+      // Interleave the buffered bytes with the referenced writes.
+      std::vector<struct iovec> iov;
+      iov.reserve(2 * wRefs_.size() + 1);
+      uint32_t pos = 0;
+      for (std::vector<WriteRef>::const_iterator it = wRefs_.begin();
+           it != wRefs_.end(); ++it) {
+        if (it->offset > pos) {
+          struct iovec v = { wBuf_.get() + pos, it->offset - pos };
+          iov.push_back(v);
+          pos = it->offset;
+        }
+        struct iovec v = { const_cast<uint8_t*>(it->buf), it->len };
+        iov.push_back(v);
+      }
+      if (have > pos) {
+        struct iovec v = { wBuf_.get() + pos, have - pos };
+        iov.push_back(v);
+      }
+      wRefs_.clear();
+      wRefBytes_ = 0;
+
+      transport_->writev(&iov[0], iov.size());
+    }
   }
 
   // Flush the underlying transport.
@@ -323,14 +484,26 @@ void TMemoryBuffer::ensureCanWrite(uint32_t len) {
   }
 
   // Grow the buffer as necessary.
+  uint32_t new_size = bufferSize_;
   while (len > avail) {
-    bufferSize_ *= 2;
-    wBound_ = buffer_ + bufferSize_;
-    avail = available_write();
+    new_size *= 2;
+    avail = new_size - (wBase_ - buffer_);
+  }
+  resizeBuffer(new_size);
+}
+
+void TMemoryBuffer::reserve(uint32_t len) {
+  // Only a hint; an external buffer cannot grow, and any write that does
+  // not fit fails when it is made.
+  if (len <= available_write() || !owner_) {
+    return;
   }
+  resizeBuffer((wBase_ - buffer_) + len);
+}
 
+void TMemoryBuffer::resizeBuffer(uint32_t size) {
   // Allocate into a new pointer so we don't bork ours if it fails.
-  void* new_buffer = std::realloc(buffer_, bufferSize_);
+  void* new_buffer = std::realloc(buffer_, size);
   if (new_buffer == NULL) {
     throw TTransportException("Out of memory.");
   }
@@ -340,7 +513,8 @@ void TMemoryBuffer::ensureCanWrite(uint32_t len) {
   rBase_ += offset;
   rBound_ += offset;
   wBase_ += offset;
-  wBound_ += offset;
+  bufferSize_ = size;
+  wBound_ = buffer_ + bufferSize_;
 }
 
 void TMemoryBuffer::writeSlow(const uint8_t* buf, uint32_t len) {
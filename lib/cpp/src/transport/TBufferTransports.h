@@ -21,9 +21,12 @@
 #define _THRIFT_TRANSPORT_TBUFFERTRANSPORTS_H_ 1
 
 #include <cstring>
+#include <vector>
 #include "boost/scoped_array.hpp"
 
 #include <transport/TTransport.h>
+#include <transport/TBufferPool.h>
+#include <transport/TVirtualTransport.h>
 
 #ifdef __GNUC__
 #define TDB_LIKELY(val) (__builtin_expect((val), 1))
@@ -46,7 +49,7 @@ namespace apache { namespace thrift { namespace transport {
  * that have to be done when the buffers are full or empty.
  *
  */
-class TBufferBase : public TTransport {
+class TBufferBase : public TVirtualTransport<TBufferBase> {
 
  public:
 
@@ -68,6 +71,19 @@ class TBufferBase : public TTransport {
     return readSlow(buf, len);
   }
 
+  /**
+   * Shortcutted version of readAll.
+   */
+  uint32_t readAll(uint8_t* buf, uint32_t len) {
+    uint8_t* new_rBase = rBase_ + len;
+    if (TDB_LIKELY(new_rBase <= rBound_)) {
+      std::memcpy(buf, rBase_, len);
+      rBase_ = new_rBase;
+      return len;
+    }
+    return apache::thrift::transport::readAll(*this, buf, len);
+  }
+
   /**
    * Fast-path write.
    *
@@ -201,29 +217,92 @@ class TUnderlyingTransport : public TBufferBase {
 
   uint32_t rBufSize_;
   uint32_t wBufSize_;
-  boost::scoped_array<uint8_t> rBuf_;
-  boost::scoped_array<uint8_t> wBuf_;
+  TPooledBuffer rBuf_;
+  TPooledBuffer wBuf_;
 
   TUnderlyingTransport(boost::shared_ptr<TTransport> transport, uint32_t sz)
     : transport_(transport)
-    , rBufSize_(sz)
-    , wBufSize_(sz)
-    , rBuf_(new uint8_t[rBufSize_])
-    , wBuf_(new uint8_t[wBufSize_]) {}
+    , rBuf_(boost::shared_ptr<TBufferPool>(), sz)
+    , wBuf_(boost::shared_ptr<TBufferPool>(), sz)
+  {
+    initBufferSizes();
+  }
 
   TUnderlyingTransport(boost::shared_ptr<TTransport> transport)
     : transport_(transport)
-    , rBufSize_(DEFAULT_BUFFER_SIZE)
-    , wBufSize_(DEFAULT_BUFFER_SIZE)
-    , rBuf_(new uint8_t[rBufSize_])
-    , wBuf_(new uint8_t[wBufSize_]) {}
+    , rBuf_(boost::shared_ptr<TBufferPool>(), DEFAULT_BUFFER_SIZE)
+    , wBuf_(boost::shared_ptr<TBufferPool>(), DEFAULT_BUFFER_SIZE)
+  {
+    initBufferSizes();
+  }
 
   TUnderlyingTransport(boost::shared_ptr<TTransport> transport, uint32_t rsz, uint32_t wsz)
     : transport_(transport)
-    , rBufSize_(rsz)
-    , wBufSize_(wsz)
-    , rBuf_(new uint8_t[rBufSize_])
-    , wBuf_(new uint8_t[wBufSize_]) {}
+    , rBuf_(boost::shared_ptr<TBufferPool>(), rsz)
+    , wBuf_(boost::shared_ptr<TBufferPool>(), wsz)
+  {
+    initBufferSizes();
+  }
+
+  /// Draws both buffers from pool, which may round their sizes up.
+  TUnderlyingTransport(boost::shared_ptr<TTransport> transport, uint32_t rsz, uint32_t wsz,
+                       boost::shared_ptr<TBufferPool> pool)
+    : transport_(transport)
+    , rBuf_(pool, rsz)
+    , wBuf_(pool, wsz)
+  {
+    initBufferSizes();
+  }
+
+  void initBufferSizes() {
+    rBufSize_ = rBuf_.size();
+    wBufSize_ = wBuf_.size();
+  }
+};
+
+/**
+ * Keeps a moving estimate of a percentile of the sizes of the messages
+ * going through a transport.  Sizes are counted in power-of-two classes,
+ * and the counts are halved after every window of messages, so that older
+ * messages weigh less and less.
+ */
+class TMessageSizeTracker {
+ public:
+  TMessageSizeTracker(uint32_t percentile = 90, uint32_t window = 64);
+
+  /**
+   * Counts a message of size bytes.
+   *
+   * @return true if this completed a window and updated the estimate.
+   */
+  bool record(uint32_t size);
+
+  /// The smallest power of two that holds the percentile of recent messages.
+  uint32_t getEstimate() const {
+    return estimate_;
+  }
+
+  /// The number of messages counted so far.
+  uint64_t getMessages() const {
+    return messages_;
+  }
+
+  /// The largest message counted so far.
+  uint32_t getMaxSize() const {
+    return maxSize_;
+  }
+
+ private:
+  static const int NUM_CLASSES = 33;
+
+  uint32_t counts_[NUM_CLASSES];
+  uint32_t total_;
+  uint32_t percentile_;
+  uint32_t window_;
+  uint32_t windowCount_;
+  uint32_t estimate_;
+  uint32_t maxSize_;
+  uint64_t messages_;
 };
 
 /**
@@ -231,6 +310,8 @@ class TUnderlyingTransport : public TBufferBase {
  * and will serve future data out of a local buffer. For writes, data is
  * stored to an in memory buffer before being written out.
  *
+ * In adaptive mode the buffers are resized to fit most of the messages
+ * going through them; see setAdaptive().
  */
 class TBufferedTransport : public TUnderlyingTransport {
  public:
@@ -238,6 +319,14 @@ class TBufferedTransport : public TUnderlyingTransport {
   /// Use default buffer sizes.
   TBufferedTransport(boost::shared_ptr<TTransport> transport)
     : TUnderlyingTransport(transport)
+    , adaptive_(false)
+    , minSize_(0)
+    , maxSize_(0)
+    , rFilled_(0)
+    , rMark_(0)
+    , wWritten_(0)
+    , grows_(0)
+    , shrinks_(0)
   {
     initPointers();
   }
@@ -245,6 +334,14 @@ class TBufferedTransport : public TUnderlyingTransport {
   /// Use specified buffer sizes.
   TBufferedTransport(boost::shared_ptr<TTransport> transport, uint32_t sz)
     : TUnderlyingTransport(transport, sz)
+    , adaptive_(false)
+    , minSize_(0)
+    , maxSize_(0)
+    , rFilled_(0)
+    , rMark_(0)
+    , wWritten_(0)
+    , grows_(0)
+    , shrinks_(0)
   {
     initPointers();
   }
@@ -252,6 +349,30 @@ class TBufferedTransport : public TUnderlyingTransport {
   /// Use specified read and write buffer sizes.
   TBufferedTransport(boost::shared_ptr<TTransport> transport, uint32_t rsz, uint32_t wsz)
     : TUnderlyingTransport(transport, rsz, wsz)
+    , adaptive_(false)
+    , minSize_(0)
+    , maxSize_(0)
+    , rFilled_(0)
+    , rMark_(0)
+    , wWritten_(0)
+    , grows_(0)
+    , shrinks_(0)
+  {
+    initPointers();
+  }
+
+  /// Draw the buffers from a pool and return them to it when destroyed.
+  TBufferedTransport(boost::shared_ptr<TTransport> transport, uint32_t rsz, uint32_t wsz,
+                     boost::shared_ptr<TBufferPool> pool)
+    : TUnderlyingTransport(transport, rsz, wsz, pool)
+    , adaptive_(false)
+    , minSize_(0)
+    , maxSize_(0)
+    , rFilled_(0)
+    , rMark_(0)
+    , wWritten_(0)
+    , grows_(0)
+    , shrinks_(0)
   {
     initPointers();
   }
@@ -259,7 +380,9 @@ class TBufferedTransport : public TUnderlyingTransport {
   virtual bool peek() {
     /* shigin: see THRIFT-96 discussion */
     if (rBase_ == rBound_) {
-      setReadBuffer(rBuf_.get(), transport_->read(rBuf_.get(), rBufSize_));
+      uint32_t got = transport_->read(rBuf_.get(), rBufSize_);
+      rFilled_ += got;
+      setReadBuffer(rBuf_.get(), got);
     }
     return (rBound_ > rBase_);
   }
@@ -269,6 +392,47 @@ class TBufferedTransport : public TUnderlyingTransport {
 
   void flush();
 
+  void readEnd();
+
+  /**
+   * Turns on adaptive buffer sizing.  The sizes of the messages read, up to
+   * each readEnd(), and written, up to each flush(), are tracked, and each
+   * buffer is resized between minSize and maxSize to hold the percentile of
+   * recent messages.  A buffer grows as soon as the estimate outgrows it,
+   * but only shrinks once the estimate fits in a quarter of it, so that
+   * sizes near a boundary don't make it go back and forth.
+   */
+  void setAdaptive(uint32_t minSize, uint32_t maxSize, uint32_t percentile = 90);
+
+  bool isAdaptive() const {
+    return adaptive_;
+  }
+
+  const TMessageSizeTracker& getReadSizes() const {
+    return rSizes_;
+  }
+
+  const TMessageSizeTracker& getWriteSizes() const {
+    return wSizes_;
+  }
+
+  uint32_t getReadBufferSize() const {
+    return rBufSize_;
+  }
+
+  uint32_t getWriteBufferSize() const {
+    return wBufSize_;
+  }
+
+  /// The number of times a buffer has grown or shrunk in adaptive mode.
+  uint32_t getGrows() const {
+    return grows_;
+  }
+
+  uint32_t getShrinks() const {
+    return shrinks_;
+  }
+
 
   /**
    * The following behavior is currently implemented by TBufferedTransport,
@@ -287,8 +451,26 @@ class TBufferedTransport : public TUnderlyingTransport {
   void initPointers() {
     setReadBuffer(rBuf_.get(), 0);
     setWriteBuffer(wBuf_.get(), wBufSize_);
-    // Write size never changes.
+    // Write size only changes in adaptive mode.
   }
+
+  /// The buffer size that suits the estimate from sizes, or 0 to keep size.
+  uint32_t adaptSize(const TMessageSizeTracker& sizes, uint32_t size) const;
+
+  bool adaptive_;
+  uint32_t minSize_;
+  uint32_t maxSize_;
+  TMessageSizeTracker rSizes_;
+  TMessageSizeTracker wSizes_;
+
+  /// Bytes read into the buffer, and consumed up to the last readEnd().
+  uint64_t rFilled_;
+  uint64_t rMark_;
+  /// Bytes written out without going through the buffer since flush().
+  uint32_t wWritten_;
+
+  uint32_t grows_;
+  uint32_t shrinks_;
 };
 
 
@@ -298,17 +480,57 @@ class TBufferedTransport : public TUnderlyingTransport {
  */
 class TBufferedTransportFactory : public TTransportFactory {
  public:
-  TBufferedTransportFactory() {}
+  /**
+   * Buffers come from the default TBufferPool, so that transports created
+   * for short connections reuse them.
+   */
+  TBufferedTransportFactory()
+    : pool_(TBufferPool::getDefaultPool())
+    , minSize_(0)
+    , maxSize_(0)
+    , percentile_(90) {}
+
+  /// Draws buffers from pool, or allocates them if it is NULL.
+  TBufferedTransportFactory(boost::shared_ptr<TBufferPool> pool)
+    : pool_(pool)
+    , minSize_(0)
+    , maxSize_(0)
+    , percentile_(90) {}
 
   virtual ~TBufferedTransportFactory() {}
 
+  /**
+   * Makes the transports adaptive, as by TBufferedTransport::setAdaptive().
+   * A maxSize of zero, the default, turns this off.
+   */
+  void setAdaptive(uint32_t minSize, uint32_t maxSize, uint32_t percentile = 90) {
+    minSize_ = minSize;
+    maxSize_ = maxSize;
+    percentile_ = percentile;
+  }
+
   /**
    * Wraps the transport into a buffered one.
    */
   virtual boost::shared_ptr<TTransport> getTransport(boost::shared_ptr<TTransport> trans) {
-    return boost::shared_ptr<TTransport>(new TBufferedTransport(trans));
+    TBufferedTransport* buffered =
+      new TBufferedTransport(trans,
+                             TUnderlyingTransport::DEFAULT_BUFFER_SIZE,
+                             TUnderlyingTransport::DEFAULT_BUFFER_SIZE,
+                             pool_);
+    boost::shared_ptr<TTransport> result(buffered);
+    if (maxSize_ > 0) {
+      buffered->setAdaptive(minSize_, maxSize_, percentile_);
+    }
+    return result;
   }
 
+ private:
+  boost::shared_ptr<TBufferPool> pool_;
+  uint32_t minSize_;
+  uint32_t maxSize_;
+  uint32_t percentile_;
+
 };
 
 
@@ -325,12 +547,29 @@ class TFramedTransport : public TUnderlyingTransport {
   /// Use default buffer sizes.
   TFramedTransport(boost::shared_ptr<TTransport> transport)
     : TUnderlyingTransport(transport)
+    , wRefThreshold_(0)
+    , wRefBytes_(0)
   {
     initPointers();
   }
 
   TFramedTransport(boost::shared_ptr<TTransport> transport, uint32_t sz)
     : TUnderlyingTransport(transport, sz)
+    , wRefThreshold_(0)
+    , wRefBytes_(0)
+  {
+    initPointers();
+  }
+
+  /**
+   * Draw the frame buffers, including those grown into, from a pool and
+   * return them to it when they are replaced or the transport is destroyed.
+   */
+  TFramedTransport(boost::shared_ptr<TTransport> transport, uint32_t sz,
+                   boost::shared_ptr<TBufferPool> pool)
+    : TUnderlyingTransport(transport, sz, sz, pool)
+    , wRefThreshold_(0)
+    , wRefBytes_(0)
   {
     initPointers();
   }
@@ -341,13 +580,50 @@ class TFramedTransport : public TUnderlyingTransport {
 
   virtual void flush();
 
+  /**
+   * Grows the frame buffer so that len more bytes fit without reallocating.
+   * When writes are being referenced, the buffer is grown by no more than
+   * the reference threshold, so that large writes still take the slow path.
+   */
+  virtual void reserve(uint32_t len);
+
   const uint8_t* borrowSlow(uint8_t* buf, uint32_t* len);
 
+  /**
+   * Writes of at least threshold bytes that don't fit in the frame buffer
+   * are referenced rather than copied, and the frame is sent from the
+   * buffer and the referenced data with one writev() on flush().  The
+   * caller must then leave such data untouched until flush() returns.
+   * Zero, the default, turns this off.
+   */
+  void setWriteRefThreshold(uint32_t threshold) {
+    wRefThreshold_ = threshold;
+  }
+
  protected:
+  /**
+   * A write that is sent from the caller's memory, and the offset in the
+   * frame buffer that it follows.
+   */
+  struct WriteRef {
+    uint32_t offset;
+    const uint8_t* buf;
+    uint32_t len;
+  };
+
+  uint32_t wRefThreshold_;
+  uint32_t wRefBytes_;
+  std::vector<WriteRef> wRefs_;
+
   /**
    * Reads a frame of input from the underlying stream.
    */
-  void readFrame();
+  virtual void readFrame();
+
+  /**
+   * Moves the frame being written into a new buffer of the given size.
+   */
+  void resizeWriteBuffer(uint32_t size);
 
   void initPointers() {
     setReadBuffer(NULL, 0);
@@ -365,7 +641,16 @@ class TFramedTransport : public TUnderlyingTransport {
  */
 class TFramedTransportFactory : public TTransportFactory {
  public:
-  TFramedTransportFactory() {}
+  /**
+   * Buffers come from the default TBufferPool, so that transports created
+   * for short connections reuse them.
+   */
+  TFramedTransportFactory()
+    : pool_(TBufferPool::getDefaultPool()) {}
+
+  /// Draws buffers from pool, or allocates them if it is NULL.
+  TFramedTransportFactory(boost::shared_ptr<TBufferPool> pool)
+    : pool_(pool) {}
 
   virtual ~TFramedTransportFactory() {}
 
@@ -373,9 +658,13 @@ class TFramedTransportFactory : public TTransportFactory {
    * Wraps the transport into a framed one.
    */
   virtual boost::shared_ptr<TTransport> getTransport(boost::shared_ptr<TTransport> trans) {
-    return boost::shared_ptr<TTransport>(new TFramedTransport(trans));
+    return boost::shared_ptr<TTransport>(
+      new TFramedTransport(trans, TUnderlyingTransport::DEFAULT_BUFFER_SIZE, pool_));
   }
 
+ private:
+  boost::shared_ptr<TBufferPool> pool_;
+
 };
 
 
@@ -623,6 +912,11 @@ class TMemoryBuffer : public TBufferBase {
   // that had been provided by getWritePtr().
   void wroteBytes(uint32_t len);
 
+  // Grows the buffer so that 'len' more bytes can be written without
+  // reallocating.  Unlike ordinary writes, this allocates exactly what is
+  // asked for rather than doubling.  Does nothing for an external buffer.
+  virtual void reserve(uint32_t len);
+
  protected:
   void swap(TMemoryBuffer& that) {
     using std::swap;
@@ -640,6 +934,9 @@ class TMemoryBuffer : public TBufferBase {
   // Make sure there's at least 'len' bytes available for writing.
   void ensureCanWrite(uint32_t len);
 
+  // Reallocate the buffer to hold 'size' bytes.
+  void resizeBuffer(uint32_t size);
+
   // Compute the position and available data for reading.
   void computeRead(uint32_t len, uint8_t** out_start, uint32_t* out_give);
 
@@ -0,0 +1,448 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <transport/TCompressedFramedTransport.h>
+
+namespace apache { namespace thrift { namespace transport {
+
+using boost::shared_ptr;
+
+static shared_ptr<TFrameCodec>* newCodecRegistry() {
+  shared_ptr<TFrameCodec>* codecs = new shared_ptr<TFrameCodec>[256];
+  codecs[TLZ4Codec::ID].reset(new TLZ4Codec());
+  return codecs;
+}
+
+static shared_ptr<TFrameCodec>* codecRegistry() {
+  static shared_ptr<TFrameCodec>* codecs = newCodecRegistry();
+  return codecs;
+}
+
+void TFrameCodec::registerCodec(shared_ptr<TFrameCodec> codec) {
+  if (codec->getId() == 0) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TFrameCodec: id 0 is reserved for stored frames");
+  }
+  codecRegistry()[codec->getId()] = codec;
+}
+
+shared_ptr<TFrameCodec> TFrameCodec::getCodec(uint8_t id) {
+  return codecRegistry()[id];
+}
+
+
+// LZ4 block format: a sequence is a token holding a literal count and a
+// match length (less MIN_MATCH) in its high and low nibbles, with 255-byte
+// extensions for either that does not fit, then the literals, then the
+// little-endian match offset.  The last sequence is literals only.
+static const uint32_t LZ4_MIN_MATCH = 4;
+static const uint32_t LZ4_LAST_LITERALS = 5;
+static const uint32_t LZ4_MATCH_FIND_LIMIT = 12;
+static const uint32_t LZ4_MAX_OFFSET = 65535;
+static const int LZ4_MAX_HASH_BITS = 12;
+
+static inline uint32_t read32(const uint8_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline uint32_t lz4Hash(uint32_t v, int bits) {
+  return (v * 2654435761U) >> (32 - bits);
+}
+
+static inline uint8_t* lz4WriteLength(uint8_t* op, uint32_t len) {
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = (uint8_t)len;
+  return op;
+}
+
+static inline uint8_t* lz4WriteLiterals(uint8_t* op, uint8_t matchNibble,
+                                        const uint8_t* lit, uint32_t litLen) {
+  if (litLen >= 15) {
+    *op++ = (uint8_t)(0xf0 | matchNibble);
+    op = lz4WriteLength(op, litLen - 15);
+  } else {
+    *op++ = (uint8_t)((litLen << 4) | matchNibble);
+  }
+  memcpy(op, lit, litLen);
+  return op + litLen;
+}
+
+// Length of the common prefix of a and b, reading no further than limit.
+static inline uint32_t lz4MatchLength(const uint8_t* a, const uint8_t* b,
+                                      const uint8_t* limit) {
+  const uint8_t* start = a;
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  while (a + sizeof(uint64_t) <= limit) {
+    uint64_t x, y;
+    memcpy(&x, a, sizeof(x));
+    memcpy(&y, b, sizeof(y));
+    if (x != y) {
+      return (a - start) + (__builtin_ctzll(x ^ y) >> 3);
+    }
+    a += sizeof(uint64_t);
+    b += sizeof(uint64_t);
+  }
+#endif
+  while (a < limit && *a == *b) {
+    ++a;
+    ++b;
+  }
+  return a - start;
+}
+
+uint32_t TLZ4Codec::compress(const uint8_t* src, uint32_t len, uint8_t* dst) const {
+  const uint8_t* const end = src + len;
+  const uint8_t* anchor = src;
+  uint8_t* op = dst;
+
+  if (len > LZ4_MATCH_FIND_LIMIT) {
+    const uint8_t* const findLimit = end - LZ4_MATCH_FIND_LIMIT;
+    const uint8_t* const matchLimit = end - LZ4_LAST_LITERALS;
+
+    // small inputs get a smaller table, which is cheaper to clear
+    int bits = 8;
+    while (bits < LZ4_MAX_HASH_BITS && (1U << bits) < len / 4) {
+      ++bits;
+    }
+    uint32_t table[1 << LZ4_MAX_HASH_BITS];
+    memset(table, 0, sizeof(uint32_t) << bits);
+
+    const uint8_t* ip = src + 1;
+    while (ip < findLimit) {
+      uint32_t h = lz4Hash(read32(ip), bits);
+      const uint8_t* ref = src + table[h];
+      table[h] = ip - src;
+
+      if (ip - ref > (ptrdiff_t)LZ4_MAX_OFFSET || read32(ref) != read32(ip)) {
+        // step further the longer it has been since the last match
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+
+      // extend the match backwards over pending literals
+      while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+        --ip;
+        --ref;
+      }
+
+      uint32_t matchLen = lz4MatchLength(ip + LZ4_MIN_MATCH, ref + LZ4_MIN_MATCH,
+                                         matchLimit);
+      op = lz4WriteLiterals(op, matchLen >= 15 ? 15 : matchLen,
+                            anchor, ip - anchor);
+      uint32_t offset = ip - ref;
+      *op++ = (uint8_t)offset;
+      *op++ = (uint8_t)(offset >> 8);
+      if (matchLen >= 15) {
+        op = lz4WriteLength(op, matchLen - 15);
+      }
+
+      ip += matchLen + LZ4_MIN_MATCH;
+      anchor = ip;
+      if (ip < findLimit) {
+        table[lz4Hash(read32(ip - 2), bits)] = ip - 2 - src;
+      }
+    }
+  }
+
+  op = lz4WriteLiterals(op, 0, anchor, end - anchor);
+  return op - dst;
+}
+
+static inline void lz4Corrupt() {
+  throw TTransportException(TTransportException::CORRUPTED_DATA,
+                            "TLZ4Codec: corrupt compressed data");
+}
+
+static inline uint32_t lz4ReadLength(const uint8_t*& ip, const uint8_t* end,
+                                     uint32_t len) {
+  uint8_t b;
+  do {
+    if (ip >= end) {
+      lz4Corrupt();
+    }
+    b = *ip++;
+    len += b;
+  } while (b == 255);
+  return len;
+}
+
+void TLZ4Codec::decompress(const uint8_t* src, uint32_t len,
+                           uint8_t* dst, uint32_t dstLen) const {
+  const uint8_t* ip = src;
+  const uint8_t* const iend = src + len;
+  uint8_t* op = dst;
+  uint8_t* const oend = dst + dstLen;
+
+  while (true) {
+    if (ip >= iend) {
+      lz4Corrupt();
+    }
+    uint8_t token = *ip++;
+
+    uint32_t litLen = token >> 4;
+    if (litLen == 15) {
+      litLen = lz4ReadLength(ip, iend, litLen);
+    }
+    if (litLen > (uint32_t)(iend - ip) || litLen > (uint32_t)(oend - op)) {
+      lz4Corrupt();
+    }
+    memcpy(op, ip, litLen);
+    op += litLen;
+    ip += litLen;
+
+    if (ip == iend) {
+      break;
+    }
+
+    if (iend - ip < 2) {
+      lz4Corrupt();
+    }
+    uint32_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > (uint32_t)(op - dst)) {
+      lz4Corrupt();
+    }
+
+    uint32_t matchLen = token & 15;
+    if (matchLen == 15) {
+      matchLen = lz4ReadLength(ip, iend, matchLen);
+    }
+    matchLen += LZ4_MIN_MATCH;
+    if (matchLen > (uint32_t)(oend - op)) {
+      lz4Corrupt();
+    }
+
+    const uint8_t* ref = op - offset;
+    if (offset >= matchLen) {
+      memcpy(op, ref, matchLen);
+      op += matchLen;
+    } else {
+      // the match overlaps what it produces, as in a run
+      uint8_t* const mend = op + matchLen;
+      while (op < mend) {
+        *op++ = *ref++;
+      }
+    }
+  }
+
+  if (op != oend) {
+    lz4Corrupt();
+  }
+}
+
+
+TCompressedFramedTransport::TCompressedFramedTransport(shared_ptr<TTransport> transport)
+  : TFramedTransport(transport)
+  , codec_(TFrameCodec::getCodec(TLZ4Codec::ID))
+  , threshold_(DEFAULT_COMPRESS_THRESHOLD)
+  , uBuf_(NULL)
+  , uBufSize_(0)
+  , cBuf_(NULL)
+  , cBufSize_(0)
+{
+  initHeader();
+}
+
+TCompressedFramedTransport::TCompressedFramedTransport(shared_ptr<TTransport> transport,
+                                                       shared_ptr<TFrameCodec> codec,
+                                                       uint32_t threshold)
+  : TFramedTransport(transport)
+  , codec_(codec)
+  , threshold_(threshold)
+  , uBuf_(NULL)
+  , uBufSize_(0)
+  , cBuf_(NULL)
+  , cBufSize_(0)
+{
+  initHeader();
+}
+
+TCompressedFramedTransport::~TCompressedFramedTransport() {
+  std::free(uBuf_);
+  std::free(cBuf_);
+}
+
+void TCompressedFramedTransport::initHeader() {
+  // TFramedTransport has left room for the frame size
+  uint8_t pad[FRAME_HEADER_SIZE - sizeof(int32_t)] = { 0 };
+  this->write(pad, sizeof(pad));
+}
+
+static void growScratch(uint8_t** scratch, uint32_t* scratchSize, uint32_t size) {
+  if (*scratchSize >= size) {
+    return;
+  }
+  uint8_t* grown = (uint8_t*)std::realloc(*scratch, size);
+  if (grown == NULL) {
+    throw TTransportException("Out of memory");
+  }
+  *scratch = grown;
+  *scratchSize = size;
+}
+
+uint8_t* TCompressedFramedTransport::encodeFrame(const TFrameCodec* codec,
+                                                 uint32_t threshold,
+                                                 uint8_t* buf, uint32_t len,
+                                                 uint8_t** scratch,
+                                                 uint32_t* scratchSize,
+                                                 uint32_t* frameLen) {
+  uint8_t* frame = buf;
+  uint32_t bodyLen = len;
+  uint8_t id = 0;
+
+  if (codec != NULL && len >= threshold && len > 0) {
+    growScratch(scratch, scratchSize,
+                FRAME_HEADER_SIZE + codec->maxCompressedSize(len));
+    uint32_t clen = codec->compress(buf + FRAME_HEADER_SIZE, len,
+                                    *scratch + FRAME_HEADER_SIZE);
+    if (clen < len) {
+      frame = *scratch;
+      bodyLen = clen;
+      id = codec->getId();
+    }
+  }
+
+  uint32_t sz = htonl(bodyLen + FRAME_HEADER_SIZE - sizeof(uint32_t));
+  uint32_t raw = htonl(len);
+  memcpy(frame, &sz, sizeof(sz));
+  frame[sizeof(sz)] = id;
+  memcpy(frame + sizeof(sz) + 1, &raw, sizeof(raw));
+
+  *frameLen = FRAME_HEADER_SIZE + bodyLen;
+  return frame;
+}
+
+void TCompressedFramedTransport::decodeFrame(const uint8_t* frame, uint32_t frameLen,
+                                             uint8_t** scratch, uint32_t* scratchSize,
+                                             const uint8_t** data, uint32_t* len) {
+  const uint32_t header = FRAME_HEADER_SIZE - sizeof(uint32_t);
+  if (frameLen < header) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "TCompressedFramedTransport: frame too short");
+  }
+
+  uint8_t id = frame[0];
+  uint32_t raw;
+  memcpy(&raw, frame + 1, sizeof(raw));
+  raw = ntohl(raw);
+
+  const uint8_t* body = frame + header;
+  uint32_t bodyLen = frameLen - header;
+
+  if (id == 0) {
+    if (raw != bodyLen) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                "TCompressedFramedTransport: bad stored frame size");
+    }
+    *data = body;
+    *len = bodyLen;
+    return;
+  }
+
+  shared_ptr<TFrameCodec> codec = TFrameCodec::getCodec(id);
+  if (!codec) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "TCompressedFramedTransport: unknown codec");
+  }
+
+  // No codec registered here expands by more than this, so larger sizes
+  // are corrupt, and must not be allocated
+  if (raw / 256 > bodyLen) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "TCompressedFramedTransport: bad uncompressed size");
+  }
+
+  growScratch(scratch, scratchSize, raw);
+  codec->decompress(body, bodyLen, *scratch, raw);
+  *data = *scratch;
+  *len = raw;
+}
+
+void TCompressedFramedTransport::readFrame() {
+  int32_t sz;
+  transport_->readAll((uint8_t*)&sz, sizeof(sz));
+  sz = ntohl(sz);
+
+  if (sz < 0) {
+    throw TTransportException("Frame size has negative value");
+  }
+
+  // The frame arrives in the read buffer and is decompressed into uBuf_
+  if (sz > static_cast<int32_t>(rBufSize_)) {
+    rBuf_.resize(sz, 0);
+    rBufSize_ = rBuf_.size();
+  }
+  transport_->readAll(rBuf_.get(), sz);
+
+  const uint8_t* data;
+  uint32_t len;
+  decodeFrame(rBuf_.get(), sz, &uBuf_, &uBufSize_, &data, &len);
+  setReadBuffer(const_cast<uint8_t*>(data), len);
+}
+
+void TCompressedFramedTransport::flush() {
+  uint32_t have = wBase_ - wBuf_.get();
+  uint32_t len = have - FRAME_HEADER_SIZE + wRefBytes_;
+
+  if (len > 0) {
+    // Referenced writes have to be gathered to be compressed
+    if (!wRefs_.empty()) {
+      std::vector<WriteRef> refs;
+      refs.swap(wRefs_);
+      wRefBytes_ = 0;
+
+      TPooledBuffer gathered(wBuf_.getPool(), have + len);
+      uint32_t pos = 0;
+      uint8_t* out = gathered.get();
+      for (std::vector<WriteRef>::const_iterator it = refs.begin();
+           it != refs.end(); ++it) {
+        memcpy(out, wBuf_.get() + pos, it->offset - pos);
+        out += it->offset - pos;
+        pos = it->offset;
+        memcpy(out, it->buf, it->len);
+        out += it->len;
+      }
+      memcpy(out, wBuf_.get() + pos, have - pos);
+      wBuf_.swap(gathered);
+      wBufSize_ = wBuf_.size();
+    }
+
+    // Reset before writing, so that we are sane if the write throws
+    wBase_ = wBuf_.get() + FRAME_HEADER_SIZE;
+    wBound_ = wBuf_.get() + wBufSize_;
+
+    uint32_t frameLen;
+    uint8_t* frame = encodeFrame(codec_.get(), threshold_, wBuf_.get(), len,
+                                 &cBuf_, &cBufSize_, &frameLen);
+    transport_->write(frame, frameLen);
+  }
+
+  transport_->flush();
+}
+
+}}} // apache::thrift::transport
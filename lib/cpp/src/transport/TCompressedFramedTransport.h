@@ -0,0 +1,203 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TCOMPRESSEDFRAMEDTRANSPORT_H_
+#define _THRIFT_TRANSPORT_TCOMPRESSEDFRAMEDTRANSPORT_H_ 1
+
+#include <transport/TBufferTransports.h>
+
+namespace apache { namespace thrift { namespace transport {
+
+/**
+ * A block compressor for whole frames.  Codecs are identified on the wire
+ * by a one-byte id (zero means the frame is stored uncompressed), and the
+ * receiving side looks the codec up by that id, so peers must register the
+ * same codecs.
+ *
+ * Codecs are shared between transports and threads, so they must not keep
+ * state between calls.
+ */
+class TFrameCodec {
+ public:
+  virtual ~TFrameCodec() {}
+
+  virtual uint8_t getId() const = 0;
+
+  /**
+   * The most that len bytes can compress to.
+   */
+  virtual uint32_t maxCompressedSize(uint32_t len) const = 0;
+
+  /**
+   * Compresses len bytes from src into dst, which has room for
+   * maxCompressedSize(len) bytes.  Returns the compressed size.
+   */
+  virtual uint32_t compress(const uint8_t* src, uint32_t len, uint8_t* dst) const = 0;
+
+  /**
+   * Decompresses len bytes from src into exactly dstLen bytes at dst.
+   * Throws a TTransportException if the data is corrupt.
+   */
+  virtual void decompress(const uint8_t* src, uint32_t len,
+                          uint8_t* dst, uint32_t dstLen) const = 0;
+
+  /**
+   * Makes a codec available for decoding frames.  TLZ4Codec is registered
+   * from the start.
+   */
+  static void registerCodec(boost::shared_ptr<TFrameCodec> codec);
+
+  /**
+   * The codec registered for id, or NULL.
+   */
+  static boost::shared_ptr<TFrameCodec> getCodec(uint8_t id);
+};
+
+/**
+ * A bundled implementation of the LZ4 block format: a greedy LZ77 with a
+ * small hash table, which compresses and decompresses at several hundred
+ * MB/s a core at the cost of a lower ratio than deflate.
+ */
+class TLZ4Codec : public TFrameCodec {
+ public:
+  static const uint8_t ID = 1;
+
+  uint8_t getId() const {
+    return ID;
+  }
+
+  uint32_t maxCompressedSize(uint32_t len) const {
+    return len + len / 255 + 16;
+  }
+
+  uint32_t compress(const uint8_t* src, uint32_t len, uint8_t* dst) const;
+
+  void decompress(const uint8_t* src, uint32_t len,
+                  uint8_t* dst, uint32_t dstLen) const;
+};
+
+/**
+ * A framed transport that compresses each frame as a whole.  Frames are
+ * laid out as
+ *
+ *   frame size (4 bytes) | codec id (1 byte) | uncompressed size (4 bytes) | body
+ *
+ * where the sizes are in network order and the frame size counts what
+ * follows it.  Frames smaller than the threshold, and frames that do not
+ * shrink, are stored with codec id zero.  Incoming frames are decoded with
+ * whichever registered codec their header names.
+ *
+ * TNonblockingServer accepts these frames when given a codec through
+ * setFrameCodec().
+ */
+class TCompressedFramedTransport : public TFramedTransport {
+ public:
+  /// Bytes ahead of the body: the frame size, codec id and uncompressed size.
+  static const uint32_t FRAME_HEADER_SIZE = 9;
+
+  static const uint32_t DEFAULT_COMPRESS_THRESHOLD = 512;
+
+  /// Compresses with TLZ4Codec.
+  TCompressedFramedTransport(boost::shared_ptr<TTransport> transport);
+
+  TCompressedFramedTransport(boost::shared_ptr<TTransport> transport,
+                             boost::shared_ptr<TFrameCodec> codec,
+                             uint32_t threshold = DEFAULT_COMPRESS_THRESHOLD);
+
+  ~TCompressedFramedTransport();
+
+  virtual void flush();
+
+  /**
+   * Frames whose body is smaller than this are not compressed.
+   */
+  void setCompressThreshold(uint32_t threshold) {
+    threshold_ = threshold;
+  }
+  uint32_t getCompressThreshold() const {
+    return threshold_;
+  }
+
+  /**
+   * Completes the frame whose body of len bytes follows FRAME_HEADER_SIZE
+   * bytes of room at buf, compressing the body with codec (which may be
+   * NULL) if it is at least threshold bytes long.  Returns the frame, which
+   * is either buf or the scratch buffer, grown with realloc() as needed,
+   * and sets *frameLen to its length including the frame size.
+   */
+  static uint8_t* encodeFrame(const TFrameCodec* codec, uint32_t threshold,
+                              uint8_t* buf, uint32_t len,
+                              uint8_t** scratch, uint32_t* scratchSize,
+                              uint32_t* frameLen);
+
+  /**
+   * Decodes a frame of frameLen bytes that follow the frame size.  Sets
+   * *data and *len to the uncompressed body, which either lies within the
+   * frame or has been decompressed into the scratch buffer.  Throws a
+   * TTransportException if the frame is malformed.
+   */
+  static void decodeFrame(const uint8_t* frame, uint32_t frameLen,
+                          uint8_t** scratch, uint32_t* scratchSize,
+                          const uint8_t** data, uint32_t* len);
+
+ protected:
+  virtual void readFrame();
+
+  void initHeader();
+
+  boost::shared_ptr<TFrameCodec> codec_;
+  uint32_t threshold_;
+
+  // decompressed input and compressed output, kept apart so that a frame
+  // can be written while one is still being read
+  uint8_t* uBuf_;
+  uint32_t uBufSize_;
+  uint8_t* cBuf_;
+  uint32_t cBufSize_;
+};
+
+/**
+ * Wraps a transport into a compressed framed one.
+ */
+class TCompressedFramedTransportFactory : public TTransportFactory {
+ public:
+  TCompressedFramedTransportFactory()
+    : codec_(TFrameCodec::getCodec(TLZ4Codec::ID))
+    , threshold_(TCompressedFramedTransport::DEFAULT_COMPRESS_THRESHOLD) {}
+
+  TCompressedFramedTransportFactory(boost::shared_ptr<TFrameCodec> codec,
+                                    uint32_t threshold)
+    : codec_(codec)
+    , threshold_(threshold) {}
+
+  virtual ~TCompressedFramedTransportFactory() {}
+
+  virtual boost::shared_ptr<TTransport> getTransport(boost::shared_ptr<TTransport> trans) {
+    return boost::shared_ptr<TTransport>(
+        new TCompressedFramedTransport(trans, codec_, threshold_));
+  }
+
+ private:
+  boost::shared_ptr<TFrameCodec> codec_;
+  uint32_t threshold_;
+};
+
+}}} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TCOMPRESSEDFRAMEDTRANSPORT_H_
@@ -17,12 +17,19 @@
  * under the License.
  */
 
+#include <algorithm>
 #include <cerrno>
 #include <exception>
 
 #include <transport/TFDTransport.h>
 
+#include <limits.h>
 #include <unistd.h>
+#include <vector>
+
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
 
 using namespace std;
 
@@ -74,4 +81,27 @@ void TFDTransport::write(const uint8_t* buf, uint32_t len) {
   }
 }
 
+void TFDTransport::writev(const struct iovec* iov, int iovcnt) {
+  // writev() may stop part way through, so work on a copy we can advance
+  std::vector<struct iovec> pending(iov, iov + iovcnt);
+  struct iovec* cur = pending.empty() ? NULL : &pending[0];
+  advanceIovec(cur, iovcnt, 0);
+
+  while (iovcnt > 0) {
+    ssize_t rv = ::writev(fd_, cur, std::min(iovcnt, IOV_MAX));
+
+    if (rv < 0) {
+      int errno_copy = errno;
+      throw TTransportException(TTransportException::UNKNOWN,
+                                "TFDTransport::writev()",
+                                errno_copy);
+    } else if (rv == 0) {
+      throw TTransportException(TTransportException::END_OF_FILE,
+                                "TFDTransport::writev()");
+    }
+
+    advanceIovec(cur, iovcnt, rv);
+  }
+}
+
 }}} // apache::thrift::transport
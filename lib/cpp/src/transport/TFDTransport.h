@@ -24,6 +24,7 @@
 #include <sys/time.h>
 
 #include "TTransport.h"
+#include "TVirtualTransport.h"
 #include "TServerSocket.h"
 
 namespace apache { namespace thrift { namespace transport {
@@ -32,7 +33,7 @@ namespace apache { namespace thrift { namespace transport {
  * Dead-simple wrapper around a file descriptor.
  *
  */
-class TFDTransport : public TTransport {
+class TFDTransport : public TVirtualTransport<TFDTransport> {
  public:
   enum ClosePolicy
   { NO_CLOSE_ON_DESTROY = 0
@@ -60,6 +61,8 @@ class TFDTransport : public TTransport {
 
   void write(const uint8_t* buf, uint32_t len);
 
+  void writev(const struct iovec* iov, int iovcnt);
+
   void setFD(int fd) { fd_ = fd; }
   int getFD() { return fd_; }
 
@@ -25,6 +25,7 @@
 #include "TTransportUtils.h"
 
 #include <pthread.h>
+#include <sched.h>
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h>
 #else
@@ -39,6 +40,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 namespace apache { namespace thrift { namespace transport {
@@ -69,16 +71,42 @@ static int clock_gettime(int clk_id /*ignored*/, struct timespec *tp) {
 }
 #endif
 
+// Writes len bytes, going around short writes.  Returns false on error.
+static bool writeFully(int fd, const uint8_t* buf, uint32_t len) {
+  while (len > 0) {
+    ssize_t rv = ::write(fd, buf, len);
+    if (rv < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    buf += rv;
+    len -= rv;
+  }
+  return true;
+}
+
 TFileTransport::TFileTransport(string path, bool readOnly)
   : readState_()
   , readBuff_(NULL)
   , currentEvent_(NULL)
+  , readPtr_(NULL)
+  , readMapped_(false)
+  , readMap_(NULL)
+  , readMapSize_(0)
   , readBuffSize_(DEFAULT_READ_BUFF_SIZE)
   , readTimeout_(NO_TAIL_READ_TIMEOUT)
   , chunkSize_(DEFAULT_CHUNK_SIZE)
   , eventBufferSize_(DEFAULT_EVENT_BUFFER_SIZE)
   , flushMaxUs_(DEFAULT_FLUSH_MAX_US)
   , flushMaxBytes_(DEFAULT_FLUSH_MAX_BYTES)
+  , flushPolicy_(FLUSH_FSYNC)
+  , directFd_(-1)
+  , directBuf_(NULL)
+  , directOffset_(0)
+  , directLen_(0)
+  , directWritten_(0)
   , maxEventSize_(DEFAULT_MAX_EVENT_SIZE)
   , maxCorruptedEvents_(DEFAULT_MAX_CORRUPTED_EVENTS)
   , eofSleepTime_(DEFAULT_EOF_SLEEP_TIME_US)
@@ -87,8 +115,10 @@ TFileTransport::TFileTransport(string path, bool readOnly)
   , writerThreadId_(0)
   , dequeueBuffer_(NULL)
   , enqueueBuffer_(NULL)
+  , swaps_(0)
   , closing_(false)
-  , forceFlush_(false)
+  , flushRequested_(0)
+  , flushCompleted_(0)
   , filename_(path)
   , fd_(0)
   , bufferAndThreadInitialized_(false)
@@ -112,8 +142,17 @@ void TFileTransport::resetOutputFile(int fd, string filename, int64_t offset) {
 
   // check if current file is still open
   if (fd_ > 0) {
+    // events may point into the mapping, and reads start over in the new file
+    if (currentEvent_) {
+      delete currentEvent_;
+      currentEvent_ = NULL;
+    }
+    readState_.resetAllValues();
+    unmapReadFile();
+
     // flush any events in the queue
     flush();
+    closeDirectOutput();
     GlobalOutput.printf("error, current file (%s) not closed", filename_.c_str());
     if (-1 == ::close(fd_)) {
       int errno_copy = errno;
@@ -172,6 +211,15 @@ TFileTransport::~TFileTransport() {
     currentEvent_ = NULL;
   }
 
+  // events may point into the mapping, so it goes after them
+  unmapReadFile();
+
+  closeDirectOutput();
+  if (directBuf_) {
+    free(directBuf_);
+    directBuf_ = NULL;
+  }
+
   // close logfile
   if (fd_ > 0) {
     if(-1 == ::close(fd_)) {
@@ -186,6 +234,13 @@ bool TFileTransport::initBufferAndWriteThread() {
     return false;
   }
 
+  // No event can be larger than a chunk, so a chunk's worth of slab
+  // always has room for the next one
+  uint32_t slabSize = chunkSize_ ? chunkSize_ : DEFAULT_CHUNK_SIZE;
+  dequeueBuffer_ = new TFileTransportBuffer(eventBufferSize_, slabSize);
+  enqueueBuffer_ = new TFileTransportBuffer(eventBufferSize_, slabSize);
+  enqueueBuffer_->publish();
+
   if (writerThreadId_ == 0) {
     if (pthread_create(&writerThreadId_, NULL, startWriterThread, (void *)this) != 0) {
       T_ERROR("Could not create writer thread");
@@ -193,8 +248,7 @@ bool TFileTransport::initBufferAndWriteThread() {
     }
   }
 
-  dequeueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
-  enqueueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
+  __sync_synchronize();
   bufferAndThreadInitialized_ = true;
 
   return true;
@@ -225,77 +279,96 @@ void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen, bool bl
     return;
   }
 
-  eventInfo* toEnqueue = new eventInfo();
-  toEnqueue->eventBuff_ = (uint8_t *)std::malloc((sizeof(uint8_t) * eventLen) + 4);
-  // first 4 bytes is the event length
-  memcpy(toEnqueue->eventBuff_, (void*)(&eventLen), 4);
-  // actual event contents
-  memcpy(toEnqueue->eventBuff_ + 4, buf, eventLen);
-  toEnqueue->eventSize_ = eventLen + 4;
-
-  // lock mutex
-  pthread_mutex_lock(&mutex_);
-
   // make sure that enqueue buffer is initialized and writer thread is running
   if (!bufferAndThreadInitialized_) {
-    if (!initBufferAndWriteThread()) {
-      delete toEnqueue;
-      pthread_mutex_unlock(&mutex_);
+    pthread_mutex_lock(&mutex_);
+    bool initialized = bufferAndThreadInitialized_ || initBufferAndWriteThread();
+    pthread_mutex_unlock(&mutex_);
+    if (!initialized) {
       return;
     }
   }
 
-  // Can't enqueue while buffer is full
-  while (enqueueBuffer_->isFull()) {
-    pthread_cond_wait(&notFull_, &mutex_);
-  }
-
-  // add to the buffer
-  if (!enqueueBuffer_->addEvent(toEnqueue)) {
-    delete toEnqueue;
-    pthread_mutex_unlock(&mutex_);
+  if (!enqueueBuffer_->fits(eventLen)) {
+    T_ERROR("msg size is greater than chunk size: %u > %u\n", eventLen, chunkSize_);
     return;
   }
 
-  // signal anybody who's waiting for the buffer to be non-empty
-  pthread_cond_signal(&notEmpty_);
+  while (true) {
+    uint64_t swaps = swaps_;
+    __sync_synchronize();
+    TFileTransportBuffer* buffer = enqueueBuffer_;
+    bool first = false;
+    TFileTransportBuffer::addResult result = buffer->addEvent(buf, eventLen, &first);
+
+    if (result == TFileTransportBuffer::ADDED) {
+      // the writer only needs waking for the first event in a buffer
+      if (first) {
+        pthread_mutex_lock(&mutex_);
+        pthread_cond_signal(&notEmpty_);
+        pthread_mutex_unlock(&mutex_);
+      }
+      break;
+    }
 
-  if (blockUntilFlush) {
-    pthread_cond_wait(&flushed_, &mutex_);
+    if (result == TFileTransportBuffer::FULL) {
+      // Can't enqueue while buffer is full
+      pthread_mutex_lock(&mutex_);
+      pthread_cond_signal(&notEmpty_);
+      while (swaps_ == swaps && !closing_) {
+        pthread_cond_wait(&notFull_, &mutex_);
+      }
+      pthread_mutex_unlock(&mutex_);
+      if (closing_) {
+        return;
+      }
+    }
+
+    // CLOSED: the writer has already swapped in the other buffer
   }
 
-  // this really should be a loop where it makes sure it got flushed
-  // because condition variables can get triggered by the os for no reason
-  // it is probably a non-factor for the time being
-  pthread_mutex_unlock(&mutex_);
+  if (blockUntilFlush) {
+    flush();
+  }
 }
 
-bool TFileTransport::swapEventBuffers(struct timespec* deadline) {
+bool TFileTransport::swapEventBuffers(struct timespec* deadline, uint64_t* flushRequest) {
   pthread_mutex_lock(&mutex_);
-  if (deadline != NULL) {
-    // if we were handed a deadline time struct, do a timed wait
-    pthread_cond_timedwait(&notEmpty_, &mutex_, deadline);
-  } else {
-    // just wait until the buffer gets an item
-    pthread_cond_wait(&notEmpty_, &mutex_);
+  if (enqueueBuffer_->isEmpty() && flushRequested_ == flushCompleted_) {
+    if (deadline != NULL) {
+      // if we were handed a deadline time struct, do a timed wait
+      pthread_cond_timedwait(&notEmpty_, &mutex_, deadline);
+    } else {
+      // just wait until the buffer gets an item
+      pthread_cond_wait(&notEmpty_, &mutex_);
+    }
   }
 
+  // flushes requested by now cover everything in the buffer we swap out
+  *flushRequest = flushRequested_;
+  pthread_mutex_unlock(&mutex_);
+
   bool swapped = false;
 
   // could be empty if we timed out
   if (!enqueueBuffer_->isEmpty()) {
+    // Publish the new buffer before closing the old one, so that writers
+    // turned away from the old one find it
     TFileTransportBuffer *temp = enqueueBuffer_;
+    dequeueBuffer_->publish();
     enqueueBuffer_ = dequeueBuffer_;
+    temp->close();
     dequeueBuffer_ = temp;
 
     swapped = true;
   }
 
-  // unlock the mutex and signal if required
-  pthread_mutex_unlock(&mutex_);
-
+  // signal writers waiting for the swap
   if (swapped) {
-    pthread_cond_signal(&notFull_);
+    pthread_mutex_lock(&mutex_);
+    swaps_++;
+    pthread_cond_broadcast(&notFull_);
+    pthread_mutex_unlock(&mutex_);
   }
 
   return swapped;
@@ -336,6 +409,7 @@ void TFileTransport::writerThread() {
   struct timespec ts_next_flush;
   getNextFlushTime(&ts_next_flush);
   uint32_t unflushed = 0;
+  uint64_t flushRequest = 0;
 
   while (1) {
     // this will only be true when the destructor is being invoked
@@ -344,19 +418,28 @@ void TFileTransport::writerThread() {
         pthread_exit(NULL);
       }
 
-      // Try to empty buffers before exit 
-      if (enqueueBuffer_->isEmpty() && dequeueBuffer_->isEmpty()) {
-        fsync(fd_);
+      // Try to empty buffers before exit (the dequeue buffer is always
+      // emptied in the same pass as it is swapped out)
+      if (enqueueBuffer_->isEmpty()) {
+        syncOutput();
+        closeDirectOutput();
         if (-1 == ::close(fd_)) {
           int errno_copy = errno;
           GlobalOutput.perror("TFileTransport: writerThread() ::close() ", errno_copy);
         }
+        // so that the destructor doesn't close it again
+        fd_ = 0;
         pthread_exit(NULL);
       }
     }
 
-    if (swapEventBuffers(&ts_next_flush)) {
+    if (swapEventBuffers(&ts_next_flush, &flushRequest)) {
       eventInfo* outEvent;
+
+      // events that follow each other in the buffer go out in one write
+      const uint8_t* run = NULL;
+      uint32_t runLen = 0;
+
       while (NULL != (outEvent = dequeueBuffer_->getNext())) {
         // Remove an event from the buffer and write it out to disk. If there is any IO error, for instance,
         // the output file is unmounted or deleted, then this event is dropped. However, the writer thread
@@ -369,6 +452,7 @@ void TFileTransport::writerThread() {
           if (closing_) {
             pthread_exit(NULL);
           }
+          closeDirectOutput();
           if (!fd_) {
             ::close(fd_);
             fd_ = 0;
@@ -403,13 +487,27 @@ void TFileTransport::writerThread() {
 
           // if adding this event will cross a chunk boundary, pad the chunk with zeros
           if (chunk1 != chunk2) {
-            // refetch the offset to keep in sync
-            offset_ = lseek(fd_, 0, SEEK_CUR);
+            if (runLen > 0) {
+              bool written = writeOutput(run, runLen);
+              runLen = 0;
+              if (!written) {
+                int errno_copy = errno;
+                GlobalOutput.perror("TFileTransport: error while writing event ", errno_copy);
+                hasIOError = true;
+                continue;
+              }
+            }
+
+            // refetch the offset to keep in sync (direct output goes
+            // through another descriptor, so there offset_ is the authority)
+            if (directFd_ < 0) {
+              offset_ = lseek(fd_, 0, SEEK_CUR);
+            }
             int32_t padding = (int32_t)((offset_ / chunkSize_ + 1) * chunkSize_ - offset_);
 
             uint8_t zeros[padding];
             bzero(zeros, padding);
-            if (-1 == ::write(fd_, zeros, padding)) {
+            if (!writeOutput(zeros, padding)) {
               int errno_copy = errno;
               GlobalOutput.perror("TFileTransport: writerThread() error while padding zeros ", errno_copy);
               hasIOError = true;
@@ -420,18 +518,31 @@ void TFileTransport::writerThread() {
           }
         }
 
-        // write the dequeued event to the file
+        // write the dequeued event to the file, along with any before it
         if (outEvent->eventSize_ > 0) {
-          if (-1 == ::write(fd_, outEvent->eventBuff_, outEvent->eventSize_)) {
-            int errno_copy = errno;
-            GlobalOutput.perror("TFileTransport: error while writing event ", errno_copy);
-            hasIOError = true;
-            continue;
+          if (runLen > 0 && run + runLen != outEvent->eventBuff_) {
+            bool written = writeOutput(run, runLen);
+            runLen = 0;
+            if (!written) {
+              int errno_copy = errno;
+              GlobalOutput.perror("TFileTransport: error while writing event ", errno_copy);
+              hasIOError = true;
+              continue;
+            }
           }
+          if (runLen == 0) {
+            run = outEvent->eventBuff_;
+          }
+          runLen += outEvent->eventSize_;
           unflushed += outEvent->eventSize_;
           offset_ += outEvent->eventSize_;
         }
       }
+      if ((runLen > 0 && !writeOutput(run, runLen)) || !endOutputBatch()) {
+        int errno_copy = errno;
+        GlobalOutput.perror("TFileTransport: error while writing event ", errno_copy);
+        hasIOError = true;
+      }
       dequeueBuffer_->reset();
     }
 
@@ -452,17 +563,144 @@ void TFileTransport::writerThread() {
     // couple of cases from which a flush could be triggered
     if ((flushTimeElapsed && unflushed > 0) ||
        unflushed > flushMaxBytes_ ||
-       forceFlush_) {
+       flushRequest > flushCompleted_) {
 
-      // sync (force flush) file to disk
-      fsync(fd_);
+      // sync (force flush) file to disk, once for every flush() caller
+      // whose events went out in the batches since the last one
+      syncOutput();
       unflushed = 0;
 
       // notify anybody waiting for flush completion
-      forceFlush_ = false;
+      pthread_mutex_lock(&mutex_);
+      flushCompleted_ = flushRequest;
       pthread_cond_broadcast(&flushed_);
+      pthread_mutex_unlock(&mutex_);
+    }
+  }
+}
+
+bool TFileTransport::writeOutput(const uint8_t* buf, uint32_t len) {
+  if (flushPolicy_ != FLUSH_DIRECT) {
+    return writeFully(fd_, buf, len);
+  }
+  if (directFd_ < 0 && !openDirectOutput()) {
+    return writeFully(fd_, buf, len);
+  }
+
+  while (len > 0) {
+    if (directLen_ == DIRECT_BUFFER_SIZE && !writeDirectBlocks()) {
+      return false;
+    }
+    uint32_t copy = min(len, DIRECT_BUFFER_SIZE - directLen_);
+    memcpy(directBuf_ + directLen_, buf, copy);
+    directLen_ += copy;
+    buf += copy;
+    len -= copy;
+  }
+  return true;
+}
+
+bool TFileTransport::endOutputBatch() {
+  if (directFd_ < 0 || directLen_ == directWritten_) {
+    return true;
+  }
+  return writeDirectBlocks();
+}
+
+void TFileTransport::syncOutput() {
+  switch (flushPolicy_) {
+  case FLUSH_NONE:
+    break;
+  case FLUSH_FDATASYNC:
+  case FLUSH_DIRECT:
+#if defined(_POSIX_SYNCHRONIZED_IO) && _POSIX_SYNCHRONIZED_IO > 0
+    fdatasync(fd_);
+    break;
+#endif
+  default:
+    fsync(fd_);
+    break;
+  }
+}
+
+bool TFileTransport::openDirectOutput() {
+#ifdef O_DIRECT
+  if (directBuf_ == NULL) {
+    void* buf;
+    if (posix_memalign(&buf, DIRECT_ALIGNMENT, DIRECT_BUFFER_SIZE) != 0) {
+      GlobalOutput("TFileTransport: could not allocate direct output buffer");
+      flushPolicy_ = FLUSH_FDATASYNC;
+      return false;
+    }
+    directBuf_ = (uint8_t*)buf;
+  }
+
+  directFd_ = ::open(filename_.c_str(), O_WRONLY | O_DIRECT);
+  if (directFd_ < 0) {
+    int errno_copy = errno;
+    GlobalOutput.perror("TFileTransport: O_DIRECT open() failed, falling back to fdatasync ", errno_copy);
+    flushPolicy_ = FLUSH_FDATASYNC;
+    return false;
+  }
+
+  // stage the partial block at the end of the file, which is rewritten
+  // whole once more events follow it
+  struct stat st;
+  if (fstat(fd_, &st) < 0) {
+    closeDirectOutput();
+    return false;
+  }
+  directOffset_ = st.st_size - st.st_size % DIRECT_ALIGNMENT;
+  directLen_ = directWritten_ = st.st_size - directOffset_;
+  if (directLen_ > 0 &&
+      pread(fd_, directBuf_, directLen_, directOffset_) != (ssize_t)directLen_) {
+    closeDirectOutput();
+    return false;
+  }
+  return true;
+#else
+  flushPolicy_ = FLUSH_FDATASYNC;
+  return false;
+#endif
+}
+
+bool TFileTransport::writeDirectBlocks() {
+  // whole blocks go out through O_DIRECT
+  uint32_t blocks = directLen_ - directLen_ % DIRECT_ALIGNMENT;
+  uint32_t done = 0;
+  while (done < blocks) {
+    ssize_t rv = pwrite(directFd_, directBuf_ + done, blocks - done, directOffset_ + done);
+    if (rv < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
     }
+    done += rv;
+  }
+
+  // The trailing partial block is appended through the page cache, so the
+  // file never holds zeros past its last event for a tailing reader to
+  // take as padding.  The file already ends at the later of the two.
+  uint32_t tail = max(blocks, directWritten_);
+  if (directLen_ > tail && !writeFully(fd_, directBuf_ + tail, directLen_ - tail)) {
+    return false;
+  }
+
+  // keep the partial block staged for the next batch
+  memmove(directBuf_, directBuf_ + blocks, directLen_ - blocks);
+  directOffset_ += blocks;
+  directLen_ -= blocks;
+  directWritten_ = directLen_;
+  return true;
+}
+
+void TFileTransport::closeDirectOutput() {
+  if (directFd_ >= 0) {
+    ::close(directFd_);
+    directFd_ = -1;
   }
+  directLen_ = directWritten_ = 0;
 }
 
 void TFileTransport::flush() {
@@ -473,9 +711,10 @@ void TFileTransport::flush() {
   // wait for flush to take place
   pthread_mutex_lock(&mutex_);
 
-  forceFlush_ = true;
+  uint64_t request = ++flushRequested_;
+  pthread_cond_signal(&notEmpty_);
 
-  while (forceFlush_) {
+  while (flushCompleted_ < request) {
     pthread_cond_wait(&flushed_, &mutex_);
   }
 
@@ -546,11 +785,95 @@ uint32_t TFileTransport::read(uint8_t* buf, uint32_t len) {
   return len;
 }
 
+const uint8_t* TFileTransport::borrow(uint8_t* /* buf */, uint32_t* len) {
+  if (!currentEvent_) {
+    currentEvent_ = readEvent();
+  }
+  if (!currentEvent_) {
+    return NULL;
+  }
+
+  uint32_t remaining = currentEvent_->eventSize_ - currentEvent_->eventBuffPos_;
+  if (remaining < *len) {
+    return NULL;
+  }
+  *len = remaining;
+  return currentEvent_->eventBuff_ + currentEvent_->eventBuffPos_;
+}
+
+void TFileTransport::consume(uint32_t len) {
+  if (!currentEvent_ ||
+      len > currentEvent_->eventSize_ - currentEvent_->eventBuffPos_) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "consume did not follow a borrow.");
+  }
+
+  // Like read(), let go of the event once it has been used up
+  currentEvent_->eventBuffPos_ += len;
+  if (currentEvent_->eventBuffPos_ == currentEvent_->eventSize_) {
+    delete currentEvent_;
+    currentEvent_ = NULL;
+  }
+}
+
+// Points readPtr_ at the mapping from offset_ to the end of its chunk,
+// extending the mapping if the file has grown.  Returns how many bytes
+// that is, or 0 at EOF.
+int32_t TFileTransport::mapReadWindow() {
+  if ((size_t)offset_ >= readMapSize_) {
+    struct stat f_info;
+    if (fstat(fd_, &f_info) < 0) {
+      int errno_copy = errno;
+      throw TTransportException(TTransportException::UNKNOWN,
+                                "TFileTransport::mapReadWindow() (fstat)",
+                                errno_copy);
+    }
+
+    if ((size_t)f_info.st_size > readMapSize_) {
+      unmapReadFile();
+      void* map = mmap(NULL, f_info.st_size, PROT_READ, MAP_SHARED, fd_, 0);
+      if (map == MAP_FAILED) {
+        int errno_copy = errno;
+        GlobalOutput.perror("TFileTransport: mapReadWindow() mmap() ", errno_copy);
+        throw TTransportException(TTransportException::UNKNOWN,
+                                  "TFileTransport::mapReadWindow() (mmap)",
+                                  errno_copy);
+      }
+      madvise(map, f_info.st_size, MADV_SEQUENTIAL);
+      readMap_ = (uint8_t*)map;
+      readMapSize_ = f_info.st_size;
+    }
+  }
+
+  if ((size_t)offset_ >= readMapSize_) {
+    return 0;
+  }
+
+  // Events never cross chunks, so windows that end on chunk boundaries
+  // hold each event whole
+  off_t windowEnd = (offset_ / chunkSize_ + 1) * (off_t)chunkSize_;
+  if ((size_t)windowEnd > readMapSize_) {
+    windowEnd = readMapSize_;
+  }
+  readPtr_ = readMap_ + offset_;
+  return windowEnd - offset_;
+}
+
+void TFileTransport::unmapReadFile() {
+  if (readMap_) {
+    if (-1 == munmap(readMap_, readMapSize_)) {
+      GlobalOutput.perror("TFileTransport: unmapReadFile() munmap() ", errno);
+    }
+    readMap_ = NULL;
+    readMapSize_ = 0;
+  }
+}
+
 // note caller is responsible for freeing returned events
 eventInfo* TFileTransport::readEvent() {
   int readTries = 0;
 
-  if (!readBuff_) {
+  if (!readBuff_ && !readMapped_) {
     readBuff_ = new uint8_t[readBuffSize_];
   }
 
@@ -559,7 +882,12 @@ eventInfo* TFileTransport::readEvent() {
     if (readState_.bufferPtr_ == readState_.bufferLen_) {
       // advance the offset pointer
       offset_ += readState_.bufferLen_;
-      readState_.bufferLen_ = ::read(fd_, readBuff_, readBuffSize_);
+      if (readMapped_) {
+        readState_.bufferLen_ = mapReadWindow();
+      } else {
+        readState_.bufferLen_ = ::read(fd_, readBuff_, readBuffSize_);
+        readPtr_ = readBuff_;
+      }
       //       if (readState_.bufferLen_) {
       //         T_DEBUG_L(1, "Amount read: %u (offset: %lu)", readState_.bufferLen_, offset_);
       //       }
@@ -610,7 +938,7 @@ eventInfo* TFileTransport::readEvent() {
         }
 
         readState_.eventSizeBuff_[readState_.eventSizeBuffPos_++] =
-          readBuff_[readState_.bufferPtr_++];
+          readPtr_[readState_.bufferPtr_++];
         if (readState_.eventSizeBuffPos_ == 4) {
           // 0 length event indicates padding
           if (*((uint32_t *)(readState_.eventSizeBuff_)) == 0) {
@@ -634,22 +962,32 @@ eventInfo* TFileTransport::readEvent() {
           }
         }
       } else {
-        if (!readState_.event_->eventBuff_) {
-          readState_.event_->eventBuff_ = new uint8_t[readState_.event_->eventSize_];
-          readState_.event_->eventBuffPos_ = 0;
+        uint32_t available = readState_.bufferLen_ - readState_.bufferPtr_;
+        if (!readState_.event_->eventBuff_ && readMapped_ &&
+            available >= readState_.event_->eventSize_) {
+          // the whole event is mapped, so hand it out where it is
+          readState_.event_->eventBuff_ = readPtr_ + readState_.bufferPtr_;
+          readState_.event_->eventBuffOwned_ = false;
+          readState_.event_->eventBuffPos_ = readState_.event_->eventSize_;
+          readState_.bufferPtr_ += readState_.event_->eventSize_;
+        } else {
+          if (!readState_.event_->eventBuff_) {
+            readState_.event_->eventBuff_ = new uint8_t[readState_.event_->eventSize_];
+            readState_.event_->eventBuffPos_ = 0;
+          }
+          // take either the entire event or the remaining bytes in the buffer
+          int reclaimBuffer = min(available,
+                                  readState_.event_->eventSize_ - readState_.event_->eventBuffPos_);
+
+          // copy data from read buffer into event buffer
+          memcpy(readState_.event_->eventBuff_ + readState_.event_->eventBuffPos_,
+                 readPtr_ + readState_.bufferPtr_,
+                 reclaimBuffer);
+
+          // increment position ptrs
+          readState_.event_->eventBuffPos_ += reclaimBuffer;
+          readState_.bufferPtr_ += reclaimBuffer;
         }
-        // take either the entire event or the remaining bytes in the buffer
-        int reclaimBuffer = min((uint32_t)(readState_.bufferLen_ - readState_.bufferPtr_),
-                                readState_.event_->eventSize_ - readState_.event_->eventBuffPos_);
-
-        // copy data from read buffer into event buffer
-        memcpy(readState_.event_->eventBuff_ + readState_.event_->eventBuffPos_,
-               readBuff_ + readState_.bufferPtr_,
-               reclaimBuffer);
-
-        // increment position ptrs
-        readState_.event_->eventBuffPos_ += reclaimBuffer;
-        readState_.bufferPtr_ += reclaimBuffer;
 
         // check if the event has been read in full
         if (readState_.event_->eventBuffPos_ == readState_.event_->eventSize_) {
@@ -850,69 +1188,114 @@ void TFileTransport::getNextFlushTime(struct timespec* ts_next_flush) {
   ts_next_flush->tv_sec += flushMaxUs_ / 1000000;
 }
 
-TFileTransportBuffer::TFileTransportBuffer(uint32_t size)
-  : bufferMode_(WRITE)
-  , writePoint_(0)
+TFileTransportBuffer::TFileTransportBuffer(uint32_t size, uint32_t slabSize)
+  : claimed_(CLOSED_BIT)
   , readPoint_(0)
+  , readEnd_(0)
   , size_(size)
+  , slabSize_(slabSize)
 {
-  buffer_ = new eventInfo*[size];
+  slots_ = new slot[size];
+  for (uint32_t i = 0; i < size; i++) {
+    slots_[i].state = EMPTY;
+  }
+  slab_ = new uint8_t[slabSize];
+  current_.eventBuffOwned_ = false;
 }
 
 TFileTransportBuffer::~TFileTransportBuffer() {
-  if (buffer_) {
-    for (uint32_t i = 0; i < writePoint_; i++) {
-      delete buffer_[i];
+  delete[] slots_;
+  delete[] slab_;
+}
+
+TFileTransportBuffer::addResult TFileTransportBuffer::addEvent(const uint8_t* buf,
+                                                               uint32_t len,
+                                                               bool* first) {
+  // Claim a slot and the slab space for the event at once.  Writers that
+  // are turned away leave the word as it was, so the byte count never
+  // grows past the slab and never carries into the event count.
+  uint64_t claim = claimed_;
+  uint32_t index;
+  uint64_t offset;
+  while (true) {
+    if (claim & CLOSED_BIT) {
+      return CLOSED;
+    }
+    index = (uint32_t)(claim >> 32);
+    offset = claim & BYTES_MASK;
+    if (index >= size_ || offset + len + 4 > slabSize_) {
+      return FULL;
+    }
+    uint64_t seen = __sync_val_compare_and_swap(&claimed_, claim,
+                                                claim + ONE_EVENT + len + 4);
+    if (seen == claim) {
+      break;
     }
-    delete[] buffer_;
-    buffer_ = NULL;
+    claim = seen;
   }
+
+  // first 4 bytes is the event length
+  memcpy(slab_ + offset, &len, 4);
+  // actual event contents
+  memcpy(slab_ + offset + 4, buf, len);
+  slots_[index].offset = (uint32_t)offset;
+  __sync_synchronize();
+  slots_[index].state = READY;
+
+  *first = (index == 0);
+  return ADDED;
 }
 
-bool TFileTransportBuffer::addEvent(eventInfo *event) {
-  if (bufferMode_ == READ) {
-    GlobalOutput("Trying to write to a buffer in read mode");
-  }
-  if (writePoint_ < size_) {
-    buffer_[writePoint_++] = event;
-    return true;
-  } else {
-    // buffer is full
-    return false;
-  }
+void TFileTransportBuffer::publish() {
+  // Nothing changes a closed word, so the reset counts are still zero
+  __sync_fetch_and_and(&claimed_, ~CLOSED_BIT);
+}
+
+void TFileTransportBuffer::close() {
+  uint64_t claim = __sync_fetch_and_or(&claimed_, CLOSED_BIT);
+  readEnd_ = (uint32_t)((claim & ~CLOSED_BIT) >> 32);
+  readPoint_ = 0;
 }
 
 eventInfo* TFileTransportBuffer::getNext() {
-  if (bufferMode_ == WRITE) {
-    bufferMode_ = READ;
-  }
-  if (readPoint_ < writePoint_) {
-    return buffer_[readPoint_++];
-  } else {
-    // no more entries
-    return NULL;
+  while (readPoint_ < readEnd_) {
+    slot& next = slots_[readPoint_++];
+
+    // wait for the writer that claimed the slot to finish copying
+    while (next.state == EMPTY) {
+      sched_yield();
+    }
+    __sync_synchronize();
+    current_.eventBuff_ = slab_ + next.offset;
+    memcpy(&current_.eventSize_, current_.eventBuff_, 4);
+    current_.eventSize_ += 4;
+    return &current_;
   }
+
+  // no more entries
+  return NULL;
 }
 
 void TFileTransportBuffer::reset() {
-  if (bufferMode_ == WRITE || writePoint_ > readPoint_) {
+  if (readPoint_ < readEnd_) {
     T_DEBUG("Resetting a buffer with unread entries");
   }
-  // Clean up the old entries
-  for (uint32_t i = 0; i < writePoint_; i++) {
-    delete buffer_[i];
+  for (uint32_t i = 0; i < readEnd_; i++) {
+    slots_[i].state = EMPTY;
   }
-  bufferMode_ = WRITE;
-  writePoint_ = 0;
   readPoint_ = 0;
+  readEnd_ = 0;
+  // Still closed, until it is published again
+  __sync_synchronize();
+  claimed_ = CLOSED_BIT;
 }
 
 bool TFileTransportBuffer::isFull() {
-  return writePoint_ == size_;
+  return ((claimed_ & ~CLOSED_BIT) >> 32) >= size_;
 }
 
 bool TFileTransportBuffer::isEmpty() {
-  return writePoint_ == 0;
+  return ((claimed_ & ~CLOSED_BIT) >> 32) == 0;
 }
 
 TFileProcessor::TFileProcessor(shared_ptr<TProcessor> processor,
@@ -42,10 +42,12 @@ typedef struct eventInfo {
   uint8_t* eventBuff_;
   uint32_t eventSize_;
   uint32_t eventBuffPos_;
+  // false if eventBuff_ points into a memory-mapped file
+  bool eventBuffOwned_;
 
-  eventInfo():eventBuff_(NULL), eventSize_(0), eventBuffPos_(0){};
+  eventInfo():eventBuff_(NULL), eventSize_(0), eventBuffPos_(0), eventBuffOwned_(true){};
   ~eventInfo() {
-    if (eventBuff_) {
+    if (eventBuff_ && eventBuffOwned_) {
       delete[] eventBuff_;
     }
   }
@@ -100,40 +102,83 @@ typedef struct readState {
  * TFileTransportBuffer - buffer class used by TFileTransport for queueing up events
  * to be written to disk.  Should be used in the following way:
  *  1) Buffer created
- *  2) Buffer written to (addEvent)
- *  3) Buffer read from (getNext)
- *  4) Buffer reset (reset)
- *  5) Go back to 2, or destroy buffer
+ *  2) Buffer opened to writers (publish)
+ *  3) Buffer written to (addEvent), by any number of threads
+ *  4) Buffer closed to writers (close)
+ *  5) Buffer read from (getNext), by one thread
+ *  6) Buffer reset (reset)
+ *  7) Go back to 2, or destroy buffer
  *
- * The buffer should never be written to after it is read from, unless it is reset first.
- * Note: The above rules are enforced mainly for debugging its sole client TFileTransport
- *       which uses the buffer in this way.
+ * Events are copied, behind their 4-byte length, into a slab allocated up
+ * front.  Writers claim a slot and a range of the slab together with one
+ * compare-and-swap on a word that packs the two counts and a closed bit,
+ * so adding an event takes no lock and no allocation.  getNext() waits
+ * for each claimed event to be copied in before handing it out.
  *
  */
 class TFileTransportBuffer {
   public:
-    TFileTransportBuffer(uint32_t size);
+    TFileTransportBuffer(uint32_t size, uint32_t slabSize);
     ~TFileTransportBuffer();
 
-    bool addEvent(eventInfo *event);
+    enum addResult {
+      ADDED,
+      FULL,
+      CLOSED
+    };
+
+    /**
+     * Copies an event in.  FULL means it has to wait for the next buffer,
+     * CLOSED that this one is being swapped out.
+     *
+     * @param first  set if this was the first event into the buffer
+     */
+    addResult addEvent(const uint8_t* buf, uint32_t len, bool* first);
+    void publish();
+    void close();
     eventInfo* getNext();
     void reset();
     bool isFull();
     bool isEmpty();
 
+    /**
+     * Whether an event of this length could ever be added.
+     */
+    bool fits(uint32_t len) {
+      return len + 4 <= slabSize_;
+    }
+
   private:
     TFileTransportBuffer(); // should not be used
 
-    enum mode {
-      WRITE,
-      READ
+    static const uint64_t CLOSED_BIT = 1ULL << 63;
+    static const uint64_t ONE_EVENT = 1ULL << 32;
+    static const uint64_t BYTES_MASK = ONE_EVENT - 1;
+
+    enum slotState {
+      EMPTY = 0,
+      READY
     };
-    mode bufferMode_;
 
-    uint32_t writePoint_;
+    struct slot {
+      uint32_t offset;
+      volatile uint32_t state;
+    };
+
+    // Closed bit, events claimed and bytes claimed.  The word is only
+    // changed while the closed bit is clear, and the bit stays set from
+    // close() through reset() until publish(), so a writer still holding a
+    // buffer that has been swapped out can neither claim space in it nor
+    // disturb its counts.
+    volatile uint64_t claimed_;
+
     uint32_t readPoint_;
+    uint32_t readEnd_;
     uint32_t size_;
-    eventInfo** buffer_;
+    uint32_t slabSize_;
+    slot* slots_;
+    uint8_t* slab_;
+    eventInfo current_;
 };
 
 /**
@@ -183,6 +228,34 @@ class TFileTransport : public TFileReaderTransport,
   uint32_t read(uint8_t* buf, uint32_t len);
   bool peek();
 
+  /**
+   * Borrows from the current event, which has to hold at least *len more
+   * bytes.  Borrowing never crosses into the next event.
+   */
+  const uint8_t* borrow(uint8_t* buf, uint32_t* len);
+  void consume(uint32_t len);
+
+  /*
+   * Override TTransport *_virt() functions to invoke our implementations.
+   * We cannot use TVirtualTransport to provide these, since we need to inherit
+   * virtually from TTransport.
+   */
+  virtual uint32_t read_virt(uint8_t* buf, uint32_t len) {
+    return this->read(buf, len);
+  }
+  virtual uint32_t readAll_virt(uint8_t* buf, uint32_t len) {
+    return this->readAll(buf, len);
+  }
+  virtual void write_virt(const uint8_t* buf, uint32_t len) {
+    this->write(buf, len);
+  }
+  virtual const uint8_t* borrow_virt(uint8_t* buf, uint32_t* len) {
+    return this->borrow(buf, len);
+  }
+  virtual void consume_virt(uint32_t len) {
+    this->consume(len);
+  }
+
   // log-file specific functions
   void seekToChunk(int32_t chunk);
   void seekToEnd();
@@ -202,6 +275,20 @@ class TFileTransport : public TFileReaderTransport,
     return readBuffSize_;
   }
 
+  /**
+   * Reads through a read-only mapping of the file instead of ::read() into
+   * the read buffer.  Events that lie within the mapping are handed out in
+   * place rather than copied, and seeking only moves the read offset.  The
+   * mapping is extended when a tailed file grows.  Must be set before the
+   * first read.
+   */
+  void setReadMapped(bool readMapped) {
+    readMapped_ = readMapped;
+  }
+  bool getReadMapped() {
+    return readMapped_;
+  }
+
   static const int32_t TAIL_READ_TIMEOUT = -1;
   static const int32_t NO_TAIL_READ_TIMEOUT = 0;
   void setReadTimeout(int32_t readTimeout) {
@@ -250,6 +337,39 @@ class TFileTransport : public TFileReaderTransport,
     return flushMaxBytes_;
   }
 
+  /**
+   * How the writer thread makes written events durable when it flushes.
+   * Events swapped out together are always written as one batch, and every
+   * flush() caller that arrived before the batch is woken by the same sync.
+   *
+   *   FLUSH_FSYNC     - fsync() the file (the default)
+   *   FLUSH_FDATASYNC - fdatasync(), skipping metadata other than the size
+   *   FLUSH_NONE      - write only, and leave syncing to the OS
+   *   FLUSH_DIRECT    - write whole aligned blocks through O_DIRECT,
+   *                     bypassing the page cache, and fdatasync() on flush.
+   *                     Falls back to FLUSH_FDATASYNC where the file system
+   *                     does not support it.
+   *
+   * Must be set before the first write.
+   */
+  enum FlushPolicy {
+    FLUSH_FSYNC,
+    FLUSH_FDATASYNC,
+    FLUSH_NONE,
+    FLUSH_DIRECT
+  };
+
+  void setFlushPolicy(FlushPolicy flushPolicy) {
+    if (bufferAndThreadInitialized_) {
+      GlobalOutput("Cannot change the flush policy after writer thread started");
+      return;
+    }
+    flushPolicy_ = flushPolicy;
+  }
+  FlushPolicy getFlushPolicy() {
+    return flushPolicy_;
+  }
+
   void setMaxEventSize(uint32_t maxEventSize) {
     maxEventSize_ = maxEventSize;
   }
@@ -276,7 +396,7 @@ class TFileTransport : public TFileReaderTransport,
  private:
   // helper functions for writing to a file
   void enqueueEvent(const uint8_t* buf, uint32_t eventLen, bool blockUntilFlush);
-  bool swapEventBuffers(struct timespec* deadline);
+  bool swapEventBuffers(struct timespec* deadline, uint64_t* flushRequest);
   bool initBufferAndWriteThread();
 
   // control for writer thread
@@ -288,11 +408,21 @@ class TFileTransport : public TFileReaderTransport,
 
   // helper functions for reading from a file
   eventInfo* readEvent();
+  int32_t mapReadWindow();
+  void unmapReadFile();
 
   // event corruption-related functions
   bool isEventCorrupted();
   void performRecovery();
 
+  // output helpers for the writer thread, which follow the flush policy
+  bool writeOutput(const uint8_t* buf, uint32_t len);
+  bool endOutputBatch();
+  void syncOutput();
+  bool openDirectOutput();
+  bool writeDirectBlocks();
+  void closeDirectOutput();
+
   // Utility functions
   void openLogFile();
   void getNextFlushTime(struct timespec* ts_next_flush);
@@ -302,6 +432,14 @@ class TFileTransport : public TFileReaderTransport,
   uint8_t* readBuff_;
   eventInfo* currentEvent_;
 
+  // bytes being parsed: readBuff_, or the mapping at offset_
+  uint8_t* readPtr_;
+
+  // read-only mapping of the whole file, if reading mapped
+  bool readMapped_;
+  uint8_t* readMap_;
+  size_t readMapSize_;
+
   uint32_t readBuffSize_;
   static const uint32_t DEFAULT_READ_BUFF_SIZE = 1 * 1024 * 1024;
 
@@ -324,6 +462,18 @@ class TFileTransport : public TFileReaderTransport,
   uint32_t flushMaxBytes_;
   static const uint32_t DEFAULT_FLUSH_MAX_BYTES = 1000 * 1024;
 
+  FlushPolicy flushPolicy_;
+
+  // O_DIRECT output: bytes from directOffset_ on are staged in an aligned
+  // buffer, of which the first directWritten_ are already in the file
+  int directFd_;
+  uint8_t* directBuf_;
+  off_t directOffset_;
+  uint32_t directLen_;
+  uint32_t directWritten_;
+  static const uint32_t DIRECT_ALIGNMENT = 4096;
+  static const uint32_t DIRECT_BUFFER_SIZE = 1024 * 1024;
+
   // max event size
   uint32_t maxEventSize_;
   static const uint32_t DEFAULT_MAX_EVENT_SIZE = 0;
@@ -350,17 +500,24 @@ class TFileTransport : public TFileReaderTransport,
   // buffers to hold data before it is flushed. Each element of the buffer stores a msg that
   // needs to be written to the file.  The buffers are swapped by the writer thread.
   TFileTransportBuffer *dequeueBuffer_;
-  TFileTransportBuffer *enqueueBuffer_;
+  TFileTransportBuffer * volatile enqueueBuffer_;
+
+  // number of times the buffers have been swapped, which writers waiting
+  // on a full buffer watch rather than the pointers, which swap back
+  volatile uint64_t swaps_;
 
   // conditions used to block when the buffer is full or empty
   pthread_cond_t notFull_, notEmpty_;
   volatile bool closing_;
 
-  // To keep track of whether the buffer has been flushed
+  // To keep track of whether the buffer has been flushed: flush() waits
+  // for the writer to complete the request it numbered
   pthread_cond_t flushed_;
-  volatile bool forceFlush_;
+  uint64_t flushRequested_;
+  uint64_t flushCompleted_;
 
-  // Mutex that is grabbed when enqueueing and swapping the read/write buffers
+  // Mutex that is grabbed when blocking on the buffers and for flushes;
+  // enqueueing does not otherwise need it
   pthread_mutex_t mutex_;
 
   // File information
@@ -368,7 +525,7 @@ class TFileTransport : public TFileReaderTransport,
   int fd_;
 
   // Whether the writer thread and buffers have been initialized
-  bool bufferAndThreadInitialized_;
+  volatile bool bufferAndThreadInitialized_;
 
   // Offset within the file
   off_t offset_;
@@ -19,6 +19,8 @@
 
 #include <cstdlib>
 #include <sstream>
+#include <strings.h>
+#include <sys/uio.h>
 
 #include "THttpClient.h"
 #include "TSocket.h"
@@ -34,7 +36,22 @@ using namespace std;
 
 // Yeah, yeah, hacky to put these here, I know.
 static const char* CRLF = "\r\n";
-static const int CRLF_LEN = 2;
+
+// Whether the header name in [name, name+len) is the given one
+static bool headerIs(const char* name, uint32_t len, const char* expected) {
+  return strlen(expected) == len && strncasecmp(name, expected, len) == 0;
+}
+
+// Whether the header value in [value, value+len) contains the given token
+static bool valueHas(const char* value, uint32_t len, const char* token) {
+  uint32_t tokenLen = strlen(token);
+  for (uint32_t i = 0; i + tokenLen <= len; ++i) {
+    if (strncasecmp(value + i, token, tokenLen) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
 
 THttpClient::THttpClient(boost::shared_ptr<TTransport> transport, string host, string path) :
   transport_(transport),
@@ -42,9 +59,12 @@ THttpClient::THttpClient(boost::shared_ptr<TTransport> transport, string host, s
   path_(path),
   readHeaders_(true),
   chunked_(false),
-  chunkedDone_(false),
+  chunkEnd_(false),
+  keepAlive_(true),
+  reconnect_(false),
   chunkSize_(0),
   contentLength_(0),
+  pendingResponses_(0),
   httpBuf_(NULL),
   httpPos_(0),
   httpBufLen_(0),
@@ -57,9 +77,12 @@ THttpClient::THttpClient(string host, int port, string path) :
   path_(path),
   readHeaders_(true),
   chunked_(false),
-  chunkedDone_(false),
+  chunkEnd_(false),
+  keepAlive_(true),
+  reconnect_(false),
   chunkSize_(0),
   contentLength_(0),
+  pendingResponses_(0),
   httpBuf_(NULL),
   httpPos_(0),
   httpBufLen_(0),
@@ -74,6 +97,18 @@ void THttpClient::init() {
     throw TTransportException("Out of memory.");
   }
   httpBuf_[httpBufLen_] = '\0';
+
+  // Everything but the length is the same for every request
+  std::ostringstream h;
+  h <<
+    "POST " << path_ << " HTTP/1.1" << CRLF <<
+    "Host: " << host_ << CRLF <<
+    "Content-Type: application/x-thrift" << CRLF <<
+    "Accept: application/x-thrift" << CRLF <<
+    "User-Agent: C++/THttpClient" << CRLF <<
+    "Content-Length: ";
+  requestHeader_ = h.str();
+  requestHeaderPrefix_ = requestHeader_.size();
 }
 
 THttpClient::~THttpClient() {
@@ -82,9 +117,18 @@ THttpClient::~THttpClient() {
   }
 }
 
+void THttpClient::resetConnection() {
+  // Whatever was buffered or outstanding belongs to the old connection
+  readBuffer_.resetBuffer();
+  httpPos_ = 0;
+  httpBufLen_ = 0;
+  readHeaders_ = true;
+  reconnect_ = false;
+  pendingResponses_ = 0;
+}
+
 uint32_t THttpClient::read(uint8_t* buf, uint32_t len) {
   if (readBuffer_.available_read() == 0) {
-    readBuffer_.resetBuffer();
     uint32_t got = readMoreData();
     if (got == 0) {
       return 0;
@@ -93,107 +137,150 @@ uint32_t THttpClient::read(uint8_t* buf, uint32_t len) {
   return readBuffer_.read(buf, len);
 }
 
+const uint8_t* THttpClient::borrow(uint8_t* buf, uint32_t* len) {
+  if (readBuffer_.available_read() == 0) {
+    readMoreData();
+  }
+  return readBuffer_.borrow(buf, len);
+}
+
+void THttpClient::consume(uint32_t len) {
+  readBuffer_.consume(len);
+}
+
 void THttpClient::readEnd() {
-  // Read any pending chunked data (footers etc.)
-  if (chunked_) {
-    while (!chunkedDone_) {
-      readChunked();
-    }
+  // Skip the unread content and any chunked footers
+  while (!readHeaders_) {
+    readMoreData();
   }
+  readBuffer_.resetBuffer();
 }
 
 uint32_t THttpClient::readMoreData() {
-  // Get more data!
-  refill();
+  // readBuffer_ observes httpBuf_, which may move from here on
+  readBuffer_.resetBuffer();
 
   if (readHeaders_) {
+    if (reconnect_) {
+      throw TTransportException(TTransportException::NOT_OPEN,
+                                "Connection closed by server before response");
+    }
     readHeaders();
+
+    // An empty response answers a oneway call; the reply to the call being
+    // read, if there is one, follows it
+    while (!chunked_ && contentLength_ == 0 && pendingResponses_ > 1) {
+      finishResponse();
+      if (reconnect_) {
+        throw TTransportException(TTransportException::NOT_OPEN,
+                                  "Connection closed by server before response");
+      }
+      readHeaders();
+    }
   }
 
   if (chunked_) {
     return readChunked();
-  } else {
-    return readContent(contentLength_);
   }
+
+  uint32_t got = readContent(&contentLength_);
+  if (contentLength_ == 0) {
+    finishResponse();
+  }
+  return got;
 }
 
 uint32_t THttpClient::readChunked() {
-  uint32_t length = 0;
+  uint32_t len;
 
-  char* line = readLine();
-  uint32_t chunkSize = parseChunkSize(line);
-  if (chunkSize == 0) {
-    readChunkedFooters();
-  } else {
-    // Read data content
-    length += readContent(chunkSize);
+  if (chunkEnd_) {
     // Read trailing CRLF after content
-    readLine();
+    readLine(&len);
+    chunkEnd_ = false;
+  }
+
+  if (chunkSize_ == 0) {
+    char* line = readLine(&len);
+    chunkSize_ = parseChunkSize(line, len);
+    if (chunkSize_ == 0) {
+      readChunkedFooters();
+      finishResponse();
+      return 0;
+    }
   }
-  return length;
+
+  // Read data content
+  uint32_t got = readContent(&chunkSize_);
+  chunkEnd_ = (chunkSize_ == 0);
+  return got;
 }
 
 void THttpClient::readChunkedFooters() {
   // End of data, read footer lines until a blank one appears
-  while (true) {
-    char* line = readLine();
-    if (strlen(line) == 0) {
-      chunkedDone_ = true;
+  uint32_t len;
+  do {
+    readLine(&len);
+  } while (len > 0);
+}
+
+uint32_t THttpClient::parseChunkSize(char* line, uint32_t len) {
+  uint32_t size = 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    char c = line[i];
+    if (c >= '0' && c <= '9') {
+      size = (size << 4) | (c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      size = (size << 4) | (c - 'a' + 10);
+    } else if (c >= 'A' && c <= 'F') {
+      size = (size << 4) | (c - 'A' + 10);
+    } else {
+      // Chunk extensions, after a ';'
       break;
     }
   }
+  return size;
 }
 
-uint32_t THttpClient::parseChunkSize(char* line) {
-  char* semi = strchr(line, ';');
-  if (semi != NULL) {
-    *semi = '\0';
+uint32_t THttpClient::readContent(uint32_t* remaining) {
+  if (*remaining == 0) {
+    return 0;
   }
-  int size = 0;
-  sscanf(line, "%x", &size);
-  return (uint32_t)size;
-}
 
-uint32_t THttpClient::readContent(uint32_t size) {
-  uint32_t need = size;
-  while (need > 0) {
-    uint32_t avail = httpBufLen_ - httpPos_;
-    if (avail == 0) {
-      // We have given all the data, reset position to head of the buffer
-      httpPos_ = 0;
-      httpBufLen_ = 0;
-      refill();
+  if (httpPos_ == httpBufLen_) {
+    // We have given all the data, reset position to head of the buffer
+    httpPos_ = 0;
+    httpBufLen_ = 0;
+    refill();
+  }
 
-      // Now have available however much we read
-      avail = httpBufLen_;
-    }
-    uint32_t give = avail;
-    if (need < give) {
-      give = need;
-    }
-    readBuffer_.write((uint8_t*)(httpBuf_+httpPos_), give);
-    httpPos_ += give;
-    need -= give;
+  // Hand out the data where it is; it stays there until the next call
+  uint32_t give = httpBufLen_ - httpPos_;
+  if (*remaining < give) {
+    give = *remaining;
   }
-  return size;
+  readBuffer_.resetBuffer((uint8_t*)(httpBuf_+httpPos_), give);
+  httpPos_ += give;
+  *remaining -= give;
+  return give;
 }
 
-char* THttpClient::readLine() {
+char* THttpClient::readLine(uint32_t* len) {
   while (true) {
-    char* eol = NULL;
-
-    eol = strstr(httpBuf_+httpPos_, CRLF);
+    char* line = httpBuf_+httpPos_;
+    char* eol = (char*)memchr(line, '\n', httpBufLen_-httpPos_);
 
-    // No CRLF yet?
+    // No end of line yet?
     if (eol == NULL) {
       // Shift whatever we have now to front and refill
       shift();
       refill();
     } else {
-      // Return pointer to next line
-      *eol = '\0';
-      char* line = httpBuf_+httpPos_;
-      httpPos_ = (eol-httpBuf_) + CRLF_LEN;
+      // Return the line, without its CRLF
+      httpPos_ = (eol-httpBuf_) + 1;
+      if (eol > line && *(eol-1) == '\r') {
+        --eol;
+      }
+      *len = eol - line;
       return line;
     }
   }
@@ -237,18 +324,20 @@ void THttpClient::readHeaders() {
   // Initialize headers state variables
   contentLength_ = 0;
   chunked_ = false;
-  chunkedDone_ = false;
+  chunkEnd_ = false;
   chunkSize_ = 0;
 
   // Control state flow
   bool statusLine = true;
   bool finished = false;
 
-  // Loop until headers are finished
+  // Loop until headers are finished.  The next response may follow in the
+  // buffer already, so only read more when there is no complete line.
   while (true) {
-    char* line = readLine();
+    uint32_t len;
+    char* line = readLine(&len);
 
-    if (strlen(line) == 0) {
+    if (len == 0) {
       if (finished) {
         readHeaders_ = false;
         return;
@@ -259,57 +348,86 @@ void THttpClient::readHeaders() {
     } else {
       if (statusLine) {
         statusLine = false;
-        finished = parseStatusLine(line);
+        finished = parseStatusLine(line, len);
       } else {
-        parseHeader(line);
+        parseHeader(line, len);
       }
     }
   }
 }
 
-bool THttpClient::parseStatusLine(char* status) {
-  char* http = status;
+bool THttpClient::parseStatusLine(char* status, uint32_t len) {
+  char* end = status + len;
 
-  char* code = strchr(http, ' ');
+  char* code = (char*)memchr(status, ' ', len);
   if (code == NULL) {
-    throw TTransportException(string("Bad Status: ") + status);
+    throw TTransportException(string("Bad Status: ") + string(status, len));
   }
 
-  *code = '\0';
-  while (*(code++) == ' ');
+  // HTTP/1.0 servers close the connection unless told otherwise
+  keepAlive_ = !headerIs(status, code - status, "HTTP/1.0");
 
-  char* msg = strchr(code, ' ');
-  if (msg == NULL) {
-    throw TTransportException(string("Bad Status: ") + status);
+  while (code < end && *code == ' ') {
+    ++code;
   }
-  *msg = '\0';
 
-  if (strcmp(code, "200") == 0) {
+  char* msg = (char*)memchr(code, ' ', end - code);
+  uint32_t codeLen = (msg == NULL ? end : msg) - code;
+
+  if (headerIs(code, codeLen, "200")) {
     // HTTP 200 = OK, we got the response
     return true;
-  } else if (strcmp(code, "100") == 0) {
+  } else if (headerIs(code, codeLen, "100")) {
     // HTTP 100 = continue, just keep reading
     return false;
   } else {
-    throw TTransportException(string("Bad Status: ") + status);
+    throw TTransportException(string("Bad Status: ") + string(status, len));
   }
 }
 
-void THttpClient::parseHeader(char* header) {
-  char* colon = strchr(header, ':');
+void THttpClient::parseHeader(char* header, uint32_t len) {
+  char* colon = (char*)memchr(header, ':', len);
   if (colon == NULL) {
     return;
   }
   uint32_t sz = colon - header;
   char* value = colon+1;
+  uint32_t valueLen = len - sz - 1;
 
-  if (strncmp(header, "Transfer-Encoding", sz) == 0) {
-    if (strstr(value, "chunked") != NULL) {
+  if (headerIs(header, sz, "Transfer-Encoding")) {
+    if (valueHas(value, valueLen, "chunked")) {
       chunked_ = true;
     }
-  } else if (strncmp(header, "Content-Length", sz) == 0) {
+  } else if (headerIs(header, sz, "Content-Length")) {
     chunked_ = false;
-    contentLength_ = atoi(value);
+    contentLength_ = 0;
+    for (uint32_t i = 0; i < valueLen; ++i) {
+      if (value[i] >= '0' && value[i] <= '9') {
+        contentLength_ = contentLength_ * 10 + (value[i] - '0');
+      }
+    }
+  } else if (headerIs(header, sz, "Connection")) {
+    if (valueHas(value, valueLen, "close")) {
+      keepAlive_ = false;
+    } else if (valueHas(value, valueLen, "keep-alive")) {
+      keepAlive_ = true;
+    }
+  }
+}
+
+void THttpClient::finishResponse() {
+  readHeaders_ = true;
+  if (pendingResponses_ > 0) {
+    --pendingResponses_;
+  }
+
+  if (!keepAlive_) {
+    // The server is done with this connection; flush() opens another.
+    // The body just handed out stays in httpBuf_ until the next read.
+    transport_->close();
+    httpPos_ = 0;
+    httpBufLen_ = 0;
+    reconnect_ = true;
   }
 }
 
@@ -318,31 +436,38 @@ void THttpClient::write(const uint8_t* buf, uint32_t len) {
 }
 
 void THttpClient::flush() {
+  if (reconnect_) {
+    if (pendingResponses_ > 0) {
+      throw TTransportException(TTransportException::NOT_OPEN,
+                                "Connection closed by server with pipelined requests outstanding");
+    }
+    transport_->open();
+    reconnect_ = false;
+  }
+
   // Fetch the contents of the write buffer
   uint8_t* buf;
   uint32_t len;
   writeBuffer_.getBuffer(&buf, &len);
 
-  // Construct the HTTP header
-  std::ostringstream h;
-  h <<
-    "POST " << path_ << " HTTP/1.1" << CRLF <<
-    "Host: " << host_ << CRLF <<
-    "Content-Type: application/x-thrift" << CRLF <<
-    "Content-Length: " << len << CRLF <<
-    "Accept: application/x-thrift" << CRLF <<
-    "User-Agent: C++/THttpClient" << CRLF <<
-    CRLF;
-  string header = h.str();
-
-  // Write the header, then the data, then flush
-  transport_->write((const uint8_t*)header.c_str(), header.size());
-  transport_->write(buf, len);
+  // Complete the HTTP header
+  char length[16];
+  snprintf(length, sizeof(length), "%u\r\n\r\n", len);
+  requestHeader_.resize(requestHeaderPrefix_);
+  requestHeader_.append(length);
+
+  // Write the header and the data together, then flush
+  struct iovec iov[2];
+  iov[0].iov_base = (void*)requestHeader_.data();
+  iov[0].iov_len = requestHeader_.size();
+  iov[1].iov_base = buf;
+  iov[1].iov_len = len;
+  transport_->writev(iov, 2);
   transport_->flush();
 
-  // Reset the buffer and header variables
+  // Reset the buffer, and expect one more response
   writeBuffer_.resetBuffer();
-  readHeaders_ = true;
+  ++pendingResponses_;
 }
 
 }}} // apache::thrift::transport
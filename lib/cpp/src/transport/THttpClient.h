@@ -31,8 +31,15 @@ namespace apache { namespace thrift { namespace transport {
  * here is a VERY basic HTTP/1.1 client which supports HTTP 100 Continue,
  * chunked transfer encoding, keepalive, etc. Tested against Apache.
  *
+ * The connection is kept open between calls.  If the server closes it after
+ * a response, it is reopened for the next request.  Requests may also be
+ * pipelined: flush() sends a request without waiting for the response to
+ * the previous one, and responses are read back in order, each ending with
+ * readEnd().  Responses are parsed in place in the receive buffer, and
+ * their bodies are read, or borrowed, from there without copying.
+ *
  */
-class THttpClient : public TTransport {
+class THttpClient : public TVirtualTransport<THttpClient> {
  public:
   THttpClient(boost::shared_ptr<TTransport> transport, std::string host, std::string path="");
 
@@ -42,28 +49,44 @@ class THttpClient : public TTransport {
 
   void open() {
     transport_->open();
+    resetConnection();
   }
 
   bool isOpen() {
-    return transport_->isOpen();
+    return transport_->isOpen() || reconnect_;
   }
 
   bool peek() {
-    return transport_->peek();
+    return (readBuffer_.available_read() > 0) || (httpPos_ < httpBufLen_) ||
+      transport_->peek();
   }
 
   void close() {
     transport_->close();
+    resetConnection();
   }
 
   uint32_t read(uint8_t* buf, uint32_t len);
 
+  const uint8_t* borrow(uint8_t* buf, uint32_t* len);
+
+  void consume(uint32_t len);
+
+  /**
+   * Skips what is left of the current response, so that the next read
+   * starts on the response to the next request.
+   */
   void readEnd();
 
   void write(const uint8_t* buf, uint32_t len);
 
   void flush();
 
+  /// Requests sent whose responses have not been read to the end.
+  uint32_t getPendingResponses() const {
+    return pendingResponses_;
+  }
+
  private:
   void init();
 
@@ -77,11 +100,18 @@ class THttpClient : public TTransport {
   std::string host_;
   std::string path_;
 
+  // The request header up to the value of Content-Length
+  std::string requestHeader_;
+  uint32_t requestHeaderPrefix_;
+
   bool readHeaders_;
   bool chunked_;
-  bool chunkedDone_;
+  bool chunkEnd_;
+  bool keepAlive_;
+  bool reconnect_;
   uint32_t chunkSize_;
   uint32_t contentLength_;
+  uint32_t pendingResponses_;
 
   char* httpBuf_;
   uint32_t httpPos_;
@@ -89,17 +119,19 @@ class THttpClient : public TTransport {
   uint32_t httpBufSize_;
 
   uint32_t readMoreData();
-  char* readLine();
+  char* readLine(uint32_t* len);
 
   void readHeaders();
-  void parseHeader(char* header);
-  bool parseStatusLine(char* status);
+  void parseHeader(char* header, uint32_t len);
+  bool parseStatusLine(char* status, uint32_t len);
+  void finishResponse();
+  void resetConnection();
 
   uint32_t readChunked();
   void readChunkedFooters();
-  uint32_t parseChunkSize(char* line);
+  uint32_t parseChunkSize(char* line, uint32_t len);
 
-  uint32_t readContent(uint32_t size);
+  uint32_t readContent(uint32_t* remaining);
 
   void refill();
   void shift();
@@ -0,0 +1,396 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+#include <sys/uio.h>
+
+#include "THttpServer.h"
+
+namespace apache { namespace thrift { namespace transport {
+
+using namespace std;
+
+const char* THttpServer::CHUNKED_RESPONSE_END = "\r\n0\r\n\r\n";
+
+static const char* CONTINUE_RESPONSE = "HTTP/1.1 100 Continue\r\n\r\n";
+
+// Whether [token, token+len) is the given one, ignoring case
+static bool tokenIs(const char* token, uint32_t len, const char* expected) {
+  return strlen(expected) == len && strncasecmp(token, expected, len) == 0;
+}
+
+// Whether [value, value+len) contains the given token, ignoring case
+static bool tokenIn(const char* value, uint32_t len, const char* token) {
+  uint32_t tokenLen = strlen(token);
+  for (uint32_t i = 0; i + tokenLen <= len; ++i) {
+    if (strncasecmp(value + i, token, tokenLen) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void THttpRequestParser::reset() {
+  state_ = READ_HEADERS;
+  pos_ = 0;
+  requestLine_ = true;
+  keepAlive_ = true;
+  chunked_ = false;
+  expectContinue_ = false;
+  contentLength_ = 0;
+  chunkLeft_ = 0;
+  bodyOffset_ = 0;
+  bodyLength_ = 0;
+}
+
+bool THttpRequestParser::readLine(const uint8_t* buf, uint32_t len,
+                                  uint32_t* lineStart, uint32_t* lineLen) {
+  const uint8_t* eol = (const uint8_t*)memchr(buf + pos_, '\n', len - pos_);
+  if (eol == NULL) {
+    if (len - pos_ > MAX_HEADER_SIZE) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                "HTTP request line too long");
+    }
+    return false;
+  }
+
+  *lineStart = pos_;
+  pos_ = (eol - buf) + 1;
+  if (eol > buf + *lineStart && *(eol - 1) == '\r') {
+    --eol;
+  }
+  *lineLen = (eol - buf) - *lineStart;
+  return true;
+}
+
+bool THttpRequestParser::parse(uint8_t* buf, uint32_t len) {
+  uint32_t start;
+  uint32_t lineLen;
+
+  while (true) {
+    switch (state_) {
+    case READ_HEADERS:
+      if (!readLine(buf, len, &start, &lineLen)) {
+        return false;
+      }
+      if (pos_ > MAX_HEADER_SIZE) {
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "HTTP request headers too long");
+      }
+      if (requestLine_) {
+        // Blank lines may come before the request line
+        if (lineLen > 0) {
+          parseRequestLine((const char*)buf + start, lineLen);
+          requestLine_ = false;
+        }
+      } else if (lineLen > 0) {
+        parseHeader((const char*)buf + start, lineLen);
+      } else {
+        bodyOffset_ = pos_;
+        state_ = chunked_ ? READ_CHUNK_SIZE : READ_BODY;
+      }
+      break;
+
+    case READ_BODY:
+      if (len - bodyOffset_ < contentLength_) {
+        return false;
+      }
+      bodyLength_ = contentLength_;
+      pos_ = bodyOffset_ + bodyLength_;
+      state_ = DONE;
+      break;
+
+    case READ_CHUNK_SIZE: {
+      if (!readLine(buf, len, &start, &lineLen)) {
+        return false;
+      }
+      // Chunk sizes and extensions count against the header limit
+      if (pos_ - bodyOffset_ - bodyLength_ > MAX_HEADER_SIZE) {
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "HTTP chunk headers too long");
+      }
+      uint32_t size = 0;
+      uint32_t digits = 0;
+      for (; digits < lineLen; ++digits) {
+        char c = buf[start + digits];
+        if (c >= '0' && c <= '9') {
+          size = (size << 4) | (c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+          size = (size << 4) | (c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+          size = (size << 4) | (c - 'A' + 10);
+        } else {
+          // Chunk extensions, after a ';'
+          break;
+        }
+      }
+      if (digits == 0 || digits > 7) {
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "Bad HTTP chunk size");
+      }
+      if (size > maxBodySize_ - bodyLength_) {
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "HTTP request body too large");
+      }
+      chunkLeft_ = size;
+      state_ = (size == 0) ? READ_TRAILERS : READ_CHUNK_DATA;
+      break;
+    }
+
+    case READ_CHUNK_DATA: {
+      // Move the chunk up against the body so far
+      uint32_t give = len - pos_;
+      if (give > chunkLeft_) {
+        give = chunkLeft_;
+      }
+      memmove(buf + bodyOffset_ + bodyLength_, buf + pos_, give);
+      bodyLength_ += give;
+      pos_ += give;
+      chunkLeft_ -= give;
+      if (chunkLeft_ > 0) {
+        return false;
+      }
+      state_ = READ_CHUNK_END;
+      break;
+    }
+
+    case READ_CHUNK_END:
+      if (!readLine(buf, len, &start, &lineLen)) {
+        return false;
+      }
+      if (lineLen != 0) {
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "HTTP chunk longer than its size");
+      }
+      state_ = READ_CHUNK_SIZE;
+      break;
+
+    case READ_TRAILERS:
+      if (!readLine(buf, len, &start, &lineLen)) {
+        return false;
+      }
+      if (pos_ - bodyOffset_ - bodyLength_ > MAX_HEADER_SIZE) {
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "HTTP trailers too long");
+      }
+      if (lineLen == 0) {
+        state_ = DONE;
+      }
+      break;
+
+    case DONE:
+      return true;
+    }
+  }
+}
+
+void THttpRequestParser::parseRequestLine(const char* line, uint32_t len) {
+  const char* method = line;
+  const char* space = (const char*)memchr(line, ' ', len);
+  const char* lastSpace = space;
+  for (const char* p = line + len - 1; p > space; --p) {
+    if (*p == ' ') {
+      lastSpace = p;
+      break;
+    }
+  }
+  if (space == NULL || lastSpace == space) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Bad HTTP request line: " + string(line, len));
+  }
+
+  // Calls only come as POSTs
+  if (!tokenIs(method, space - method, "POST")) {
+    throw TTransportException(TTransportException::CORRUPTED_DATA,
+                              "Unsupported HTTP method: " + string(method, space - method));
+  }
+
+  // HTTP/1.0 clients close the connection unless told otherwise
+  keepAlive_ = !tokenIs(lastSpace + 1, (line + len) - (lastSpace + 1), "HTTP/1.0");
+}
+
+void THttpRequestParser::parseHeader(const char* line, uint32_t len) {
+  const char* colon = (const char*)memchr(line, ':', len);
+  if (colon == NULL) {
+    return;
+  }
+  uint32_t nameLen = colon - line;
+  const char* value = colon + 1;
+  uint32_t valueLen = len - nameLen - 1;
+
+  if (tokenIs(line, nameLen, "Content-Length")) {
+    contentLength_ = 0;
+    for (uint32_t i = 0; i < valueLen; ++i) {
+      if (value[i] >= '0' && value[i] <= '9') {
+        // Can't overflow, as contentLength_ is at most maxBodySize_
+        uint64_t length = (uint64_t)contentLength_ * 10 + (value[i] - '0');
+        if (length > maxBodySize_) {
+          throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                    "HTTP request body too large");
+        }
+        contentLength_ = (uint32_t)length;
+      } else if (value[i] != ' ') {
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "Bad HTTP Content-Length");
+      }
+    }
+  } else if (tokenIs(line, nameLen, "Transfer-Encoding")) {
+    chunked_ = tokenIn(value, valueLen, "chunked");
+  } else if (tokenIs(line, nameLen, "Connection")) {
+    if (tokenIn(value, valueLen, "close")) {
+      keepAlive_ = false;
+    } else if (tokenIn(value, valueLen, "keep-alive")) {
+      keepAlive_ = true;
+    }
+  } else if (tokenIs(line, nameLen, "Expect")) {
+    expectContinue_ = tokenIn(value, valueLen, "100-continue");
+  }
+}
+
+
+THttpServer::THttpServer(boost::shared_ptr<TTransport> transport, string contentType) :
+  transport_(transport),
+  contentType_(contentType),
+  responded_(true),
+  httpBuf_(NULL),
+  httpBufLen_(0),
+  httpBufSize_(1024) {
+  httpBuf_ = (uint8_t*)std::malloc(httpBufSize_);
+  if (httpBuf_ == NULL) {
+    throw TTransportException("Out of memory.");
+  }
+}
+
+THttpServer::~THttpServer() {
+  std::free(httpBuf_);
+}
+
+uint32_t THttpServer::read(uint8_t* buf, uint32_t len) {
+  if (readBuffer_.available_read() == 0) {
+    if (!readRequest()) {
+      return 0;
+    }
+  }
+  return readBuffer_.read(buf, len);
+}
+
+bool THttpServer::readRequest() {
+  // Every request gets a response, even a oneway call
+  if (!responded_) {
+    flush();
+  }
+
+  // Drop the last request, keeping any that were pipelined after it
+  uint32_t used = parser_.getRequestLength();
+  memmove(httpBuf_, httpBuf_ + used, httpBufLen_ - used);
+  httpBufLen_ -= used;
+  parser_.reset();
+
+  bool continued = false;
+  while (!parser_.parse(httpBuf_, httpBufLen_)) {
+    if (parser_.headersDone() && parser_.expectContinue() && !continued) {
+      transport_->write((const uint8_t*)CONTINUE_RESPONSE, strlen(CONTINUE_RESPONSE));
+      transport_->flush();
+      continued = true;
+    }
+
+    // The buffer only fills up with the request being parsed, so the
+    // parser's limits bound how far it grows
+    if (httpBufLen_ == httpBufSize_) {
+      uint8_t* newBuf = (uint8_t*)std::realloc(httpBuf_, httpBufSize_ * 2);
+      if (newBuf == NULL) {
+        throw TTransportException("Out of memory.");
+      }
+      httpBuf_ = newBuf;
+      httpBufSize_ *= 2;
+    }
+
+    uint32_t got = transport_->read(httpBuf_ + httpBufLen_, httpBufSize_ - httpBufLen_);
+    if (got == 0) {
+      if (httpBufLen_ == 0) {
+        return false;
+      }
+      throw TTransportException(TTransportException::END_OF_FILE,
+                                "Connection closed in the middle of an HTTP request");
+    }
+    httpBufLen_ += got;
+  }
+
+  // The body is read where it is, until the next request is received
+  readBuffer_.resetBuffer(httpBuf_ + parser_.getBodyOffset(), parser_.getBodyLength());
+  responded_ = false;
+  return true;
+}
+
+void THttpServer::write(const uint8_t* buf, uint32_t len) {
+  writeBuffer_.write(buf, len);
+}
+
+void THttpServer::flush() {
+  uint8_t* buf;
+  uint32_t len;
+  writeBuffer_.getBuffer(&buf, &len);
+
+  bool chunked = parser_.isChunked() && len > 0;
+  string header(RESPONSE_HEADER_SIZE + contentType_.size(), '\0');
+  header.resize(writeResponseHeader(&header[0], len, chunked, parser_.isKeepAlive(),
+                                    contentType_));
+
+  // Write the header, the data and any chunk trailer together
+  struct iovec iov[3];
+  iov[0].iov_base = &header[0];
+  iov[0].iov_len = header.size();
+  iov[1].iov_base = buf;
+  iov[1].iov_len = len;
+  iov[2].iov_base = (void*)CHUNKED_RESPONSE_END;
+  iov[2].iov_len = strlen(CHUNKED_RESPONSE_END);
+  transport_->writev(iov, chunked ? 3 : 2);
+  transport_->flush();
+
+  writeBuffer_.resetBuffer();
+  responded_ = true;
+
+  if (!parser_.isKeepAlive()) {
+    transport_->close();
+  }
+}
+
+uint32_t THttpServer::writeResponseHeader(char* buf, uint32_t len, bool chunked, bool keepAlive,
+                                          const string& contentType) {
+  uint32_t size = RESPONSE_HEADER_SIZE + contentType.size();
+  int n;
+  if (chunked) {
+    n = snprintf(buf, size,
+                 "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n%s"
+                 "Transfer-Encoding: chunked\r\n\r\n%x\r\n",
+                 contentType.c_str(), keepAlive ? "" : "Connection: close\r\n", len);
+  } else {
+    n = snprintf(buf, size,
+                 "HTTP/1.1 200 OK\r\nContent-Type: %s\r\n%s"
+                 "Content-Length: %u\r\n\r\n",
+                 contentType.c_str(), keepAlive ? "" : "Connection: close\r\n", len);
+  }
+  assert(n > 0 && (uint32_t)n < size);
+  return n;
+}
+
+}}} // apache::thrift::transport
@@ -0,0 +1,252 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_THTTPSERVER_H_
+#define _THRIFT_TRANSPORT_THTTPSERVER_H_ 1
+
+#include <string>
+#include <transport/TBufferTransports.h>
+
+namespace apache { namespace thrift { namespace transport {
+
+/**
+ * Incremental parser for the HTTP POST requests that carry Thrift calls.
+ * It works on a buffer holding what has been received of a request so far,
+ * picking up where it left off each time more arrives, so it suits
+ * non-blocking servers as well as blocking ones.  The buffer may be moved
+ * or grown between calls, as only offsets into it are kept.
+ */
+class THttpRequestParser {
+ public:
+  /// Longest request line and headers accepted
+  static const uint32_t MAX_HEADER_SIZE = 64 * 1024;
+
+  /// Largest request body accepted unless configured otherwise
+  static const uint32_t DEFAULT_MAX_BODY_SIZE = 64 * 1024 * 1024;
+
+  explicit THttpRequestParser(uint32_t maxBodySize = DEFAULT_MAX_BODY_SIZE) :
+    maxBodySize_(maxBodySize) {
+    reset();
+  }
+
+  /// Prepares to parse a new request.
+  void reset();
+
+  /**
+   * Bounds the body of the requests parsed from now on, and with it the
+   * buffer that holds them; a longer body is a parse error.
+   */
+  void setMaxBodySize(uint32_t maxBodySize) {
+    maxBodySize_ = maxBodySize;
+  }
+
+  uint32_t getMaxBodySize() const {
+    return maxBodySize_;
+  }
+
+  /**
+   * Parses more of the request at the start of buf, of which len bytes have
+   * been received.  A chunked body is moved together within buf as it is
+   * parsed, so the body always ends up in one piece.
+   *
+   * @return true once the whole request has been received.
+   * @throws TTransportException if the request is malformed.
+   */
+  bool parse(uint8_t* buf, uint32_t len);
+
+  /// Whether the request line and headers have all been received.
+  bool headersDone() const {
+    return state_ != READ_HEADERS;
+  }
+
+  /// Whether the client waits for "100 Continue" before sending the body.
+  bool expectContinue() const {
+    return expectContinue_;
+  }
+
+  /// Whether the connection stays open after the response.
+  bool isKeepAlive() const {
+    return keepAlive_;
+  }
+
+  /// Whether the body was sent in chunks.
+  bool isChunked() const {
+    return chunked_;
+  }
+
+  uint32_t getBodyOffset() const {
+    return bodyOffset_;
+  }
+
+  uint32_t getBodyLength() const {
+    return bodyLength_;
+  }
+
+  /// Bytes of buf the request took up; any more belong to the next one.
+  uint32_t getRequestLength() const {
+    return pos_;
+  }
+
+ private:
+  enum State {
+    READ_HEADERS,
+    READ_BODY,
+    READ_CHUNK_SIZE,
+    READ_CHUNK_DATA,
+    READ_CHUNK_END,
+    READ_TRAILERS,
+    DONE
+  };
+
+  bool readLine(const uint8_t* buf, uint32_t len, uint32_t* lineStart, uint32_t* lineLen);
+  void parseRequestLine(const char* line, uint32_t len);
+  void parseHeader(const char* line, uint32_t len);
+
+  uint32_t maxBodySize_;
+  State state_;
+  uint32_t pos_;
+  bool requestLine_;
+  bool keepAlive_;
+  bool chunked_;
+  bool expectContinue_;
+  uint32_t contentLength_;
+  uint32_t chunkLeft_;
+  uint32_t bodyOffset_;
+  uint32_t bodyLength_;
+};
+
+/**
+ * Server side of THttpClient, for blocking servers.  Each request is the
+ * body of an HTTP POST, and each response goes back as the body of a 200
+ * response.  Connections are kept alive unless the client asks otherwise,
+ * and pipelined requests are answered in order.
+ *
+ * TNonblockingServer speaks the same protocol with setHttp(), using
+ * THttpRequestParser and writeResponseHeader() directly.
+ */
+class THttpServer : public TVirtualTransport<THttpServer> {
+ public:
+  /// Room that writeResponseHeader() needs beyond the content type
+  static const uint32_t RESPONSE_HEADER_SIZE = 160;
+
+  THttpServer(boost::shared_ptr<TTransport> transport,
+              std::string contentType = "application/x-thrift");
+
+  ~THttpServer();
+
+  void open() {
+    transport_->open();
+  }
+
+  bool isOpen() {
+    return transport_->isOpen();
+  }
+
+  bool peek() {
+    return (readBuffer_.available_read() > 0) ||
+      (httpBufLen_ > parser_.getRequestLength()) || transport_->peek();
+  }
+
+  void close() {
+    transport_->close();
+  }
+
+  uint32_t read(uint8_t* buf, uint32_t len);
+
+  void write(const uint8_t* buf, uint32_t len);
+
+  void flush();
+
+  /// Limits request bodies, as THttpRequestParser::setMaxBodySize().
+  void setMaxBodySize(uint32_t maxBodySize) {
+    parser_.setMaxBodySize(maxBodySize);
+  }
+
+  /**
+   * Formats the header of a response with a body of len bytes into buf,
+   * which must have room for RESPONSE_HEADER_SIZE bytes more than the
+   * content type.  A chunked response, which must not be empty, is sent
+   * as a single chunk whose size line is included here, and the body is
+   * followed by CHUNKED_RESPONSE_END.
+   *
+   * @return the length of the header.
+   */
+  static uint32_t writeResponseHeader(char* buf, uint32_t len, bool chunked, bool keepAlive,
+                                      const std::string& contentType);
+
+  /// What follows the body of a chunked response.
+  static const char* CHUNKED_RESPONSE_END;
+
+ protected:
+  /**
+   * Receives the next request, and leaves its body in readBuffer_.
+   *
+   * @return false if the client closed the connection instead.
+   */
+  bool readRequest();
+
+  boost::shared_ptr<TTransport> transport_;
+  std::string contentType_;
+
+  THttpRequestParser parser_;
+  bool responded_;
+  TMemoryBuffer readBuffer_;
+  TMemoryBuffer writeBuffer_;
+
+  uint8_t* httpBuf_;
+  uint32_t httpBufLen_;
+  uint32_t httpBufSize_;
+};
+
+/**
+ * Wraps the transports of accepted connections in THttpServer.  It has to
+ * make both the input and the output transports, since a response has to
+ * follow the request it answers: getTransports() gives both sides of a
+ * connection the same THttpServer.
+ */
+class THttpServerTransportFactory : public TTransportFactory {
+ public:
+  THttpServerTransportFactory(std::string contentType = "application/x-thrift",
+                              uint32_t maxBodySize = THttpRequestParser::DEFAULT_MAX_BODY_SIZE)
+    : contentType_(contentType),
+      maxBodySize_(maxBodySize) {}
+
+  virtual ~THttpServerTransportFactory() {}
+
+  virtual boost::shared_ptr<TTransport> getTransport(boost::shared_ptr<TTransport> trans) {
+    THttpServer* server = new THttpServer(trans, contentType_);
+    server->setMaxBodySize(maxBodySize_);
+    return boost::shared_ptr<TTransport>(server);
+  }
+
+  virtual void getTransports(boost::shared_ptr<TTransport> trans,
+                             boost::shared_ptr<TTransport>& input,
+                             boost::shared_ptr<TTransport>& output) {
+    input = getTransport(trans);
+    output = input;
+  }
+
+ private:
+  std::string contentType_;
+  uint32_t maxBodySize_;
+};
+
+}}} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_THTTPSERVER_H_
@@ -18,6 +18,7 @@
  */
 
 #include <config.h>
+#include <algorithm>
 #include <cstring>
 #include <sstream>
 #include <sys/socket.h>
@@ -30,6 +31,8 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <vector>
 
 #include "concurrency/Monitor.h"
 #include "TSocket.h"
@@ -42,6 +45,10 @@ using namespace std;
 // Global var to track total socket sys calls
 uint32_t g_socket_syscalls = 0;
 
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
+
 /**
  * TSocket implementation.
  *
@@ -430,6 +437,53 @@ void TSocket::write(const uint8_t* buf, uint32_t len) {
   }
 }
 
+void TSocket::writev(const struct iovec* iov, int iovcnt) {
+  if (socket_ < 0) {
+    throw TTransportException(TTransportException::NOT_OPEN, "Called writev on non-open socket");
+  }
+
+  // sendmsg() may stop part way through, so work on a copy we can advance
+  std::vector<struct iovec> pending(iov, iov + iovcnt);
+  struct iovec* cur = pending.empty() ? NULL : &pending[0];
+  advanceIovec(cur, iovcnt, 0);
+
+  while (iovcnt > 0) {
+
+    int flags = 0;
+    #ifdef MSG_NOSIGNAL
+    // Suppress SIGPIPE, as in write()
+    flags |= MSG_NOSIGNAL;
+    #endif // ifdef MSG_NOSIGNAL
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = cur;
+    msg.msg_iovlen = std::min(iovcnt, IOV_MAX);
+
+    ssize_t b = sendmsg(socket_, &msg, flags);
+    ++g_socket_syscalls;
+
+    // Fail on a send error
+    if (b < 0) {
+      int errno_copy = errno;
+      GlobalOutput.perror("TSocket::writev() sendmsg() " + getSocketInfo(), errno_copy);
+
+      if (errno_copy == EPIPE || errno_copy == ECONNRESET || errno_copy == ENOTCONN) {
+        close();
+        throw TTransportException(TTransportException::NOT_OPEN, "writev() sendmsg()", errno_copy);
+      }
+
+      throw TTransportException(TTransportException::UNKNOWN, "writev() sendmsg()", errno_copy);
+    }
+
+    // Fail on blocked send
+    if (b == 0) {
+      throw TTransportException(TTransportException::NOT_OPEN, "Socket sendmsg returned 0.");
+    }
+    advanceIovec(cur, iovcnt, b);
+  }
+}
+
 std::string TSocket::getHost() {
   return host_;
 }
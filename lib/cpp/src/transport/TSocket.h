@@ -25,6 +25,7 @@
 #include <netdb.h>
 
 #include "TTransport.h"
+#include "TVirtualTransport.h"
 #include "TServerSocket.h"
 
 namespace apache { namespace thrift { namespace transport {
@@ -33,7 +34,7 @@ namespace apache { namespace thrift { namespace transport {
  * TCP Socket implementation of the TTransport interface.
  *
  */
-class TSocket : public TTransport {
+class TSocket : public TVirtualTransport<TSocket> {
   /**
    * We allow the TServerSocket acceptImpl() method to access the private
    * members of a socket so that it can access the TSocket(int socket)
@@ -98,6 +99,11 @@ class TSocket : public TTransport {
    */
   void write(const uint8_t* buf, uint32_t len);
 
+  /**
+   * Writes several buffers to the underlying socket with sendmsg().
+   */
+  void writev(const struct iovec* iov, int iovcnt);
+
   /**
    * Get the host that the socket is connected to
    *
@@ -24,13 +24,84 @@
 #include <boost/shared_ptr.hpp>
 #include <transport/TTransportException.h>
 #include <string>
+#include <sys/uio.h>
 
 namespace apache { namespace thrift { namespace transport {
 
+/**
+ * Helper template to hoist readAll implementation out of TTransport
+ */
+template <class Transport_>
+uint32_t readAll(Transport_ &trans, uint8_t* buf, uint32_t len) {
+  uint32_t have = 0;
+  uint32_t get = 0;
+
+  while (have < len) {
+    get = trans.read(buf+have, len-have);
+    if (get <= 0) {
+      throw TTransportException(TTransportException::END_OF_FILE,
+                                "No more data to read.");
+    }
+    have += get;
+  }
+
+  return have;
+}
+
+/**
+ * Helper template to discard exactly len bytes from a transport.  Bytes
+ * that are already buffered are dropped with borrow()/consume(); otherwise
+ * they are read into a scratch buffer and thrown away.
+ */
+template <class Transport_>
+uint32_t skipAll(Transport_ &trans, uint32_t len) {
+  uint32_t got = len;
+  if (trans.borrow(NULL, &got) != NULL) {
+    trans.consume(len);
+    return len;
+  }
+
+  uint8_t scratch[512];
+  uint32_t remaining = len;
+  while (remaining > 0) {
+    uint32_t chunk = remaining < sizeof(scratch) ? remaining : sizeof(scratch);
+    trans.readAll(scratch, chunk);
+    remaining -= chunk;
+  }
+
+  return len;
+}
+
+/**
+ * Helper for writev() implementations: steps past len bytes that were
+ * written from the front of an iovec array, adjusting the first remaining
+ * entry in place.  Entries that have been used up (or were empty) are
+ * dropped from the front.
+ */
+inline void advanceIovec(struct iovec*& iov, int& iovcnt, size_t len) {
+  while (iovcnt > 0 && len >= iov->iov_len) {
+    len -= iov->iov_len;
+    ++iov;
+    --iovcnt;
+  }
+  if (len > 0) {
+    iov->iov_base = static_cast<char*>(iov->iov_base) + len;
+    iov->iov_len -= len;
+  }
+}
+
+
 /**
  * Generic interface for a method of transporting data. A TTransport may be
  * capable of either reading or writing, but not necessarily both.
  *
+ * The data-path methods (read, readAll, write, borrow, consume) are
+ * non-virtual wrappers around *_virt() methods.  Subclasses should derive
+ * from TVirtualTransport, which implements the *_virt() methods in terms of
+ * the subclass's own non-virtual methods.  This lets code that knows the
+ * concrete transport type (e.g. TBinaryProtocolT<TMemoryBuffer>) call those
+ * methods directly, so they can be inlined.
+ *
  */
 class TTransport {
  public:
@@ -83,7 +154,10 @@ class TTransport {
    * @return How many bytes were actually read
    * @throws TTransportException If an error occurs
    */
-  virtual uint32_t read(uint8_t* /* buf */, uint32_t /* len */) {
+  uint32_t read(uint8_t* buf, uint32_t len) {
+    return read_virt(buf, len);
+  }
+  virtual uint32_t read_virt(uint8_t* /* buf */, uint32_t /* len */) {
     throw TTransportException(TTransportException::NOT_OPEN, "Base TTransport cannot read.");
   }
 
@@ -95,20 +169,11 @@ class TTransport {
    * @return How many bytes read, which must be equal to size
    * @throws TTransportException If insufficient data was read
    */
-  virtual uint32_t readAll(uint8_t* buf, uint32_t len) {
-    uint32_t have = 0;
-    uint32_t get = 0;
-
-    while (have < len) {
-      get = read(buf+have, len-have);
-      if (get <= 0) {
-        throw TTransportException(TTransportException::END_OF_FILE,
-				  "No more data to read.");
-      }
-      have += get;
-    }
-
-    return have;
+  uint32_t readAll(uint8_t* buf, uint32_t len) {
+    return readAll_virt(buf, len);
+  }
+  virtual uint32_t readAll_virt(uint8_t* buf, uint32_t len) {
+    return apache::thrift::transport::readAll(*this, buf, len);
   }
 
   /**
@@ -128,10 +193,31 @@ class TTransport {
    * @param buf  The data to write out
    * @throws TTransportException if an error occurs
    */
-  virtual void write(const uint8_t* /* buf */, uint32_t /* len */) {
+  void write(const uint8_t* buf, uint32_t len) {
+    write_virt(buf, len);
+  }
+  virtual void write_virt(const uint8_t* /* buf */, uint32_t /* len */) {
     throw TTransportException(TTransportException::NOT_OPEN, "Base TTransport cannot write.");
   }
 
+  /**
+   * Writes the contents of several buffers, in order and in their entirety.
+   * Transports backed by a file descriptor do this with a single writev()
+   * call where they can; the default writes each buffer in turn.
+   *
+   * @param iov     The buffers to write out
+   * @param iovcnt  How many buffers there are
+   * @throws TTransportException if an error occurs
+   */
+  void writev(const struct iovec* iov, int iovcnt) {
+    writev_virt(iov, iovcnt);
+  }
+  virtual void writev_virt(const struct iovec* iov, int iovcnt) {
+    for (int i = 0; i < iovcnt; ++i) {
+      write(static_cast<const uint8_t*>(iov[i].iov_base), iov[i].iov_len);
+    }
+  }
+
   /**
    * Called when write is completed.
    * This can be over-ridden to perform a transport-specific action
@@ -151,6 +237,15 @@ class TTransport {
    */
   virtual void flush() {}
 
+  /**
+   * Hints that about len more bytes are going to be written before the
+   * next flush, so that buffering transports can size their write buffer
+   * once instead of growing it repeatedly.  The default does nothing.
+   *
+   * @param len  How many bytes are about to be written
+   */
+  virtual void reserve(uint32_t /* len */) {}
+
   /**
    * Attempts to return a pointer to \c len bytes, possibly copied into \c buf.
    * Does not consume the bytes read (i.e.: a later read will return the same
@@ -175,7 +270,10 @@ class TTransport {
    *         the transport's internal buffers.
    * @throws TTransportException if an error occurs
    */
-  virtual const uint8_t* borrow(uint8_t* /* buf */, uint32_t* /* len */) {
+  const uint8_t* borrow(uint8_t* buf, uint32_t* len) {
+    return borrow_virt(buf, len);
+  }
+  virtual const uint8_t* borrow_virt(uint8_t* /* buf */, uint32_t* /* len */) {
     return NULL;
   }
 
@@ -188,7 +286,10 @@ class TTransport {
    * @param len  How many bytes to consume
    * @throws TTransportException If an error occurs
    */
-  virtual void consume(uint32_t /* len */) {
+  void consume(uint32_t len) {
+    consume_virt(len);
+  }
+  virtual void consume_virt(uint32_t /* len */) {
     throw TTransportException(TTransportException::NOT_OPEN, "Base TTransport cannot consume.");
   }
 
@@ -218,6 +319,19 @@ class TTransportFactory {
     return trans;
   }
 
+  /**
+   * Wraps a connection's transport for both input and output, when this
+   * factory makes both.  Transports that have to pair a response with its
+   * request hand back the same object for each.  The default calls
+   * getTransport() once for each.
+   */
+  virtual void getTransports(boost::shared_ptr<TTransport> trans,
+                             boost::shared_ptr<TTransport>& input,
+                             boost::shared_ptr<TTransport>& output) {
+    input = getTransport(trans);
+    output = getTransport(trans);
+  }
+
 };
 
 }}} // apache::thrift::transport
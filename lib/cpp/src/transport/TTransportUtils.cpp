@@ -23,6 +23,198 @@ using std::string;
 
 namespace apache { namespace thrift { namespace transport {
 
+const uint32_t TAsyncPipeSink::DEFAULT_MAX_QUEUED_BYTES;
+
+TAsyncPipeSink::TAsyncPipeSink(boost::shared_ptr<TTransport> dstTrans,
+                               uint32_t maxQueuedBytes,
+                               boost::shared_ptr<TBufferPool> pool) :
+  dstTrans_(dstTrans),
+  pool_(pool),
+  maxQueuedBytes_(maxQueuedBytes),
+  closing_(false),
+  failed_(false),
+  queuedBytes_(0),
+  submitted_(0),
+  written_(0),
+  dropped_(0),
+  droppedBytes_(0) {
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&notEmpty_, NULL);
+  pthread_cond_init(&drained_, NULL);
+
+  if (pthread_create(&writerThreadId_, NULL, startWriterThread, (void *)this) != 0) {
+    pthread_cond_destroy(&drained_);
+    pthread_cond_destroy(&notEmpty_);
+    pthread_mutex_destroy(&mutex_);
+    throw TTransportException("Could not create writer thread");
+  }
+}
+
+TAsyncPipeSink::~TAsyncPipeSink() {
+  pthread_mutex_lock(&mutex_);
+  closing_ = true;
+  pthread_cond_signal(&notEmpty_);
+  pthread_mutex_unlock(&mutex_);
+  pthread_join(writerThreadId_, NULL);
+
+  pthread_cond_destroy(&drained_);
+  pthread_cond_destroy(&notEmpty_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+bool TAsyncPipeSink::submit(const uint8_t* buf, uint32_t len) {
+  if (len == 0) {
+    return true;
+  }
+
+  pthread_mutex_lock(&mutex_);
+  ++submitted_;
+  if (failed_ || queuedBytes_ + len > maxQueuedBytes_) {
+    ++dropped_;
+    droppedBytes_ += len;
+    pthread_mutex_unlock(&mutex_);
+    return false;
+  }
+  queuedBytes_ += len;
+  pthread_mutex_unlock(&mutex_);
+
+  // Copy outside the lock; the room for it is already taken
+  Capture capture;
+  capture.size = len;
+  capture.buf = pool_ ? pool_->get(&capture.size) : new uint8_t[len];
+  capture.len = len;
+  memcpy(capture.buf, buf, len);
+
+  pthread_mutex_lock(&mutex_);
+  bool wasEmpty = queue_.empty();
+  queue_.push_back(capture);
+  if (wasEmpty) {
+    pthread_cond_signal(&notEmpty_);
+  }
+  pthread_mutex_unlock(&mutex_);
+  return true;
+}
+
+void TAsyncPipeSink::drain() {
+  // Bytes stay queued until they have been written and flushed
+  pthread_mutex_lock(&mutex_);
+  while (queuedBytes_ > 0) {
+    pthread_cond_wait(&drained_, &mutex_);
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+void TAsyncPipeSink::writerThread() {
+  std::vector<Capture> batch;
+  pthread_mutex_lock(&mutex_);
+  while (true) {
+    while (queue_.empty() && !closing_) {
+      pthread_cond_wait(&notEmpty_, &mutex_);
+    }
+    if (queue_.empty()) {
+      break;
+    }
+    batch.assign(queue_.begin(), queue_.end());
+    queue_.clear();
+    bool sinkFailed = failed_;
+    pthread_mutex_unlock(&mutex_);
+
+    // Everything that queued up while the last batch was written goes out
+    // with a single flush
+    uint32_t bytes = 0;
+    uint32_t failed = 0;
+    size_t i = 0;
+    if (sinkFailed) {
+      failed = batch.size();
+    } else {
+      try {
+        for (; i < batch.size(); ++i) {
+          dstTrans_->write(batch[i].buf, batch[i].len);
+        }
+        // Nothing is written until the flush goes through
+        i = 0;
+        dstTrans_->flush();
+      } catch (TTransportException& ttx) {
+        GlobalOutput.printf("TAsyncPipeSink: dropping captures after write error: %s", ttx.what());
+        failed = batch.size() - i;
+      } catch (std::exception& x) {
+        GlobalOutput.printf("TAsyncPipeSink: giving up after write error: %s", x.what());
+        failed = batch.size() - i;
+        sinkFailed = true;
+      } catch (...) {
+        GlobalOutput.printf("TAsyncPipeSink: giving up after unknown write error");
+        failed = batch.size() - i;
+        sinkFailed = true;
+      }
+    }
+    uint32_t failedBytes = 0;
+    for (i = 0; i < batch.size(); ++i) {
+      bytes += batch[i].len;
+      if (i >= batch.size() - failed) {
+        failedBytes += batch[i].len;
+      }
+      if (pool_) {
+        pool_->put(batch[i].buf, batch[i].size);
+      } else {
+        delete[] batch[i].buf;
+      }
+    }
+
+    pthread_mutex_lock(&mutex_);
+    failed_ = sinkFailed;
+    written_ += batch.size() - failed;
+    dropped_ += failed;
+    droppedBytes_ += failedBytes;
+    queuedBytes_ -= bytes;
+    if (queuedBytes_ == 0) {
+      pthread_cond_broadcast(&drained_);
+    }
+  }
+  pthread_mutex_unlock(&mutex_);
+}
+
+uint64_t TAsyncPipeSink::getSubmitted() {
+  pthread_mutex_lock(&mutex_);
+  uint64_t submitted = submitted_;
+  pthread_mutex_unlock(&mutex_);
+  return submitted;
+}
+
+uint64_t TAsyncPipeSink::getWritten() {
+  pthread_mutex_lock(&mutex_);
+  uint64_t written = written_;
+  pthread_mutex_unlock(&mutex_);
+  return written;
+}
+
+uint64_t TAsyncPipeSink::getDropped() {
+  pthread_mutex_lock(&mutex_);
+  uint64_t dropped = dropped_;
+  pthread_mutex_unlock(&mutex_);
+  return dropped;
+}
+
+uint64_t TAsyncPipeSink::getDroppedBytes() {
+  pthread_mutex_lock(&mutex_);
+  uint64_t droppedBytes = droppedBytes_;
+  pthread_mutex_unlock(&mutex_);
+  return droppedBytes;
+}
+
+uint32_t TAsyncPipeSink::getQueuedBytes() {
+  pthread_mutex_lock(&mutex_);
+  uint32_t queuedBytes = queuedBytes_;
+  pthread_mutex_unlock(&mutex_);
+  return queuedBytes;
+}
+
+bool TAsyncPipeSink::isFailed() {
+  pthread_mutex_lock(&mutex_);
+  bool failed = failed_;
+  pthread_mutex_unlock(&mutex_);
+  return failed;
+}
+
 uint32_t TPipedTransport::read(uint8_t* buf, uint32_t len) {
   uint32_t need = len;
 
@@ -30,20 +222,19 @@ uint32_t TPipedTransport::read(uint8_t* buf, uint32_t len) {
   if (rLen_-rPos_ < need) {
     // Copy out whatever we have
     if (rLen_-rPos_ > 0) {
-      memcpy(buf, rBuf_+rPos_, rLen_-rPos_);
+      memcpy(buf, rBuf_.get() + rPos_, rLen_-rPos_);
       need -= rLen_-rPos_;
       buf += rLen_-rPos_;
       rPos_ = rLen_;
     }
 
     // Double the size of the underlying buffer if it is full
-    if (rLen_ == rBufSize_) {
-      rBufSize_ *=2;
-      rBuf_ = (uint8_t *)std::realloc(rBuf_, sizeof(uint8_t) * rBufSize_);
+    if (rLen_ == rBuf_.size()) {
+      rBuf_.resize(rBuf_.size() * 2, rLen_);
     }
 
     // try to fill up the buffer
-    rLen_ += srcTrans_->read(rBuf_+rPos_, rBufSize_ - rPos_);
+    rLen_ += srcTrans_->read(rBuf_.get() + rPos_, rBuf_.size() - rPos_);
   }
 
 
@@ -53,7 +244,7 @@ uint32_t TPipedTransport::read(uint8_t* buf, uint32_t len) {
     give = rLen_-rPos_;
   }
   if (give > 0) {
-    memcpy(buf, rBuf_+rPos_, give);
+    memcpy(buf, rBuf_.get() + rPos_, give);
     rPos_ += give;
     need -= give;
   }
@@ -67,24 +258,23 @@ void TPipedTransport::write(const uint8_t* buf, uint32_t len) {
   }
 
   // Make the buffer as big as it needs to be
-  if ((len + wLen_) >= wBufSize_) {
-    uint32_t newBufSize = wBufSize_*2;
+  if ((len + wLen_) >= wBuf_.size()) {
+    uint32_t newBufSize = wBuf_.size()*2;
     while ((len + wLen_) >= newBufSize) {
       newBufSize *= 2;
     }
-    wBuf_ = (uint8_t *)std::realloc(wBuf_, sizeof(uint8_t) * newBufSize);
-    wBufSize_ = newBufSize;
+    wBuf_.resize(newBufSize, wLen_);
   }
 
   // Copy into the buffer
-  memcpy(wBuf_ + wLen_, buf, len);
+  memcpy(wBuf_.get() + wLen_, buf, len);
   wLen_ += len;
 }
 
 void TPipedTransport::flush()  {
   // Write out any data waiting in the write buffer
   if (wLen_ > 0) {
-    srcTrans_->write(wBuf_, wLen_);
+    srcTrans_->write(wBuf_.get(), wLen_);
     wLen_ = 0;
   }
 
@@ -23,7 +23,11 @@
 #include <cstdlib>
 #include <cstring>
 #include <string>
+#include <deque>
+#include <vector>
 #include <algorithm>
+#include <pthread.h>
+#include <boost/noncopyable.hpp>
 #include <transport/TTransport.h>
 // Include the buffered transports that used to be defined here.
 #include <transport/TBufferTransports.h>
@@ -38,7 +42,7 @@ namespace apache { namespace thrift { namespace transport {
  * go anywhere.
  *
  */
-class TNullTransport : public TTransport {
+class TNullTransport : public TVirtualTransport<TNullTransport> {
  public:
   TNullTransport() {}
 
@@ -57,12 +61,93 @@ class TNullTransport : public TTransport {
 };
 
 
+/**
+ * Passes what TPipedTransports capture on to their target transport from a
+ * background thread, so that logging requests adds no more to their latency
+ * than a copy.  Captures are copied into buffers from a TBufferPool and
+ * queued, and the thread writes whatever has queued up since it last woke,
+ * one write() per capture, then calls flush() once for all of them.  When
+ * the queue holds maxQueuedBytes, captures are dropped and counted instead.
+ * A batch that fails with a TTransportException is dropped; anything else
+ * thrown by the target fails the sink, which then drops every capture.
+ */
+class TAsyncPipeSink : boost::noncopyable {
+ public:
+  static const uint32_t DEFAULT_MAX_QUEUED_BYTES = 16 * 1024 * 1024;
+
+  TAsyncPipeSink(boost::shared_ptr<TTransport> dstTrans,
+                 uint32_t maxQueuedBytes = DEFAULT_MAX_QUEUED_BYTES,
+                 boost::shared_ptr<TBufferPool> pool = TBufferPool::getDefaultPool());
+
+  /// Writes out what is queued, then stops the thread.
+  ~TAsyncPipeSink();
+
+  /**
+   * Queues a copy of len bytes from buf to be written.
+   *
+   * @return false if it was dropped because the queue is full.
+   */
+  bool submit(const uint8_t* buf, uint32_t len);
+
+  /// Waits until nothing submitted is left to be written and flushed.
+  void drain();
+
+  boost::shared_ptr<TTransport> getTargetTransport() {
+    return dstTrans_;
+  }
+
+  /// Captures submitted, written, and dropped.
+  uint64_t getSubmitted();
+  uint64_t getWritten();
+  uint64_t getDropped();
+  uint64_t getDroppedBytes();
+
+  /// Bytes queued or being written.
+  uint32_t getQueuedBytes();
+
+  /// Whether the target threw something other than a TTransportException.
+  bool isFailed();
+
+ private:
+  struct Capture {
+    uint8_t* buf;
+    uint32_t size;
+    uint32_t len;
+  };
+
+  static void* startWriterThread(void* ptr) {
+    static_cast<TAsyncPipeSink*>(ptr)->writerThread();
+    return NULL;
+  }
+
+  void writerThread();
+
+  boost::shared_ptr<TTransport> dstTrans_;
+  boost::shared_ptr<TBufferPool> pool_;
+  uint32_t maxQueuedBytes_;
+
+  pthread_mutex_t mutex_;
+  pthread_cond_t notEmpty_;
+  pthread_cond_t drained_;
+  pthread_t writerThreadId_;
+  bool closing_;
+  bool failed_;
+
+  std::deque<Capture> queue_;
+  uint32_t queuedBytes_;
+  uint64_t submitted_;
+  uint64_t written_;
+  uint64_t dropped_;
+  uint64_t droppedBytes_;
+};
+
 /**
  * TPipedTransport. This transport allows piping of a request from one
  * transport to another either when readEnd() or writeEnd(). The typical
  * use case for this is to log a request or a reply to disk.
  * The underlying buffer expands to a keep a copy of the entire
- * request/response.
+ * request/response.  With setAsyncSink(), the copy is handed to a
+ * TAsyncPipeSink instead of being written and flushed then and there.
  *
  */
 class TPipedTransport : virtual public TTransport {
@@ -71,15 +156,12 @@ class TPipedTransport : virtual public TTransport {
                   boost::shared_ptr<TTransport> dstTrans) :
     srcTrans_(srcTrans),
     dstTrans_(dstTrans),
-    rBufSize_(512), rPos_(0), rLen_(0),
-    wBufSize_(512), wLen_(0) {
+    rBuf_(boost::shared_ptr<TBufferPool>(), 512), rPos_(0), rLen_(0),
+    wBuf_(boost::shared_ptr<TBufferPool>(), 512), wLen_(0) {
 
     // default is to to pipe the request when readEnd() is called
     pipeOnRead_ = true;
     pipeOnWrite_ = false;
-
-    rBuf_ = (uint8_t*) std::malloc(sizeof(uint8_t) * rBufSize_);
-    wBuf_ = (uint8_t*) std::malloc(sizeof(uint8_t) * wBufSize_);
   }
 
   TPipedTransport(boost::shared_ptr<TTransport> srcTrans,
@@ -87,18 +169,32 @@ class TPipedTransport : virtual public TTransport {
                   uint32_t sz) :
     srcTrans_(srcTrans),
     dstTrans_(dstTrans),
-    rBufSize_(512), rPos_(0), rLen_(0),
-    wBufSize_(sz), wLen_(0) {
+    rBuf_(boost::shared_ptr<TBufferPool>(), 512), rPos_(0), rLen_(0),
+    wBuf_(boost::shared_ptr<TBufferPool>(), sz), wLen_(0) {
 
-    rBuf_ = (uint8_t*) std::malloc(sizeof(uint8_t) * rBufSize_);
-    wBuf_ = (uint8_t*) std::malloc(sizeof(uint8_t) * wBufSize_);
+    pipeOnRead_ = true;
+    pipeOnWrite_ = false;
   }
 
-  ~TPipedTransport() {
-    std::free(rBuf_);
-    std::free(wBuf_);
+  /**
+   * Takes its buffers from pool, and gives them back to it as they grow and
+   * when it is destroyed, instead of using the heap.
+   */
+  TPipedTransport(boost::shared_ptr<TTransport> srcTrans,
+                  boost::shared_ptr<TTransport> dstTrans,
+                  uint32_t sz,
+                  boost::shared_ptr<TBufferPool> pool) :
+    srcTrans_(srcTrans),
+    dstTrans_(dstTrans),
+    rBuf_(pool, 512), rPos_(0), rLen_(0),
+    wBuf_(pool, sz), wLen_(0) {
+
+    pipeOnRead_ = true;
+    pipeOnWrite_ = false;
   }
 
+  ~TPipedTransport() {}
+
   bool isOpen() {
     return srcTrans_->isOpen();
   }
@@ -106,13 +202,12 @@ class TPipedTransport : virtual public TTransport {
   bool peek() {
     if (rPos_ >= rLen_) {
       // Double the size of the underlying buffer if it is full
-      if (rLen_ == rBufSize_) {
-        rBufSize_ *=2;
-        rBuf_ = (uint8_t *)std::realloc(rBuf_, sizeof(uint8_t) * rBufSize_);
+      if (rLen_ == rBuf_.size()) {
+        rBuf_.resize(rBuf_.size() * 2, rLen_);
       }
 
       // try to fill up the buffer
-      rLen_ += srcTrans_->read(rBuf_+rPos_, rBufSize_ - rPos_);
+      rLen_ += srcTrans_->read(rBuf_.get() + rPos_, rBuf_.size() - rPos_);
     }
     return (rLen_ > rPos_);
   }
@@ -134,13 +229,20 @@ class TPipedTransport : virtual public TTransport {
     pipeOnWrite_ = pipeVal;
   }
 
+  /**
+   * Hands what is piped to sink, which writes it to its own target from
+   * its thread, rather than to the target transport.  NULL turns this off.
+   */
+  void setAsyncSink(boost::shared_ptr<TAsyncPipeSink> sink) {
+    sink_ = sink;
+  }
+
   uint32_t read(uint8_t* buf, uint32_t len);
 
   void readEnd() {
 
     if (pipeOnRead_) {
-      dstTrans_->write(rBuf_, rPos_);
-      dstTrans_->flush();
+      pipe(rBuf_.get(), rPos_);
     }
 
     srcTrans_->readEnd();
@@ -148,7 +250,7 @@ class TPipedTransport : virtual public TTransport {
     // If requests are being pipelined, copy down our read-ahead data,
     // then reset our state.
     int read_ahead = rLen_ - rPos_;
-    memcpy(rBuf_, rBuf_ + rPos_, read_ahead);
+    memmove(rBuf_.get(), rBuf_.get() + rPos_, read_ahead);
     rPos_ = 0;
     rLen_ = read_ahead;
   }
@@ -157,8 +259,7 @@ class TPipedTransport : virtual public TTransport {
 
   void writeEnd() {
     if (pipeOnWrite_) {
-      dstTrans_->write(wBuf_, wLen_);
-      dstTrans_->flush();
+      pipe(wBuf_.get(), wLen_);
     }
   }
 
@@ -168,17 +269,37 @@ class TPipedTransport : virtual public TTransport {
     return dstTrans_;
   }
 
+  /*
+   * Override TTransport *_virt() functions to invoke our implementations.
+   * We cannot use TVirtualTransport to provide these, since we need to inherit
+   * virtually from TTransport.
+   */
+  virtual uint32_t read_virt(uint8_t* buf, uint32_t len) {
+    return this->read(buf, len);
+  }
+  virtual void write_virt(const uint8_t* buf, uint32_t len) {
+    this->write(buf, len);
+  }
+
  protected:
+  void pipe(const uint8_t* buf, uint32_t len) {
+    if (sink_) {
+      sink_->submit(buf, len);
+    } else {
+      dstTrans_->write(buf, len);
+      dstTrans_->flush();
+    }
+  }
+
   boost::shared_ptr<TTransport> srcTrans_;
   boost::shared_ptr<TTransport> dstTrans_;
+  boost::shared_ptr<TAsyncPipeSink> sink_;
 
-  uint8_t* rBuf_;
-  uint32_t rBufSize_;
+  TPooledBuffer rBuf_;
   uint32_t rPos_;
   uint32_t rLen_;
 
-  uint8_t* wBuf_;
-  uint32_t wBufSize_;
+  TPooledBuffer wBuf_;
   uint32_t wLen_;
 
   bool pipeOnRead_;
@@ -192,17 +313,36 @@ class TPipedTransport : virtual public TTransport {
  */
 class TPipedTransportFactory : public TTransportFactory {
  public:
-  TPipedTransportFactory() {}
-  TPipedTransportFactory(boost::shared_ptr<TTransport> dstTrans) {
+  /**
+   * The transports made take their buffers from the default TBufferPool,
+   * as those from TBufferedTransportFactory do.
+   */
+  TPipedTransportFactory()
+    : pool_(TBufferPool::getDefaultPool()) {}
+  TPipedTransportFactory(boost::shared_ptr<TTransport> dstTrans)
+    : pool_(TBufferPool::getDefaultPool()) {
     initializeTargetTransport(dstTrans);
   }
   virtual ~TPipedTransportFactory() {}
 
+  /**
+   * Pipes through sink, whose target becomes the target transport, so that
+   * the transports made pass on what they capture asynchronously.
+   */
+  TPipedTransportFactory(boost::shared_ptr<TAsyncPipeSink> sink) :
+    sink_(sink),
+    pool_(TBufferPool::getDefaultPool()) {
+    initializeTargetTransport(sink->getTargetTransport());
+  }
+
   /**
    * Wraps the base transport into a piped transport.
    */
   virtual boost::shared_ptr<TTransport> getTransport(boost::shared_ptr<TTransport> srcTrans) {
-    return boost::shared_ptr<TTransport>(new TPipedTransport(srcTrans, dstTrans_));
+    TPipedTransport* piped = new TPipedTransport(srcTrans, dstTrans_, 512, pool_);
+    boost::shared_ptr<TTransport> result(piped);
+    piped->setAsyncSink(sink_);
+    return result;
   }
 
   virtual void initializeTargetTransport(boost::shared_ptr<TTransport> dstTrans) {
@@ -215,6 +355,8 @@ class TPipedTransportFactory : public TTransportFactory {
 
  protected:
   boost::shared_ptr<TTransport> dstTrans_;
+  boost::shared_ptr<TAsyncPipeSink> sink_;
+  boost::shared_ptr<TBufferPool> pool_;
 };
 
 /**
@@ -250,6 +392,21 @@ class TPipedFileReaderTransport : public TPipedTransport,
   void seekToChunk(int32_t chunk);
   void seekToEnd();
 
+  /*
+   * Override TTransport *_virt() functions to invoke our implementations.
+   * We cannot use TVirtualTransport to provide these, since we need to inherit
+   * virtually from TTransport.
+   */
+  virtual uint32_t read_virt(uint8_t* buf, uint32_t len) {
+    return this->read(buf, len);
+  }
+  virtual uint32_t readAll_virt(uint8_t* buf, uint32_t len) {
+    return this->readAll(buf, len);
+  }
+  virtual void write_virt(const uint8_t* buf, uint32_t len) {
+    this->write(buf, len);
+  }
+
  protected:
   // shouldn't be used
   TPipedFileReaderTransport();
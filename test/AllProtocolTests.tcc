@@ -126,6 +126,98 @@ void testMessage() {
   }
 }
 
+template <typename TProto>
+void writeSkipStruct(shared_ptr<TProtocol> protocol) {
+  protocol->writeStructBegin("skip_struct");
+
+  protocol->writeFieldBegin("a_bool", T_BOOL, (int16_t)1);
+  protocol->writeBool(true);
+  protocol->writeFieldEnd();
+
+  protocol->writeFieldBegin("an_i64", T_I64, (int16_t)2);
+  protocol->writeI64(-(1LL << 40));
+  protocol->writeFieldEnd();
+
+  protocol->writeFieldBegin("a_string", T_STRING, (int16_t)40);
+  protocol->writeString("a bit longer than the smallest possible");
+  protocol->writeFieldEnd();
+
+  protocol->writeFieldBegin("an_i32_list", T_LIST, (int16_t)41);
+  protocol->writeListBegin(T_I32, 100);
+  for (int32_t i = 0; i < 100; i++) {
+    protocol->writeI32(i * 99991);
+  }
+  protocol->writeListEnd();
+  protocol->writeFieldEnd();
+
+  protocol->writeFieldBegin("a_double_set", T_SET, (int16_t)42);
+  protocol->writeSetBegin(T_DOUBLE, 3);
+  protocol->writeDouble(1.5);
+  protocol->writeDouble(-2.5);
+  protocol->writeDouble(1e100);
+  protocol->writeSetEnd();
+  protocol->writeFieldEnd();
+
+  protocol->writeFieldBegin("a_map", T_MAP, (int16_t)43);
+  protocol->writeMapBegin(T_I16, T_I64, 2);
+  protocol->writeI16(7);
+  protocol->writeI64(1LL << 50);
+  protocol->writeI16(-7);
+  protocol->writeI64(-1);
+  protocol->writeMapEnd();
+  protocol->writeFieldEnd();
+
+  protocol->writeFieldBegin("a_nested_map", T_MAP, (int16_t)44);
+  protocol->writeMapBegin(T_STRING, T_STRUCT, 1);
+  protocol->writeString("key");
+  protocol->writeStructBegin("inner");
+  protocol->writeFieldBegin("a_bool", T_BOOL, (int16_t)1);
+  protocol->writeBool(false);
+  protocol->writeFieldEnd();
+  protocol->writeFieldBegin("a_byte_list", T_LIST, (int16_t)2);
+  protocol->writeListBegin(T_BYTE, 2);
+  protocol->writeByte(1);
+  protocol->writeByte(2);
+  protocol->writeListEnd();
+  protocol->writeFieldEnd();
+  protocol->writeFieldStop();
+  protocol->writeStructEnd();
+  protocol->writeMapEnd();
+  protocol->writeFieldEnd();
+
+  protocol->writeFieldStop();
+  protocol->writeStructEnd();
+
+  // Sentinel, so we can tell the skip stopped in the right place.
+  protocol->writeI32(0x5ca1ab1e);
+}
+
+template <typename TProto>
+void testSkip() {
+  shared_ptr<TTransport> transport(new TMemoryBuffer());
+  shared_ptr<TProtocol> protocol(new TProto(transport));
+  writeSkipStruct<TProto>(protocol);
+
+  shared_ptr<TTransport> transport2(new TMemoryBuffer());
+  shared_ptr<TProtocol> protocol2(new TProto(transport2));
+  writeSkipStruct<TProto>(protocol2);
+
+  // Protocol-specific skip, through the virtual interface.
+  uint32_t skipped = protocol->skip(T_STRUCT);
+  // Generic, fully-decoding skip.
+  uint32_t expected = apache::thrift::protocol::skip(*protocol2, T_STRUCT);
+
+  if (skipped != expected) {
+    throw TException("skip() returned the wrong size.");
+  }
+
+  int32_t sentinel;
+  protocol->readI32(sentinel);
+  if (sentinel != 0x5ca1ab1e) {
+    throw TException("skip() stopped in the wrong place.");
+  }
+}
+
 template <typename TProto>
 void testProtocol(const char* protoname) {
   try {
@@ -217,6 +309,8 @@ void testProtocol(const char* protoname) {
 
     testMessage<TProto>();
 
+    testSkip<TProto>();
+
     printf("%s => OK\n", protoname);
   } catch (TException e) {
     snprintf(errorMessage, ERR_LEN, "%s => Test FAILED: %s", protoname, e.what());
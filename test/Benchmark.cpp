@@ -19,13 +19,34 @@
 
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 #include <transport/TBufferTransports.h>
+#include <transport/TBufferPool.h>
+#include <transport/TTransportUtils.h>
+#include <transport/TFDTransport.h>
+#include <transport/TFileTransport.h>
+#include <transport/THttpClient.h>
+#include <transport/TSocket.h>
+#include <transport/TCompressedFramedTransport.h>
+#ifdef HAVE_ZLIB
+#include <transport/TZlibTransport.h>
+#endif
 #include <protocol/TBinaryProtocol.h>
+#include <protocol/TCompactProtocol.h>
 #include <protocol/TJSONProtocol.h>
 #include "gen-cpp/DebugProtoTest_types.h"
+#include "gen-cpp/ArenaTest_types.h"
+#include "gen-cpp/JumpTableTest_types.h"
+#include "gen-cpp/WideStructTest_types.h"
+#include <TArena.h>
 #include <time.h>
 #include "../lib/cpp/src/protocol/TDebugProtocol.h"
 #include <sys/time.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
 
 class Timer {
 public:
@@ -48,6 +69,782 @@ public:
 
 };
 
+// Three 100k-element primitive lists, transferred one element at a time
+// and with the protocol's bulk list functions.
+template <class Protocol_>
+void benchLists(const char* name, int num) {
+  using namespace std;
+  using namespace apache::thrift::transport;
+  using namespace apache::thrift::protocol;
+
+  uint32_t size = 100000;
+  vector<int32_t> i32s(size);
+  vector<int64_t> i64s(size);
+  vector<double> doubles(size);
+  for (uint32_t i = 0; i < size; i++) {
+    i32s[i] = (i % 2 ? -1 : 1) * (int32_t)(i * 2654435761U >> (i % 24));
+    i64s[i] = (int64_t)i32s[i] << (i % 32);
+    doubles[i] = i32s[i] / 3.0;
+  }
+
+  boost::shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer());
+  Protocol_ wprot(buf);
+  Timer timer;
+
+  for (int i = 0; i < num; i ++) {
+    buf->resetBuffer();
+    apache::thrift::protocol::writeI32List(wprot, &i32s[0], size);
+    apache::thrift::protocol::writeI64List(wprot, &i64s[0], size);
+    apache::thrift::protocol::writeDoubleList(wprot, &doubles[0], size);
+  }
+  cout << " Write (lists, loop, " << name << "): " << num / (1000 * timer.frame()) << " kHz" << endl;
+
+  timer.start();
+
+  for (int i = 0; i < num; i ++) {
+    buf->resetBuffer();
+    wprot.writeI32List(&i32s[0], size);
+    wprot.writeI64List(&i64s[0], size);
+    wprot.writeDoubleList(&doubles[0], size);
+  }
+  cout << " Write (lists, bulk, " << name << "): " << num / (1000 * timer.frame()) << " kHz" << endl;
+
+  uint8_t* data;
+  uint32_t datasize;
+  buf->getBuffer(&data, &datasize);
+
+  timer.start();
+
+  for (int i = 0; i < num; i ++) {
+    boost::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+    Protocol_ prot(buf2);
+    apache::thrift::protocol::readI32List(prot, &i32s[0], size);
+    apache::thrift::protocol::readI64List(prot, &i64s[0], size);
+    apache::thrift::protocol::readDoubleList(prot, &doubles[0], size);
+  }
+  cout << " Read (lists, loop, " << name << "): " << num / (1000 * timer.frame()) << " kHz" << endl;
+
+  timer.start();
+
+  for (int i = 0; i < num; i ++) {
+    boost::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+    Protocol_ prot(buf2);
+    prot.readI32List(&i32s[0], size);
+    prot.readI64List(&i64s[0], size);
+    prot.readDoubleList(&doubles[0], size);
+  }
+  cout << " Read (lists, bulk, " << name << "): " << num / (1000 * timer.frame()) << " kHz" << endl;
+}
+
+// Varints of random width, one protocol call each, in ns per value.
+typedef apache::thrift::protocol::TCompactProtocolT<
+  apache::thrift::transport::TMemoryBuffer> TCompactMemoryProtocol;
+
+static void writeVarint(TCompactMemoryProtocol& prot, int32_t value) {
+  prot.writeI32(value);
+}
+
+static void writeVarint(TCompactMemoryProtocol& prot, int64_t value) {
+  prot.writeI64(value);
+}
+
+static void readVarint(TCompactMemoryProtocol& prot, int32_t& value) {
+  prot.readI32(value);
+}
+
+static void readVarint(TCompactMemoryProtocol& prot, int64_t& value) {
+  prot.readI64(value);
+}
+
+template <class Int_>
+void benchVarints(const char* name, int bits) {
+  using namespace std;
+  using namespace apache::thrift::transport;
+
+  uint32_t count = 1000000;
+  vector<Int_> values(count);
+  uint64_t state = 88172645463325252ULL;
+  for (uint32_t i = 0; i < count; i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    int width = 1 + (int)(state % bits);
+    values[i] = (Int_)((state >> 8) & (((uint64_t)1 << (width - 1)) * 2 - 1));
+  }
+
+  boost::shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer(count * 10));
+  TCompactMemoryProtocol wprot(buf);
+  Timer timer;
+  for (uint32_t i = 0; i < count; i++) {
+    writeVarint(wprot, values[i]);
+  }
+  cout << " Write (varints, " << name << "): " << timer.frame() * 1e9 / count << " ns/value" << endl;
+
+  uint8_t* data;
+  uint32_t datasize;
+  buf->getBuffer(&data, &datasize);
+  boost::shared_ptr<TMemoryBuffer> rbuf(new TMemoryBuffer(data, datasize));
+  TCompactMemoryProtocol rprot(rbuf);
+  timer.start();
+  for (uint32_t i = 0; i < count; i++) {
+    readVarint(rprot, values[i]);
+  }
+  cout << " Read (varints, " << name << "): " << timer.frame() * 1e9 / count << " ns/value" << endl;
+}
+
+// Reads of a 200-field struct, dispatching on field ids with the default
+// switch and through the table generated by the "jump_table" option.
+template <class Protocol_>
+void benchWide(const char* name, int num) {
+  using namespace std;
+  using namespace thrift::test::wide;
+  using namespace apache::thrift::transport;
+
+  WideStruct ws;
+  boost::shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer());
+  Protocol_ wprot(buf);
+  ws.write(&wprot);
+  uint8_t* data;
+  uint32_t datasize;
+  buf->getBuffer(&data, &datasize);
+
+  {
+    Timer timer;
+    for (int i = 0; i < num; i ++) {
+      WideStruct ws2;
+      boost::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+      Protocol_ prot(buf2);
+      ws2.read(&prot);
+    }
+    cout << " Read (wide, switch, " << name << "): " << num / (1000 * timer.frame()) << " kHz" << endl;
+  }
+
+  {
+    Timer timer;
+    for (int i = 0; i < num; i ++) {
+      thrift::test::jump::WideStruct ws2;
+      boost::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+      Protocol_ prot(buf2);
+      ws2.read(&prot);
+    }
+    cout << " Read (wide, jump table, " << name << "): " << num / (1000 * timer.frame()) << " kHz" << endl;
+  }
+}
+
+// Reads and discards everything sent to it, standing in for a client.
+static void* drain(void* arg) {
+  int fd = *static_cast<int*>(arg);
+  static char buf[256 * 1024];
+  while (read(fd, buf, sizeof(buf)) > 0) {
+  }
+  return NULL;
+}
+
+// Frames carrying one large binary field, sent over a socketpair with the
+// blob copied into the frame buffer and referenced from a writev().
+void benchBlobs(uint32_t size, int num) {
+  using namespace std;
+  using namespace apache::thrift::transport;
+  using namespace apache::thrift::protocol;
+
+  string blob(size, 'b');
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    return;
+  }
+  pthread_t reader;
+  pthread_create(&reader, NULL, drain, &fds[1]);
+  boost::shared_ptr<TFDTransport> sock(new TFDTransport(fds[0]));
+
+  for (int ref = 0; ref < 2; ref++) {
+    boost::shared_ptr<TFramedTransport> framed(new TFramedTransport(sock));
+    if (ref) {
+      framed->setWriteRefThreshold(64 * 1024);
+    }
+    TBinaryProtocolT<TFramedTransport> prot(framed);
+
+    Timer timer;
+    for (int i = 0; i < num; i ++) {
+      prot.writeI32(i);
+      prot.writeBinary(blob);
+      framed->flush();
+    }
+    double elapsed = timer.frame();
+    cout << " Write (" << (size >> 20) << " MB blobs, " << (ref ? "writev" : "copied") << "): "
+         << (double)size * num / (elapsed * (1 << 20)) << " MB/s" << endl;
+  }
+
+  close(fds[0]);
+  pthread_join(reader, NULL);
+  close(fds[1]);
+}
+
+// Replays a 512 MB log of 1 KB events with TFileTransport, through the
+// read buffer, through a mapping, and borrowing events from the mapping.
+void benchFileReplay() {
+  using namespace std;
+  using namespace apache::thrift::transport;
+
+  const char* path = "/tmp/thrift_benchmark.log";
+  const uint32_t chunk_size = 16 * 1024 * 1024;
+  const uint32_t event_size = 1024;
+  const uint64_t file_size = 512ULL * 1024 * 1024;
+
+  // Written directly in the chunked format, padding to chunk boundaries
+  FILE* f = fopen(path, "w");
+  if (f == NULL) {
+    return;
+  }
+  string event(event_size, 'e');
+  string padding(event_size + 4, '\0');
+  uint64_t events = 0;
+  for (uint64_t pos = 0; pos < file_size; ) {
+    uint32_t room = chunk_size - pos % chunk_size;
+    if (room < event_size + 4) {
+      fwrite(padding.data(), 1, room, f);
+      pos += room;
+      continue;
+    }
+    fwrite(&event_size, 4, 1, f);
+    fwrite(event.data(), 1, event_size, f);
+    pos += event_size + 4;
+    events++;
+  }
+  fclose(f);
+
+  uint8_t buf[event_size];
+  for (int mode = 0; mode < 3; mode++) {
+    TFileTransport in(path, true);
+    in.setReadMapped(mode > 0);
+
+    Timer timer;
+    for (uint64_t i = 0; i < events; i++) {
+      if (mode < 2) {
+        in.readAll(buf, event_size);
+      } else {
+        uint32_t len = event_size;
+        in.borrow(NULL, &len);
+        in.consume(len);
+      }
+    }
+    double elapsed = timer.frame();
+    const char* name = mode == 0 ? "read()" : mode == 1 ? "mmap" : "mmap, borrow";
+    cout << " Read (file replay, " << name << "): "
+         << file_size / (elapsed * 1024 * 1024) << " MB/s" << endl;
+  }
+
+  unlink(path);
+}
+
+struct LoggerArgs {
+  apache::thrift::transport::TFileTransport* out;
+  int events;
+};
+
+static void* logEvents(void* arg) {
+  LoggerArgs* args = static_cast<LoggerArgs*>(arg);
+  uint8_t event[100];
+  memset(event, 'l', sizeof(event));
+  for (int i = 0; i < args->events; i++) {
+    args->out->write(event, sizeof(event));
+  }
+  return NULL;
+}
+
+// 100-byte events logged to one TFileTransport from many threads at once.
+void benchFileLogging(int threads, int events,
+                      apache::thrift::transport::TFileTransport::FlushPolicy policy =
+                        apache::thrift::transport::TFileTransport::FLUSH_FSYNC,
+                      const char* name = "fsync") {
+  using namespace std;
+  using namespace apache::thrift::transport;
+
+  const char* path = "/tmp/thrift_benchmark.log";
+  unlink(path);
+  {
+    TFileTransport out(path);
+    out.setFlushPolicy(policy);
+    vector<pthread_t> ids(threads);
+    LoggerArgs args = { &out, events };
+
+    Timer timer;
+    for (int t = 0; t < threads; t++) {
+      pthread_create(&ids[t], NULL, logEvents, &args);
+    }
+    for (int t = 0; t < threads; t++) {
+      pthread_join(ids[t], NULL);
+    }
+    out.flush();
+    double elapsed = timer.frame();
+    cout << " Write (file logging, " << name << ", " << threads << " threads): "
+         << threads * events / (1000 * elapsed) << " kHz" << endl;
+  }
+  unlink(path);
+}
+
+struct CommitArgs {
+  apache::thrift::transport::TFileTransport* out;
+  int commits;
+  double seconds;
+};
+
+static void* commitEvents(void* arg) {
+  CommitArgs* args = static_cast<CommitArgs*>(arg);
+  uint8_t event[100];
+  memset(event, 'c', sizeof(event));
+  Timer timer;
+  for (int i = 0; i < args->commits; i++) {
+    args->out->write(event, sizeof(event));
+    args->out->flush();
+  }
+  args->seconds = timer.frame();
+  return NULL;
+}
+
+// 100-byte events each followed by flush(), so that every write waits for
+// its sync.  Threads that commit at once share a sync.
+void benchFileCommits(int threads, int commits,
+                      apache::thrift::transport::TFileTransport::FlushPolicy policy,
+                      const char* name) {
+  using namespace std;
+  using namespace apache::thrift::transport;
+
+  const char* path = "/tmp/thrift_benchmark.log";
+  unlink(path);
+  {
+    TFileTransport out(path);
+    out.setFlushPolicy(policy);
+    vector<pthread_t> ids(threads);
+    vector<CommitArgs> args(threads);
+
+    Timer timer;
+    for (int t = 0; t < threads; t++) {
+      args[t].out = &out;
+      args[t].commits = commits;
+      pthread_create(&ids[t], NULL, commitEvents, &args[t]);
+    }
+    double seconds = 0;
+    for (int t = 0; t < threads; t++) {
+      pthread_join(ids[t], NULL);
+      seconds += args[t].seconds;
+    }
+    double elapsed = timer.frame();
+    cout << " Commit (" << name << ", " << threads << " threads): "
+         << threads * commits / (1000 * elapsed) << " kHz, "
+         << 1000000 * seconds / (threads * commits) << " us/commit" << endl;
+  }
+  unlink(path);
+}
+
+// RPC-sized frames of serialized structs, compressed one frame at a time.
+void benchFrameCompression(uint32_t frameSize, int frames) {
+  using namespace std;
+  using namespace thrift::test::debug;
+  using namespace apache::thrift::transport;
+  using namespace apache::thrift::protocol;
+  using boost::shared_ptr;
+
+  // Records that share their layout but not their values
+  shared_ptr<TMemoryBuffer> records(new TMemoryBuffer());
+  TBinaryProtocolT<TMemoryBuffer> prot(records);
+  for (int i = 0; records->available_read() < frameSize; i++) {
+    OneOfEach ooe;
+    ooe.integer32 = i * 7919;
+    ooe.integer64 = (int64_t)i * 1000003;
+    ooe.double_precision = i / 7.0;
+    char text[64];
+    snprintf(text, sizeof(text), "user%d@host%d.example.com", i * 31 % 1000, i % 13);
+    ooe.some_characters = text;
+    ooe.write(&prot);
+  }
+  string frame = records->getBufferAsString().substr(0, frameSize);
+  double bytes = (double)frameSize * frames;
+
+  {
+    shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer(frameSize * 2));
+    TCompressedFramedTransport out(wire);
+    TCompressedFramedTransport in(wire);
+    string got(frameSize, '\0');
+
+    Timer timer;
+    uint32_t wireSize = 0;
+    for (int i = 0; i < frames; i++) {
+      wire->resetBuffer();
+      out.write((const uint8_t*)frame.data(), frame.size());
+      out.flush();
+      wireSize = wire->available_read();
+    }
+    double compress = timer.frame();
+
+    wire->resetBuffer();
+    out.write((const uint8_t*)frame.data(), frame.size());
+    out.flush();
+    string compressed = wire->getBufferAsString();
+    timer.start();
+    for (int i = 0; i < frames; i++) {
+      wire->resetBuffer((uint8_t*)compressed.data(), compressed.size());
+      in.readAll((uint8_t*)&got[0], got.size());
+    }
+    double decompress = timer.frame();
+    assert(got == frame);
+
+    cout << " Frame compression (lz4, " << frameSize << " B): ratio "
+         << (double)frameSize / wireSize << ", compress "
+         << compress * 1e9 / bytes << " ns/B, decompress "
+         << decompress * 1e9 / bytes << " ns/B" << endl;
+  }
+
+#ifdef HAVE_ZLIB
+  {
+    shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer(frameSize * 2));
+    string got(frameSize, '\0');
+
+    Timer timer;
+    uint32_t wireSize = 0;
+    for (int i = 0; i < frames; i++) {
+      wire->resetBuffer();
+      TZlibTransport out(wire, false, 128, 1024, frameSize, frameSize);
+      out.write((const uint8_t*)frame.data(), frame.size());
+      out.flush();
+      wireSize = wire->available_read();
+    }
+    double compress = timer.frame();
+
+    string compressed = wire->getBufferAsString();
+    timer.start();
+    for (int i = 0; i < frames; i++) {
+      wire->resetBuffer((uint8_t*)compressed.data(), compressed.size());
+      TZlibTransport in(wire, false, frameSize, frameSize);
+      in.readAll((uint8_t*)&got[0], got.size());
+    }
+    double decompress = timer.frame();
+    assert(got == frame);
+
+    cout << " Frame compression (zlib, " << frameSize << " B): ratio "
+         << (double)frameSize / wireSize << ", compress "
+         << compress * 1e9 / bytes << " ns/B, decompress "
+         << decompress * 1e9 / bytes << " ns/B" << endl;
+  }
+#endif
+}
+
+// Short connections through TFramedTransportFactory, each answering one
+// request with a reply that grows the frame buffer, with buffers from a
+// pool and from the heap.
+void benchConnectionBuffers(uint32_t replySize, int conns) {
+  using namespace std;
+  using namespace apache::thrift::transport;
+  using boost::shared_ptr;
+
+  string request(64, 'q');
+  string reply(replySize, 'r');
+
+  for (int pooled = 0; pooled < 2; pooled++) {
+    shared_ptr<TBufferPool> pool;
+    if (pooled) {
+      pool.reset(new TBufferPool());
+    }
+    TFramedTransportFactory factory(pool);
+    shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer(replySize * 2));
+
+    Timer timer;
+    for (int i = 0; i < conns; i++) {
+      wire->resetBuffer();
+      uint32_t len = htonl(request.size());
+      wire->write((const uint8_t*)&len, sizeof(len));
+      wire->write((const uint8_t*)request.data(), request.size());
+
+      shared_ptr<TTransport> trans = factory.getTransport(wire);
+      uint8_t got[64];
+      trans->readAll(got, sizeof(got));
+      trans->write((const uint8_t*)reply.data(), reply.size());
+      trans->flush();
+    }
+    double elapsed = timer.frame();
+
+    cout << " Connection buffers (" << (pooled ? "pooled" : "heap") << ", "
+         << replySize << " B replies): " << elapsed * 1e9 / conns << " ns";
+    if (pooled) {
+      cout << ", hit rate "
+           << (double)pool->getHits() / (pool->getHits() + pool->getMisses())
+           << ", " << pool->getRetainedBytes() << " B retained";
+    }
+    cout << endl;
+  }
+}
+
+// A minimal HTTP/1.1 server on a loopback port that echoes each request
+// body back, serving one connection at a time.  It reads pipelined
+// requests as they come and, when closeEach is set, closes the connection
+// after every response.
+struct EchoHttpServer {
+  int listenFd;
+  int port;
+  bool closeEach;
+};
+
+static void* serveEchoHttp(void* arg) {
+  EchoHttpServer* server = static_cast<EchoHttpServer*>(arg);
+  int fd;
+  while ((fd = accept(server->listenFd, NULL, NULL)) >= 0) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    std::string in;
+    char buf[64 * 1024];
+    bool open = true;
+    while (open) {
+      ssize_t got = read(fd, buf, sizeof(buf));
+      if (got <= 0) {
+        break;
+      }
+      in.append(buf, got);
+
+      // Answer every complete request received so far in one write
+      std::string out;
+      size_t pos = 0;
+      while (open) {
+        size_t end = in.find("\r\n\r\n", pos);
+        if (end == std::string::npos) {
+          break;
+        }
+        size_t length = in.find("Content-Length: ", pos);
+        size_t bodyLen = strtoul(in.c_str() + length + 16, NULL, 10);
+        if (in.size() < end + 4 + bodyLen) {
+          break;
+        }
+        char header[128];
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 200 OK\r\n%sContent-Type: application/x-thrift\r\n"
+                 "Content-Length: %lu\r\n\r\n",
+                 server->closeEach ? "Connection: close\r\n" : "",
+                 (unsigned long)bodyLen);
+        out += header;
+        out.append(in, end + 4, bodyLen);
+        pos = end + 4 + bodyLen;
+        open = !server->closeEach;
+      }
+      in.erase(0, pos);
+      if (!out.empty() && write(fd, out.data(), out.size()) < 0) {
+        break;
+      }
+    }
+    close(fd);
+  }
+  return NULL;
+}
+
+// Calls to a local HTTP server through THttpClient, reconnecting for each
+// call, on one kept-alive connection, and pipelined depth calls at a time.
+void benchHttpCalls(uint32_t size, int calls, int depth) {
+  using namespace std;
+  using namespace apache::thrift::transport;
+  using boost::shared_ptr;
+
+  string request(size, 'q');
+  string response(size, '\0');
+
+  for (int mode = 0; mode < 3; mode++) {
+    EchoHttpServer server;
+    server.listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    server.closeEach = (mode == 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    if (bind(server.listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+        listen(server.listenFd, 128) != 0 ||
+        getsockname(server.listenFd, (struct sockaddr*)&addr, &addrLen) != 0) {
+      close(server.listenFd);
+      return;
+    }
+    server.port = ntohs(addr.sin_port);
+    pthread_t thread;
+    pthread_create(&thread, NULL, serveEchoHttp, &server);
+
+    shared_ptr<TSocket> socket(new TSocket("127.0.0.1", server.port));
+    socket->setNoDelay(true);
+    THttpClient client(socket, "localhost", "/");
+    client.open();
+
+    int batch = (mode == 2) ? depth : 1;
+    Timer timer;
+    for (int i = 0; i < calls; i += batch) {
+      for (int j = 0; j < batch; j++) {
+        client.write((const uint8_t*)request.data(), request.size());
+        client.flush();
+      }
+      for (int j = 0; j < batch; j++) {
+        client.readAll((uint8_t*)&response[0], response.size());
+        client.readEnd();
+      }
+    }
+    double elapsed = timer.frame();
+    assert(response == request);
+    client.close();
+
+    shutdown(server.listenFd, SHUT_RDWR);
+    close(server.listenFd);
+    pthread_join(thread, NULL);
+
+    const char* name = (mode == 0) ? "reconnecting" : (mode == 1) ? "keep-alive" : "pipelined";
+    cout << " HTTP calls (" << name << ", " << size << " B): "
+         << elapsed * 1e6 / calls << " us per call" << endl;
+  }
+}
+
+// Counts the reads that reach the underlying transport.
+class CountingTransport : public apache::thrift::transport::TVirtualTransport<CountingTransport> {
+ public:
+  CountingTransport(boost::shared_ptr<apache::thrift::transport::TTransport> transport)
+    : transport_(transport), reads_(0) {}
+
+  uint32_t read(uint8_t* buf, uint32_t len) {
+    ++reads_;
+    return transport_->read(buf, len);
+  }
+
+  boost::shared_ptr<apache::thrift::transport::TTransport> transport_;
+  uint64_t reads_;
+};
+
+struct MessageStream {
+  int fd;
+  std::string cycle;
+  int cycles;
+};
+
+// Writes the cycle of messages over and over, standing in for a client.
+static void* writeMessages(void* arg) {
+  MessageStream* stream = static_cast<MessageStream*>(arg);
+  for (int i = 0; i < stream->cycles; i++) {
+    const char* p = stream->cycle.data();
+    size_t left = stream->cycle.size();
+    while (left > 0) {
+      ssize_t n = write(stream->fd, p, left);
+      if (n <= 0) {
+        return NULL;
+      }
+      p += n;
+      left -= n;
+    }
+  }
+  return NULL;
+}
+
+// Reads messages over a socketpair with TBufferedTransport, one big one
+// among every bigEvery, with fixed small and big buffers and with adaptive
+// ones, counting the reads from the socket.
+void benchAdaptiveBuffers(uint32_t smallSize, uint32_t bigSize, int bigEvery, int cycles) {
+  using namespace std;
+  using namespace apache::thrift::transport;
+  using boost::shared_ptr;
+
+  MessageStream stream;
+  stream.cycles = cycles;
+  for (int i = 0; i < bigEvery; i++) {
+    stream.cycle.append(i == 0 ? bigSize : smallSize, 'm');
+  }
+  int messages = bigEvery * cycles;
+  string message(bigSize, '\0');
+
+  for (int mode = 0; mode < 3; mode++) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+      return;
+    }
+    stream.fd = fds[1];
+    pthread_t writer;
+    pthread_create(&writer, NULL, writeMessages, &stream);
+
+    shared_ptr<CountingTransport> counted(
+      new CountingTransport(shared_ptr<TTransport>(new TFDTransport(fds[0]))));
+    uint32_t size = (mode == 1) ? 64 * 1024 : TUnderlyingTransport::DEFAULT_BUFFER_SIZE;
+    TBufferedTransport buffered(counted, size, size, shared_ptr<TBufferPool>());
+    if (mode == 2) {
+      buffered.setAdaptive(TUnderlyingTransport::DEFAULT_BUFFER_SIZE, 1 << 20);
+    }
+
+    Timer timer;
+    for (int i = 0; i < messages; i++) {
+      buffered.readAll((uint8_t*)&message[0], (i % bigEvery == 0) ? bigSize : smallSize);
+      buffered.readEnd();
+    }
+    double elapsed = timer.frame();
+
+    pthread_join(writer, NULL);
+    close(fds[0]);
+    close(fds[1]);
+
+    const char* name = (mode == 0) ? "fixed small" : (mode == 1) ? "fixed 64 KB" : "adaptive";
+    cout << " Buffered reads (" << name << ", " << smallSize << " B + 1 in " << bigEvery
+         << " of " << bigSize << " B): " << elapsed * 1e9 / messages << " ns, "
+         << (double)counted->reads_ / messages << " reads per message, "
+         << buffered.getReadBufferSize() << " B buffer" << endl;
+  }
+}
+
+static uint64_t nowNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Requests read through TPipedTransport while it logs them to a
+// TFileTransport, without logging, piping synchronously and through a
+// TAsyncPipeSink, with the latency each request sees.
+void benchPipedLogging(uint32_t size, int requests,
+                       apache::thrift::transport::TFileTransport::FlushPolicy policy,
+                       const char* policyName) {
+  using namespace std;
+  using namespace apache::thrift::transport;
+  using boost::shared_ptr;
+
+  const char* path = "/tmp/thrift_benchmark.log";
+  string request(size, 'p');
+  string got(size, '\0');
+
+  for (int mode = 0; mode < 3; mode++) {
+    unlink(path);
+    shared_ptr<TFileTransport> log(new TFileTransport(path));
+    log->setFlushPolicy(policy);
+    shared_ptr<TAsyncPipeSink> sink;
+    if (mode == 2) {
+      sink.reset(new TAsyncPipeSink(log));
+    }
+    shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer(size * 2));
+    TPipedTransport piped(wire, log);
+    piped.setPipeOnRead(mode != 0);
+    piped.setAsyncSink(sink);
+
+    vector<uint64_t> latencies(requests);
+    uint64_t start = nowNs();
+    for (int i = 0; i < requests; i++) {
+      wire->resetBuffer();
+      wire->write((const uint8_t*)request.data(), request.size());
+      uint64_t begin = nowNs();
+      piped.readAll((uint8_t*)&got[0], size);
+      piped.readEnd();
+      latencies[i] = nowNs() - begin;
+    }
+    double elapsed = (nowNs() - start) / 1e9;
+    if (sink) {
+      sink->drain();
+    }
+
+    sort(latencies.begin(), latencies.end());
+    const char* name = (mode == 0) ? "no logging" : (mode == 1) ? "sync" : "async";
+    cout << " Piped requests (" << name << ", " << policyName << ", " << size << " B): "
+         << requests / (1000 * elapsed) << " kHz, p50 " << latencies[requests / 2] / 1000.0
+         << " us, p99 " << latencies[requests * 99 / 100] / 1000.0 << " us";
+    if (sink) {
+      cout << ", " << sink->getDropped() << " dropped";
+    }
+    cout << endl;
+  }
+  unlink(path);
+}
+
 int main() {
   using namespace std;
   using namespace thrift::test::debug;
@@ -82,6 +879,17 @@ int main() {
     cout << "Write: " << num / (1000 * timer.frame()) << " kHz" << endl;
   }
 
+  {
+    Timer timer;
+
+    for (int i = 0; i < num; i ++) {
+      buf->resetBuffer();
+      TBinaryProtocolT<TMemoryBuffer> prot(buf);
+      ooe.write(&prot);
+    }
+    cout << "Write (templates): " << num / (1000 * timer.frame()) << " kHz" << endl;
+  }
+
   uint8_t* data;
   uint32_t datasize;
 
@@ -103,6 +911,283 @@ int main() {
     cout << " Read: " << num / (1000 * timer.frame()) << " kHz" << endl;
   }
 
+  {
+
+    Timer timer;
+
+    for (int i = 0; i < num; i ++) {
+      OneOfEach ooe2;
+      shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+      TBinaryProtocolT<TMemoryBuffer> prot(buf2);
+      ooe2.read(&prot);
+    }
+    cout << " Read (templates): " << num / (1000 * timer.frame()) << " kHz" << endl;
+  }
+
+  {
+    int json_num = num / 10;
+    Timer timer;
+
+    for (int i = 0; i < json_num; i ++) {
+      buf->resetBuffer();
+      TJSONProtocol prot(buf);
+      ooe.write(&prot);
+    }
+    cout << "Write (JSON): " << json_num / (1000 * timer.frame()) << " kHz" << endl;
+
+    uint8_t* json_data;
+    uint32_t json_size;
+    buf->getBuffer(&json_data, &json_size);
+
+    timer.start();
+
+    for (int i = 0; i < json_num; i ++) {
+      OneOfEach ooe2;
+      shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(json_data, json_size));
+      TJSONProtocol prot(buf2);
+      ooe2.read(&prot);
+    }
+    cout << " Read (JSON): " << json_num / (1000 * timer.frame()) << " kHz" << endl;
+  }
+
+  // String-heavy struct, to exercise the borrow() path for string reads.
+  Base64 b64;
+  b64.a  = 42;
+  b64.b1 = std::string(256, 'a');
+  b64.b2 = std::string(256, 'b');
+  b64.b3 = std::string(256, 'c');
+  b64.b4 = std::string(256, 'd');
+  b64.b5 = std::string(256, 'e');
+  b64.b6 = std::string(256, 'f');
+
+  {
+    shared_ptr<TMemoryBuffer> sbuf(new TMemoryBuffer());
+    TBinaryProtocolT<TMemoryBuffer> wprot(sbuf);
+    b64.write(&wprot);
+    sbuf->getBuffer(&data, &datasize);
+
+    Timer timer;
+
+    for (int i = 0; i < num; i ++) {
+      Base64 b64_2;
+      shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+      TBinaryProtocolT<TMemoryBuffer> prot(buf2);
+      b64_2.read(&prot);
+    }
+    cout << " Read (strings, binary): " << num / (1000 * timer.frame()) << " kHz" << endl;
+  }
+
+  {
+    shared_ptr<TMemoryBuffer> sbuf(new TMemoryBuffer());
+    TCompactProtocolT<TMemoryBuffer> wprot(sbuf);
+    b64.write(&wprot);
+    sbuf->getBuffer(&data, &datasize);
+
+    Timer timer;
+
+    for (int i = 0; i < num; i ++) {
+      Base64 b64_2;
+      shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+      TCompactProtocolT<TMemoryBuffer> prot(buf2);
+      b64_2.read(&prot);
+    }
+    cout << " Read (strings, compact): " << num / (1000 * timer.frame()) << " kHz" << endl;
+  }
+
+  // Nested containers, to compare the protocol-specific skip() against the
+  // generic one that decodes every value.
+  HolyMoley hm;
+  for (int i = 0; i < 16; i++) {
+    hm.big.push_back(ooe);
+    hm.big.back().byte_list.assign(64, 7);
+    hm.big.back().i16_list.assign(64, 300);
+    hm.big.back().i64_list.assign(64, (int64_t)1 << 40);
+  }
+  for (int i = 0; i < 8; i++) {
+    std::vector<std::string> strings(8, std::string(32, 'a' + i));
+    hm.contain.insert(strings);
+  }
+  for (int i = 0; i < 8; i++) {
+    std::vector<Bonk> bonks(4);
+    for (size_t j = 0; j < bonks.size(); j++) {
+      bonks[j].type = j;
+      bonks[j].message = std::string(48, 'z');
+    }
+    hm.bonks[std::string(16, 'A' + i)] = bonks;
+  }
+
+  int skip_num = num / 10;
+
+  {
+    shared_ptr<TMemoryBuffer> sbuf(new TMemoryBuffer());
+    TBinaryProtocolT<TMemoryBuffer> wprot(sbuf);
+    hm.write(&wprot);
+    sbuf->getBuffer(&data, &datasize);
+
+    Timer timer;
+
+    for (int i = 0; i < skip_num; i ++) {
+      shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+      TBinaryProtocolT<TMemoryBuffer> prot(buf2);
+      apache::thrift::protocol::skip(prot, T_STRUCT);
+    }
+    cout << " Skip (generic, binary): " << skip_num / (1000 * timer.frame()) << " kHz" << endl;
+
+    timer.start();
+
+    for (int i = 0; i < skip_num; i ++) {
+      shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+      TBinaryProtocolT<TMemoryBuffer> prot(buf2);
+      prot.skip(T_STRUCT);
+    }
+    cout << " Skip (binary): " << skip_num / (1000 * timer.frame()) << " kHz" << endl;
+  }
+
+  {
+    shared_ptr<TMemoryBuffer> sbuf(new TMemoryBuffer());
+    TCompactProtocolT<TMemoryBuffer> wprot(sbuf);
+    hm.write(&wprot);
+    sbuf->getBuffer(&data, &datasize);
+
+    Timer timer;
+
+    for (int i = 0; i < skip_num; i ++) {
+      shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+      TCompactProtocolT<TMemoryBuffer> prot(buf2);
+      apache::thrift::protocol::skip(prot, T_STRUCT);
+    }
+    cout << " Skip (generic, compact): " << skip_num / (1000 * timer.frame()) << " kHz" << endl;
+
+    timer.start();
+
+    for (int i = 0; i < skip_num; i ++) {
+      shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+      TCompactProtocolT<TMemoryBuffer> prot(buf2);
+      prot.skip(T_STRUCT);
+    }
+    cout << " Skip (compact): " << skip_num / (1000 * timer.frame()) << " kHz" << endl;
+  }
+
+  // Writing a large struct into a fresh frame, letting the frame buffer
+  // grow versus reserving the exact size up front.
+  {
+    HolyMoley big_hm;
+    for (int i = 0; i < 64; i++) {
+      big_hm.big.insert(big_hm.big.end(), hm.big.begin(), hm.big.end());
+    }
+    shared_ptr<TTransport> null_trans(new TNullTransport());
+    int write_num = skip_num / 10;
+
+    Timer timer;
+
+    for (int i = 0; i < write_num; i ++) {
+      shared_ptr<TFramedTransport> framed(new TFramedTransport(null_trans));
+      TBinaryProtocolT<TFramedTransport> prot(framed);
+      big_hm.write(&prot);
+      framed->flush();
+    }
+    cout << " Write (framed, growing): " << write_num / (1000 * timer.frame()) << " kHz" << endl;
+
+    timer.start();
+
+    for (int i = 0; i < write_num; i ++) {
+      shared_ptr<TFramedTransport> framed(new TFramedTransport(null_trans));
+      TBinaryProtocolT<TFramedTransport> prot(framed);
+      framed->reserve(big_hm.serializedSize(&prot));
+      big_hm.write(&prot);
+      framed->flush();
+    }
+    cout << " Write (framed, reserved): " << write_num / (1000 * timer.frame()) << " kHz" << endl;
+  }
+
+  // The same nested struct read onto the heap and into an arena that is
+  // reset between messages.
+  {
+    shared_ptr<TMemoryBuffer> sbuf(new TMemoryBuffer());
+    TBinaryProtocolT<TMemoryBuffer> wprot(sbuf);
+    hm.write(&wprot);
+    sbuf->getBuffer(&data, &datasize);
+
+    Timer timer;
+
+    for (int i = 0; i < skip_num; i ++) {
+      HolyMoley hm2;
+      shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+      TBinaryProtocolT<TMemoryBuffer> prot(buf2);
+      hm2.read(&prot);
+    }
+    double elapsed = timer.frame();
+    cout << " Read (nested, heap): " << skip_num / (1000 * elapsed) << " kHz" << endl;
+
+    // Every allocation served by the arena is one the heap read makes.
+    apache::thrift::TArena arena;
+    uint64_t allocs = 0;
+    timer.start();
+
+    for (int i = 0; i < skip_num; i ++) {
+      {
+        apache::thrift::TArenaScope scope(&arena);
+        thrift::test::arena::HolyMoley hm2;
+        shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
+        TBinaryProtocolT<TMemoryBuffer> prot(buf2);
+        hm2.read(&prot);
+      }
+      allocs += arena.allocations();
+      arena.reset();
+    }
+    elapsed = timer.frame();
+    cout << " Read (nested, arena): " << skip_num / (1000 * elapsed) << " kHz, "
+         << allocs / skip_num << " heap allocs/read avoided" << endl;
+  }
+
+  benchLists<TBinaryProtocolT<TMemoryBuffer> >("binary", skip_num / 100);
+  benchLists<TCompactProtocolT<TMemoryBuffer> >("compact", skip_num / 100);
+
+  benchVarints<int32_t>("i32", 32);
+  benchVarints<int64_t>("i64", 64);
+
+  benchWide<TBinaryProtocolT<TMemoryBuffer> >("binary", skip_num / 10);
+  benchWide<TCompactProtocolT<TMemoryBuffer> >("compact", skip_num / 10);
+
+  benchBlobs(1 << 20, 400);
+  benchBlobs(4 << 20, 100);
+  benchBlobs(16 << 20, 25);
+
+  benchFileReplay();
+
+  benchFileLogging(1, 200000);
+  benchFileLogging(32, 20000);
+  benchFileLogging(1, 200000, TFileTransport::FLUSH_FDATASYNC, "fdatasync");
+  benchFileLogging(1, 200000, TFileTransport::FLUSH_NONE, "none");
+  benchFileLogging(1, 200000, TFileTransport::FLUSH_DIRECT, "direct");
+
+  benchFileCommits(1, 500, TFileTransport::FLUSH_FSYNC, "fsync");
+  benchFileCommits(1, 500, TFileTransport::FLUSH_FDATASYNC, "fdatasync");
+  benchFileCommits(1, 500, TFileTransport::FLUSH_NONE, "none");
+  benchFileCommits(1, 500, TFileTransport::FLUSH_DIRECT, "direct");
+  benchFileCommits(32, 100, TFileTransport::FLUSH_FSYNC, "fsync");
+  benchFileCommits(32, 100, TFileTransport::FLUSH_FDATASYNC, "fdatasync");
+  benchFileCommits(32, 100, TFileTransport::FLUSH_NONE, "none");
+  benchFileCommits(32, 100, TFileTransport::FLUSH_DIRECT, "direct");
+
+  benchFrameCompression(1 << 10, 100000);
+  benchFrameCompression(16 << 10, 10000);
+  benchFrameCompression(256 << 10, 500);
+
+  benchConnectionBuffers(256, 200000);
+  benchConnectionBuffers(16 << 10, 100000);
+
+  benchHttpCalls(64, 5000, 16);
+  benchHttpCalls(16 << 10, 5000, 16);
+
+  benchAdaptiveBuffers(200, 200, 1, 200000);
+  benchAdaptiveBuffers(200, 64 << 10, 4, 5000);
+  benchAdaptiveBuffers(200, 64 << 10, 32, 2000);
+  benchAdaptiveBuffers(16 << 10, 256 << 10, 2, 2000);
+
+  benchPipedLogging(256, 2000, TFileTransport::FLUSH_FSYNC, "fsync");
+  benchPipedLogging(256, 100000, TFileTransport::FLUSH_NONE, "none");
+
 
   return 0;
 }
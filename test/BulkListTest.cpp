@@ -0,0 +1,204 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <limits>
+#include <transport/TBufferTransports.h>
+#include <protocol/TBinaryProtocol.h>
+#include <protocol/TCompactProtocol.h>
+#include <protocol/TDenseProtocol.h>
+#include <protocol/TJSONProtocol.h>
+#include "gen-cpp/DebugProtoTest_types.h"
+
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TBufferedTransport;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TBinaryProtocolT;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TCompactProtocolT;
+using apache::thrift::protocol::TDenseProtocol;
+using apache::thrift::protocol::TJSONProtocol;
+using apache::thrift::protocol::TProtocol;
+using boost::shared_ptr;
+using namespace thrift::test::debug;
+
+BOOST_AUTO_TEST_SUITE( BulkListTest )
+
+// Long enough to span several of the protocols' internal chunks, and with
+// values of every varint length, both signs.
+static CompactProtoTestStruct makeLists() {
+  CompactProtoTestStruct cpts;
+  for (int i = 0; i < 3000; ++i) {
+    int sign = (i % 2 == 0) ? 1 : -1;
+    cpts.i16_list.push_back((int16_t)(sign * (i * 11 % 32768)));
+    cpts.i32_list.push_back(sign * (int32_t)(((uint32_t)i * 2654435761U) >> (i % 32)));
+    cpts.i64_list.push_back(sign * (int64_t)(((uint64_t)i * 11400714819323198485ULL) >> (i % 64)));
+    cpts.double_list.push_back(sign * i / 7.0);
+  }
+  cpts.i16_list.push_back(std::numeric_limits<int16_t>::min());
+  cpts.i32_list.push_back(std::numeric_limits<int32_t>::min());
+  cpts.i64_list.push_back(std::numeric_limits<int64_t>::min());
+  cpts.i64_list.push_back(std::numeric_limits<int64_t>::max());
+  return cpts;
+}
+
+template <class Protocol_, class Transport_>
+void checkRoundTrip(shared_ptr<Transport_> trans,
+                    const uint8_t* padding = NULL,
+                    uint32_t padding_len = 0) {
+  CompactProtoTestStruct orig = makeLists();
+  Protocol_ prot(trans);
+
+  orig.write(&prot);
+  trans->write(padding, padding_len);
+  trans->flush();
+  CompactProtoTestStruct copy;
+  copy.read(&prot);
+
+  BOOST_CHECK(orig.i16_list == copy.i16_list);
+  BOOST_CHECK(orig.i32_list == copy.i32_list);
+  BOOST_CHECK(orig.i64_list == copy.i64_list);
+  BOOST_CHECK(orig.double_list == copy.double_list);
+}
+
+BOOST_AUTO_TEST_CASE( test_round_trip ) {
+  checkRoundTrip<TBinaryProtocol>(
+      shared_ptr<TMemoryBuffer>(new TMemoryBuffer()));
+  checkRoundTrip<TBinaryProtocolT<TMemoryBuffer> >(
+      shared_ptr<TMemoryBuffer>(new TMemoryBuffer()));
+  checkRoundTrip<TCompactProtocol>(
+      shared_ptr<TMemoryBuffer>(new TMemoryBuffer()));
+  checkRoundTrip<TCompactProtocolT<TMemoryBuffer> >(
+      shared_ptr<TMemoryBuffer>(new TMemoryBuffer()));
+  checkRoundTrip<TJSONProtocol>(
+      shared_ptr<TMemoryBuffer>(new TMemoryBuffer()));
+}
+
+BOOST_AUTO_TEST_CASE( test_round_trip_dense ) {
+  // TDenseProtocol derives from TBinaryProtocol, but its lists must still
+  // be varint encoded and step through its TypeSpec.
+  CompactProtoTestStruct orig = makeLists();
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TDenseProtocol prot(buffer, CompactProtoTestStruct::local_reflection);
+
+  orig.write(&prot);
+  CompactProtoTestStruct copy;
+  copy.read(&prot);
+  BOOST_CHECK_EQUAL(buffer->available_read(), 0U);
+  BOOST_CHECK(orig.i16_list == copy.i16_list);
+  BOOST_CHECK(orig.i32_list == copy.i32_list);
+  BOOST_CHECK(orig.i64_list == copy.i64_list);
+  BOOST_CHECK(orig.double_list == copy.double_list);
+
+  // Small integers take a byte each, where the binary encoding would take
+  // their full width; doubles are eight bytes either way.
+  CompactProtoTestStruct empty;
+  CompactProtoTestStruct small;
+  for (int i = 0; i < 100; ++i) {
+    small.i16_list.push_back(i);
+    small.i32_list.push_back(i);
+    small.i64_list.push_back(i);
+    small.double_list.push_back(i);
+  }
+  empty.write(&prot);
+  uint32_t emptySize = buffer->available_read();
+  buffer->resetBuffer();
+  small.write(&prot);
+  BOOST_CHECK_EQUAL(buffer->available_read() - emptySize, 100U * (1 + 1 + 1 + 8));
+  copy.read(&prot);
+  BOOST_CHECK(small.i64_list == copy.i64_list);
+  BOOST_CHECK(small.double_list == copy.double_list);
+
+  // Through the virtual interface as well.
+  TProtocol* vprot = &prot;
+  orig.write(vprot);
+  CompactProtoTestStruct vcopy;
+  vcopy.read(vprot);
+  BOOST_CHECK_EQUAL(buffer->available_read(), 0U);
+  BOOST_CHECK(orig.i32_list == vcopy.i32_list);
+  BOOST_CHECK(orig.double_list == vcopy.double_list);
+}
+
+BOOST_AUTO_TEST_CASE( test_round_trip_small_buffer ) {
+  // With a small read buffer the compact protocol falls back to reading
+  // one element at a time every time the buffer runs low.  Borrowing a
+  // varint from a TBufferedTransport needs ten bytes to follow it, so the
+  // stream is padded past the end of the struct.
+  uint8_t padding[16] = {0};
+  uint32_t sizes[] = {7, 37, 1024};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    shared_ptr<TMemoryBuffer> mem(new TMemoryBuffer());
+    shared_ptr<TBufferedTransport> trans(new TBufferedTransport(mem, sizes[i]));
+    checkRoundTrip<TCompactProtocol>(trans, padding, sizeof(padding));
+
+    mem.reset(new TMemoryBuffer());
+    trans.reset(new TBufferedTransport(mem, sizes[i]));
+    checkRoundTrip<TBinaryProtocol>(trans, padding, sizeof(padding));
+  }
+}
+
+template <class Protocol_>
+void checkSameEncoding() {
+  CompactProtoTestStruct cpts = makeLists();
+  shared_ptr<TMemoryBuffer> bulkBuf(new TMemoryBuffer());
+  shared_ptr<TMemoryBuffer> loopBuf(new TMemoryBuffer());
+  Protocol_ bulk(bulkBuf);
+  Protocol_ loop(loopBuf);
+
+  uint32_t bulkSize = 0;
+  uint32_t loopSize = 0;
+  bulkSize += bulk.writeI16List(&cpts.i16_list[0], cpts.i16_list.size());
+  bulkSize += bulk.writeI32List(&cpts.i32_list[0], cpts.i32_list.size());
+  bulkSize += bulk.writeI64List(&cpts.i64_list[0], cpts.i64_list.size());
+  bulkSize += bulk.writeDoubleList(&cpts.double_list[0], cpts.double_list.size());
+  for (size_t i = 0; i < cpts.i16_list.size(); ++i) {
+    loopSize += loop.writeI16(cpts.i16_list[i]);
+  }
+  for (size_t i = 0; i < cpts.i32_list.size(); ++i) {
+    loopSize += loop.writeI32(cpts.i32_list[i]);
+  }
+  for (size_t i = 0; i < cpts.i64_list.size(); ++i) {
+    loopSize += loop.writeI64(cpts.i64_list[i]);
+  }
+  for (size_t i = 0; i < cpts.double_list.size(); ++i) {
+    loopSize += loop.writeDouble(cpts.double_list[i]);
+  }
+
+  BOOST_CHECK_EQUAL(bulkSize, loopSize);
+  BOOST_CHECK_EQUAL(bulkBuf->getBufferAsString(), loopBuf->getBufferAsString());
+}
+
+BOOST_AUTO_TEST_CASE( test_same_encoding ) {
+  checkSameEncoding<TBinaryProtocol>();
+  checkSameEncoding<TCompactProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE( test_compact_overlong_varint ) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  uint8_t junk[32];
+  memset(junk, 0xff, sizeof(junk));
+  buffer->write(junk, sizeof(junk));
+  TCompactProtocol prot(buffer);
+
+  int64_t values[2];
+  BOOST_CHECK_THROW(prot.readI64List(values, 2),
+                    apache::thrift::protocol::TProtocolException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,137 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <limits>
+#include <transport/TBufferTransports.h>
+#include <protocol/TCompactProtocol.h>
+
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TBufferedTransport;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TCompactProtocolT;
+using apache::thrift::protocol::TProtocolException;
+using boost::shared_ptr;
+
+BOOST_AUTO_TEST_SUITE( CompactVarintTest )
+
+// The plain byte-at-a-time encoding, for comparison.
+static std::string referenceVarint(uint64_t n) {
+  std::string out;
+  while (n >= 0x80) {
+    out += (char)((n & 0x7f) | 0x80);
+    n >>= 7;
+  }
+  out += (char)n;
+  return out;
+}
+
+// Every width from 0 to 64 bits, at and either side of the boundaries.
+static std::vector<int64_t> interestingValues() {
+  std::vector<int64_t> values;
+  for (int bits = 0; bits < 64; ++bits) {
+    uint64_t p = (uint64_t)1 << bits;
+    values.push_back((int64_t)(p - 1));
+    values.push_back((int64_t)p);
+    values.push_back((int64_t)(p + 1));
+    values.push_back(-(int64_t)p);
+    values.push_back(-(int64_t)p + 1);
+  }
+  values.push_back(std::numeric_limits<int64_t>::max());
+  values.push_back(std::numeric_limits<int64_t>::min());
+  return values;
+}
+
+BOOST_AUTO_TEST_CASE( test_encoding ) {
+  std::vector<int64_t> values = interestingValues();
+  for (size_t i = 0; i < values.size(); ++i) {
+    uint64_t n = (uint64_t)values[i];
+    shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+    TCompactProtocolT<TMemoryBuffer> prot(buffer);
+
+    // writeI64(x) emits the varint of 2 * x for non-negative x, which
+    // covers every raw varint length from one byte to ten.
+    uint64_t zigzag = (n >> 1) << 1;
+    int64_t i64 = (int64_t)(zigzag >> 1);
+    uint32_t wsize = prot.writeI64(i64);
+    std::string expected = referenceVarint(zigzag);
+    BOOST_CHECK_EQUAL(buffer->getBufferAsString(), expected);
+    BOOST_CHECK_EQUAL(wsize, expected.size());
+    BOOST_CHECK_EQUAL(prot.serializedSizeI64(i64), expected.size());
+
+    buffer->resetBuffer();
+    wsize = prot.writeI64(values[i]);
+    BOOST_CHECK_EQUAL(wsize, buffer->available_read());
+    BOOST_CHECK_EQUAL(prot.serializedSizeI64(values[i]), wsize);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_round_trip ) {
+  std::vector<int64_t> values = interestingValues();
+
+  // Once on a transport that can always lend ten bytes, and once on one
+  // that runs dry mid-varint and forces the byte-at-a-time path.
+  shared_ptr<TMemoryBuffer> mem(new TMemoryBuffer());
+  TCompactProtocol prot(mem);
+  shared_ptr<TMemoryBuffer> small(new TMemoryBuffer());
+  shared_ptr<TBufferedTransport> buffered(new TBufferedTransport(small, 9));
+  TCompactProtocol bprot(buffered);
+  for (size_t i = 0; i < values.size(); ++i) {
+    prot.writeI64(values[i]);
+    prot.writeI32((int32_t)values[i]);
+    bprot.writeI64(values[i]);
+    bprot.writeI32((int32_t)values[i]);
+  }
+  // Room for the last borrow() to see ten bytes.
+  uint8_t padding[16] = {0};
+  prot.getTransport()->write(padding, sizeof(padding));
+  buffered->write(padding, sizeof(padding));
+  buffered->flush();
+
+  for (size_t i = 0; i < values.size(); ++i) {
+    int64_t i64;
+    int32_t i32;
+    prot.readI64(i64);
+    prot.readI32(i32);
+    BOOST_CHECK_EQUAL(i64, values[i]);
+    BOOST_CHECK_EQUAL(i32, (int32_t)values[i]);
+    bprot.readI64(i64);
+    bprot.readI32(i32);
+    BOOST_CHECK_EQUAL(i64, values[i]);
+    BOOST_CHECK_EQUAL(i32, (int32_t)values[i]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_overlong ) {
+  uint8_t data[16];
+  memset(data, 0xff, sizeof(data));
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(data, sizeof(data)));
+  TCompactProtocol prot(buffer);
+  int64_t i64;
+  BOOST_CHECK_THROW(prot.readI64(i64), TProtocolException);
+
+  // Nine continuation bytes and a terminator is still legal.
+  data[9] = 0x01;
+  buffer.reset(new TMemoryBuffer(data, sizeof(data)));
+  TCompactProtocol prot2(buffer);
+  BOOST_CHECK_EQUAL(prot2.readI64(i64), 10U);
+  BOOST_CHECK_EQUAL(i64, std::numeric_limits<int64_t>::min());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
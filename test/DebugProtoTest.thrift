@@ -64,6 +64,13 @@ struct HolyMoley {
   3: map<string,list<Bonk>> bonks,
 }
 
+struct LazyNesting {
+  1: i32 id,
+  2: HolyMoley big (cpp.lazy = "1"),
+  3: binary blob (cpp.lazy = "1"),
+  4: optional Bonk bonk (cpp.lazy = "1"),
+}
+
 struct Backwards {
   2: i32 first_tag2,
   1: i32 second_tag1,
@@ -155,5 +155,70 @@ int main() {
 
   assert(base == base2);
 
+  cout << "Testing escapes" << endl;
+
+  // Every byte value, at every offset relative to the word-at-a-time
+  // string scanners' eight byte blocks.
+  std::string all;
+  for (int i = 0; i < 256; i++) {
+    all += (char)i;
+    all += std::string(i % 11, 'x');
+  }
+  ooe.some_characters = all;
+  ooe.zomg_unicode = std::string(1000, 'y') + "\"" + std::string(7, 'z');
+  ooe.write(proto.get());
+  ooe2.read(proto.get());
+  assert(ooe == ooe2);
+
+  std::string escaped = apache::thrift::ThriftJSONString(ooe);
+  for (size_t i = 0; i < escaped.size(); i++) {
+    assert((uint8_t)escaped[i] >= 0x20);
+  }
+
+  cout << "Testing integers" << endl;
+
+  ooe.a_bite = -128;
+  ooe.integer16 = -32768;
+  ooe.integer32 = -2147483647 - 1;
+  ooe.integer64 = -9223372036854775807LL - 1;
+  ooe.write(proto.get());
+  ooe2.read(proto.get());
+  assert(ooe == ooe2);
+  assert(apache::thrift::ThriftJSONString(ooe).find(
+         "{\"i64\":-9223372036854775808}") != std::string::npos);
+
+  ooe.integer16 = 32767;
+  ooe.integer64 = 9223372036854775807LL;
+  ooe.write(proto.get());
+  ooe2.read(proto.get());
+  assert(ooe == ooe2);
+
+  // An i16 that doesn't fit must be rejected, not truncated.
+  buffer->resetBuffer();
+  std::string json = "{\"4\":{\"i16\":32768}}";
+  buffer->write((const uint8_t*)json.data(), json.size());
+  bool threw = false;
+  try {
+    ooe2.read(proto.get());
+  } catch (const apache::thrift::protocol::TProtocolException&) {
+    threw = true;
+  }
+  assert(threw);
+
+  // So must a double that doesn't parse, quoted or not
+  const char* badDoubles[] = {"{\"7\":{\"dbl\":-}}", "{\"7\":{\"dbl\":\"pi\"}}"};
+  for (int i = 0; i < 2; ++i) {
+    buffer->resetBuffer();
+    json = badDoubles[i];
+    buffer->write((const uint8_t*)json.data(), json.size());
+    threw = false;
+    try {
+      ooe2.read(proto.get());
+    } catch (const apache::thrift::protocol::TProtocolException&) {
+      threw = true;
+    }
+    assert(threw);
+  }
+
   return 0;
 }
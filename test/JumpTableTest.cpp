@@ -0,0 +1,127 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <transport/TBufferTransports.h>
+#include <protocol/TBinaryProtocol.h>
+#include <protocol/TCompactProtocol.h>
+#include "gen-cpp/DebugProtoTest_types.h"
+#include "gen-cpp/JumpTableTest_types.h"
+#include "gen-cpp/WideStructTest_types.h"
+
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::protocol::TBinaryProtocolT;
+using apache::thrift::protocol::TCompactProtocolT;
+using apache::thrift::protocol::T_BOOL;
+using apache::thrift::protocol::T_I32;
+using apache::thrift::protocol::T_STRING;
+using boost::shared_ptr;
+
+namespace debug = thrift::test::debug;
+namespace jump = thrift::test::jump;
+namespace wide = thrift::test::wide;
+
+BOOST_AUTO_TEST_SUITE( JumpTableTest )
+
+// Reads in with the jump table and writes back out, which must reproduce
+// the bytes written by the struct that was generated with a switch.
+template <class Protocol_, class From_, class To_>
+void checkRoundTrip(const From_& from) {
+  shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer());
+  Protocol_ prot(buf);
+  from.write(&prot);
+  std::string expected = buf->getBufferAsString();
+
+  To_ to;
+  to.read(&prot);
+  BOOST_CHECK_EQUAL(buf->available_read(), 0U);
+  to.write(&prot);
+  BOOST_CHECK(buf->getBufferAsString() == expected);
+}
+
+static wide::WideStruct makeWide() {
+  wide::WideStruct ws;
+  ws.field1 = 1;
+  ws.field188 = "one eighty-eight";
+  ws.field375 = 5000000000LL;
+  ws.field29939 = true;
+  return ws;
+}
+
+BOOST_AUTO_TEST_CASE( test_in_order ) {
+  // Bonk's ids are dense, the others' go through the hash
+  debug::Bonk bonk;
+  bonk.type = 31337;
+  bonk.message = "bonk";
+  debug::BigFieldIdStruct big;
+  big.field1 = "one";
+  big.field2 = "forty-five";
+
+  checkRoundTrip<TBinaryProtocolT<TMemoryBuffer>, debug::Bonk, jump::Bonk>(bonk);
+  checkRoundTrip<TCompactProtocolT<TMemoryBuffer>, debug::Bonk, jump::Bonk>(bonk);
+  checkRoundTrip<TBinaryProtocolT<TMemoryBuffer>, debug::BigFieldIdStruct, jump::BigFieldIdStruct>(big);
+  checkRoundTrip<TCompactProtocolT<TMemoryBuffer>, debug::BigFieldIdStruct, jump::BigFieldIdStruct>(big);
+  checkRoundTrip<TBinaryProtocolT<TMemoryBuffer>, wide::WideStruct, jump::WideStruct>(makeWide());
+  checkRoundTrip<TCompactProtocolT<TMemoryBuffer>, wide::WideStruct, jump::WideStruct>(makeWide());
+}
+
+// Fields out of declaration order, an id the struct doesn't know and a
+// known id with the wrong type all miss the fast path.
+template <class Protocol_>
+void checkOutOfOrder() {
+  shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer());
+  Protocol_ prot(buf);
+  prot.writeStructBegin("WideStruct");
+  prot.writeFieldBegin("field29939", T_BOOL, 29939);
+  prot.writeBool(true);
+  prot.writeFieldEnd();
+  prot.writeFieldBegin("field188", T_STRING, 188);
+  prot.writeString("one eighty-eight");
+  prot.writeFieldEnd();
+  prot.writeFieldBegin("field1", T_I32, 1);
+  prot.writeI32(1);
+  prot.writeFieldEnd();
+  prot.writeFieldBegin("unknown", T_I32, 3);
+  prot.writeI32(3);
+  prot.writeFieldEnd();
+  prot.writeFieldBegin("field375", T_STRING, 375);
+  prot.writeString("not an i64");
+  prot.writeFieldEnd();
+  prot.writeFieldBegin("unknown", T_STRING, 1000);
+  prot.writeString("unknown");
+  prot.writeFieldEnd();
+  prot.writeFieldStop();
+  prot.writeStructEnd();
+
+  jump::WideStruct ws;
+  ws.read(&prot);
+  BOOST_CHECK_EQUAL(buf->available_read(), 0U);
+  BOOST_CHECK_EQUAL(ws.field1, 1);
+  BOOST_CHECK_EQUAL(ws.field188, "one eighty-eight");
+  BOOST_CHECK_EQUAL(ws.field375, 0);
+  BOOST_CHECK(!ws.__isset.field375);
+  BOOST_CHECK_EQUAL(ws.field29939, true);
+}
+
+BOOST_AUTO_TEST_CASE( test_out_of_order ) {
+  checkOutOfOrder<TBinaryProtocolT<TMemoryBuffer> >();
+  checkOutOfOrder<TCompactProtocolT<TMemoryBuffer> >();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
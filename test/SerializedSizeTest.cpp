@@ -0,0 +1,144 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <transport/TBufferTransports.h>
+#include <protocol/TBinaryProtocol.h>
+#include <protocol/TCompactProtocol.h>
+#include "gen-cpp/DebugProtoTest_types.h"
+
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::protocol::TBinaryProtocolT;
+using apache::thrift::protocol::TCompactProtocolT;
+using apache::thrift::protocol::TProtocol;
+using boost::shared_ptr;
+using namespace thrift::test::debug;
+
+BOOST_AUTO_TEST_SUITE( SerializedSizeTest )
+
+static CompactProtoTestStruct makeCompactProtoTestStruct() {
+  CompactProtoTestStruct cpts;
+  cpts.a_byte = -127;
+  cpts.a_i16 = -32000;
+  cpts.a_i32 = 1 << 30;
+  cpts.a_i64 = -((int64_t)1 << 62);
+  cpts.a_double = 3.25;
+  cpts.a_string = "sized";
+  cpts.a_binary = std::string(300, '\0');
+  cpts.true_field = true;
+  cpts.false_field = false;
+  for (int i = 0; i < 20; ++i) {
+    cpts.byte_list.push_back(i);
+    cpts.i16_list.push_back(-i * 1000);
+    cpts.i32_list.push_back(i << 24);
+    cpts.i64_list.push_back((int64_t)i << 50);
+    cpts.double_list.push_back(i / 3.0);
+    cpts.string_list.push_back(std::string(i, 's'));
+    cpts.boolean_list.push_back(i % 2 == 0);
+    cpts.i32_set.insert(i);
+    cpts.i32_byte_map[i] = i;
+  }
+  cpts.struct_list.resize(3);
+  cpts.byte_list_map[7].assign(5, 9);
+  return cpts;
+}
+
+static HolyMoley makeHolyMoley() {
+  HolyMoley hm;
+  OneOfEach ooe;
+  ooe.some_characters = "sizing";
+  ooe.base64 = "\1\2\3\255";
+  hm.big.assign(3, ooe);
+  hm.contain.insert(std::vector<std::string>(2, "and a one"));
+  hm.bonks["two"].resize(2);
+  return hm;
+}
+
+template <class Protocol_, class Struct_>
+void checkSize(const Struct_& obj, bool exact) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol_ prot(buffer);
+
+  uint32_t size = obj.serializedSize(&prot);
+  uint32_t written = obj.write(&prot);
+  BOOST_CHECK_EQUAL(written, buffer->available_read());
+  if (exact) {
+    BOOST_CHECK_EQUAL(size, written);
+  } else {
+    BOOST_CHECK(size >= written);
+  }
+
+  // The virtual interface must agree with the templated one.
+  TProtocol* vprot = &prot;
+  BOOST_CHECK_EQUAL(obj.serializedSize(vprot), size);
+}
+
+BOOST_AUTO_TEST_CASE( test_binary_exact ) {
+  checkSize<TBinaryProtocolT<TMemoryBuffer> >(makeCompactProtoTestStruct(), true);
+  checkSize<TBinaryProtocolT<TMemoryBuffer> >(makeHolyMoley(), true);
+  checkSize<TBinaryProtocolT<TMemoryBuffer> >(OneOfEach(), true);
+}
+
+BOOST_AUTO_TEST_CASE( test_compact_upper_bound ) {
+  checkSize<TCompactProtocolT<TMemoryBuffer> >(makeCompactProtoTestStruct(), false);
+  checkSize<TCompactProtocolT<TMemoryBuffer> >(makeHolyMoley(), false);
+  checkSize<TCompactProtocolT<TMemoryBuffer> >(OneOfEach(), false);
+}
+
+BOOST_AUTO_TEST_CASE( test_reserve ) {
+  HolyMoley hm = makeHolyMoley();
+
+  // A reserved TMemoryBuffer takes the whole struct without growing.
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(16));
+  TBinaryProtocolT<TMemoryBuffer> prot(buffer);
+  uint32_t size = hm.serializedSize(&prot);
+  buffer->reserve(size);
+  BOOST_CHECK_EQUAL(buffer->available_write(), size);
+  uint8_t* before = buffer->getWritePtr(0);
+  hm.write(&prot);
+  BOOST_CHECK(buffer->getWritePtr(0) == before + size);
+  BOOST_CHECK_EQUAL(buffer->available_write(), 0U);
+
+  // Same for a frame; the frame on the wire is unaffected.
+  shared_ptr<TMemoryBuffer> sink(new TMemoryBuffer());
+  shared_ptr<TFramedTransport> framed(new TFramedTransport(sink, 16));
+  TBinaryProtocolT<TFramedTransport> fprot(framed);
+  framed->reserve(size);
+  hm.write(&fprot);
+  framed->flush();
+  BOOST_CHECK_EQUAL(sink->available_read(), size + 4);
+
+  HolyMoley hm2;
+  shared_ptr<TFramedTransport> reader(new TFramedTransport(sink));
+  TBinaryProtocolT<TFramedTransport> rprot(reader);
+  hm2.read(&rprot);
+  BOOST_CHECK(hm2 == hm);
+}
+
+BOOST_AUTO_TEST_CASE( test_reserve_external ) {
+  // An external buffer cannot grow, and reserving is only a hint.
+  uint8_t storage[64];
+  TMemoryBuffer buffer(storage, sizeof(storage));
+  uint32_t avail = buffer.available_write();
+  buffer.reserve(avail + 1024);
+  BOOST_CHECK_EQUAL(buffer.available_write(), avail);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
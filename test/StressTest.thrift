@@ -29,5 +29,8 @@ service Service {
   list<byte>  echoList(1: list<byte> arg),
   set<byte>  echoSet(1: set<byte> arg),
   map<byte, byte>  echoMap(1: map<byte, byte> arg),
+
+  /** Runs on the IO threads of a thread-pool TNonblockingServer */
+  i32 echoI32Inline(1: i32 arg) (cpp.dispatch = "inline"),
 }
 
@@ -0,0 +1,158 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <TArena.h>
+#include <transport/TBufferTransports.h>
+#include <protocol/TBinaryProtocol.h>
+#include <protocol/TCompactProtocol.h>
+#include "gen-cpp/DebugProtoTest_types.h"
+#include "gen-cpp/ArenaTest_types.h"
+
+using apache::thrift::TArena;
+using apache::thrift::TArenaScope;
+using apache::thrift::TArenaString;
+using apache::thrift::transport::TMemoryBuffer;
+using boost::shared_ptr;
+
+BOOST_AUTO_TEST_SUITE( TArenaTest )
+
+BOOST_AUTO_TEST_CASE( test_allocate ) {
+  TArena arena(256);
+  BOOST_CHECK(TArena::current() == NULL);
+
+  char* a = static_cast<char*>(arena.allocate(10));
+  char* b = static_cast<char*>(arena.allocate(10));
+  BOOST_CHECK_EQUAL((reinterpret_cast<uintptr_t>(a) % sizeof(void*)), 0U);
+  BOOST_CHECK_EQUAL((reinterpret_cast<uintptr_t>(b) % sizeof(void*)), 0U);
+  BOOST_CHECK(a + 10 <= b);
+  BOOST_CHECK_EQUAL(arena.bytesReserved(), 256U);
+
+  // Oversized requests get their own chunk and are released by reset().
+  arena.allocate(1024);
+  BOOST_CHECK_EQUAL(arena.bytesReserved(), 256U + 1024U);
+  for (int i = 0; i < 100; ++i) {
+    arena.allocate(16);
+  }
+  size_t reserved = arena.bytesReserved();
+  BOOST_CHECK_EQUAL(arena.allocations(), 103U);
+  arena.reset();
+  BOOST_CHECK_EQUAL(arena.bytesAllocated(), 0U);
+  BOOST_CHECK_EQUAL(arena.allocations(), 0U);
+  BOOST_CHECK_EQUAL(arena.bytesReserved(), reserved - 1024);
+
+  // Retained chunks are reused rather than reallocated.
+  for (int i = 0; i < 100; ++i) {
+    arena.allocate(16);
+  }
+  BOOST_CHECK_EQUAL(arena.bytesReserved(), reserved - 1024);
+  BOOST_CHECK_EQUAL(arena.allocations(), 100U);
+}
+
+BOOST_AUTO_TEST_CASE( test_scope ) {
+  TArena outer;
+  TArena inner;
+  {
+    TArenaScope s1(&outer);
+    BOOST_CHECK(TArena::current() == &outer);
+    {
+      TArenaScope s2(&inner);
+      BOOST_CHECK(TArena::current() == &inner);
+      TArenaString str("allocated from the inner arena, not the heap");
+      BOOST_CHECK(str.get_allocator().arena() == &inner);
+      BOOST_CHECK(inner.bytesAllocated() > 0);
+    }
+    BOOST_CHECK(TArena::current() == &outer);
+  }
+  BOOST_CHECK(TArena::current() == NULL);
+
+  // Without an arena bound, arena types fall back to the heap.
+  TArenaString str("heap");
+  BOOST_CHECK(str.get_allocator().arena() == NULL);
+}
+
+template <class Protocol_>
+void testRoundTrip() {
+  thrift::test::debug::HolyMoley hm;
+  thrift::test::debug::OneOfEach ooe;
+  ooe.some_characters = "Debug THIS!";
+  ooe.zomg_unicode = "\xd7\n\a\t";
+  ooe.base64 = std::string("\0\1\2\3", 4);
+  hm.big.push_back(ooe);
+  ooe.integer32 = 42;
+  hm.big.push_back(ooe);
+
+  std::vector<std::string> strs;
+  strs.push_back("and a one");
+  strs.push_back("and a two");
+  hm.contain.insert(strs);
+  hm.contain.insert(std::vector<std::string>());
+
+  thrift::test::debug::Bonk bonk;
+  bonk.type = 1;
+  bonk.message = "Wait.";
+  hm.bonks["two"].push_back(bonk);
+  hm.bonks["nothing"];
+
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol_ prot(buffer);
+  hm.write(&prot);
+  std::string serialized = buffer->getBufferAsString();
+
+  TArena arena;
+  {
+    TArenaScope scope(&arena);
+    thrift::test::arena::HolyMoley ahm;
+    ahm.read(&prot);
+    BOOST_CHECK(arena.bytesAllocated() > 0);
+
+    BOOST_REQUIRE_EQUAL(ahm.big.size(), 2U);
+    BOOST_CHECK_EQUAL(ahm.big[1].integer32, 42);
+    BOOST_CHECK(ahm.big[0].some_characters == "Debug THIS!");
+    BOOST_CHECK(ahm.big[0].base64 == TArenaString("\0\1\2\3", 4));
+    BOOST_CHECK_EQUAL(ahm.contain.size(), 2U);
+    BOOST_CHECK(ahm.bonks["two"][0].message == "Wait.");
+    BOOST_CHECK(ahm.bonks["nothing"].empty());
+
+    // Writing the arena struct back out must produce the same bytes.
+    ahm.write(&prot);
+    BOOST_CHECK(buffer->getBufferAsString() == serialized);
+
+    // Same again through the virtual TProtocol interface.
+    apache::thrift::protocol::TProtocol* vprot = &prot;
+    thrift::test::arena::HolyMoley vhm;
+    vhm.read(vprot);
+    BOOST_CHECK(vhm == ahm);
+    vhm.write(vprot);
+    BOOST_CHECK(buffer->getBufferAsString() == serialized);
+  }
+  arena.reset();
+}
+
+BOOST_AUTO_TEST_CASE( test_binary_roundtrip ) {
+  testRoundTrip<apache::thrift::protocol::TBinaryProtocolT<TMemoryBuffer> >();
+  testRoundTrip<apache::thrift::protocol::TBinaryProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE( test_compact_roundtrip ) {
+  testRoundTrip<apache::thrift::protocol::TCompactProtocolT<TMemoryBuffer> >();
+  testRoundTrip<apache::thrift::protocol::TCompactProtocol>();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -27,6 +27,7 @@ using boost::shared_ptr;
 using apache::thrift::transport::TMemoryBuffer;
 using apache::thrift::transport::TBufferedTransport;
 using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TMessageSizeTracker;
 using apache::thrift::transport::test::TShortReadTransport;
 
 // Shamelessly copied from ZlibTransport.  TODO: refactor.
@@ -486,6 +487,79 @@ BOOST_AUTO_TEST_CASE( test_BufferedTransport_Read_Short ) {
   }
 }
 
+BOOST_AUTO_TEST_CASE( test_MessageSizeTracker ) {
+  TMessageSizeTracker tracker(90, 10);
+  BOOST_CHECK_EQUAL(tracker.getEstimate(), 0u);
+
+  // Nine small messages and a big one: the 90th percentile is small
+  for (int i = 0; i < 9; i++) {
+    BOOST_CHECK(!tracker.record(100));
+  }
+  BOOST_CHECK(tracker.record(5000));
+  BOOST_CHECK_EQUAL(tracker.getEstimate(), 128u);
+
+  // Mostly big ones from then on, which soon outweigh the older ones
+  for (int i = 0; i < 20; i++) {
+    tracker.record(i % 5 == 0 ? 100 : 5000);
+  }
+  BOOST_CHECK_EQUAL(tracker.getEstimate(), 8192u);
+  BOOST_CHECK_EQUAL(tracker.getMessages(), 30u);
+  BOOST_CHECK_EQUAL(tracker.getMaxSize(), 5000u);
+}
+
+BOOST_AUTO_TEST_CASE( test_BufferedTransport_Adaptive ) {
+  init_data();
+
+  // Pairs of big and small messages, read and echoed back
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  uint32_t sizes[] = { 20000, 100 };
+  uint32_t offset = 0;
+  for (int i = 0; i < 128; i++) {
+    wire->write(&data[offset], sizes[i % 2]);
+    offset = (offset + sizes[i % 2]) % (1<<14);
+  }
+
+  shared_ptr<TMemoryBuffer> out(new TMemoryBuffer());
+  shared_ptr<TShortReadTransport> in(new TShortReadTransport(wire, 0.5));
+  TBufferedTransport reader(in, 512);
+  TBufferedTransport writer(out, 512);
+  reader.setAdaptive(256, 1<<16, 75);
+  writer.setAdaptive(256, 1<<16, 75);
+
+  uint8_t message[20000];
+  offset = 0;
+  for (int i = 0; i < 128; i++) {
+    reader.readAll(message, sizes[i % 2]);
+    reader.readEnd();
+    BOOST_CHECK(memcmp(message, &data[offset], sizes[i % 2]) == 0);
+    writer.write(message, sizes[i % 2]);
+    writer.flush();
+    offset = (offset + sizes[i % 2]) % (1<<14);
+  }
+  BOOST_CHECK_EQUAL(out->available_read(), 64u * 20100);
+
+  // A quarter of the messages are big, so the buffers grew to hold them
+  BOOST_CHECK_EQUAL(reader.getReadSizes().getMessages(), 128u);
+  BOOST_CHECK_EQUAL(reader.getReadBufferSize(), 32768u);
+  BOOST_CHECK_EQUAL(writer.getWriteBufferSize(), 32768u);
+  BOOST_CHECK_EQUAL(reader.getGrows(), 1u);
+
+  // Once only small ones come, they shrink again
+  for (int i = 0; i < 128; i++) {
+    wire->write(data, 100);
+  }
+  for (int i = 0; i < 128; i++) {
+    reader.readAll(message, 100);
+    reader.readEnd();
+    BOOST_CHECK(memcmp(message, data, 100) == 0);
+    writer.write(message, 100);
+    writer.flush();
+  }
+  BOOST_CHECK_EQUAL(reader.getReadBufferSize(), 256u);
+  BOOST_CHECK_EQUAL(writer.getWriteBufferSize(), 256u);
+  BOOST_CHECK_EQUAL(reader.getShrinks(), 1u);
+}
+
 BOOST_AUTO_TEST_CASE( test_FramedTransport_Write ) {
   init_data();
 
@@ -0,0 +1,143 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <pthread.h>
+#include <string>
+#include <transport/TBufferPool.h>
+#include <transport/TBufferTransports.h>
+
+using namespace apache::thrift::transport;
+using boost::shared_ptr;
+
+BOOST_AUTO_TEST_SUITE( TBufferPoolTest )
+
+BOOST_AUTO_TEST_CASE( test_size_classes ) {
+  TBufferPool pool;
+
+  uint32_t size = 1;
+  uint8_t* buf = pool.get(&size);
+  BOOST_CHECK_EQUAL(size, TBufferPool::MIN_BUFFER_SIZE);
+  pool.put(buf, size);
+
+  size = 3000;
+  buf = pool.get(&size);
+  BOOST_CHECK_EQUAL(size, 4096u);
+  pool.put(buf, size);
+
+  // Too large to pool
+  size = TBufferPool::MAX_BUFFER_SIZE + 1;
+  buf = pool.get(&size);
+  BOOST_CHECK_EQUAL(size, TBufferPool::MAX_BUFFER_SIZE + 1);
+  pool.put(buf, size);
+
+  BOOST_CHECK_EQUAL(pool.getHits(), 0u);
+  BOOST_CHECK_EQUAL(pool.getMisses(), 3u);
+  BOOST_CHECK_EQUAL(pool.getRetainedBytes(), 512u + 4096u);
+}
+
+BOOST_AUTO_TEST_CASE( test_reuse ) {
+  TBufferPool pool;
+
+  uint32_t size = 1000;
+  uint8_t* buf = pool.get(&size);
+  pool.put(buf, size);
+
+  size = 600;
+  BOOST_CHECK(pool.get(&size) == buf);
+  BOOST_CHECK_EQUAL(size, 1024u);
+  BOOST_CHECK_EQUAL(pool.getHits(), 1u);
+  BOOST_CHECK_EQUAL(pool.getRetainedBytes(), 0u);
+  pool.put(buf, size);
+}
+
+BOOST_AUTO_TEST_CASE( test_retention_bound ) {
+  // Nothing stays in the thread cache, and 4 KB in the free list
+  TBufferPool pool(4096, 0);
+
+  uint8_t* bufs[4];
+  for (int i = 0; i < 4; ++i) {
+    uint32_t size = 2048;
+    bufs[i] = pool.get(&size);
+  }
+  for (int i = 0; i < 4; ++i) {
+    pool.put(bufs[i], 2048);
+  }
+  BOOST_CHECK_EQUAL(pool.getRetainedBytes(), 4096u);
+
+  for (int i = 0; i < 4; ++i) {
+    uint32_t size = 2048;
+    bufs[i] = pool.get(&size);
+  }
+  BOOST_CHECK_EQUAL(pool.getHits(), 2u);
+  BOOST_CHECK_EQUAL(pool.getMisses(), 6u);
+  for (int i = 0; i < 4; ++i) {
+    pool.put(bufs[i], 2048);
+  }
+}
+
+static void* returnBuffer(void* arg) {
+  TBufferPool* pool = static_cast<TBufferPool*>(arg);
+  uint32_t size = 8192;
+  pool->put(pool->get(&size), size);
+  return NULL;
+}
+
+BOOST_AUTO_TEST_CASE( test_thread_exit ) {
+  TBufferPool pool;
+
+  // The buffer goes into the thread's cache, and to the free list when
+  // the thread exits, where this thread finds it.
+  pthread_t thread;
+  BOOST_REQUIRE_EQUAL(pthread_create(&thread, NULL, returnBuffer, &pool), 0);
+  pthread_join(thread, NULL);
+  BOOST_CHECK_EQUAL(pool.getRetainedBytes(), 8192u);
+
+  uint32_t size = 8192;
+  uint8_t* buf = pool.get(&size);
+  BOOST_CHECK_EQUAL(pool.getHits(), 1u);
+  pool.put(buf, size);
+}
+
+BOOST_AUTO_TEST_CASE( test_factory_transports ) {
+  shared_ptr<TBufferPool> pool(new TBufferPool());
+  TFramedTransportFactory factory(pool);
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  std::string reply(10000, 'r');
+
+  for (int i = 0; i < 10; ++i) {
+    wire->resetBuffer();
+    shared_ptr<TTransport> trans = factory.getTransport(wire);
+    trans->write((const uint8_t*)reply.data(), reply.size());
+    trans->flush();
+    BOOST_CHECK_EQUAL(wire->available_read(), reply.size() + 4);
+  }
+
+  // Read, write and grown write buffers are only allocated the first time
+  BOOST_CHECK_EQUAL(pool->getMisses(), 3u);
+  BOOST_CHECK_EQUAL(pool->getHits(), 27u);
+
+  TBufferedTransportFactory buffered(pool);
+  {
+    shared_ptr<TTransport> trans = buffered.getTransport(wire);
+  }
+  BOOST_CHECK_EQUAL(pool->getMisses(), 3u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,222 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <transport/TCompressedFramedTransport.h>
+
+using namespace apache::thrift::transport;
+using boost::shared_ptr;
+
+BOOST_AUTO_TEST_SUITE( TCompressedFramedTransportTest )
+
+// Log-like text, which compresses well
+static std::string makeText(size_t len) {
+  std::string text;
+  for (int i = 0; text.size() < len; ++i) {
+    char line[64];
+    snprintf(line, sizeof(line), "request %d from host%d took %d us\n",
+             i, i % 7, (i * 7919) % 1000);
+    text += line;
+  }
+  text.resize(len);
+  return text;
+}
+
+static std::string makeRandom(size_t len, unsigned seed) {
+  std::string data(len, '\0');
+  for (size_t i = 0; i < len; ++i) {
+    seed = seed * 1103515245 + 12345;
+    data[i] = (char)(seed >> 16);
+  }
+  return data;
+}
+
+static std::string roundTrip(const TFrameCodec& codec, const std::string& in,
+                             uint32_t* clen = NULL) {
+  std::vector<uint8_t> compressed(codec.maxCompressedSize(in.size()));
+  uint32_t len = codec.compress((const uint8_t*)in.data(), in.size(), &compressed[0]);
+  BOOST_CHECK(len <= compressed.size());
+  if (clen != NULL) {
+    *clen = len;
+  }
+  std::string out(in.size(), '\0');
+  codec.decompress(&compressed[0], len, (uint8_t*)&out[0], out.size());
+  return out;
+}
+
+BOOST_AUTO_TEST_CASE( test_lz4_round_trip ) {
+  TLZ4Codec codec;
+
+  size_t sizes[] = { 0, 1, 12, 13, 17, 100, 4096, 65536, 300000 };
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    std::string text = makeText(sizes[i]);
+    BOOST_CHECK(roundTrip(codec, text) == text);
+    std::string random = makeRandom(sizes[i], i);
+    BOOST_CHECK(roundTrip(codec, random) == random);
+  }
+
+  uint32_t clen;
+  std::string text = makeText(100000);
+  BOOST_CHECK(roundTrip(codec, text, &clen) == text);
+  BOOST_CHECK(clen < text.size() / 2);
+
+  // Runs are matches that overlap their own output
+  std::string zeros(1 << 20, '\0');
+  BOOST_CHECK(roundTrip(codec, zeros, &clen) == zeros);
+  BOOST_CHECK(clen < zeros.size() / 200);
+}
+
+BOOST_AUTO_TEST_CASE( test_lz4_corrupt ) {
+  TLZ4Codec codec;
+  std::string text = makeText(10000);
+  std::vector<uint8_t> compressed(codec.maxCompressedSize(text.size()));
+  uint32_t len = codec.compress((const uint8_t*)text.data(), text.size(), &compressed[0]);
+  std::string out(text.size(), '\0');
+
+  // Truncated, or into the wrong size of buffer
+  BOOST_CHECK_THROW(codec.decompress(&compressed[0], len - 1, (uint8_t*)&out[0], out.size()),
+                    TTransportException);
+  BOOST_CHECK_THROW(codec.decompress(&compressed[0], len, (uint8_t*)&out[0], out.size() - 1),
+                    TTransportException);
+  BOOST_CHECK_THROW(codec.decompress(&compressed[0], 0, (uint8_t*)&out[0], out.size()),
+                    TTransportException);
+
+  // Damage is either caught or decodes to something, but never overruns
+  for (int i = 0; i < 2000; ++i) {
+    std::vector<uint8_t> damaged(compressed.begin(), compressed.begin() + len);
+    damaged[(i * 7919) % len] ^= (uint8_t)(1 + i % 255);
+    try {
+      codec.decompress(&damaged[0], len, (uint8_t*)&out[0], out.size());
+    } catch (TTransportException&) {
+    }
+  }
+}
+
+static std::string writeFrames(const std::vector<std::string>& messages,
+                               uint32_t threshold) {
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  TCompressedFramedTransport trans(wire, TFrameCodec::getCodec(TLZ4Codec::ID), threshold);
+  for (size_t i = 0; i < messages.size(); ++i) {
+    trans.write((const uint8_t*)messages[i].data(), messages[i].size());
+    trans.flush();
+  }
+  return wire->getBufferAsString();
+}
+
+static void checkFrames(const std::string& bytes, const std::vector<std::string>& messages) {
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  wire->write((const uint8_t*)bytes.data(), bytes.size());
+  TCompressedFramedTransport trans(wire);
+  for (size_t i = 0; i < messages.size(); ++i) {
+    std::string got(messages[i].size(), '\0');
+    trans.readAll((uint8_t*)&got[0], got.size());
+    BOOST_CHECK(got == messages[i]);
+  }
+  BOOST_CHECK(!trans.peek());
+}
+
+BOOST_AUTO_TEST_CASE( test_transport_round_trip ) {
+  std::vector<std::string> messages;
+  messages.push_back("small");
+  messages.push_back(makeText(100000));
+  messages.push_back(makeRandom(5000, 1));
+  messages.push_back(makeText(600));
+
+  std::string bytes = writeFrames(messages, 512);
+  checkFrames(bytes, messages);
+
+  // The first frame is stored, the second compressed, the random one
+  // stored because it does not shrink
+  const uint32_t header = TCompressedFramedTransport::FRAME_HEADER_SIZE;
+  BOOST_CHECK_EQUAL(bytes[4], 0);
+  BOOST_CHECK_EQUAL(bytes.substr(header, 5), "small");
+  size_t second = header + 5;
+  BOOST_CHECK_EQUAL(bytes[second + 4], (char)TLZ4Codec::ID);
+  BOOST_CHECK(bytes.size() < 100000 / 2);
+
+  // Nothing is compressed below the threshold
+  std::string stored = writeFrames(messages, 1 << 20);
+  checkFrames(stored, messages);
+  BOOST_CHECK(stored.size() > 100000);
+}
+
+BOOST_AUTO_TEST_CASE( test_referenced_writes ) {
+  std::string big = makeText(50000);
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  TCompressedFramedTransport out(wire);
+  out.setWriteRefThreshold(1000);
+  out.write((const uint8_t*)"head", 4);
+  out.write((const uint8_t*)big.data(), big.size());
+  out.write((const uint8_t*)"tail", 4);
+  out.flush();
+
+  TCompressedFramedTransport in(wire);
+  std::string got(big.size() + 8, '\0');
+  in.readAll((uint8_t*)&got[0], got.size());
+  BOOST_CHECK(got == "head" + big + "tail");
+}
+
+// Stores bytes reversed, to show that the header picks the codec
+class ReverseCodec : public TFrameCodec {
+ public:
+  uint8_t getId() const { return 200; }
+  uint32_t maxCompressedSize(uint32_t len) const { return len; }
+  uint32_t compress(const uint8_t* src, uint32_t len, uint8_t* dst) const {
+    for (uint32_t i = 0; i < len; ++i) {
+      dst[i] = src[len - 1 - i];
+    }
+    // pretend to have saved a byte so the codec is used
+    return len > 0 ? len - 1 : 0;
+  }
+  void decompress(const uint8_t* src, uint32_t len, uint8_t* dst, uint32_t dstLen) const {
+    if (len + 1 != dstLen) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA);
+    }
+    for (uint32_t i = 0; i < len; ++i) {
+      dst[dstLen - 1 - i] = src[i];
+    }
+    dst[0] = 'x';
+  }
+};
+
+BOOST_AUTO_TEST_CASE( test_codec_registry ) {
+  shared_ptr<TFrameCodec> reverse(new ReverseCodec());
+
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  TCompressedFramedTransport out(wire, reverse, 0);
+  out.write((const uint8_t*)"xabcdef", 7);
+  out.flush();
+  std::string bytes = wire->getBufferAsString();
+
+  // The codec has to be registered to be decoded
+  TCompressedFramedTransport in(wire);
+  uint8_t buf[7];
+  BOOST_CHECK_THROW(in.read(buf, sizeof(buf)), TTransportException);
+
+  TFrameCodec::registerCodec(reverse);
+  wire->resetBuffer();
+  wire->write((const uint8_t*)bytes.data(), bytes.size());
+  in.readAll(buf, sizeof(buf));
+  BOOST_CHECK(std::string((char*)buf, sizeof(buf)) == "xabcdef");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
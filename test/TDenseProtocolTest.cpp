@@ -0,0 +1,83 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <transport/TBufferTransports.h>
+#include <protocol/TDenseProtocol.h>
+#include "gen-cpp/DebugProtoTest_types.h"
+
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::protocol::TDenseProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::protocol::TProtocolException;
+using apache::thrift::protocol::T_STRUCT;
+using boost::shared_ptr;
+using namespace thrift::test::debug;
+
+// TDenseProtocol derives from TBinaryProtocol for its primitives, and has
+// to keep the binary protocol's optimized paths from reaching its streams.
+BOOST_AUTO_TEST_SUITE( TDenseProtocolTest )
+
+static CompactProtoTestStruct makeStruct() {
+  CompactProtoTestStruct cpts;
+  cpts.a_i16 = 300;
+  cpts.a_i32 = 70000;
+  cpts.a_i64 = 5;
+  cpts.a_string = "dense";
+  for (int i = 0; i < 10; ++i) {
+    cpts.i32_list.push_back(i * 1000);
+    cpts.string_list.push_back(std::string(i, 'd'));
+    cpts.i32_byte_map[i] = i;
+  }
+  cpts.struct_list.resize(2);
+  return cpts;
+}
+
+BOOST_AUTO_TEST_CASE( test_skip ) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TDenseProtocol prot(buffer, CompactProtoTestStruct::local_reflection);
+  CompactProtoTestStruct cpts = makeStruct();
+  const uint8_t sentinel = 0x7f;
+
+  // The skip has to stop right at the end of the struct, directly and
+  // through the virtual interface.
+  cpts.write(&prot);
+  buffer->write(&sentinel, 1);
+  prot.skip(T_STRUCT);
+  BOOST_CHECK_EQUAL(buffer->available_read(), 1U);
+  buffer->resetBuffer();
+
+  cpts.write(&prot);
+  buffer->write(&sentinel, 1);
+  TProtocol* vprot = &prot;
+  vprot->skip(T_STRUCT);
+  BOOST_CHECK_EQUAL(buffer->available_read(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE( test_serialized_size_unsupported ) {
+  // The binary protocol's fixed widths would be wrong for a dense stream.
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TDenseProtocol prot(buffer, CompactProtoTestStruct::local_reflection);
+  CompactProtoTestStruct cpts = makeStruct();
+  BOOST_CHECK_THROW(cpts.serializedSize(&prot), TProtocolException);
+  TProtocol* vprot = &prot;
+  BOOST_CHECK_THROW(cpts.serializedSize(vprot), TProtocolException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
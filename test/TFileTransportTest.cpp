@@ -0,0 +1,269 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include <transport/TFileTransport.h>
+
+using apache::thrift::transport::TFileTransport;
+using apache::thrift::transport::TFileTransportBuffer;
+
+BOOST_AUTO_TEST_SUITE( TFileTransportTest )
+
+static const uint32_t kChunkSize = 1024;
+
+// Events of varying sizes, which the writer pads to keep within chunks.
+static std::string makeEvent(int i) {
+  return std::string(1 + (i * 37) % 300, (char)('a' + i % 26));
+}
+
+static void writeEvents(const std::string& path, int begin, int end,
+                        TFileTransport::FlushPolicy policy = TFileTransport::FLUSH_FSYNC,
+                        int flushEvery = 0) {
+  TFileTransport out(path);
+  out.setChunkSize(kChunkSize);
+  out.setFlushMaxUs(10000);
+  out.setFlushPolicy(policy);
+  for (int i = begin; i < end; ++i) {
+    std::string event = makeEvent(i);
+    out.write((const uint8_t*)event.data(), event.size());
+    if (flushEvery && i % flushEvery == 0) {
+      out.flush();
+    }
+  }
+  out.flush();
+}
+
+struct TempFile {
+  std::string path;
+  TempFile() {
+    char name[] = "/tmp/TFileTransportTest.XXXXXX";
+    int fd = mkstemp(name);
+    close(fd);
+    path = name;
+  }
+  ~TempFile() {
+    unlink(path.c_str());
+  }
+};
+
+static void checkEvents(TFileTransport& in, int begin, int end) {
+  for (int i = begin; i < end; ++i) {
+    std::string event = makeEvent(i);
+    std::string got(event.size(), '\0');
+    in.readAll((uint8_t*)&got[0], got.size());
+    BOOST_CHECK(got == event);
+  }
+  BOOST_CHECK(!in.peek());
+}
+
+BOOST_AUTO_TEST_CASE( test_read_modes ) {
+  TempFile file;
+  writeEvents(file.path, 0, 100);
+
+  for (int mapped = 0; mapped < 2; ++mapped) {
+    TFileTransport in(file.path, true);
+    in.setChunkSize(kChunkSize);
+    in.setReadMapped(mapped);
+    BOOST_CHECK(in.getNumChunks() > 10);
+    checkEvents(in, 0, 100);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_borrow ) {
+  TempFile file;
+  writeEvents(file.path, 0, 10);
+
+  TFileTransport in(file.path, true);
+  in.setChunkSize(kChunkSize);
+  in.setReadMapped(true);
+  for (int i = 0; i < 10; ++i) {
+    std::string event = makeEvent(i);
+
+    // Borrowing is limited to the current event
+    uint32_t len = event.size() + 1;
+    BOOST_CHECK(in.borrow(NULL, &len) == NULL);
+
+    len = 1;
+    const uint8_t* data = in.borrow(NULL, &len);
+    BOOST_REQUIRE(data != NULL);
+    BOOST_CHECK_EQUAL(len, event.size());
+    BOOST_CHECK(std::string((const char*)data, len) == event);
+    in.consume(len);
+  }
+  BOOST_CHECK(!in.peek());
+}
+
+BOOST_AUTO_TEST_CASE( test_reset_file ) {
+  TempFile first, second;
+  writeEvents(first.path, 0, 10);
+  writeEvents(second.path, 100, 110);
+
+  for (int mapped = 0; mapped < 2; ++mapped) {
+    TFileTransport in(first.path, true);
+    in.setChunkSize(kChunkSize);
+    in.setReadMapped(mapped);
+
+    // Nothing read from the old file outlives the switch, even when it
+    // points into the old mapping
+    uint8_t b;
+    in.readAll(&b, 1);
+    in.resetOutputFile(0, second.path, 0);
+    checkEvents(in, 100, 110);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_seek_and_grow ) {
+  TempFile file;
+  writeEvents(file.path, 0, 100);
+
+  TFileTransport in(file.path, true);
+  in.setChunkSize(kChunkSize);
+  in.setReadMapped(true);
+
+  // The first event in the last chunk, then back to the start
+  uint32_t chunks = in.getNumChunks();
+  in.seekToChunk(chunks - 1);
+  BOOST_CHECK_EQUAL(in.getCurChunk(), chunks - 1);
+  BOOST_CHECK(in.peek());
+  in.seekToChunk(0);
+  checkEvents(in, 0, 100);
+
+  // Events appended after the mapping was made are picked up
+  writeEvents(file.path, 100, 150);
+  checkEvents(in, 100, 150);
+}
+
+BOOST_AUTO_TEST_CASE( test_flush_policies ) {
+  TFileTransport::FlushPolicy policies[] = {
+    TFileTransport::FLUSH_FSYNC,
+    TFileTransport::FLUSH_FDATASYNC,
+    TFileTransport::FLUSH_NONE,
+    TFileTransport::FLUSH_DIRECT
+  };
+
+  for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); ++p) {
+    TempFile file;
+
+    // Flushing every few events makes many small batches, which for direct
+    // output rewrite the same partial block; the second writer picks up
+    // a file that does not end on a block boundary
+    writeEvents(file.path, 0, 200, policies[p], 7);
+    writeEvents(file.path, 200, 300, policies[p]);
+
+    TFileTransport in(file.path, true);
+    in.setChunkSize(kChunkSize);
+    checkEvents(in, 0, 300);
+  }
+}
+
+struct WriterArgs {
+  TFileTransport* out;
+  int thread;
+  int events;
+};
+
+static void* writeThreadEvents(void* arg) {
+  WriterArgs* args = static_cast<WriterArgs*>(arg);
+  for (int i = 0; i < args->events; ++i) {
+    int32_t event[2] = { args->thread, i };
+    args->out->write((const uint8_t*)event, sizeof(event));
+  }
+  return NULL;
+}
+
+BOOST_AUTO_TEST_CASE( test_concurrent_writers ) {
+  TempFile file;
+  const int threads = 8;
+  const int events = 5000;
+
+  {
+    // A small event buffer, so that writers keep filling it up
+    TFileTransport out(file.path);
+    out.setEventBufferSize(64);
+    out.setFlushMaxUs(10000);
+
+    std::vector<pthread_t> ids(threads);
+    std::vector<WriterArgs> args(threads);
+    for (int t = 0; t < threads; ++t) {
+      args[t].out = &out;
+      args[t].thread = t;
+      args[t].events = events;
+      pthread_create(&ids[t], NULL, writeThreadEvents, &args[t]);
+    }
+    for (int t = 0; t < threads; ++t) {
+      pthread_join(ids[t], NULL);
+    }
+    out.flush();
+  }
+
+  // Every event is there once, and each thread's are in order
+  TFileTransport in(file.path, true);
+  std::vector<int> next(threads, 0);
+  for (int i = 0; i < threads * events; ++i) {
+    int32_t event[2];
+    in.readAll((uint8_t*)event, sizeof(event));
+    BOOST_REQUIRE(event[0] >= 0 && event[0] < threads);
+    BOOST_CHECK_EQUAL(event[1], next[event[0]]++);
+  }
+  BOOST_CHECK(!in.peek());
+}
+
+BOOST_AUTO_TEST_CASE( test_buffer_claims ) {
+  TFileTransportBuffer buffer(4, 64);
+  const uint8_t event[20] = {0};
+  bool first = false;
+
+  // Closed until published
+  BOOST_CHECK_EQUAL(buffer.addEvent(event, 8, &first), TFileTransportBuffer::CLOSED);
+  buffer.publish();
+  BOOST_CHECK_EQUAL(buffer.addEvent(event, 8, &first), TFileTransportBuffer::ADDED);
+  BOOST_CHECK(first);
+  BOOST_CHECK_EQUAL(buffer.addEvent(event, 8, &first), TFileTransportBuffer::ADDED);
+  BOOST_CHECK(!first);
+
+  // Turned-away writers leave the counts alone, however often they try
+  for (int i = 0; i < 1000; ++i) {
+    BOOST_CHECK_EQUAL(buffer.addEvent(event, 40, &first), TFileTransportBuffer::FULL);
+  }
+  BOOST_CHECK_EQUAL(buffer.addEvent(event, 20, &first), TFileTransportBuffer::ADDED);
+  BOOST_CHECK(!buffer.isFull());
+
+  buffer.close();
+  BOOST_CHECK_EQUAL(buffer.addEvent(event, 8, &first), TFileTransportBuffer::CLOSED);
+  int read = 0;
+  while (buffer.getNext() != NULL) {
+    ++read;
+  }
+  BOOST_CHECK_EQUAL(read, 3);
+
+  // A writer still holding the buffer once it is reset gets nowhere, and
+  // the first event after it is published again is still the first
+  buffer.reset();
+  BOOST_CHECK_EQUAL(buffer.addEvent(event, 8, &first), TFileTransportBuffer::CLOSED);
+  BOOST_CHECK(buffer.isEmpty());
+  buffer.publish();
+  BOOST_CHECK_EQUAL(buffer.addEvent(event, 8, &first), TFileTransportBuffer::ADDED);
+  BOOST_CHECK(first);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,185 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <string>
+#include <transport/THttpClient.h>
+
+using namespace apache::thrift::transport;
+using boost::shared_ptr;
+
+BOOST_AUTO_TEST_SUITE( THttpClientTest )
+
+/**
+ * Serves canned responses and records requests, and can be closed and
+ * reopened like a socket.
+ */
+class HttpWire : public TVirtualTransport<HttpWire> {
+ public:
+  HttpWire() : open_(true), opens_(0) {}
+
+  bool isOpen() {
+    return open_;
+  }
+
+  void open() {
+    open_ = true;
+    ++opens_;
+  }
+
+  void close() {
+    open_ = false;
+  }
+
+  uint32_t read(uint8_t* buf, uint32_t len) {
+    // Trickle the responses in to split them across reads
+    return in_.read(buf, std::min(len, 7u));
+  }
+
+  void write(const uint8_t* buf, uint32_t len) {
+    out_.write(buf, len);
+  }
+
+  TMemoryBuffer in_;
+  TMemoryBuffer out_;
+  bool open_;
+  int opens_;
+};
+
+static void respond(HttpWire* wire, const std::string& response) {
+  wire->in_.write((const uint8_t*)response.data(), response.size());
+}
+
+static void call(THttpClient* client, const std::string& request) {
+  client->write((const uint8_t*)request.data(), request.size());
+  client->flush();
+}
+
+static std::string readBody(THttpClient* client, uint32_t len) {
+  std::string body(len, '\0');
+  client->readAll((uint8_t*)&body[0], len);
+  client->readEnd();
+  return body;
+}
+
+BOOST_AUTO_TEST_CASE( test_request ) {
+  shared_ptr<HttpWire> wire(new HttpWire());
+  THttpClient client(wire, "example.com", "/service");
+
+  call(&client, "hello");
+  std::string request = wire->out_.getBufferAsString();
+  BOOST_CHECK_EQUAL(request.find("POST /service HTTP/1.1\r\n"), 0u);
+  BOOST_CHECK(request.find("Host: example.com\r\n") != std::string::npos);
+  BOOST_CHECK(request.find("Content-Length: 5\r\n\r\nhello") != std::string::npos);
+  BOOST_CHECK_EQUAL(client.getPendingResponses(), 1u);
+}
+
+BOOST_AUTO_TEST_CASE( test_pipelined_responses ) {
+  shared_ptr<HttpWire> wire(new HttpWire());
+  THttpClient client(wire, "example.com", "/");
+
+  call(&client, "one");
+  call(&client, "two");
+  call(&client, "three");
+  BOOST_CHECK_EQUAL(client.getPendingResponses(), 3u);
+
+  // All three arrive together, with headers in any case
+  respond(wire.get(),
+          "HTTP/1.1 200 OK\r\ncontent-length: 5\r\n\r\nfirst"
+          "HTTP/1.1 100 Continue\r\n\r\n"
+          "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+          "3\r\nsec\r\n3;ext=1\r\nond\r\n0\r\nFooter: x\r\n\r\n"
+          "HTTP/1.1 200 OK\r\nCONTENT-LENGTH: 5\r\n\r\nthird");
+
+  BOOST_CHECK_EQUAL(readBody(&client, 5), "first");
+  BOOST_CHECK_EQUAL(readBody(&client, 6), "second");
+  BOOST_CHECK_EQUAL(client.getPendingResponses(), 1u);
+  BOOST_CHECK_EQUAL(readBody(&client, 5), "third");
+  BOOST_CHECK_EQUAL(client.getPendingResponses(), 0u);
+  BOOST_CHECK_EQUAL(wire->opens_, 0);
+}
+
+BOOST_AUTO_TEST_CASE( test_unread_content_skipped ) {
+  shared_ptr<HttpWire> wire(new HttpWire());
+  THttpClient client(wire, "example.com", "/");
+
+  call(&client, "one");
+  call(&client, "two");
+  respond(wire.get(),
+          "HTTP/1.1 200 OK\r\nContent-Length: 26\r\n\r\nabcdefghijklmnopqrstuvwxyz"
+          "HTTP/1.1 200 OK\r\nContent-Length: 3\r\n\r\nend");
+
+  BOOST_CHECK_EQUAL(readBody(&client, 2), "ab");
+  BOOST_CHECK_EQUAL(readBody(&client, 3), "end");
+}
+
+BOOST_AUTO_TEST_CASE( test_borrow ) {
+  shared_ptr<HttpWire> wire(new HttpWire());
+  THttpClient client(wire, "example.com", "/");
+
+  call(&client, "one");
+  respond(wire.get(), "HTTP/1.1 200 OK\r\nContent-Length: 4\r\n\r\nbody");
+
+  // The body is borrowed from what was received with the headers
+  uint32_t len = 1;
+  const uint8_t* data = client.borrow(NULL, &len);
+  BOOST_REQUIRE(data != NULL);
+  BOOST_CHECK_EQUAL(std::string((const char*)data, len), "body");
+  client.consume(1);
+  BOOST_CHECK_EQUAL(readBody(&client, 3), "ody");
+}
+
+BOOST_AUTO_TEST_CASE( test_connection_close ) {
+  shared_ptr<HttpWire> wire(new HttpWire());
+  THttpClient client(wire, "example.com", "/");
+
+  call(&client, "one");
+  respond(wire.get(), "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\nok");
+  BOOST_CHECK_EQUAL(readBody(&client, 2), "ok");
+  BOOST_CHECK(!wire->isOpen());
+  BOOST_CHECK(client.isOpen());
+
+  // The next request goes out on a new connection
+  call(&client, "two");
+  BOOST_CHECK_EQUAL(wire->opens_, 1);
+  respond(wire.get(), "HTTP/1.0 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  BOOST_CHECK_EQUAL(readBody(&client, 2), "ok");
+  BOOST_CHECK(!wire->isOpen());
+
+  // Pipelined requests are lost with the connection
+  call(&client, "three");
+  call(&client, "four");
+  respond(wire.get(), "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\nok");
+  BOOST_CHECK_EQUAL(readBody(&client, 2), "ok");
+  uint8_t buf[2];
+  BOOST_CHECK_THROW(client.read(buf, 2), TTransportException);
+  BOOST_CHECK_THROW(call(&client, "five"), TTransportException);
+}
+
+BOOST_AUTO_TEST_CASE( test_bad_status ) {
+  shared_ptr<HttpWire> wire(new HttpWire());
+  THttpClient client(wire, "example.com", "/");
+
+  call(&client, "one");
+  respond(wire.get(), "HTTP/1.1 500 Internal Server Error\r\n\r\n");
+  uint8_t buf[1];
+  BOOST_CHECK_THROW(client.read(buf, 1), TTransportException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
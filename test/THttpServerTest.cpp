@@ -0,0 +1,226 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <string>
+#include <sys/socket.h>
+#include <transport/TFDTransport.h>
+#include <transport/THttpClient.h>
+#include <transport/THttpServer.h>
+
+using namespace apache::thrift::transport;
+using boost::shared_ptr;
+
+BOOST_AUTO_TEST_SUITE( THttpServerTest )
+
+// Feeds the request to the parser a few bytes at a time, as a non-blocking
+// server receives it, and returns the body.
+static std::string parseTrickled(THttpRequestParser* parser, std::string* request) {
+  uint8_t* buf = (uint8_t*)&(*request)[0];
+  uint32_t len = 0;
+  while (!parser->parse(buf, len)) {
+    BOOST_REQUIRE(len < request->size());
+    len = std::min<uint32_t>(len + 3, request->size());
+  }
+  return std::string((const char*)buf + parser->getBodyOffset(), parser->getBodyLength());
+}
+
+BOOST_AUTO_TEST_CASE( test_parse_content_length ) {
+  std::string request =
+    "POST /service HTTP/1.1\r\nHost: x\r\ncontent-length: 11\r\n\r\nhello world"
+    "POST /service HTTP/1.1\r\n";
+  THttpRequestParser parser;
+  BOOST_CHECK_EQUAL(parseTrickled(&parser, &request), "hello world");
+  BOOST_CHECK(parser.isKeepAlive());
+  BOOST_CHECK(!parser.isChunked());
+  BOOST_CHECK_EQUAL(request.substr(parser.getRequestLength()), "POST /service HTTP/1.1\r\n");
+}
+
+BOOST_AUTO_TEST_CASE( test_parse_chunked ) {
+  std::string request =
+    "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n"
+    "5\r\nhello\r\n1;ext=1\r\n \r\nA\r\nworld, too\r\n0\r\nTrailer: x\r\n\r\n"
+    "next";
+  THttpRequestParser parser;
+  BOOST_CHECK_EQUAL(parseTrickled(&parser, &request), "hello world, too");
+  BOOST_CHECK(!parser.isKeepAlive());
+  BOOST_CHECK(parser.isChunked());
+  BOOST_CHECK_EQUAL(request.substr(parser.getRequestLength()), "next");
+}
+
+BOOST_AUTO_TEST_CASE( test_parse_http10_and_continue ) {
+  std::string request =
+    "POST / HTTP/1.0\r\nExpect: 100-continue\r\nContent-Length: 2\r\n\r\n";
+  THttpRequestParser parser;
+  BOOST_CHECK(!parser.parse((uint8_t*)&request[0], request.size()));
+  BOOST_CHECK(parser.headersDone());
+  BOOST_CHECK(parser.expectContinue());
+  BOOST_CHECK(!parser.isKeepAlive());
+  request += "ok";
+  BOOST_CHECK(parser.parse((uint8_t*)&request[0], request.size()));
+  BOOST_CHECK_EQUAL(parser.getBodyLength(), 2u);
+}
+
+BOOST_AUTO_TEST_CASE( test_parse_errors ) {
+  const char* bad[] = {
+    "GET / HTTP/1.1\r\n\r\n",
+    "POST\r\n\r\n",
+    "POST / HTTP/1.1\r\nContent-Length: x\r\n\r\n",
+    "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+    "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n1\r\nab\r\n"
+  };
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    std::string request(bad[i]);
+    THttpRequestParser parser;
+    BOOST_CHECK_THROW(parser.parse((uint8_t*)&request[0], request.size()), TTransportException);
+  }
+
+  std::string huge = "POST / HTTP/1.1\r\nX: " +
+    std::string(THttpRequestParser::MAX_HEADER_SIZE, 'x');
+  THttpRequestParser parser;
+  BOOST_CHECK_THROW(parser.parse((uint8_t*)&huge[0], huge.size()), TTransportException);
+}
+
+BOOST_AUTO_TEST_CASE( test_parse_body_limits ) {
+  const char* bad[] = {
+    // Overflows 32 bits
+    "POST / HTTP/1.1\r\nContent-Length: 4294967306\r\n\r\n",
+    "POST / HTTP/1.1\r\nContent-Length: 17\r\n\r\n",
+    "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n8\r\nabcdefgh\r\n9\r\n"
+  };
+  for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    std::string request(bad[i]);
+    THttpRequestParser parser(16);
+    BOOST_CHECK_THROW(parser.parse((uint8_t*)&request[0], request.size()), TTransportException);
+  }
+
+  std::string request = "POST / HTTP/1.1\r\nContent-Length: 16\r\n\r\n" + std::string(16, 'b');
+  THttpRequestParser parser(16);
+  BOOST_CHECK(parser.parse((uint8_t*)&request[0], request.size()));
+  BOOST_CHECK_EQUAL(parser.getBodyLength(), 16u);
+
+  // Chunk headers are bounded like the request headers
+  std::string chunks = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+  std::string chunk = "1;" + std::string(1000, 'e') + "\r\nc\r\n";
+  while (chunks.size() < 2 * THttpRequestParser::MAX_HEADER_SIZE) {
+    chunks += chunk;
+  }
+  parser.reset();
+  parser.setMaxBodySize(THttpRequestParser::DEFAULT_MAX_BODY_SIZE);
+  BOOST_CHECK_THROW(parser.parse((uint8_t*)&chunks[0], chunks.size()), TTransportException);
+}
+
+BOOST_AUTO_TEST_CASE( test_response_header ) {
+  std::string contentType("application/json");
+  std::string buf(THttpServer::RESPONSE_HEADER_SIZE + contentType.size(), '\0');
+  uint32_t len = THttpServer::writeResponseHeader(&buf[0], 42, false, true, contentType);
+  BOOST_CHECK_EQUAL(buf.substr(0, len),
+                    "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                    "Content-Length: 42\r\n\r\n");
+  len = THttpServer::writeResponseHeader(&buf[0], 42, true, false, contentType);
+  BOOST_CHECK_EQUAL(buf.substr(0, len),
+                    "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                    "Connection: close\r\nTransfer-Encoding: chunked\r\n\r\n2a\r\n");
+}
+
+BOOST_AUTO_TEST_CASE( test_client_round_trips ) {
+  int fds[2];
+  BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  shared_ptr<TFDTransport> clientSide(new TFDTransport(fds[0], TFDTransport::CLOSE_ON_DESTROY));
+  shared_ptr<TFDTransport> serverSide(new TFDTransport(fds[1], TFDTransport::CLOSE_ON_DESTROY));
+  THttpClient client(clientSide, "localhost", "/");
+  THttpServer server(serverSide);
+
+  // Two pipelined calls, then a third after their responses
+  std::string calls[] = { "first", "second", std::string(50000, 'x') };
+  for (int i = 0; i < 2; ++i) {
+    client.write((const uint8_t*)calls[i].data(), calls[i].size());
+    client.flush();
+  }
+  for (int i = 0; i < 3; ++i) {
+    if (i == 2) {
+      client.write((const uint8_t*)calls[i].data(), calls[i].size());
+      client.flush();
+    }
+    std::string request(calls[i].size(), '\0');
+    server.readAll((uint8_t*)&request[0], request.size());
+    BOOST_CHECK(request == calls[i]);
+    std::string response = "re:" + request;
+    server.write((const uint8_t*)response.data(), response.size());
+    server.flush();
+
+    if (i == 1) {
+      std::string got(8, '\0');
+      client.readAll((uint8_t*)&got[0], got.size());
+      client.readEnd();
+      BOOST_CHECK_EQUAL(got, "re:first");
+      got.resize(9);
+      client.readAll((uint8_t*)&got[0], got.size());
+      client.readEnd();
+      BOOST_CHECK_EQUAL(got, "re:second");
+    }
+  }
+  std::string got(50003, '\0');
+  client.readAll((uint8_t*)&got[0], got.size());
+  client.readEnd();
+  BOOST_CHECK(got == "re:" + calls[2]);
+
+  // A closed client ends the requests cleanly
+  client.close();
+  uint8_t b;
+  BOOST_CHECK_EQUAL(server.read(&b, 1), 0u);
+}
+
+BOOST_AUTO_TEST_CASE( test_oneway_call ) {
+  int fds[2];
+  BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+  shared_ptr<TFDTransport> clientSide(new TFDTransport(fds[0], TFDTransport::CLOSE_ON_DESTROY));
+  shared_ptr<TFDTransport> serverSide(new TFDTransport(fds[1], TFDTransport::CLOSE_ON_DESTROY));
+  THttpClient client(clientSide, "localhost", "/");
+
+  // Servers get both transports of a connection from the factory at once
+  THttpServerTransportFactory factory;
+  shared_ptr<TTransport> in, out;
+  factory.getTransports(serverSide, in, out);
+  BOOST_CHECK(in == out);
+
+  // A oneway call is answered with an empty response, which the client
+  // passes over on its way to the reply to the next call
+  std::string oneway = "oneway", twoway = "twoway";
+  client.write((const uint8_t*)oneway.data(), oneway.size());
+  client.flush();
+  client.write((const uint8_t*)twoway.data(), twoway.size());
+  client.flush();
+
+  std::string request(6, '\0');
+  in->readAll((uint8_t*)&request[0], request.size());
+  BOOST_CHECK_EQUAL(request, oneway);
+  in->readAll((uint8_t*)&request[0], request.size());
+  BOOST_CHECK_EQUAL(request, twoway);
+  out->write((const uint8_t*)"reply", 5);
+  out->flush();
+
+  std::string got(5, '\0');
+  client.readAll((uint8_t*)&got[0], got.size());
+  client.readEnd();
+  BOOST_CHECK_EQUAL(got, "reply");
+  BOOST_CHECK_EQUAL(client.getPendingResponses(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,183 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <transport/TBufferTransports.h>
+#include <protocol/TBinaryProtocol.h>
+#include <protocol/TCompactProtocol.h>
+#include <protocol/TDenseProtocol.h>
+#include <protocol/TJSONProtocol.h>
+#include "gen-cpp/DebugProtoTest_types.h"
+
+using apache::thrift::transport::TMemoryBuffer;
+using boost::shared_ptr;
+using namespace thrift::test::debug;
+
+BOOST_AUTO_TEST_SUITE( TLazyFieldTest )
+
+static LazyNesting makeLazyNesting() {
+  LazyNesting ln;
+  ln.id = 7;
+
+  OneOfEach ooe;
+  ooe.some_characters = "lazy";
+  ooe.integer32 = 12345;
+  ln.mutable_big().big.push_back(ooe);
+  ln.mutable_big().big.push_back(ooe);
+  std::vector<std::string> strs(3, "contained");
+  ln.mutable_big().contain.insert(strs);
+  Bonk bonk;
+  bonk.type = 3;
+  bonk.message = "lazy bonk";
+  ln.mutable_big().bonks["key"].push_back(bonk);
+
+  ln.mutable_blob() = std::string("\0\1\2\3 blob", 9);
+  ln.mutable_bonk() = bonk;
+  ln.__isset.bonk = true;
+  return ln;
+}
+
+template <class Protocol_>
+void testLazy() {
+  LazyNesting ln = makeLazyNesting();
+
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol_ prot(buffer);
+  ln.write(&prot);
+  std::string serialized = buffer->getBufferAsString();
+
+  // Reading captures the lazy fields without decoding them.
+  LazyNesting ln2;
+  ln2.read(&prot);
+  BOOST_CHECK_EQUAL(ln2.id, 7);
+  BOOST_CHECK(ln2.__lazy_big.pending());
+  BOOST_CHECK(ln2.__lazy_blob.pending());
+  BOOST_CHECK(ln2.__lazy_bonk.pending());
+  BOOST_CHECK(ln2.__isset.bonk);
+
+  // Untouched fields are written back verbatim.
+  ln2.write(&prot);
+  BOOST_CHECK(buffer->getBufferAsString() == serialized);
+  buffer->resetBuffer();
+
+  // Reading through an accessor decodes on demand.
+  BOOST_CHECK(ln2.get_big() == ln.get_big());
+  BOOST_CHECK(!ln2.__lazy_big.pending());
+  BOOST_CHECK(ln2.get_blob() == ln.get_blob());
+  BOOST_CHECK(ln2 == ln);
+
+  // Modifications through mutable_ accessors are serialized.
+  ln2.mutable_bonk().message = "changed";
+  ln2.mutable_big().big.clear();
+  ln2.write(&prot);
+  LazyNesting ln3;
+  ln3.read(&prot);
+  BOOST_CHECK_EQUAL(ln3.get_bonk().message, "changed");
+  BOOST_CHECK(ln3.get_big().big.empty());
+  BOOST_CHECK(ln3.get_blob() == ln.get_blob());
+
+  // Also through the virtual TProtocol interface.
+  buffer->resetBuffer((uint8_t*)serialized.data(), serialized.size());
+  apache::thrift::protocol::TProtocol* vprot = &prot;
+  LazyNesting ln4;
+  ln4.read(vprot);
+  BOOST_CHECK(ln4.__lazy_big.pending());
+  BOOST_CHECK(ln4 == ln);
+}
+
+BOOST_AUTO_TEST_CASE( test_binary ) {
+  testLazy<apache::thrift::protocol::TBinaryProtocolT<TMemoryBuffer> >();
+  testLazy<apache::thrift::protocol::TBinaryProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE( test_compact ) {
+  testLazy<apache::thrift::protocol::TCompactProtocolT<TMemoryBuffer> >();
+  testLazy<apache::thrift::protocol::TCompactProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE( test_cross_protocol ) {
+  LazyNesting ln = makeLazyNesting();
+
+  shared_ptr<TMemoryBuffer> bbuf(new TMemoryBuffer());
+  apache::thrift::protocol::TBinaryProtocol bprot(bbuf);
+  ln.write(&bprot);
+
+  LazyNesting ln2;
+  ln2.read(&bprot);
+  BOOST_CHECK(ln2.__lazy_big.pending());
+
+  // Bytes captured from the binary protocol must not leak into another
+  // encoding; the fields are decoded and re-serialized instead.
+  shared_ptr<TMemoryBuffer> cbuf(new TMemoryBuffer());
+  apache::thrift::protocol::TCompactProtocol cprot(cbuf);
+  ln2.write(&cprot);
+  LazyNesting ln3;
+  ln3.read(&cprot);
+  BOOST_CHECK(ln3 == ln);
+
+  // Protocols that can't capture decode eagerly.
+  shared_ptr<TMemoryBuffer> jbuf(new TMemoryBuffer());
+  apache::thrift::protocol::TJSONProtocol jprot(jbuf);
+  ln.write(&jprot);
+  LazyNesting ln4;
+  ln4.read(&jprot);
+  BOOST_CHECK(!ln4.__lazy_big.pending());
+  BOOST_CHECK(ln4.get_big() == ln.get_big());
+}
+
+BOOST_AUTO_TEST_CASE( test_dense ) {
+  using apache::thrift::protocol::TDenseProtocol;
+  LazyNesting ln = makeLazyNesting();
+
+  // TDenseProtocol derives from TBinaryProtocol but encodes differently,
+  // so it must never be mistaken for binary, not even through TProtocol*.
+  shared_ptr<TMemoryBuffer> dbuf(new TMemoryBuffer());
+  TDenseProtocol dprot(dbuf, LazyNesting::local_reflection);
+  ln.write(&dprot);
+  std::string serialized = dbuf->getBufferAsString();
+
+  LazyNesting ln2;
+  ln2.read(&dprot);
+  BOOST_CHECK(!ln2.__lazy_big.pending());
+  BOOST_CHECK(ln2 == ln);
+
+  dbuf->resetBuffer((uint8_t*)serialized.data(), serialized.size());
+  apache::thrift::protocol::TProtocol* vprot = &dprot;
+  LazyNesting ln3;
+  ln3.read(vprot);
+  BOOST_CHECK(!ln3.__lazy_big.pending());
+  BOOST_CHECK(ln3 == ln);
+
+  // Fields captured from plain binary are re-serialized for dense.
+  shared_ptr<TMemoryBuffer> bbuf(new TMemoryBuffer());
+  apache::thrift::protocol::TBinaryProtocol bprot(bbuf);
+  ln.write(&bprot);
+  LazyNesting ln4;
+  ln4.read(&bprot);
+  BOOST_CHECK(ln4.__lazy_big.pending());
+  shared_ptr<TMemoryBuffer> dbuf2(new TMemoryBuffer());
+  TDenseProtocol dprot2(dbuf2, LazyNesting::local_reflection);
+  vprot = &dprot2;
+  ln4.write(vprot);
+  LazyNesting ln5;
+  ln5.read(&dprot2);
+  BOOST_CHECK(ln5 == ln);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -27,6 +27,35 @@ using boost::shared_ptr;
 using apache::thrift::transport::TTransportException;
 using apache::thrift::transport::TPipedTransport;
 using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TAsyncPipeSink;
+using apache::thrift::transport::TBufferPool;
+using apache::thrift::transport::TPipedTransportFactory;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TVirtualTransport;
+
+// Throws something that is not a TTransportException on its first write()
+class TBrokenTransport : public TVirtualTransport<TBrokenTransport> {
+ public:
+  TBrokenTransport() : writes_(0) {}
+
+  void write(const uint8_t* /* buf */, uint32_t /* len */) {
+    if (writes_++ == 0) {
+      throw std::runtime_error("broken");
+    }
+  }
+
+  int writes_;
+};
+
+// Accepts every write() but fails to flush them
+class TUnflushableTransport : public TVirtualTransport<TUnflushableTransport> {
+ public:
+  void write(const uint8_t* /* buf */, uint32_t /* len */) {}
+
+  void flush() {
+    throw TTransportException("unflushable");
+  }
+};
 
 int main() {
   shared_ptr<TMemoryBuffer> underlying(new TMemoryBuffer);
@@ -49,6 +78,86 @@ int main() {
   trans->readEnd();
   assert( pipe->getBufferAsString() == "cdef" );
 
+  // The same through a sink, which writes from its own thread
+  pipe->resetBuffer();
+  {
+    shared_ptr<TAsyncPipeSink> sink(new TAsyncPipeSink(pipe, 6));
+    trans->setAsyncSink(sink);
+    underlying->write((uint8_t*)"ghijkl", 6);
+    trans->readAll(buffer, 4);
+    trans->readEnd();
+    trans->readAll(buffer, 2);
+    trans->readEnd();
+    sink->drain();
+    assert( pipe->getBufferAsString() == "ghijkl" );
+    assert( sink->getWritten() == 2 );
+    assert( sink->getQueuedBytes() == 0 );
+
+    // More than the queue holds is dropped, and counted
+    underlying->write((uint8_t*)"mnopqrs", 7);
+    trans->readAll(buffer, 3);
+    trans->readAll(buffer, 4);
+    trans->readEnd();
+    sink->drain();
+    assert( pipe->getBufferAsString() == "ghijkl" );
+    assert( sink->getSubmitted() == 3 );
+    assert( sink->getDropped() == 1 );
+    assert( sink->getDroppedBytes() == 7 );
+    trans->setAsyncSink(shared_ptr<TAsyncPipeSink>());
+  }
+
+  // A sink without a pool, flushed as it is destroyed
+  pipe->resetBuffer();
+  {
+    shared_ptr<TAsyncPipeSink> sink(
+      new TAsyncPipeSink(pipe, 1024, shared_ptr<TBufferPool>()));
+    for (int i = 0; i < 100; i++) {
+      sink->submit((const uint8_t*)"t", 1);
+    }
+  }
+  assert( pipe->getBufferAsString() == string(100, 't') );
+
+  // Anything else thrown by the target fails the sink, which then drops
+  // everything instead of leaving it queued
+  {
+    shared_ptr<TBrokenTransport> broken(new TBrokenTransport);
+    shared_ptr<TAsyncPipeSink> sink(new TAsyncPipeSink(broken));
+    sink->submit((const uint8_t*)"u", 1);
+    sink->drain();
+    assert( sink->isFailed() );
+    assert( !sink->submit((const uint8_t*)"v", 1) );
+    sink->drain();
+    assert( sink->getWritten() == 0 );
+    assert( sink->getDropped() == 2 );
+    assert( broken->writes_ == 1 );
+  }
+
+  // A failed flush drops every capture in the batch
+  {
+    shared_ptr<TUnflushableTransport> unflushable(new TUnflushableTransport);
+    shared_ptr<TAsyncPipeSink> sink(new TAsyncPipeSink(unflushable));
+    sink->submit((const uint8_t*)"w", 1);
+    sink->drain();
+    assert( !sink->isFailed() );
+    assert( sink->getWritten() == 0 );
+    assert( sink->getDropped() == 1 );
+  }
+
+  // Transports from the factory keep whole requests in pooled buffers
+  pipe->resetBuffer();
+  underlying->resetBuffer();
+  {
+    TPipedTransportFactory factory(pipe);
+    shared_ptr<TTransport> pooled = factory.getTransport(underlying);
+    string request(5000, 'w');
+    underlying->write((const uint8_t*)request.data(), request.size());
+    string got(request.size(), ' ');
+    pooled->readAll((uint8_t*)&got[0], got.size());
+    pooled->readEnd();
+    assert( got == request );
+    assert( pipe->getBufferAsString() == request );
+  }
+
   return 0;
 
 }
@@ -0,0 +1,232 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * Structs only the C++ tests and benchmarks need, generated without any
+ * extra options. Keep them out of DebugProtoTest.thrift, which every
+ * language builds.
+ */
+
+namespace cpp thrift.test.wide
+
+/**
+ * Two hundred fields with sparse ids, for benchmarking read() dispatch.
+ */
+struct WideStruct {
+  1: i32 field1,
+  188: string field188,
+  375: i64 field375,
+  465: double field465,
+  652: bool field652,
+  839: i32 field839,
+  929: string field929,
+  1116: i64 field1116,
+  1206: double field1206,
+  1393: bool field1393,
+  1580: i32 field1580,
+  1670: string field1670,
+  1857: i64 field1857,
+  2044: double field2044,
+  2134: bool field2134,
+  2321: i32 field2321,
+  2411: string field2411,
+  2598: i64 field2598,
+  2785: double field2785,
+  2875: bool field2875,
+  3062: i32 field3062,
+  3152: string field3152,
+  3339: i64 field3339,
+  3526: double field3526,
+  3616: bool field3616,
+  3803: i32 field3803,
+  3990: string field3990,
+  4080: i64 field4080,
+  4267: double field4267,
+  4357: bool field4357,
+  4544: i32 field4544,
+  4731: string field4731,
+  4821: i64 field4821,
+  5008: double field5008,
+  5195: bool field5195,
+  5285: i32 field5285,
+  5472: string field5472,
+  5562: i64 field5562,
+  5749: double field5749,
+  5936: bool field5936,
+  6026: i32 field6026,
+  6213: string field6213,
+  6303: i64 field6303,
+  6490: double field6490,
+  6677: bool field6677,
+  6767: i32 field6767,
+  6954: string field6954,
+  7141: i64 field7141,
+  7231: double field7231,
+  7418: bool field7418,
+  7508: i32 field7508,
+  7695: string field7695,
+  7882: i64 field7882,
+  7972: double field7972,
+  8159: bool field8159,
+  8346: i32 field8346,
+  8436: string field8436,
+  8623: i64 field8623,
+  8713: double field8713,
+  8900: bool field8900,
+  9087: i32 field9087,
+  9177: string field9177,
+  9364: i64 field9364,
+  9454: double field9454,
+  9641: bool field9641,
+  9828: i32 field9828,
+  9918: string field9918,
+  10105: i64 field10105,
+  10292: double field10292,
+  10382: bool field10382,
+  10569: i32 field10569,
+  10659: string field10659,
+  10846: i64 field10846,
+  11033: double field11033,
+  11123: bool field11123,
+  11310: i32 field11310,
+  11497: string field11497,
+  11587: i64 field11587,
+  11774: double field11774,
+  11864: bool field11864,
+  12051: i32 field12051,
+  12238: string field12238,
+  12328: i64 field12328,
+  12515: double field12515,
+  12605: bool field12605,
+  12792: i32 field12792,
+  12979: string field12979,
+  13069: i64 field13069,
+  13256: double field13256,
+  13443: bool field13443,
+  13533: i32 field13533,
+  13720: string field13720,
+  13810: i64 field13810,
+  13997: double field13997,
+  14184: bool field14184,
+  14274: i32 field14274,
+  14461: string field14461,
+  14551: i64 field14551,
+  14738: double field14738,
+  14925: bool field14925,
+  15015: i32 field15015,
+  15202: string field15202,
+  15389: i64 field15389,
+  15479: double field15479,
+  15666: bool field15666,
+  15756: i32 field15756,
+  15943: string field15943,
+  16130: i64 field16130,
+  16220: double field16220,
+  16407: bool field16407,
+  16594: i32 field16594,
+  16684: string field16684,
+  16871: i64 field16871,
+  16961: double field16961,
+  17148: bool field17148,
+  17335: i32 field17335,
+  17425: string field17425,
+  17612: i64 field17612,
+  17702: double field17702,
+  17889: bool field17889,
+  18076: i32 field18076,
+  18166: string field18166,
+  18353: i64 field18353,
+  18540: double field18540,
+  18630: bool field18630,
+  18817: i32 field18817,
+  18907: string field18907,
+  19094: i64 field19094,
+  19281: double field19281,
+  19371: bool field19371,
+  19558: i32 field19558,
+  19745: string field19745,
+  19835: i64 field19835,
+  20022: double field20022,
+  20112: bool field20112,
+  20299: i32 field20299,
+  20486: string field20486,
+  20576: i64 field20576,
+  20763: double field20763,
+  20853: bool field20853,
+  21040: i32 field21040,
+  21227: string field21227,
+  21317: i64 field21317,
+  21504: double field21504,
+  21691: bool field21691,
+  21781: i32 field21781,
+  21968: string field21968,
+  22058: i64 field22058,
+  22245: double field22245,
+  22432: bool field22432,
+  22522: i32 field22522,
+  22709: string field22709,
+  22896: i64 field22896,
+  22986: double field22986,
+  23173: bool field23173,
+  23263: i32 field23263,
+  23450: string field23450,
+  23637: i64 field23637,
+  23727: double field23727,
+  23914: bool field23914,
+  24004: i32 field24004,
+  24191: string field24191,
+  24378: i64 field24378,
+  24468: double field24468,
+  24655: bool field24655,
+  24842: i32 field24842,
+  24932: string field24932,
+  25119: i64 field25119,
+  25209: double field25209,
+  25396: bool field25396,
+  25583: i32 field25583,
+  25673: string field25673,
+  25860: i64 field25860,
+  26047: double field26047,
+  26137: bool field26137,
+  26324: i32 field26324,
+  26414: string field26414,
+  26601: i64 field26601,
+  26788: double field26788,
+  26878: bool field26878,
+  27065: i32 field27065,
+  27155: string field27155,
+  27342: i64 field27342,
+  27529: double field27529,
+  27619: bool field27619,
+  27806: i32 field27806,
+  27993: string field27993,
+  28083: i64 field28083,
+  28270: double field28270,
+  28360: bool field28360,
+  28547: i32 field28547,
+  28734: string field28734,
+  28824: i64 field28824,
+  29011: double field29011,
+  29101: bool field29101,
+  29288: i32 field29288,
+  29475: string field29475,
+  29565: i64 field29565,
+  29752: double field29752,
+  29939: bool field29939,
+}
@@ -0,0 +1,126 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/auto_unit_test.hpp>
+#include <unistd.h>
+#include <transport/TBufferTransports.h>
+#include <transport/TFDTransport.h>
+#include <protocol/TBinaryProtocol.h>
+
+using apache::thrift::transport::TBufferedTransport;
+using apache::thrift::transport::TFDTransport;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TTransport;
+using apache::thrift::protocol::TBinaryProtocol;
+using boost::shared_ptr;
+
+BOOST_AUTO_TEST_SUITE( WritevTest )
+
+BOOST_AUTO_TEST_CASE( test_advance_iovec ) {
+  char a[4], b[8];
+  struct iovec iov[3] = { { a, 4 }, { NULL, 0 }, { b, 8 } };
+  struct iovec* cur = iov;
+  int cnt = 3;
+
+  apache::thrift::transport::advanceIovec(cur, cnt, 2);
+  BOOST_CHECK_EQUAL(cnt, 3);
+  BOOST_CHECK(cur->iov_base == a + 2);
+  BOOST_CHECK_EQUAL(cur->iov_len, 2U);
+
+  // Steps over the empty entry along with the rest of the first
+  apache::thrift::transport::advanceIovec(cur, cnt, 5);
+  BOOST_CHECK_EQUAL(cnt, 1);
+  BOOST_CHECK(cur->iov_base == b + 3);
+  BOOST_CHECK_EQUAL(cur->iov_len, 5U);
+
+  apache::thrift::transport::advanceIovec(cur, cnt, 5);
+  BOOST_CHECK_EQUAL(cnt, 0);
+}
+
+// A mix of small writes, which are copied, and large ones, which may be
+// referenced, as a protocol would make them.
+static void writeMessage(shared_ptr<TTransport> trans, const std::string& blob) {
+  TBinaryProtocol prot(trans);
+  for (int i = 0; i < 3; ++i) {
+    prot.writeI32(i);
+    prot.writeBinary(blob);
+    prot.writeString("small");
+  }
+  prot.writeBinary(blob.substr(0, 100));
+}
+
+BOOST_AUTO_TEST_CASE( test_framed_refs ) {
+  std::string blob(100000, 'x');
+  for (size_t i = 0; i < blob.size(); ++i) {
+    blob[i] = (char)(i * 7);
+  }
+
+  shared_ptr<TMemoryBuffer> copied(new TMemoryBuffer());
+  shared_ptr<TFramedTransport> framed(new TFramedTransport(copied));
+  writeMessage(framed, blob);
+  framed->flush();
+
+  shared_ptr<TMemoryBuffer> referenced(new TMemoryBuffer());
+  framed.reset(new TFramedTransport(referenced));
+  framed->setWriteRefThreshold(4096);
+  for (int i = 0; i < 2; ++i) {
+    framed->reserve(4 * blob.size());
+    writeMessage(framed, blob);
+    framed->flush();
+  }
+
+  std::string expected = copied->getBufferAsString();
+  BOOST_CHECK(referenced->getBufferAsString() == expected + expected);
+
+  // Nothing left over from the last frame
+  framed->flush();
+  BOOST_CHECK(referenced->getBufferAsString() == expected + expected);
+}
+
+BOOST_AUTO_TEST_CASE( test_buffered_writev ) {
+  std::string blob(10000, 'y');
+  shared_ptr<TMemoryBuffer> mem(new TMemoryBuffer());
+  shared_ptr<TBufferedTransport> buffered(new TBufferedTransport(mem, 512));
+  buffered->write((const uint8_t*)"head", 4);
+  buffered->write((const uint8_t*)blob.data(), blob.size());
+  buffered->write((const uint8_t*)"tail", 4);
+  buffered->flush();
+  BOOST_CHECK(mem->getBufferAsString() == "head" + blob + "tail");
+}
+
+BOOST_AUTO_TEST_CASE( test_fd_writev ) {
+  int fds[2];
+  BOOST_REQUIRE(pipe(fds) == 0);
+  TFDTransport out(fds[1], TFDTransport::CLOSE_ON_DESTROY);
+  TFDTransport in(fds[0], TFDTransport::CLOSE_ON_DESTROY);
+
+  char a[] = "scatter";
+  char b[] = "/";
+  char c[] = "gather";
+  struct iovec iov[4] = { { a, 7 }, { b, 1 }, { NULL, 0 }, { c, 6 } };
+  out.writev(iov, 4);
+  out.writev(iov, 0);
+
+  uint8_t buf[14];
+  in.readAll(buf, sizeof(buf));
+  BOOST_CHECK(std::string((char*)buf, sizeof(buf)) == "scatter/gather");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -21,8 +21,11 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include <protocol/TBinaryProtocol.h>
+#include <protocol/TJSONProtocol.h>
 #include <transport/TTransportUtils.h>
 #include <transport/TSocket.h>
+#include <transport/TCompressedFramedTransport.h>
+#include <transport/THttpClient.h>
 
 #include <boost/shared_ptr.hpp>
 #include "ThriftTest.h"
@@ -56,6 +59,9 @@ int main(int argc, char** argv) {
   int port = 9090;
   int numTests = 1;
   bool framed = false;
+  bool compressed = false;
+  bool http = false;
+  bool json = false;
 
   for (int i = 0; i < argc; ++i) {
     if (strcmp(argv[i], "-h") == 0) {
@@ -71,6 +77,12 @@ int main(int argc, char** argv) {
       numTests = atoi(argv[++i]);
     } else if (strcmp(argv[i], "-f") == 0) {
       framed = true;
+    } else if (strcmp(argv[i], "-c") == 0) {
+      compressed = true;
+    } else if (strcmp(argv[i], "-H") == 0) {
+      http = true;
+    } else if (strcmp(argv[i], "-j") == 0) {
+      json = true;
     }
   }
 
@@ -79,7 +91,13 @@ int main(int argc, char** argv) {
 
   shared_ptr<TSocket> socket(new TSocket(host, port));
 
-  if (framed) {
+  if (http) {
+    shared_ptr<THttpClient> httpSocket(new THttpClient(socket, host, "/"));
+    transport = httpSocket;
+  } else if (compressed) {
+    shared_ptr<TCompressedFramedTransport> compressedSocket(new TCompressedFramedTransport(socket));
+    transport = compressedSocket;
+  } else if (framed) {
     shared_ptr<TFramedTransport> framedSocket(new TFramedTransport(socket));
     transport = framedSocket;
   } else {
@@ -87,7 +105,12 @@ int main(int argc, char** argv) {
     transport = bufferedSocket;
   }
 
-  shared_ptr<TBinaryProtocol> protocol(new TBinaryProtocol(transport));
+  shared_ptr<TProtocol> protocol;
+  if (json) {
+    protocol.reset(new TJSONProtocol(transport));
+  } else {
+    protocol.reset(new TBinaryProtocol(transport));
+  }
   ThriftTestClient testClient(protocol);
 
   uint64_t time_min = 0;
@@ -20,12 +20,15 @@
 #include <concurrency/ThreadManager.h>
 #include <concurrency/PosixThreadFactory.h>
 #include <protocol/TBinaryProtocol.h>
+#include <protocol/TJSONProtocol.h>
 #include <server/TSimpleServer.h>
 #include <server/TThreadedServer.h>
 #include <server/TThreadPoolServer.h>
 #include <server/TNonblockingServer.h>
 #include <transport/TServerSocket.h>
 #include <transport/TTransportUtils.h>
+#include <transport/TCompressedFramedTransport.h>
+#include <transport/THttpServer.h>
 #include "ThriftTest.h"
 
 #include <iostream>
@@ -293,17 +296,23 @@ int main(int argc, char **argv) {
   string serverType = "simple";
   string protocolType = "binary";
   size_t workerCount = 4;
+  bool compressed = false;
+  bool http = false;
 
   ostringstream usage;
 
   usage <<
-    argv[0] << " [--port=<port number>] [--server-type=<server-type>] [--protocol-type=<protocol-type>] [--workers=<worker-count>]" << endl <<
+    argv[0] << " [--port=<port number>] [--server-type=<server-type>] [--protocol-type=<protocol-type>] [--workers=<worker-count>] [--compressed] [--http]" << endl <<
 
     "\t\tserver-type\t\ttype of server, \"simple\", \"thread-pool\", \"threaded\", or \"nonblocking\".  Default is " << serverType << endl <<
 
-    "\t\tprotocol-type\t\ttype of protocol, \"binary\", \"ascii\", or \"xml\".  Default is " << protocolType << endl <<
+    "\t\tprotocol-type\t\ttype of protocol, \"binary\", \"json\", \"ascii\", or \"xml\".  Default is " << protocolType << endl <<
 
-    "\t\tworkers\t\tNumber of thread pools workers.  Only valid for thread-pool server type.  Default is " << workerCount << endl;
+    "\t\tworkers\t\tNumber of thread pools workers.  Only valid for thread-pool server type.  Default is " << workerCount << endl <<
+
+    "\t\tcompressed\t\tUse compressed frames (TCompressedFramedTransport).  Default is off" << endl <<
+
+    "\t\thttp\t\tCarry calls in HTTP requests (THttpServer).  Default is off" << endl;
 
   map<string, string>  args;
 
@@ -341,6 +350,7 @@ int main(int argc, char **argv) {
     if (!args["protocol-type"].empty()) {
       protocolType = args["protocol-type"];
       if (protocolType == "binary") {
+      } else if (protocolType == "json") {
       } else if (protocolType == "ascii") {
 	throw invalid_argument("ASCII protocol not supported");
       } else if (protocolType == "xml") {
@@ -353,6 +363,9 @@ int main(int argc, char **argv) {
     if (!args["workers"].empty()) {
       workerCount = atoi(args["workers"].c_str());
     }
+
+    compressed = !args["compressed"].empty();
+    http = !args["http"].empty();
   } catch (exception& e) {
     cerr << e.what() << endl;
     cerr << usage;
@@ -360,6 +373,11 @@ int main(int argc, char **argv) {
 
   // Dispatcher
   shared_ptr<TProtocolFactory> protocolFactory(new TBinaryProtocolFactory());
+  string contentType = "application/x-thrift";
+  if (protocolType == "json") {
+    protocolFactory.reset(new TJSONProtocolFactory());
+    contentType = "application/json";
+  }
 
   shared_ptr<TestHandler> testHandler(new TestHandler());
 
@@ -370,6 +388,11 @@ int main(int argc, char **argv) {
 
   // Factory
   shared_ptr<TTransportFactory> transportFactory(new TBufferedTransportFactory());
+  if (http) {
+    transportFactory.reset(new THttpServerTransportFactory(contentType));
+  } else if (compressed) {
+    transportFactory.reset(new TCompressedFramedTransportFactory());
+  }
 
   if (serverType == "simple") {
 
@@ -414,7 +437,12 @@ int main(int argc, char **argv) {
     threadedServer.serve();
 
   } else if (serverType == "nonblocking") {
-    TNonblockingServer nonblockingServer(testProcessor, port);
+    TNonblockingServer nonblockingServer(testProcessor, protocolFactory, port);
+    if (http) {
+      nonblockingServer.setHttp(true, contentType);
+    } else if (compressed) {
+      nonblockingServer.setFrameCodec(TFrameCodec::getCodec(TLZ4Codec::ID));
+    }
     printf("Starting the nonblocking server on port %d...\n", port);
     nonblockingServer.serve();
   }
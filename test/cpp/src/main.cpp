@@ -94,6 +94,7 @@ class Server : public ServiceIf {
   int8_t echoByte(const int8_t arg) {return arg;}
   int32_t echoI32(const int32_t arg) {return arg;}
   int64_t echoI64(const int64_t arg) {return arg;}
+  int32_t echoI32Inline(const int32_t arg) {return arg;}
   void echoString(string& out, const string &arg) {
     if (arg != "hello") {
       T_ERROR_ABORT("WRONG STRING!!!!");
@@ -23,6 +23,7 @@
 #include <concurrency/Util.h>
 #include <concurrency/Mutex.h>
 #include <protocol/TBinaryProtocol.h>
+#include <protocol/TJSONProtocol.h>
 #include <server/TSimpleServer.h>
 #include <server/TThreadPoolServer.h>
 #include <server/TThreadedServer.h>
@@ -31,6 +32,7 @@
 #include <transport/TSocket.h>
 #include <transport/TTransportUtils.h>
 #include <transport/TFileTransport.h>
+#include <transport/THttpClient.h>
 #include <TLogging.h>
 
 #include "Service.h"
@@ -40,6 +42,7 @@
 
 #include <iostream>
 #include <set>
+#include <vector>
 #include <stdexcept>
 #include <sstream>
 
@@ -100,6 +103,7 @@ class Server : public ServiceIf {
   int8_t echoByte(const int8_t arg) {return arg;}
   int32_t echoI32(const int32_t arg) {return arg;}
   int64_t echoI64(const int64_t arg) {return arg;}
+  int32_t echoI32Inline(const int32_t arg) {return arg;}
   void echoString(string& out, const string &arg) {
     if (arg != "hello") {
       T_ERROR_ABORT("WRONG STRING!!!!");
@@ -119,13 +123,15 @@ private:
 class ClientThread: public Runnable {
 public:
 
-  ClientThread(shared_ptr<TTransport>transport, shared_ptr<ServiceClient> client, Monitor& monitor, size_t& workerCount, size_t loopCount, TType loopType) :
+  ClientThread(shared_ptr<TTransport>transport, shared_ptr<ServiceClient> client, Monitor& monitor, size_t& workerCount, size_t loopCount, TType loopType, size_t pipeline) :
     _transport(transport),
     _client(client),
     _monitor(monitor),
     _workerCount(workerCount),
     _loopCount(loopCount),
-    _loopType(loopType)
+    _loopType(loopType),
+    _pipeline(pipeline),
+    _latencies(32, 0)
   {}
 
   void run() {
@@ -146,8 +152,10 @@ public:
     case T_VOID: loopEchoVoid(); break;
     case T_BYTE: loopEchoByte(); break;
     case T_I32: loopEchoI32(); break;
+    case T_I16: loopEchoI32Inline(); break;
     case T_I64: loopEchoI64(); break;
     case T_STRING: loopEchoString(); break;
+    case T_STRUCT: loopMixed(); break;
     default: cerr << "Unexpected loop type" << _loopType << endl; break;
     }
 
@@ -168,45 +176,162 @@ public:
     }
   }
 
+  // Count calls begun at start in the power of two bucket of their latency
+  void recordLatency(int64_t start, size_t calls) {
+    int64_t usec = Util::currentTimeUsec() - start;
+    size_t bucket = 0;
+    while (usec > 1 && bucket + 1 < _latencies.size()) {
+      usec >>= 1;
+      bucket++;
+    }
+    _latencies[bucket] += calls;
+  }
+
+  // Calls are sent _pipeline at a time before reading their results, and
+  // all take the time until the last result
+  size_t pipelined(size_t ix) {
+    return min(_pipeline, _loopCount - ix);
+  }
+
   void loopEchoVoid() {
-    for (size_t ix = 0; ix < _loopCount; ix++) {
-      _client->echoVoid();
+    for (size_t ix = 0; ix < _loopCount; ix += pipelined(ix)) {
+      int64_t start = Util::currentTimeUsec();
+      for (size_t call = 0; call < pipelined(ix); call++) {
+        _client->send_echoVoid();
+      }
+      for (size_t call = 0; call < pipelined(ix); call++) {
+        _client->recv_echoVoid();
+      }
+      recordLatency(start, pipelined(ix));
     }
   }
 
   void loopEchoByte() {
-    for (size_t ix = 0; ix < _loopCount; ix++) {
+    for (size_t ix = 0; ix < _loopCount; ix += pipelined(ix)) {
       int8_t arg = 1;
       int8_t result;
-      result =_client->echoByte(arg);
-      assert(result == arg);
+      int64_t start = Util::currentTimeUsec();
+      for (size_t call = 0; call < pipelined(ix); call++) {
+        _client->send_echoByte(arg);
+      }
+      for (size_t call = 0; call < pipelined(ix); call++) {
+        result =_client->recv_echoByte();
+        assert(result == arg);
+      }
+      recordLatency(start, pipelined(ix));
     }
   }
 
   void loopEchoI32() {
-    for (size_t ix = 0; ix < _loopCount; ix++) {
+    for (size_t ix = 0; ix < _loopCount; ix += pipelined(ix)) {
       int32_t arg = 1;
       int32_t result;
-      result =_client->echoI32(arg);
-      assert(result == arg);
+      int64_t start = Util::currentTimeUsec();
+      for (size_t call = 0; call < pipelined(ix); call++) {
+        _client->send_echoI32(arg);
+      }
+      for (size_t call = 0; call < pipelined(ix); call++) {
+        result =_client->recv_echoI32();
+        assert(result == arg);
+      }
+      recordLatency(start, pipelined(ix));
+    }
+  }
+
+  void loopEchoI32Inline() {
+    for (size_t ix = 0; ix < _loopCount; ix += pipelined(ix)) {
+      int32_t arg = 1;
+      int32_t result;
+      int64_t start = Util::currentTimeUsec();
+      for (size_t call = 0; call < pipelined(ix); call++) {
+        _client->send_echoI32Inline(arg);
+      }
+      for (size_t call = 0; call < pipelined(ix); call++) {
+        result =_client->recv_echoI32Inline();
+        assert(result == arg);
+      }
+      recordLatency(start, pipelined(ix));
     }
   }
 
   void loopEchoI64() {
-    for (size_t ix = 0; ix < _loopCount; ix++) {
+    for (size_t ix = 0; ix < _loopCount; ix += pipelined(ix)) {
       int64_t arg = 1;
       int64_t result;
-      result =_client->echoI64(arg);
-      assert(result == arg);
+      int64_t start = Util::currentTimeUsec();
+      for (size_t call = 0; call < pipelined(ix); call++) {
+        _client->send_echoI64(arg);
+      }
+      for (size_t call = 0; call < pipelined(ix); call++) {
+        result =_client->recv_echoI64();
+        assert(result == arg);
+      }
+      recordLatency(start, pipelined(ix));
     }
   }
 
   void loopEchoString() {
-    for (size_t ix = 0; ix < _loopCount; ix++) {
+    for (size_t ix = 0; ix < _loopCount; ix += pipelined(ix)) {
       string arg = "hello";
       string result;
-      _client->echoString(result, arg);
-      assert(result == arg);
+      int64_t start = Util::currentTimeUsec();
+      for (size_t call = 0; call < pipelined(ix); call++) {
+        _client->send_echoString(arg);
+      }
+      for (size_t call = 0; call < pipelined(ix); call++) {
+        _client->recv_echoString(result);
+        assert(result == arg);
+      }
+      recordLatency(start, pipelined(ix));
+    }
+  }
+
+  // Each round of calls is a slow echoVoid ahead of quick echoI32s, each
+  // with its sequence id, and each taking the time until its own result.
+  // A server answering in order holds the quick calls behind the slow one.
+  void loopMixed() {
+    shared_ptr<TProtocol> oprot = _client->getOutputProtocol();
+    shared_ptr<TProtocol> iprot = _client->getInputProtocol();
+    vector<int64_t> sent(_pipeline);
+    for (size_t ix = 0; ix < _loopCount; ix += pipelined(ix)) {
+      size_t calls = pipelined(ix);
+      for (size_t call = 0; call < calls; call++) {
+        sent[call] = Util::currentTimeUsec();
+        if (call == 0) {
+          oprot->writeMessageBegin("echoVoid", T_CALL, 0);
+          Service_echoVoid_pargs args;
+          args.write(oprot.get());
+        } else {
+          int32_t arg = (int32_t)call;
+          oprot->writeMessageBegin("echoI32", T_CALL, arg);
+          Service_echoI32_pargs args;
+          args.arg = &arg;
+          args.write(oprot.get());
+        }
+        oprot->writeMessageEnd();
+        oprot->getTransport()->writeEnd();
+        oprot->getTransport()->flush();
+      }
+      for (size_t call = 0; call < calls; call++) {
+        string fname;
+        TMessageType mtype;
+        int32_t seqid;
+        iprot->readMessageBegin(fname, mtype, seqid);
+        assert(mtype == T_REPLY && seqid >= 0 && (size_t)seqid < calls);
+        if (seqid == 0) {
+          Service_echoVoid_presult result;
+          result.read(iprot.get());
+        } else {
+          int32_t value;
+          Service_echoI32_presult result;
+          result.success = &value;
+          result.read(iprot.get());
+          assert(value == seqid);
+        }
+        iprot->readMessageEnd();
+        iprot->getTransport()->readEnd();
+        recordLatency(sent[seqid], 1);
+      }
     }
   }
 
@@ -216,8 +341,10 @@ public:
   size_t& _workerCount;
   size_t _loopCount;
   TType _loopType;
+  size_t _pipeline;
   long long _startTime;
   long long _endTime;
+  vector<size_t> _latencies;
   bool _done;
   Monitor _sleep;
 };
@@ -229,6 +356,7 @@ int main(int argc, char **argv) {
   string serverType = "simple";
   string protocolType = "binary";
   size_t workerCount = 4;
+  size_t ioThreadCount = 1;
   size_t clientCount = 20;
   size_t loopCount = 50000;
   TType loopType  = T_VOID;
@@ -237,22 +365,33 @@ int main(int argc, char **argv) {
   bool logRequests = false;
   string requestLogPath = "./requestlog.tlog";
   bool replayRequests = false;
+  bool http = false;
+  string inlineMethods = "annotated";
+  size_t pipeline = 1;
+  uint32_t maxCoalescedBytes = 65536;
+  uint32_t maxInFlight = 1;
 
   ostringstream usage;
 
   usage <<
-    argv[0] << " [--port=<port number>] [--server] [--server-type=<server-type>] [--protocol-type=<protocol-type>] [--workers=<worker-count>] [--clients=<client-count>] [--loop=<loop-count>]" << endl <<
+    argv[0] << " [--port=<port number>] [--server] [--server-type=<server-type>] [--protocol-type=<protocol-type>] [--workers=<worker-count>] [--io-threads=<io-thread-count>] [--clients=<client-count>] [--loop=<loop-count>] [--http] [--inline=<methods>] [--pipeline=<depth>] [--coalesce=<bytes>] [--in-flight=<requests>]" << endl <<
     "\tclients        Number of client threads to create - 0 implies no clients, i.e. server only.  Default is " << clientCount << endl <<
     "\thelp           Prints this help text." << endl <<
-    "\tcall           Service method to call.  Default is " << callName << endl <<
+    "\tcall           Service method to call, or \"mixed\" for a slow echoVoid ahead of quick echoI32s in each pipelined round.  Default is " << callName << endl <<
     "\tloop           The number of remote thrift calls each client makes.  Default is " << loopCount << endl <<
     "\tport           The port the server and clients should bind to for thrift network connections.  Default is " << port << endl <<
     "\tserver         Run the Thrift server in this process.  Default is " << runServer << endl <<
     "\tserver-type    Type of server, \"simple\" or \"thread-pool\".  Default is " << serverType << endl <<
-    "\tprotocol-type  Type of protocol, \"binary\", \"ascii\", or \"xml\".  Default is " << protocolType << endl <<
+    "\tprotocol-type  Type of protocol, \"binary\" or \"json\".  Default is " << protocolType << endl <<
+    "\thttp           Carry calls in HTTP requests instead of frames.  Default is " << http << endl <<
+    "\tinline         Methods the thread-pool server runs on its IO threads: \"annotated\" in the IDL (echoI32Inline), \"none\", or a comma separated list.  Default is " << inlineMethods << endl <<
+    "\tpipeline       Number of calls each client sends before reading their results.  Default is " << pipeline << endl <<
+    "\tcoalesce       Most bytes of responses to pipelined calls the server sends together, 0 for none.  Default is " << maxCoalescedBytes << endl <<
+    "\tin-flight      Most pipelined calls from one client the thread-pool server processes at once, answering them as they finish.  Default is " << maxInFlight << endl <<
     "\tlog-request    Log all request to ./requestlog.tlog. Default is " << logRequests << endl <<
     "\treplay-request Replay requests from log file (./requestlog.tlog) Default is " << replayRequests << endl <<
-    "\tworkers        Number of thread pools workers.  Only valid for thread-pool server type.  Default is " << workerCount << endl;
+    "\tworkers        Number of thread pools workers.  Only valid for thread-pool server type.  Default is " << workerCount << endl <<
+    "\tio-threads     Number of IO threads, each with its own event loop, in each server.  Default is " << ioThreadCount << endl;
 
 
   map<string, string>  args;
@@ -320,6 +459,40 @@ int main(int argc, char **argv) {
       workerCount = atoi(args["workers"].c_str());
     }
 
+    if (!args["io-threads"].empty()) {
+      ioThreadCount = atoi(args["io-threads"].c_str());
+    }
+
+    if (!args["protocol-type"].empty()) {
+      protocolType = args["protocol-type"];
+      if (protocolType != "binary" && protocolType != "json") {
+        throw invalid_argument("Unknown protocol type "+protocolType);
+      }
+    }
+
+    if (!args["http"].empty()) {
+      http = args["http"] == "true";
+    }
+
+    if (!args["inline"].empty()) {
+      inlineMethods = args["inline"];
+    }
+
+    if (!args["pipeline"].empty()) {
+      pipeline = atoi(args["pipeline"].c_str());
+      if (pipeline == 0) {
+        throw invalid_argument("Pipeline depth must be at least 1");
+      }
+    }
+
+    if (!args["coalesce"].empty()) {
+      maxCoalescedBytes = atoi(args["coalesce"].c_str());
+    }
+
+    if (!args["in-flight"].empty()) {
+      maxInFlight = atoi(args["in-flight"].c_str());
+    }
+
   } catch(exception& e) {
     cerr << e.what() << endl;
     cerr << usage;
@@ -351,6 +524,8 @@ int main(int argc, char **argv) {
     exit(0);
   }
 
+  shared_ptr<TNonblockingServer> server;
+  shared_ptr<TNonblockingServer> server2;
 
   if (runServer) {
 
@@ -358,6 +533,9 @@ int main(int argc, char **argv) {
 
     // Protocol Factory
     shared_ptr<TProtocolFactory> protocolFactory(new TBinaryProtocolFactory());
+    if (protocolType == "json") {
+      protocolFactory.reset(new TJSONProtocolFactory());
+    }
 
     // Transport Factory
     shared_ptr<TTransportFactory>      transportFactory;
@@ -372,13 +550,12 @@ int main(int argc, char **argv) {
         shared_ptr<TTransportFactory>(new TPipedTransportFactory(fileTransport));
     }
 
-    shared_ptr<Thread> serverThread;
-    shared_ptr<Thread> serverThread2;
+    string contentType = protocolType == "json" ? "application/json" : "application/x-thrift";
 
     if (serverType == "simple") {
 
-      serverThread = threadFactory->newThread(shared_ptr<TServer>(new TNonblockingServer(serviceProcessor, protocolFactory, port)));
-      serverThread2 = threadFactory->newThread(shared_ptr<TServer>(new TNonblockingServer(serviceProcessor, protocolFactory, port+1)));
+      server.reset(new TNonblockingServer(serviceProcessor, protocolFactory, port));
+      server2.reset(new TNonblockingServer(serviceProcessor, protocolFactory, port+1));
 
     } else if (serverType == "thread-pool") {
 
@@ -386,10 +563,42 @@ int main(int argc, char **argv) {
 
       threadManager->threadFactory(threadFactory);
       threadManager->start();
-      serverThread = threadFactory->newThread(shared_ptr<TServer>(new TNonblockingServer(serviceProcessor, protocolFactory, port, threadManager)));
-      serverThread2 = threadFactory->newThread(shared_ptr<TServer>(new TNonblockingServer(serviceProcessor, protocolFactory, port+1, threadManager)));
+      server.reset(new TNonblockingServer(serviceProcessor, protocolFactory, port, threadManager));
+      server2.reset(new TNonblockingServer(serviceProcessor, protocolFactory, port+1, threadManager));
+    }
+
+    server->setHttp(http, contentType);
+    server2->setHttp(http, contentType);
+    server->setNumIOThreads(ioThreadCount);
+    server2->setNumIOThreads(ioThreadCount);
+    server->setMaxCoalescedBytes(maxCoalescedBytes);
+    server2->setMaxCoalescedBytes(maxCoalescedBytes);
+    server->setMaxInFlightRequests(maxInFlight);
+    server2->setMaxInFlightRequests(maxInFlight);
+
+    if (inlineMethods == "none") {
+      set<string> annotated;
+      serviceProcessor->getInlineMethods(annotated);
+      for (set<string>::const_iterator name = annotated.begin(); name != annotated.end(); ++name) {
+        server->setMethodInline(*name, false);
+        server2->setMethodInline(*name, false);
+      }
+    } else if (inlineMethods != "annotated") {
+      size_t begin = 0;
+      while (begin <= inlineMethods.size()) {
+        size_t end = inlineMethods.find(',', begin);
+        if (end == string::npos) {
+          end = inlineMethods.size();
+        }
+        server->setMethodInline(inlineMethods.substr(begin, end - begin), true);
+        server2->setMethodInline(inlineMethods.substr(begin, end - begin), true);
+        begin = end + 1;
+      }
     }
 
+    shared_ptr<Thread> serverThread = threadFactory->newThread(server);
+    shared_ptr<Thread> serverThread2 = threadFactory->newThread(server2);
+
     cerr << "Starting the server on port " << port << " and " << (port + 1) << endl;
     serverThread->start();
     serverThread2->start();
@@ -414,18 +623,30 @@ int main(int argc, char **argv) {
     if (callName == "echoVoid") { loopType = T_VOID;}
     else if (callName == "echoByte") { loopType = T_BYTE;}
     else if (callName == "echoI32") { loopType = T_I32;}
+    else if (callName == "echoI32Inline") { loopType = T_I16;}
     else if (callName == "echoI64") { loopType = T_I64;}
     else if (callName == "echoString") { loopType = T_STRING;}
+    else if (callName == "mixed") { loopType = T_STRUCT;}
     else {throw invalid_argument("Unknown service call "+callName);}
 
     for (size_t ix = 0; ix < clientCount; ix++) {
 
       shared_ptr<TSocket> socket(new TSocket("127.0.0.1", port + (ix % 2)));
-      shared_ptr<TFramedTransport> framedSocket(new TFramedTransport(socket));
-      shared_ptr<TProtocol> protocol(new TBinaryProtocol(framedSocket));
+      shared_ptr<TTransport> transport;
+      if (http) {
+        transport.reset(new THttpClient(socket, "127.0.0.1", "/"));
+      } else {
+        transport.reset(new TFramedTransport(socket));
+      }
+      shared_ptr<TProtocol> protocol;
+      if (protocolType == "json") {
+        protocol.reset(new TJSONProtocol(transport));
+      } else {
+        protocol.reset(new TBinaryProtocol(transport));
+      }
       shared_ptr<ServiceClient> serviceClient(new ServiceClient(protocol));
 
-      clientThreads.insert(threadFactory->newThread(shared_ptr<ClientThread>(new ClientThread(socket, serviceClient, monitor, threadCount, loopCount, loopType))));
+      clientThreads.insert(threadFactory->newThread(shared_ptr<ClientThread>(new ClientThread(socket, serviceClient, monitor, threadCount, loopCount, loopType, pipeline))));
     }
 
     for (std::set<shared_ptr<Thread> >::const_iterator thread = clientThreads.begin(); thread != clientThreads.end(); thread++) {
@@ -451,6 +672,8 @@ int main(int argc, char **argv) {
       time01 =  Util::currentTime();
     }
 
+    vector<size_t> latencies(32, 0);
+
     long long firstTime = 9223372036854775807LL;
     long long lastTime = 0;
 
@@ -483,18 +706,63 @@ int main(int argc, char **argv) {
       }
 
       averageTime+= delta;
+
+      for (size_t bucket = 0; bucket < latencies.size(); bucket++) {
+        latencies[bucket] += client->_latencies[bucket];
+      }
     }
 
     averageTime /= clientCount;
 
 
-    cout <<  "workers :" << workerCount << ", client : " << clientCount << ", loops : " << loopCount << ", rate : " << (clientCount * loopCount * 1000) / ((double)(time01 - time00)) << endl;
+    // Upper bounds of the buckets holding the latency percentiles
+    const double percentiles[] = {0.5, 0.9, 0.99, 0.999};
+    cout << "latency usec";
+    for (size_t ix = 0; ix < sizeof(percentiles) / sizeof(percentiles[0]); ix++) {
+      size_t seen = 0;
+      size_t bucket = 0;
+      while (bucket + 1 < latencies.size() &&
+             seen + latencies[bucket] < percentiles[ix] * clientCount * loopCount) {
+        seen += latencies[bucket++];
+      }
+      cout << (ix == 0 ? " : " : ", ") << "p" << percentiles[ix] * 100 << " < " << (2LL << bucket);
+    }
+    cout << endl;
+
+    cout <<  "workers :" << workerCount << ", io-threads : " << ioThreadCount << ", client : " << clientCount << ", loops : " << loopCount << ", pipeline : " << pipeline << ", rate : " << (clientCount * loopCount * 1000) / ((double)(time01 - time00)) << endl;
 
     count_map count = serviceHandler->getCount();
     count_map::iterator iter;
     for (iter = count.begin(); iter != count.end(); ++iter) {
       printf("%s => %d\n", iter->first, iter->second);
     }
+
+    // IO thread notifications, each of which once cost a pipe write and read
+    if (server) {
+      uint64_t notifications = 0;
+      uint64_t signals = 0;
+      uint64_t wakeups = 0;
+      uint64_t recvs = 0;
+      uint64_t sends = 0;
+      for (size_t ix = 0; ix < ioThreadCount; ix++) {
+        notifications += server->getIOThread(ix)->getNumNotifications() +
+                         server2->getIOThread(ix)->getNumNotifications();
+        signals += server->getIOThread(ix)->getNumSignals() +
+                   server2->getIOThread(ix)->getNumSignals();
+        wakeups += server->getIOThread(ix)->getNumWakeups() +
+                   server2->getIOThread(ix)->getNumWakeups();
+        recvs += server->getIOThread(ix)->getNumRecvs() +
+                 server2->getIOThread(ix)->getNumRecvs();
+        sends += server->getIOThread(ix)->getNumSends() +
+                 server2->getIOThread(ix)->getNumSends();
+      }
+      printf("notifications => %llu, signals => %llu, wakeups => %llu\n",
+             (unsigned long long)notifications, (unsigned long long)signals,
+             (unsigned long long)wakeups);
+      printf("server recvs per call => %.3f, sends per call => %.3f\n",
+             recvs / (double)(clientCount * loopCount),
+             sends / (double)(clientCount * loopCount));
+    }
     cerr << "done." << endl;
   }
 
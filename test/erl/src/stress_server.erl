@@ -31,7 +31,8 @@
          echoString/1,
          echoList/1,
          echoSet/1,
-         echoMap/1
+         echoMap/1,
+         echoI32Inline/1
         ]).
 
 start_link(Port) ->
@@ -62,3 +63,5 @@ echoSet(X) ->
     X.
 echoMap(X) ->
     X.
+echoI32Inline(X) ->
+    X.